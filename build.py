@@ -2,6 +2,7 @@ import subprocess
 import os
 import sys
 import glob
+import re
 import toml     # pip install toml
 # import hcl2 as hcl     # pip install python-hcl2
 
@@ -13,6 +14,37 @@ import toml     # pip install toml
 
 common_flags = ["-lm", "-g", "-Wall", "-lws2_32", "-I.", "-I./devices", "-I./tests", "utils.c"]
 
+# Single library build: all the modules are linked into one library with LTO, the symbols of every
+# module are prefixed with its target name so that the copies of utils.c and the module API don't clash
+static_lib = "bin/x86emu.dll"
+static_runner = "bin/x86emu.exe"    # Native runner (main.c) linked with the same modules
+static_dir = "bin/static"
+static_cflags = ["-O2", "-flto=auto", "-g", "-Wall", "-I.", "-I./devices", "-I./tests"]
+static_libs = ["-lm", "-lws2_32"]
+static_max_ranges = 4   # STATIC_MAX_RANGES in static_devices.h
+static_max_pins = 8     # STATIC_MAX_PINS in static_devices.h
+# static_device_t entry points (static_devices.h)
+static_funcs = {
+    "set_log_func": "void {}(void(*)(const char*, char*))",
+    "set_log_level": "void {}(uint8_t)",
+    "set_trace_file": "void {}(const char*)",
+    "set_trace_source": "void {}(uint16_t*, uint16_t*)",
+    "set_scheduler_hooks": "void {}(uint64_t*, void(*)(void))",
+    "log_flush": "void {}(void)",
+    "module_reset": "void {}(void)",
+    "module_save": "void {}(void)",
+    "module_restore": "void {}(void)",
+    "module_checkpoint": "void {}(void)",
+    "module_restore_checkpoint": "void {}(uint64_t)",
+    "module_tick": "int {}(uint32_t)",
+    "module_next_event": "uint32_t {}(uint32_t)",
+    "module_run": "int {}(uint32_t, uint32_t*)",
+    "data_write": "void {}(uint32_t, uint16_t, uint8_t)",
+    "data_read": "uint16_t {}(uint32_t, uint8_t)",
+    "code_read": "uint16_t {}(uint32_t, uint8_t)",
+    "module_input": "void {}(uint8_t)",
+}
+
 
 def get_config(filename: str):
     with open(filename, 'r') as f:
@@ -52,11 +84,118 @@ def build_target(target, config):
             return 1
 
 
+def get_module_symbols(target, srcs):
+    ''' Returns the global symbols defined by the module sources: {name: nm symbol type} '''
+    obj = f"{static_dir}/{target}_symbols.o"
+    flags = ' '.join(f for f in static_cflags if not f.startswith("-flto"))    # nm needs regular objects
+    output = subprocess.getoutput(f"gcc -r -nostdlib {flags} {' '.join(srcs)} -o {obj}")
+    if not os.path.isfile(obj):
+        print(f"Failed\nERROR: {output}")
+        return None
+    symbols = {}
+    for line in subprocess.getoutput(f"nm -g --defined-only {obj}").splitlines():
+        items = line.split()
+        if len(items) == 3 and items[1] in "TDBRCVWG" and re.fullmatch(r"[A-Za-z_]\w*", items[2]):
+            symbols[items[2]] = items[1]
+    os.remove(obj)
+    return symbols
+
+
+def build_static_module(target, config):
+    ''' Compiles the module with its symbols prefixed, returns the list of objects and the defined symbols '''
+    print(f"Building {target} . . . ", end='', flush=True)
+    srcs = config[target]['module'] + ["utils.c"]
+    symbols = get_module_symbols(target, srcs)
+    if symbols is None:
+        return None, None
+    prefix_header = f"{static_dir}/{target}_prefix.h"
+    with open(prefix_header, 'w') as f:
+        f.write(f"// Generated by build.py: symbols of the {target} module in the single library build\n")
+        for sym in symbols:
+            f.write(f"#define {sym} {target}_{sym}\n")
+    objs = []
+    for src in srcs:
+        obj = f"{static_dir}/{target}_{os.path.splitext(os.path.basename(src))[0]}.o"
+        output = subprocess.getoutput(f"gcc -c {' '.join(static_cflags)} -include {prefix_header} {src} -o {obj}")
+        if len(output) > 0:
+            print(f"Failed\nERROR: {output}")
+            return None, None
+        objs.append(obj)
+    print("Done")
+    return objs, symbols
+
+
+def generate_static_table(modules, config):
+    ''' Writes the static_device_t table of the modules, modules: {target: defined symbols} '''
+    fname = f"{static_dir}/static_table.c"
+    lines = ["// Generated by build.py from config.toml", '#include "static_devices.h"', ""]
+    for target, symbols in modules.items():
+        for func, signature in static_funcs.items():
+            if symbols.get(func) == 'T':     # Data symbols with these names are not entry points
+                lines.append(signature.format(f"{target}_{func}") + ";")
+    lines += ["", "const static_device_t static_devices[] = {"]
+    for target, symbols in modules.items():
+        ranges = config[target].get('address_ranges', [])[:static_max_ranges]
+        ranges_str = ', '.join(f"{{0x{r[0]:X}, 0x{r[1]:X}}}" for r in ranges)
+        lines.append(f'    {{.name = "{target}", .type = "{config[target]["type"]}", .ranges_num = {len(ranges)}, .address_ranges = {{{ranges_str}}},')
+        for func in static_funcs:
+            lines.append(f"        .{func} = {f'{target}_{func}' if symbols.get(func) == 'T' else 'NULL'},")
+        lines.append("    },")
+    lines += ["};", f"const uint32_t static_devices_num = {len(modules)};", ""]
+    # Wires, the pins are the pin_t structures (pins.h) of the modules
+    wires = {name: wire for name, wire in config.items() if wire['type'] == 'wire'}
+    for wire in wires.values():
+        for dev, pin in wire['pins'][:static_max_pins]:
+            lines.append(f"extern struct pin_t {dev}_{pin};")
+    lines += ["", "const static_wire_t static_wires[] = {"]
+    for name, wire in wires.items():
+        pins = wire['pins'][:static_max_pins]
+        pins_str = ', '.join(f"&{dev}_{pin}" for dev, pin in pins)
+        names_str = ', '.join(f'"{dev}.{pin}"' for dev, pin in pins)
+        lines.append(f'    {{.name = "{name}", .default_state = {wire["default_state"]}, .pins_num = {len(pins)}, .pins = {{{pins_str}}}, .pin_names = {{{names_str}}}}},')
+    lines += ["};", f"const uint32_t static_wires_num = {len(wires)};", ""]
+    with open(fname, 'w') as f:
+        f.write('\n'.join(lines))
+    return fname
+
+
+def build_static(runner=False):
+    ''' Links all the modules of config.toml into one library (static_lib), see static_devices.h,
+        or into the native runner executable (static_runner) '''
+    config = get_config("config.toml")
+    os.makedirs(static_dir, exist_ok=True)
+    objs = []
+    modules = {}
+    for target in config:
+        if config[target]['type'] == 'wire' or len(config[target]['module'][0]) == 0:
+            continue
+        target_objs, symbols = build_static_module(target, config)
+        if target_objs is None:
+            return 1
+        objs += target_objs
+        modules[target] = symbols
+    fname = static_runner if runner else static_lib
+    print(f"Linking {fname} . . . ", end='', flush=True)
+    if os.path.isfile(fname):
+        os.remove(fname)
+    srcs = objs + ["static_devices.c", generate_static_table(modules, config)]
+    if runner:
+        srcs.append("main.c")
+    output = subprocess.getoutput(f"gcc {'' if runner else '-shared'} {' '.join(static_cflags)} {' '.join(srcs)} -o {fname} {' '.join(static_libs)}")
+    if len(output) == 0:
+        print("Done")
+        return 0
+    print(f"Failed\nERROR: {output}")
+    return 1
+
+
 def build(target):
     config = get_config("config.toml")
     # config = get_config("config.hcl")
     if target == "all":
         for target in config:
+            if config[target]['type'] == 'wire':
+                continue
             if build_target(target, config):
                 break
     else:
@@ -87,6 +226,10 @@ def main():
     if len(sys.argv) > 1:
         if sys.argv[1] == "all":
             build("all")
+        elif sys.argv[1] == "static":
+            build_static()
+        elif sys.argv[1] == "runner":
+            build_static(runner=True)
         else:
             build(sys.argv[1])
     else:
@@ -3,6 +3,7 @@ import log_manager
 import copy
 import os
 import glob
+import shutil
 import zipfile
 from datetime import datetime
 
@@ -14,6 +15,15 @@ elif os_type == 'Linux':
     from elftools.elf.elffile import ELFFile
 
 
+TICKS_BATCH = 100_000   # How many ticks the native scheduler runs per call
+STATIC_LIBRARY = "bin/x86emu.dll"   # Single library build of all the modules (python build.py static)
+SNAPSHOT_FILE = "data/snapshot.bin" # Incremental checkpoints of all the modules (SNAPSHOT_FILE in utils.h)
+SNAPSHOT_NO_TICK = 0xFFFFFFFFFFFFFFFF
+REWIND_SLOTS = 16                   # Checkpoints in the in-memory rewind ring (REWIND_SLOTS in utils.h)
+IP_REGISTER = 17        # register_name_t values, see devices/8086_cpu.h
+CS_REGISTER = 18
+
+
 def get_type(item):
     if item == "void":
         return None
@@ -25,6 +35,8 @@ def get_type(item):
         return ctypes.c_uint16
     if item == "uint32_t":
         return ctypes.c_uint32
+    if item == "uint64_t":
+        return ctypes.c_uint64
     print(f"ERROR: Unknown type: {item}")
     os.exit(1)
 
@@ -70,24 +82,79 @@ def get_functions_list(dll_filename):
     return symbols
 
 
+class StaticModule():
+    ''' Module of the single library build: its symbols are prefixed with the module name '''
+    libraries = {}
+
+    def __init__(self, filename, dev_name):
+        if filename not in StaticModule.libraries:
+            StaticModule.libraries[filename] = ctypes.CDLL(filename)
+        self._library = StaticModule.libraries[filename]
+        self._handle = self._library._handle    # Used by in_dll()
+        self.symbol_prefix = f"{dev_name}_"
+
+    def __getattr__(self, name):
+        return getattr(self._library, self.symbol_prefix + name)
+
+
+instance_libraries = set()     # Library copies loaded by the machine instances of this process
+
+
+def load_module(filename, dev_name=None, instance_dir=None):
+    ''' dev_name selects the module of the single library build.
+        instance_dir - directory of the machine instance the module belongs to, None - the current directory.
+        The modules keep their state in globals, so every instance loads its own copy of the library
+        (instance_dir/filename) and gets its own globals, the files of the module are kept in instance_dir '''
+    if instance_dir is not None:
+        copy_name = os.path.join(instance_dir, filename)
+        if copy_name not in instance_libraries:    # A loaded library must not be overwritten
+            os.makedirs(os.path.dirname(copy_name), exist_ok=True)
+            shutil.copyfile(filename, copy_name)
+            instance_libraries.add(copy_name)
+        filename = copy_name
+    if dev_name is None:
+        module = ctypes.CDLL(filename)
+    else:
+        module = StaticModule(filename, dev_name)
+    module.set_instance_dir.argtypes = [ctypes.c_char_p]
+    module.set_instance_dir.restype = ctypes.c_int
+    if module.set_instance_dir(("" if instance_dir is None else instance_dir).encode('utf-8')) != 0:
+        raise Exception(f"ERROR::: Cannot use {instance_dir} as the machine directory!")
+    return module
+
+
 class CommonDevModule():
-    def __init__(self, filename):
+    def __init__(self, filename, dev_name=None, instance_dir=None):
         self.id = 0
         self.filename = filename
-        self.device = ctypes.CDLL(filename)
+        self.device = load_module(filename, dev_name, instance_dir)
         # Log output function
         self.device.set_log_func.argtypes = [log_manager.print_callback_t]
         self.device.set_log_func.restype = None
         self.device.set_log_func(log_manager.print_callback)
 
         self.set_log_level = get_dll_function(self.device, "void set_log_level(uint8_t)")
+        # Binary trace output, see trace_decoder.py
+        self.device.set_trace_file.argtypes = [ctypes.c_char_p]
+        self.device.set_trace_file.restype = None
+        self.device.set_trace_source.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        self.device.set_trace_source.restype = None
+        self.set_trace_source = self.device.set_trace_source
+        self.log_flush = get_dll_function(self.device, "void log_flush(void)")
 
         self.module_reset = get_dll_function(self.device, "void module_reset(void)")
         self.module_reset()
 
         self.module_save = get_dll_function(self.device, "void module_save(void)")
         self.module_restore = get_dll_function(self.device, "void module_restore(void)")
+        self.module_checkpoint = get_dll_function(self.device, "void module_checkpoint(void)")
+        self.module_restore_checkpoint = get_dll_function(self.device, "void module_restore_checkpoint(uint64_t)")
+        self.module_rewind_save = get_dll_function(self.device, "void module_rewind_save(uint32_t)")
+        self.module_rewind_restore = get_dll_function(self.device, "void module_rewind_restore(uint32_t)")
         self.module_tick = get_dll_function(self.device, "int module_tick(uint32_t)")
+
+    def set_trace_file(self, filename):
+        self.device.set_trace_file(filename.encode('utf-8'))
     
 
 class ReadWriteModule:
@@ -108,8 +175,8 @@ class ReadWriteModule:
 
 
 class DevModule(CommonDevModule, ReadWriteModule):
-    def __init__(self, filename):
-        super().__init__(filename)
+    def __init__(self, filename, dev_name=None, instance_dir=None):
+        super().__init__(filename, dev_name, instance_dir)
         # self.device.module_get_address_range.argtypes = None
         # self.device.module_get_address_range.restype = ctypes.POINTER(ctypes.c_uint32)
         # range_ptr = self.device.module_get_address_range()
@@ -120,19 +187,36 @@ class DevModule(CommonDevModule, ReadWriteModule):
 
 
 class AddressSpace(CommonDevModule, ReadWriteModule):
-    def __init__(self, filename):
-        super().__init__(filename)
+    def __init__(self, filename, dev_name=None, instance_dir=None):
+        super().__init__(filename, dev_name, instance_dir)
         write_func_t = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_uint16, ctypes.c_uint8)
         read_func_t = ctypes.CFUNCTYPE(ctypes.c_uint16, ctypes.c_uint32, ctypes.c_uint8)
         self.device.map_device.argtypes = [ctypes.c_uint32, ctypes.c_uint32, write_func_t, read_func_t]
         self.device.map_device.restype = ctypes.c_uint32
         self.map_device = self.device.map_device
         self.set_read_write_functions()
+        if hasattr(self.device, "set_code_write_hook"):
+            self.device.set_code_write_hook.argtypes = [ctypes.c_void_p]
+            self.device.set_code_write_hook.restype = None
+            self.set_code_write_hook = self.device.set_code_write_hook
+        if hasattr(self.device, "set_ram_map_hook"):
+            self.device.set_ram_map_hook.argtypes = [ctypes.c_void_p]
+            self.device.set_ram_map_hook.restype = None
+            self.set_ram_map_hook = self.device.set_ram_map_hook
+        # RAM and page attributes the CPU accesses directly
+        if hasattr(self.device, "mem_get_ram"):
+            self.device.mem_get_ram.argtypes = None
+            self.device.mem_get_ram.restype = ctypes.c_void_p
+            self.device.mem_get_page_attrs.argtypes = None
+            self.device.mem_get_page_attrs.restype = ctypes.c_void_p
+            self.ram_p = self.device.mem_get_ram()
+            self.page_attrs_p = self.device.mem_get_page_attrs()
+            self.mem_set_backing = get_dll_function(self.device, "int mem_set_backing(uint8_t)")
 
 
 class Processor(CommonDevModule):
-    def __init__(self, filename):
-        super().__init__(filename)
+    def __init__(self, filename, dev_name=None, instance_dir=None):
+        super().__init__(filename, dev_name, instance_dir)
         write_func_t = ctypes.CFUNCTYPE(None, ctypes.c_uint32, ctypes.c_uint16, ctypes.c_uint8)
         read_func_t = ctypes.CFUNCTYPE(ctypes.c_uint16, ctypes.c_uint32, ctypes.c_uint8)
         self.device.connect_address_space.argtypes = [ctypes.c_uint8, write_func_t, read_func_t]
@@ -140,20 +224,132 @@ class Processor(CommonDevModule):
         self.device.set_code_read_func.argtypes = [read_func_t]
         self.connect_address_space = self.device.connect_address_space
         self.set_code_read_func = self.device.set_code_read_func
+        self.device.set_memory_map.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        self.device.set_memory_map.restype = None
+        self.set_memory_map = self.device.set_memory_map
+        # Called natively by the memory module when the RAM moves
+        self.set_memory_map_p = get_native_func_ptr(self.device, "set_memory_map")
         # Get tick counter function
         # self.device.cpu_get_ticks.argtypes = None
-        # self.device.cpu_get_ticks.restype = ctypes.c_uint32
+        # self.device.cpu_get_ticks.restype = ctypes.c_uint64
         # self.cpu_get_ticks = self.device.cpu_get_ticks
-        self.cpu_get_ticks = get_dll_function(self.device, "uint32_t cpu_get_ticks(void)")
+        self.cpu_get_ticks = get_dll_function(self.device, "uint64_t cpu_get_ticks(void)")
+        # Called natively by the memory module on writes into code pages
+        self.invalidate_code_p = get_native_func_ptr(self.device, "cpu_invalidate_code")
+        self.print_block_stats = get_dll_function(self.device, "void cpu_print_block_stats(void)")
+        # 0 - interpreter only, 1 - hot blocks are compiled, 2 - compiled code is checked against the interpreter
+        self.set_jit_mode = get_dll_function(self.device, "void cpu_set_jit_mode(uint8_t)")
+        # 0 - a tick is an instruction, 1 - a tick is a clock cycle, instructions take the cycles of the 8086
+        self.set_timing = get_dll_function(self.device, "void cpu_set_timing(uint8_t)")
+        # CS:IP the trace records of all the modules are taken from
+        self.device.cpu_get_register_ptr.argtypes = [ctypes.c_uint8]
+        self.device.cpu_get_register_ptr.restype = ctypes.c_void_p
+        self.cs_p = self.device.cpu_get_register_ptr(CS_REGISTER)
+        self.ip_p = self.device.cpu_get_register_ptr(IP_REGISTER)
+
+
+def get_native_func_ptr(dll_object, func_name):
+    ''' Returns the raw address of an exported function so native code can call it directly '''
+    return ctypes.cast(getattr(dll_object, func_name), ctypes.c_void_p)
+
+
+class Scheduler():
+    def __init__(self, filename, dev_name=None, instance_dir=None):
+        self.filename = filename
+        self.device = load_module(filename, dev_name, instance_dir)
+        self.device.set_log_func.argtypes = [log_manager.print_callback_t]
+        self.device.set_log_func.restype = None
+        self.device.set_log_func(log_manager.print_callback)
+
+        self.scheduler_reset = get_dll_function(self.device, "void scheduler_reset(void)")
+        self.scheduler_reset()
+        self.device.scheduler_add_device.argtypes = [ctypes.c_char_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+        self.device.scheduler_add_device.restype = ctypes.c_int
+        self.device.scheduler_get_ticks_ptr.argtypes = None
+        self.device.scheduler_get_ticks_ptr.restype = ctypes.c_void_p
+        self.ticks_p = self.device.scheduler_get_ticks_ptr()
+        self.wakeup_p = get_native_func_ptr(self.device, "scheduler_wakeup")
+        self.set_ticks = get_dll_function(self.device, "void scheduler_set_ticks(uint64_t)")
+        self.get_ticks = get_dll_function(self.device, "uint64_t scheduler_get_ticks(void)")
+        self.get_error = get_dll_function(self.device, "int scheduler_get_error(void)")
+        self.run_ticks = get_dll_function(self.device, "uint64_t run_ticks(uint64_t)")
+        self.log_flush = get_dll_function(self.device, "void log_flush(void)")
+        self.snapshot_truncate = get_dll_function(self.device, "int snapshot_truncate(uint64_t)")
+        self.snapshot_last_tick = get_dll_function(self.device, "uint64_t snapshot_last_tick(void)")
+        # Wire fabric, see wires.c and wires.py
+        self.wires_reset = get_dll_function(self.device, "void wires_reset(void)")
+        self.wires_reset()
+        self.device.wire_create.argtypes = [ctypes.c_char_p]
+        self.device.wire_create.restype = ctypes.c_int
+        self.wire_create = self.device.wire_create
+        self.device.wire_connect.argtypes = [ctypes.c_uint32, ctypes.c_void_p]
+        self.device.wire_connect.restype = ctypes.c_int
+        self.wire_connect = self.device.wire_connect
+        self.device.wire_set_callback.argtypes = [ctypes.c_uint32, ctypes.CFUNCTYPE(None, ctypes.c_uint8)]
+        self.device.wire_set_callback.restype = None
+        self.wire_set_callback = self.device.wire_set_callback
+        self.wire_set_state = get_dll_function(self.device, "void wire_set_state(uint32_t, uint8_t)")
+        self.wire_get_state = get_dll_function(self.device, "uint8_t wire_get_state(uint32_t)")
+        self.wires_checkpoint = get_dll_function(self.device, "void wires_checkpoint(void)")
+        self.wires_restore_checkpoint = get_dll_function(self.device, "void wires_restore_checkpoint(uint64_t)")
+        self.wires_rewind_save = get_dll_function(self.device, "void wires_rewind_save(uint32_t)")
+        self.wires_rewind_restore = get_dll_function(self.device, "void wires_rewind_restore(uint32_t)")
+        # Input journal, see journal.c
+        self.device.input_add.argtypes = [ctypes.c_char_p, ctypes.c_void_p]
+        self.device.input_add.restype = ctypes.c_int
+        self.input_send = get_dll_function(self.device, "void input_send(uint32_t, uint8_t)")
+        self.device.journal_record.argtypes = [ctypes.c_char_p]
+        self.device.journal_record.restype = ctypes.c_int
+        self.device.journal_replay.argtypes = [ctypes.c_char_p]
+        self.device.journal_replay.restype = ctypes.c_int
+        self.journal_stop = get_dll_function(self.device, "void journal_stop(void)")
+        self.inputs = {}    # Input name: index
+
+    def add_device(self, device, dev_name):
+        device.device.set_scheduler_hooks.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+        device.device.set_scheduler_hooks.restype = None
+        device.device.set_scheduler_hooks(self.ticks_p, self.wakeup_p)
+        tick_p = get_native_func_ptr(device.device, "module_tick")
+        # Devices without module_next_event are ticked every tick
+        next_event_p = None
+        if hasattr(device.device, "module_next_event"):
+            next_event_p = get_native_func_ptr(device.device, "module_next_event")
+        # Devices with module_run execute several ticks per call between the deadlines
+        run_p = None
+        if hasattr(device.device, "module_run"):
+            run_p = get_native_func_ptr(device.device, "module_run")
+        if self.device.scheduler_add_device(dev_name.encode('utf-8'), tick_p, next_event_p, run_p) < 0:
+            raise Exception(f"ERROR::: Cannot add device {dev_name} to the scheduler!")
+        # Devices with module_input take data from the host (keyboard, serial port), it goes through the journal
+        if hasattr(device.device, "module_input"):
+            self.inputs[dev_name] = self.device.input_add(dev_name.encode('utf-8'), get_native_func_ptr(device.device, "module_input"))
+            if self.inputs[dev_name] < 0:
+                raise Exception(f"ERROR::: Cannot add input of device {dev_name}!")
 
 
 class DevManager():
-    def __init__(self):
+    def __init__(self, instance_dir=None):
+        ''' instance_dir - directory of the machine (its modules, logs and state files), None - the current directory '''
+        self.instance_dir = instance_dir
+        self.scheduler = None
         self.devices = {}
         self._save_state_at = 0
         self._set_log_level_at = []  # [device_name, ticks, new_log_level]
         self._ticks = 0
+        self._checkpoint_every = 0
+        self._next_checkpoint = 0
+        self._snapshot_started = False  # The first checkpoint of a new run starts a new snapshot file
+        self._rewind_every = 0
+        self._next_rewind = 0
+        self._rewind_ticks = []         # Ticks of the checkpoints in the rewind ring, the oldest first
+        self._rewind_slot = 0           # Slot of the next checkpoint
     
+    def path(self, filename):
+        ''' Returns the path of a file of the machine, filename is relative to its directory '''
+        if self.instance_dir is None:
+            return filename
+        return os.path.join(self.instance_dir, filename)
+
     def save_state_at(self, ticks):
         self._save_state_at = ticks
     
@@ -164,9 +360,24 @@ class DevManager():
         else:
             raise Exception(f"ERROR::: Cannot set_log_level_at for device {ticks[0]}: device does not exist!")
     
+    def set_scheduler(self, scheduler):
+        self.scheduler = scheduler
+        for dev_name, dev in self.devices.items():
+            self.scheduler.add_device(dev, dev_name)
+
     def add_device(self, device, dev_name):
         self.devices[dev_name] = device
+        device.set_trace_file(f"logs/{dev_name}.trace")
+        if self.scheduler:
+            self.scheduler.add_device(device, dev_name)
     
+    def flush_logs(self):
+        ''' Waits until the log writer threads of all the modules have written everything '''
+        for _, dev in self.devices.items():
+            dev.log_flush()
+        if self.scheduler:
+            self.scheduler.log_flush()
+
     def reset_devices(self):
         for _, dev in self.devices.items():
             dev.module_reset()
@@ -174,34 +385,136 @@ class DevManager():
     def save_devices(self):
         for _, dev in self.devices.items():
             dev.module_save()
-        files = glob.glob('./data/*.bin')
+        base_dir = self.path('.')
+        files = glob.glob(os.path.join(base_dir, 'data', '*.bin'))
         now = datetime.now() # current date and time
         date_time = now.strftime("%m-%d-%Y_%H-%M-%S")
 
-        with zipfile.ZipFile(f"data/state_{date_time}.zip", mode="w") as archive:
+        with zipfile.ZipFile(self.path(f"data/state_{date_time}.zip"), mode="w") as archive:
             for f in files:
-                archive.write(f)
+                archive.write(f, os.path.relpath(f, base_dir))
     
     def restore_devices(self):
         for dev_name, dev in self.devices.items():
             dev.module_restore()
             if dev_name == 'cpu':
                 self._ticks = dev.cpu_get_ticks()
-    
-    def tick_devices(self):
-        """ On fail saves devices and returns False """
-        self._ticks += 1
-        for dev_name, dev in self.devices.items():
-            try:
-                if 0 != dev.module_tick(self._ticks):
-                    self.save_devices()
-                    return False
-            except Exception as e:
-                print(f"Error ticking device {dev_name}!")
-                print(e)
+        self.scheduler.set_ticks(self._ticks)
+        self._rewind_ticks = []
+        self._next_rewind = self._ticks
+
+    def checkpoint_every(self, ticks):
+        ''' Makes a checkpoint every ticks ticks, starting from the current tick '''
+        self._checkpoint_every = ticks
+        self._next_checkpoint = self._ticks
+
+    def checkpoint(self):
+        ''' Appends the state changed since the previous checkpoint to the snapshot file:
+            the RAM pages written since then and the registers of every module '''
+        if not self._snapshot_started:
+            if os.path.exists(self.path(SNAPSHOT_FILE)):
+                os.remove(self.path(SNAPSHOT_FILE))
+            self._snapshot_started = True
+        for _, dev in self.devices.items():
+            dev.module_checkpoint()
+        self.scheduler.wires_checkpoint()
+
+    def restore_checkpoint(self, ticks=None):
+        ''' Restores the state as of the checkpoint at ticks (the last one if None),
+            the later checkpoints are dropped and the run continues the snapshot file '''
+        if ticks is None:
+            ticks = self.scheduler.snapshot_last_tick()
+        if ticks == SNAPSHOT_NO_TICK or self.scheduler.snapshot_truncate(ticks) != 0:
+            raise Exception(f"ERROR::: Cannot restore checkpoint from {SNAPSHOT_FILE}")
+        for _, dev in self.devices.items():
+            dev.module_restore_checkpoint(ticks)
+        self.scheduler.wires_restore_checkpoint(ticks)
+        self._ticks = ticks
+        self.scheduler.set_ticks(ticks)
+        self._snapshot_started = True
+        if self._checkpoint_every > 0:
+            self._next_checkpoint = ticks + self._checkpoint_every
+        self._rewind_ticks = []
+        self._next_rewind = ticks
+
+    def rewind_every(self, ticks):
+        ''' Keeps a checkpoint of every ticks ticks in the in-memory rewind ring, the last REWIND_SLOTS of them '''
+        self._rewind_every = ticks
+        self._next_rewind = self._ticks
+
+    def rewind_save(self):
+        slot = self._rewind_slot
+        for _, dev in self.devices.items():
+            dev.module_rewind_save(slot)
+        self.scheduler.wires_rewind_save(slot)
+        self._rewind_ticks = (self._rewind_ticks + [self._ticks])[-REWIND_SLOTS:]
+        self._rewind_slot = (slot + 1) % REWIND_SLOTS
+
+    def rewind_to(self, ticks):
+        ''' Restores the last checkpoint of the rewind ring at or before ticks and runs to ticks,
+            the run is deterministic so it ends in the state the machine had at ticks.
+            Returns False if a device fails on the way '''
+        index = len([t for t in self._rewind_ticks if t <= ticks]) - 1
+        if index < 0:
+            raise Exception(f"ERROR::: No checkpoint at or before tick {ticks} in the rewind ring")
+        slot = (self._rewind_slot - len(self._rewind_ticks) + index) % REWIND_SLOTS
+        for _, dev in self.devices.items():
+            dev.module_rewind_restore(slot)
+        self.scheduler.wires_rewind_restore(slot)
+        self._ticks = self._rewind_ticks[index]
+        self.scheduler.set_ticks(self._ticks)
+        self._rewind_ticks = self._rewind_ticks[:index + 1]
+        self._rewind_slot = (slot + 1) % REWIND_SLOTS
+        self._next_rewind = self._ticks + self._rewind_every
+        while self._ticks < ticks:
+            if not self.tick_devices(ticks - self._ticks):
                 return False
-            # if dev_name == 'cpu':
-            #     self._ticks = dev.cpu_get_ticks()
+        return True
+
+    def send_input(self, dev_name, value):
+        ''' Passes a byte from the host to the device (a key scan code to ppi, a received byte to serial_port) '''
+        self.scheduler.input_send(self.scheduler.inputs[dev_name], value)
+
+    def record_inputs(self, filename):
+        ''' Records the inputs of the devices and the wire states set from python, starting from the current tick '''
+        if self.scheduler.device.journal_record(filename.encode('utf-8')) != 0:
+            raise Exception(f"ERROR::: Cannot record inputs to {filename}")
+
+    def replay_inputs(self, filename):
+        ''' Replays the inputs recorded by record_inputs() from the current tick, the state of the devices has to be
+            the one of the recorded run at this tick (restored from its checkpoint or state files) '''
+        if self.scheduler.device.journal_replay(filename.encode('utf-8')) != 0:
+            raise Exception(f"ERROR::: Cannot replay inputs from {filename}")
+
+    def _next_stop(self, max_ticks):
+        ''' Returns the tick number where the native scheduler has to hand control back to python '''
+        target = self._ticks + max_ticks
+        if self._save_state_at > self._ticks:
+            target = min(target, self._save_state_at)
+        if self._checkpoint_every > 0:
+            target = min(target, self._next_checkpoint)
+        if self._rewind_every > 0:
+            target = min(target, self._next_rewind)
+        for i in self._set_log_level_at:
+            if i[1] > self._ticks:
+                target = min(target, i[1])
+        return target
+
+    def tick_devices(self, max_ticks=TICKS_BATCH):
+        """ Runs up to max_ticks ticks in the native scheduler. On fail saves devices and returns False """
+        num_ticks = self._next_stop(max_ticks) - self._ticks
+        done = self.scheduler.run_ticks(num_ticks)
+        self._ticks += done
+        if self._checkpoint_every > 0 and self._ticks >= self._next_checkpoint:
+            self.checkpoint()
+            self._next_checkpoint = self._ticks + self._checkpoint_every
+        if self._rewind_every > 0 and self._ticks >= self._next_rewind:
+            self.rewind_save()
+            self._next_rewind = self._ticks + self._rewind_every
+        if done != num_ticks:
+            print(f"Device failed at tick {self._ticks + 1} with status {self.scheduler.get_error()}")
+            self.save_devices()
+            return False
         if self._save_state_at > 0 and self._ticks >= self._save_state_at:
             self.save_devices()
             print(f"Target ticks {self._save_state_at} reached, devices state saved!")
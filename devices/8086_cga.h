@@ -9,4 +9,9 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width);
 uint16_t data_read(uint32_t addr, uint8_t width);
 void module_save(void);
 void module_restore(void);
+void module_checkpoint(void);
+void module_restore_checkpoint(uint64_t tick);
+void module_rewind_save(uint32_t slot);
+void module_rewind_restore(uint32_t slot);
 int module_tick(uint32_t ticks);
+uint32_t module_next_event(uint32_t ticks);
@@ -1,6 +1,7 @@
 #include "8086_cpu.h"
 #include "pins.h"
 #include <string.h>
+#include <stddef.h>
 
 #define COMMON_LOG_FILE "logs/cpu_log.txt"
 #define REGISTERS_FILE  "logs/regs.txt"
@@ -9,12 +10,45 @@
 #define DEVICE_NAME         "CPU"
 #define DEVICE_LOG_FILE     COMMON_LOG_FILE
 
-WRITE_FUNC_PTR(mem_write);
-READ_FUNC_PTR(mem_read);
+WRITE_FUNC_PTR(mem_write_func);
+READ_FUNC_PTR(mem_read_func);
 WRITE_FUNC_PTR(io_write);
 READ_FUNC_PTR(io_read);
 uint16_t(*code_read)(uint32_t, uint8_t);
 
+#define DIRECT_MEM_MASK ((MEM_PAGES_NUM << MEM_PAGE_SHIFT) - 1)
+
+// RAM and page attributes of the memory module, see set_memory_map()
+static uint8_t *direct_ram = NULL;
+static uint8_t *direct_page_attrs = NULL;
+
+/* Plain RAM pages are read and written directly. ROM and MMIO pages, writes into pages with code
+   (they invalidate the decoded instructions) and words crossing a page go through the memory module */
+static inline uint16_t mem_read(uint32_t addr, uint8_t width) {
+    uint32_t offset = addr & DIRECT_MEM_MASK;
+    if((direct_ram != NULL) && ((direct_page_attrs[offset >> MEM_PAGE_SHIFT] & MEM_PAGE_TYPE_MASK) != MEM_PAGE_MMIO) &&
+       ((width == 1) || ((offset & (MEM_PAGE_SIZE - 1)) != (MEM_PAGE_SIZE - 1)))) {
+        uint16_t value = (width == 1) ? direct_ram[offset] : (direct_ram[offset] | (direct_ram[offset + 1] << 8));
+        mytrace(TRACE_MEM_READ, offset, value, width);
+        return value;
+    }
+    return mem_read_func(addr, width);
+}
+
+static inline void mem_write(uint32_t addr, uint16_t value, uint8_t width) {
+    uint32_t offset = addr & DIRECT_MEM_MASK;
+    if((direct_ram != NULL) && (direct_page_attrs[offset >> MEM_PAGE_SHIFT] == MEM_PAGE_RAM) &&
+       ((width == 1) || ((offset & (MEM_PAGE_SIZE - 1)) != (MEM_PAGE_SIZE - 1)))) {
+        mytrace(TRACE_MEM_WRITE, offset, value, width);
+        direct_ram[offset] = value & 0xFF;
+        if(width == 2) {
+            direct_ram[offset + 1] = value >> 8;
+        }
+        return;
+    }
+    mem_write_func(addr, value, width);
+}
+
 // typedef enum {
 //     invalid_register = 0,
 //     AX_register,
@@ -44,34 +78,50 @@ uint16_t(*code_read)(uint32_t, uint8_t);
 
 typedef struct {
     // Helper registers
-    uint32_t ticks;
+    uint64_t ticks;     // System tick, a cycle timed run passes 2^32 ticks in 15 minutes of guest time
     uint32_t invalid_operations;
     uint8_t halt;
-    // Main registers
-    uint16_t AX;    // Accumulator AH=AX>>8; AL=AX&0xFF
-    uint16_t BX;    // Base BH=BX>>8; BL=BX&0xFF
-    uint16_t CX;    // Count CH=CX>>8; CL=CX&0xFF
-    uint16_t DX;    // Data DH=DX>>8; DL=DX&0xFF
-    // Index registers
-    uint16_t SI;    // Source index
-    uint16_t DI;    // Destination index
-    uint16_t BP;    // Base pointer
-    uint16_t SP;    // Stack pointer
+    // Main and index registers in the order of the REG and R/M fields
+    union {
+        struct {
+            uint16_t AX;    // Accumulator AH=AX>>8; AL=AX&0xFF
+            uint16_t CX;    // Count CH=CX>>8; CL=CX&0xFF
+            uint16_t DX;    // Data DH=DX>>8; DL=DX&0xFF
+            uint16_t BX;    // Base BH=BX>>8; BL=BX&0xFF
+            uint16_t SP;    // Stack pointer
+            uint16_t BP;    // Base pointer
+            uint16_t SI;    // Source index
+            uint16_t DI;    // Destination index
+        };
+        uint16_t regs16[8];
+        uint8_t regs8[16];  // AL, AH, CL, CH, ... (little-endian host), see REG8()
+    };
     // Program counter
     uint16_t IP;    // Instruction pointer
-    // Segment registers
-    uint16_t CS;    // Sode segment
-    uint16_t DS;    // Data segment
-    uint16_t ES;    // Extra segment
-    uint16_t SS;    // Stack segment
+    // Segment registers in the order of the SEGREG field
+    union {
+        struct {
+            uint16_t ES;    // Extra segment
+            uint16_t CS;    // Sode segment
+            uint16_t SS;    // Stack segment
+            uint16_t DS;    // Data segment
+        };
+        uint16_t sregs[4];
+    };
     // Status register
     uint16_t flags;
     uint16_t int_vector;    // 0xFFFF is invalid value
     uint16_t prefixes;
+    uint16_t wait_cycles;   // CPU_TIMING_CYCLES: clock cycles of the last instruction still to be spent
     register_name_t override_segment;
 } registers_t;
 registers_t *REGS = NULL;
 
+// Direct access by the REG and R/M fields: 0-7 = AX, CX, DX, BX, SP, BP, SI, DI or AL, CL, DL, BL, AH, CH, DH, BH
+static const uint8_t reg8_index[8] = {0, 2, 4, 6, 1, 3, 5, 7};
+#define REG16(field)    (REGS->regs16[(field) & 0x07])
+#define REG8(field)     (REGS->regs8[reg8_index[(field) & 0x07]])
+
 // register_name_t override_segment = invalid_register;
 
 typedef enum {
@@ -125,16 +175,39 @@ typedef enum {
 //     char * destination;
 // } operands_t;
 
-size_t ticks_num = 0;
+uint32_t processed_commands[0x100];
+
+// Flags written by update_flags(), TF, IF and DF are never deferred
+#define ARITHMETIC_FLAGS ((1 << CF) | (1 << PF) | (1 << AF) | (1 << ZF) | (1 << SF) | (1 << OF))
+
+// Operation whose flags are not in REGS->flags yet, see update_flags()
+typedef struct {
+    uint8_t pending;
+    uint8_t width;
+    operation_t op_type;
+    uint32_t dst;
+    uint32_t src;
+    uint32_t res;
+} lazy_flags_t;
+
+static lazy_flags_t lazy_flags;
+static uint8_t parity_table[0x100];
 
-uint32_t processed_commands[0xFF];
+void materialize_flags(void);
+uint8_t get_lazy_flag(flag_t flag);
 
 uint8_t get_flag(flag_t flag) {
+    if(lazy_flags.pending && (ARITHMETIC_FLAGS & (1 << flag))) {
+        return get_lazy_flag(flag);
+    }
     return (REGS->flags & (1 << flag)) > 0;
 }
 
 void set_flag(flag_t flag, uint16_t value) {
     uint16_t mask = 1 << flag;
+    if(lazy_flags.pending && (ARITHMETIC_FLAGS & mask)) {
+        materialize_flags();    // The pending operation must not overwrite this flag later
+    }
     if (value > 0) {
         REGS->flags |= mask;
     } else {
@@ -155,17 +228,79 @@ void set_prefix(prefix_t px, uint16_t value) {
     }
 }
 
-uint8_t get_parity(uint16_t byte) {
-    // Returns 1 if the byte contains an even number of 1-bits, otherwise returns 0
-    uint8_t counter = 0;
-    for(int i=1; i<0x100; i<<=1) {
-        if ((byte & i) > 0)
-            counter++;
+void init_parity_table(void) {
+    for(uint32_t byte=0; byte<0x100; byte++) {
+        uint8_t counter = 0;
+        for(uint32_t i=1; i<0x100; i<<=1) {
+            if ((byte & i) > 0)
+                counter++;
+        }
+        parity_table[byte] = (counter & 0x01)? 0:1;
     }
-    return (counter & 0x01)? 0:1;
 }
 
+uint8_t get_parity(uint16_t byte) {
+    // Returns 1 if the low byte contains an even number of 1-bits, otherwise returns 0
+    return parity_table[byte & 0xFF];
+}
+
+// Only records the operation, the flags are computed when they are read (see get_flag())
 void update_flags(uint32_t dst, uint32_t src, uint32_t res, uint8_t width, operation_t op_type) {
+    // 8 and 16-bit ADD and SUB overwrite all the arithmetic flags, the other operations
+    // keep some of them, so the pending ones have to be written first
+    uint8_t overwrites_all = ((op_type == ADD_OP) || (op_type == SUB_OP)) && ((width == 1) || (width == 2));
+    if(lazy_flags.pending && !overwrites_all) {
+        materialize_flags();
+    }
+    lazy_flags.pending = 1;
+    lazy_flags.width = width;
+    lazy_flags.op_type = op_type;
+    lazy_flags.dst = dst;
+    lazy_flags.src = src;
+    lazy_flags.res = res;
+}
+
+// Computes a single flag of the pending operation, falls back to materialize_flags() for the rare cases
+uint8_t get_lazy_flag(flag_t flag) {
+    uint8_t width = lazy_flags.width;
+    if((width == 1) || (width == 2)) {
+        uint32_t mask = (width == 1) ? 0xFF : 0xFFFF;
+        uint32_t res = lazy_flags.res;
+        switch(flag) {
+            case ZF:
+                return (res & mask) == 0;
+            case SF:
+                return (res & ((width == 1) ? 0x80 : 0x8000)) > 0;
+            case PF:
+                return parity_table[res & 0xFF];
+            case CF:
+                if(lazy_flags.op_type == LOGIC_OP) {
+                    return 0;
+                } else if(lazy_flags.op_type == ADD_OP) {
+                    return (res & mask) < (lazy_flags.dst & mask);
+                } else if(lazy_flags.op_type == SUB_OP) {
+                    return (lazy_flags.dst & mask) < (lazy_flags.src & mask);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    materialize_flags();
+    return (REGS->flags & (1 << flag)) > 0;
+}
+
+// Writes the flags of the pending operation into REGS->flags
+void materialize_flags(void) {
+    if(!lazy_flags.pending) {
+        return;
+    }
+    lazy_flags.pending = 0;
+    uint32_t dst = lazy_flags.dst;
+    uint32_t src = lazy_flags.src;
+    uint32_t res = lazy_flags.res;
+    uint8_t width = lazy_flags.width;
+    operation_t op_type = lazy_flags.op_type;
     if(width == 1) {
         set_flag(SF, (res & 0x80) > 0);
         set_flag(ZF, (res & 0xFF) == 0);
@@ -358,55 +493,53 @@ uint8_t get_l(uint16_t reg_value) {
     return reg_value & 0xFF;
 }
 
+static char *reg_name_strings[] = {
+    [AX_register] = "AX", [AL_register] = "AL", [AH_register] = "AH",
+    [BX_register] = "BX", [BL_register] = "BL", [BH_register] = "BH",
+    [CX_register] = "CX", [CL_register] = "CL", [CH_register] = "CH",
+    [DX_register] = "DX", [DL_register] = "DL", [DH_register] = "DH",
+    [SI_register] = "SI", [DI_register] = "DI", [BP_register] = "BP", [SP_register] = "SP",
+    [IP_register] = "IP", [CS_register] = "CS", [DS_register] = "DS", [ES_register] = "ES", [SS_register] = "SS",
+};
+
+static const register_name_t reg16_names[8] = {
+    AX_register, CX_register, DX_register, BX_register, SP_register, BP_register, SI_register, DI_register,
+};
+static const register_name_t segreg_names[4] = {
+    ES_register, CS_register, SS_register, DS_register,
+};
+static const register_name_t reg8_names[8] = {
+    AL_register, CL_register, DL_register, BL_register, AH_register, CH_register, DH_register, BH_register,
+};
+
+// Location of every register_name_t in registers_t, 8-bit registers are the bytes of regs8[]
+typedef struct {
+    uint8_t offset;
+    uint8_t width;  // 0 for names which are not a plain register
+} reg_location_t;
+
+#define REG16_LOCATION(_reg)        {offsetof(registers_t, _reg), 2}
+#define REG8_LOCATION(_reg, _high)  {offsetof(registers_t, _reg) + (_high), 1}
+
+static const reg_location_t reg_locations[] = {
+    [AX_register] = REG16_LOCATION(AX), [AL_register] = REG8_LOCATION(AX, 0), [AH_register] = REG8_LOCATION(AX, 1),
+    [BX_register] = REG16_LOCATION(BX), [BL_register] = REG8_LOCATION(BX, 0), [BH_register] = REG8_LOCATION(BX, 1),
+    [CX_register] = REG16_LOCATION(CX), [CL_register] = REG8_LOCATION(CX, 0), [CH_register] = REG8_LOCATION(CX, 1),
+    [DX_register] = REG16_LOCATION(DX), [DL_register] = REG8_LOCATION(DX, 0), [DH_register] = REG8_LOCATION(DX, 1),
+    [SI_register] = REG16_LOCATION(SI), [DI_register] = REG16_LOCATION(DI),
+    [BP_register] = REG16_LOCATION(BP), [SP_register] = REG16_LOCATION(SP),
+    [IP_register] = REG16_LOCATION(IP),
+    [CS_register] = REG16_LOCATION(CS), [DS_register] = REG16_LOCATION(DS),
+    [ES_register] = REG16_LOCATION(ES), [SS_register] = REG16_LOCATION(SS),
+    [FLAGS_register] = {0, 0},
+    [override_segment] = {0, 0},
+};
+
 char * get_reg_name_string(register_name_t reg_name) {
-    switch (reg_name) {
-        case invalid_register:
-            return "Invalid Register";
-        case AX_register:
-            return "AX";
-        case AL_register:
-            return "AL";
-        case AH_register:
-            return "AH";
-        case BX_register:
-            return "BX";
-        case BL_register:
-            return "BL";
-        case BH_register:
-            return "BH";
-        case CX_register:
-            return "CX";
-        case CL_register:
-            return "CL";
-        case CH_register:
-            return "CH";
-        case DX_register:
-            return "DX";
-        case DL_register:
-            return "DL";
-        case DH_register:
-            return "DH";
-        case SI_register:
-            return "SI";
-        case DI_register:
-            return "DI";
-        case BP_register:
-            return "BP";
-        case SP_register:
-            return "SP";
-        case IP_register:
-            return "IP";
-        case CS_register:
-            return "CS";
-        case DS_register:
-            return "DS";
-        case ES_register:
-            return "ES";
-        case SS_register:
-            return "SS";
-        default:
-            return "Invalid Register";
+    if((reg_name > SS_register) || (reg_name == invalid_register)) {
+        return "Invalid Register";
     }
+    return reg_name_strings[reg_name];
 }
 
 // Width == 1 for byte and 2 for word
@@ -414,104 +547,25 @@ register_name_t get_reg_name(uint8_t rm_field, uint8_t width) {
     if((width < 1) || (width > 2)) {
         printf("ERROR: Invalid width: %d\n", width);
     }
-    switch(rm_field) {
-        case 0:
-            if(width == 1)
-                return AL_register;
-            else
-                return AX_register;
-            break;
-        case 1:
-            if(width == 1)
-                return CL_register;
-            else
-                return CX_register;
-            break;
-        case 2:
-            if(width == 1)
-                return DL_register;
-            else
-                return DX_register;
-            break;
-        case 3:
-            if(width == 1)
-                return BL_register;
-            else
-                return BX_register;
-            break;
-        case 4:
-            if(width == 1)
-                return AH_register;
-            else
-                return SP_register;
-            break;
-        case 5:
-            if(width == 1)
-                return CH_register;
-            else
-                return BP_register;
-            break;
-        case 6:
-            if(width == 1)
-                return DH_register;
-            else
-                return SI_register;
-            break;
-        case 7:
-            if(width == 1)
-                return BH_register;
-            else
-                return DI_register;
-            break;
-        default:
-            return invalid_register;
+    if(rm_field > 7) {
+        return invalid_register;
     }
+    return (width == 1) ? reg8_names[rm_field] : reg16_names[rm_field];
 }
 
 uint16_t get_register_value(register_name_t reg_name) {
+    if(reg_name <= override_segment) {
+        const reg_location_t *location = &reg_locations[reg_name];
+        if(location->width == 2) {
+            return *(uint16_t*)((uint8_t*)REGS + location->offset);
+        } else if(location->width == 1) {
+            return *((uint8_t*)REGS + location->offset);
+        }
+    }
     switch(reg_name) {
-        case AX_register:
-            return REGS->AX;
-        case AL_register:
-            return get_l(REGS->AX);
-        case AH_register:
-            return get_h(REGS->AX);
-        case BX_register:
-            return REGS->BX;
-        case BL_register:
-            return get_l(REGS->BX);
-        case BH_register:
-            return get_h(REGS->BX);
-        case CX_register:
-            return REGS->CX;
-        case CL_register:
-            return get_l(REGS->CX);
-        case CH_register:
-            return get_h(REGS->CX);
-        case DX_register:
-            return REGS->DX;
-        case DL_register:
-            return get_l(REGS->DX);
-        case DH_register:
-            return get_h(REGS->DX);
-        case SI_register:
-            return REGS->SI;
-        case DI_register:
-            return REGS->DI;
-        case BP_register:
-            return REGS->BP;
-        case SP_register:
-            return REGS->SP;
-        case IP_register:
-            return REGS->IP;
-        case CS_register:
-            return REGS->CS;
-        case DS_register:
-            return REGS->DS;
-        case ES_register:
-            return REGS->ES;
-        case SS_register:
-            return REGS->SS;
+        case FLAGS_register:
+            materialize_flags();
+            return REGS->flags;
         case override_segment:
             return REGS->override_segment;
         default:
@@ -521,71 +575,19 @@ uint16_t get_register_value(register_name_t reg_name) {
 }
 
 void set_register_value(register_name_t reg_name, uint16_t value) {
+    if(reg_name <= override_segment) {
+        const reg_location_t *location = &reg_locations[reg_name];
+        if(location->width == 2) {
+            *(uint16_t*)((uint8_t*)REGS + location->offset) = value;
+            return;
+        } else if(location->width == 1) {
+            *((uint8_t*)REGS + location->offset) = value & 0xFF;
+            return;
+        }
+    }
     switch(reg_name) {
-        case AX_register:
-            REGS->AX = value;
-            break;
-        case AL_register:
-            REGS->AX = set_l(REGS->AX, value & 0xFF);
-            break;
-        case AH_register:
-            REGS->AX = set_h(REGS->AX, value & 0xFF);
-            break;
-        case BX_register:
-            REGS->BX = value;
-            break;
-        case BL_register:
-            REGS->BX = set_l(REGS->BX, value & 0xFF);
-            break;
-        case BH_register:
-            REGS->BX = set_h(REGS->BX, value & 0xFF);
-            break;
-        case CX_register:
-            REGS->CX = value;
-            break;
-        case CL_register:
-            REGS->CX = set_l(REGS->CX, value & 0xFF);
-            break;
-        case CH_register:
-            REGS->CX = set_h(REGS->CX, value & 0xFF);
-            break;
-        case DX_register:
-            REGS->DX = value;
-            break;
-        case DL_register:
-            REGS->DX = set_l(REGS->DX, value & 0xFF);
-            break;
-        case DH_register:
-            REGS->DX = set_h(REGS->DX, value & 0xFF);
-            break;
-        case SI_register:
-            REGS->SI = value;
-            break;
-        case DI_register:
-            REGS->DI = value;
-            break;
-        case BP_register:
-            REGS->BP = value;
-            break;
-        case SP_register:
-            REGS->SP = value;
-            break;
-        case IP_register:
-            REGS->IP = value;
-            break;
-        case CS_register:
-            REGS->CS = value;
-            break;
-        case DS_register:
-            REGS->DS = value;
-            break;
-        case ES_register:
-            REGS->ES = value;
-            break;
-        case SS_register:
-            REGS->SS = value;
-            break;
         case FLAGS_register:
+            lazy_flags.pending = 0;
             REGS->flags = value;
             break;
         case override_segment:
@@ -599,9 +601,9 @@ void set_register_value(register_name_t reg_name, uint16_t value) {
 uint32_t get_addr(register_name_t segment_reg, uint16_t addr) {
     // override_segment
     uint32_t ret_val = 0;
-    if((segment_reg == DS_register) && (get_register_value(override_segment) != invalid_register)) {
-        ret_val = get_register_value(get_register_value(override_segment));
-        set_register_value(override_segment, invalid_register);
+    if((segment_reg == DS_register) && (REGS->override_segment != invalid_register)) {
+        ret_val = get_register_value(REGS->override_segment);
+        REGS->override_segment = invalid_register;
     } else {
         ret_val = get_register_value(segment_reg);
     }
@@ -610,21 +612,19 @@ uint32_t get_addr(register_name_t segment_reg, uint16_t addr) {
 }
 
 void push_register(uint16_t value) {
-    set_register_value(SP_register, get_register_value(SP_register) - 2);
-    uint32_t addr = get_addr(SS_register, get_register_value(SP_register));
-    mem_write(addr, value, 2);
+    REGS->SP -= 2;
+    mem_write(((uint32_t)REGS->SS << 4) + REGS->SP, value, 2);
 }
 
 void pop_register(register_name_t reg_name) {
-    uint32_t addr = get_addr(SS_register, get_register_value(SP_register));
-    set_register_value(reg_name, mem_read(addr, 2));
-    set_register_value(SP_register, get_register_value(SP_register) + 2);
+    uint16_t value = mem_read(((uint32_t)REGS->SS << 4) + REGS->SP, 2);
+    set_register_value(reg_name, value);
+    REGS->SP += 2;
 }
 
 uint16_t pop_value(void) {
-    uint32_t addr = get_addr(SS_register, get_register_value(SP_register));
-    uint16_t value = mem_read(addr, 2);
-    set_register_value(SP_register, get_register_value(SP_register) + 2);
+    uint16_t value = mem_read(((uint32_t)REGS->SS << 4) + REGS->SP, 2);
+    REGS->SP += 2;
     return value;
 }
 
@@ -643,33 +643,33 @@ operands_t decode_operands(uint8_t opcode, uint8_t *data, uint8_t single) {
     uint32_t addr = 0;
     switch(rm_field) {
         case 0:
-            addr = get_register_value(BX_register) + get_register_value(SI_register);
+            addr = REGS->BX + REGS->SI;
             break;
         case 1:
-            addr = get_register_value(BX_register) + get_register_value(DI_register);
+            addr = REGS->BX + REGS->DI;
             break;
         case 2:
-            addr = get_register_value(BP_register) + get_register_value(SI_register);
+            addr = REGS->BP + REGS->SI;
             break;
         case 3:
-            addr = get_register_value(BP_register) + get_register_value(DI_register);
+            addr = REGS->BP + REGS->DI;
             break;
         case 4:
-            addr = get_register_value(SI_register);
+            addr = REGS->SI;
             break;
         case 5:
-            addr = get_register_value(DI_register);
+            addr = REGS->DI;
             break;
         case 6:
             if(mod_field == 0) {
                 addr = data[1] + (data[2] << 8);
                 operands.num_bytes += 2;
             } else {
-                addr = get_register_value(BP_register);
+                addr = REGS->BP;
             }
             break;
         case 7:
-            addr = get_register_value(BX_register);
+            addr = REGS->BX;
             break;
     }
     if(mod_field == 1) {
@@ -680,6 +680,8 @@ operands_t decode_operands(uint8_t opcode, uint8_t *data, uint8_t single) {
         operands.num_bytes += 2;
     }
     addr = get_addr(DS_register, addr);
+    uint8_t src_field = reg_field;  // Register operands, read directly from the register file
+    uint8_t dst_field = rm_field;
     if(((opcode & 0x02) == 0) || (single == 1)) {  // Destination bit == 0 or REG field is used as an opcode extension
         if(single) {
             // REG field is used as an opcode extension
@@ -706,6 +708,8 @@ operands_t decode_operands(uint8_t opcode, uint8_t *data, uint8_t single) {
         }
     } else {
         // Instruction destination is specified in REG field
+        dst_field = reg_field;
+        src_field = rm_field;
         operands.dst_type = 0;
         operands.dst.register_name = get_reg_name(reg_field, operands.width);
         operands.destination = get_reg_name_string(operands.dst.register_name);
@@ -720,7 +724,7 @@ operands_t decode_operands(uint8_t opcode, uint8_t *data, uint8_t single) {
         }
     }
     if(operands.src_type == 0) {    // Register mode
-        operands.src_val = get_register_value(operands.src.register_name);
+        operands.src_val = (operands.width == 1) ? REG8(src_field) : REG16(src_field);
     } else if(operands.src_type == 1) { // Memory mode
         operands.src_val = mem_read(addr, operands.width);
     } else if(operands.src_type == 2) { // Immed mode
@@ -731,700 +735,437 @@ operands_t decode_operands(uint8_t opcode, uint8_t *data, uint8_t single) {
         }
     }
     if(operands.dst_type == 0) {    // Register mode
-        operands.dst_val = get_register_value(operands.dst.register_name);
+        operands.dst_val = (operands.width == 1) ? REG8(dst_field) : REG16(dst_field);
     } else {                        // Memory mode
         operands.dst_val = mem_read(addr, operands.width);
     }
     return operands;
 }
 
-int16_t jmp_instr(uint8_t opcode, uint8_t *data) {
-    // Conditional Jump instructions table:
-    // Mnemonic Condition tested        Jump if ... (p69, 2-46)         Opcode
-    // JA/JNBE  (CF OR ZF)=O            above/not below nor equal
-    // JAE/JNB  CF=O                    above or equal/ not below       0x73
-    // JB/JNAE  CF=1                    below / not above nor equal
-    // JBE/JNA  (CF OR ZF)=1            below or equal/ not above
-    // JC       CF=1                    carry
-    // JE/JZ    ZF=1                    equal/zero
-    // JG/JNLE  ((SF XOR OF) OR ZF)=O   greater / not less nor equal
-    // JGE/JNL  (SF XOR OF)=O           greater or equal/not less
-    // JL/JNGE  (SF XOR OF)=1           less/not greater nor equal
-    // JLE/JNG  ((SF XOR OF) OR ZF)=1   less or equal/ not greater
-    // JNC      CF=O                    not carry
-    // JNE/JNZ  ZF=O                    not equal/ not zero             0x75
-    // JNO      OF=O                    not overflow                    0x71
-    // JNP/JPO  PF=O                    not parity / parity odd         0x7B
-    // JNS      SF=O                    not sign                        0x79
-    // JO       OF=1                    overflow
-    // JP/JPE   PF=1                    parity / parity equal
-    // JS       SF=1                    sign
-    // Relative jump jump relative to the first byte of the next
-    // instruction: JMP 0x00 jumps to the first byte of the next instruction
-    int32_t ip_inc = 0;
-    switch(opcode) {
-        case 0x70: {    // JO SHORT-LABEL: [0x70, IP-INC8]
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x70: Relative Jump JO SHORT-LABEL");
-            if (get_flag(OF) == 1) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition OF == 1 didn't meet: OF = %d\n", get_flag(OF));
-            }
-            break;
-        }
-        case 0x71: {    // JNO SHORT-LABEL: [0x71, IP-INC8]
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x71: Relative Jump JNO");
-            if (get_flag(OF) == 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition OF == 0 didn't meet: OF = %d\n", get_flag(OF));
-            }
-            break;
-        }
-        case 0x72: {    // JB/JNAE/SHORT-LABEL JC: [0x72, IP-INC8] (p269, 4-30)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x72: Relative Jump JB/JNAE/SHORT-LABEL JC");
-            if (get_flag(CF) == 1) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition CF == 1 didn't meet: CF = %d\n", get_flag(CF));
-            }
-            break;
-        }
-        case 0x73: {    // JNB/JAE SHORT-LABEL JNC: [0x73, IP-INC8] (p269, 4-30)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x73: Relative Jump JNB/JAE");
-            if (get_flag(CF) == 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition CF == 0 didn't meet: CF = %d\n", get_flag(CF));
-            }
-            break;
-        }
-        case 0x74: {  // JE/JZ SHORT-LABEL: [0x74, IP-INC8]
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x74: Relative Jump JE/JZ");
-            if (get_flag(ZF) == 1) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition ZF == 1 didn't meet: ZF = %d\n", get_flag(ZF));
-            }
-            break;
-        }
-        case 0x75: {    // JNE/JNZ SHORT-LABEL: [0x75, IP-INC8] (p269, 4-30)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x75: Relative Jump JNE/JNZ");
-            if (get_flag(ZF) == 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition ZF == 0 didn't meet: ZF = %d\n", get_flag(ZF));
-            }
-            break;
-        }
-        case 0x76: {  // JBE/JNA SHORT-LABEL: [0x76, IP-INC8]
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x76: Relative Jump JBE/JNA SHORT-LABEL");
-            if ((get_flag(CF) == 1) || (get_flag(ZF) == 1)) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition (CF == 1 or ZF == 1) didn't meet: ZF = %d and CF = %d\n", get_flag(ZF), get_flag(CF));
-            }
-            break;
-        }
-        case 0x78: {  // JS SHORT-LABEL: [0x78, IP-INC8]
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x78: Relative Jump JS SHORT-LABEL");
-            if (get_flag(SF) == 1) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition SF == 1 didn't meet: SF = %d\n", get_flag(SF));
-            }
-            break;
-        }
-        case 0x79: {    // JNS SHORT-LABEL: [0x79, IP-INC8] (p269, 4-30)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x79: Relative Jump JNS");
-            if (get_flag(SF) == 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition SF == 0 didn't meet: SF = %d\n", get_flag(SF));
-            }
-            break;
-        }
-        case 0x7A: {  // JP/JPE SHORT-LABEL: [0x7A, IP-INC8]
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x7A: Relative Jump JP/JPE");
-            if (get_flag(PF) == 1) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition PF == 1 didn't meet: PF = %d\n", get_flag(PF));
-            }
-            break;
-        }
-        case 0x7B: {    // JNP/JPO SHORT-LABEL: [0x7B, IP-INC8] (p269, 4-30)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x7B: Relative Jump JNP/JPO");
-            if (get_flag(PF) == 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition PF == 0 didn't meet: PF = %d\n", get_flag(PF));
-            }
-            break;
-        }
-        case 0x7C: {   // JL/JNGE SHORT-LABEL: [0x7F, IP-INC8] (p269, 4-30)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0x7C: Relative Jump JL/JNGE");
-            if ((get_flag(SF) ^ get_flag(OF)) > 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition PF == 0 didn't meet: PF = %d\n", get_flag(PF));
-            }
-            break;
-        }
-        case 0xC2:  // RET IMMED16 (intrasegment): [0xC2, DATA-LO, DATA-HI]
-        case 0xC3:  // RET (intrasegment)
-        case 0xCA:  // RET IMMED16 (intersegment): [0xCA, DATA-LO, DATA-HI] p68
-        case 0xCB:  // RET (intersegment): [0xCB]
-            pop_register(IP_register);
-            if((opcode == 0xCA) || (opcode == 0xCB)) {
-                pop_register(CS_register);
-            }
-            if((opcode == 0xC2) || (opcode == 0xCA)) {
-                set_register_value(SP_register, get_register_value(SP_register) + (data[0] + (data[1] << 8)));
-            }
-            mylog(0, "logs/main.log", "Instruction 00x%02X: RET (IP = 0x%04X, CS = 0x%04X, SP = 0x%04X)\n",
-                                                                   opcode, get_register_value(IP_register),
-                                                                   get_register_value(CS_register),
-                                                                   get_register_value(SP_register));
-            break;
-        case 0xCF: {  // IRET
-            pop_register(IP_register);
-            pop_register(CS_register);
-            pop_register(FLAGS_register);
-            break;
-        }
-        case 0xE0: {  // LOOPNE/LOOPNZ SHORT-LABEL: [0xE0, IP-INC8]
-            // LOOPNE decrements CX and checks that CX is not zero and ZF is clear - if these
-            // conditions are met, it jumps at label, otherwise falls through
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0xE0: Relative Jump LOOPNE/LOOPNZ SHORT-LABEL: ");
-            uint16_t cx_val = get_register_value(CX_register);
-            set_register_value(CX_register, cx_val - 1);
-            mylog(0, "logs/main.log", "CX = 0x%04X, ZF = 0x%02X;", get_register_value(CX_register), get_flag(ZF));
-            if(get_register_value(CX_register) != 0 && get_flag(ZF) == 0) {
-                mylog(0, "logs/main.log", " jump to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition (CX != 0 and ZF == 0) didn't meet: CX = 0x%04X, ZF = %d\n", get_register_value(CX_register), get_flag(ZF));
-            }
-            break;
-        }
-        case 0xE1: {  // LOOPE/LOOPZ SHORT-LABEL: [0xE1, IP-INC8]
-            // LOOPE decrements ecx and checks that ecx is not zero and ZF is set - if these
-            // conditions are met, it jumps at label, otherwise falls through
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0xE1: Relative Jump LOOPE/LOOPZ SHORT-LABEL: ");
-            uint16_t cx_val = get_register_value(CX_register);
-            set_register_value(CX_register, cx_val - 1);
-            mylog(0, "logs/main.log", "CX = 0x%04X, ZF = 0x%02X;", get_register_value(CX_register), get_flag(ZF));
-            if(get_register_value(CX_register) != 0 && get_flag(ZF) == 1) {
-                mylog(0, "logs/main.log", " jump to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition (CX != 0 and ZF == 1) didn't meet: CX = 0x%04X, ZF = %d\n", get_register_value(CX_register), get_flag(ZF));
-            }
-            break;
-        }
-        case 0xE2: {  // LOOP SHORT-LABEL
-            // LOOP decrements CX by 1 and transfers control
-            // to the target operand if CX is not 0; otherwise the
-            // instruction following LOOP is executed.
-            mylog(0, "logs/main.log", "Instruction 0xE2: Relative Jump LOOP SHORT-LABEL: ");
-            ip_inc += 2;
-            uint16_t dest_val = get_register_value(CX_register);
-            uint16_t res_val = dest_val - 1;
-            // if((data[0] == 0xFE) && (res_val != 0)) {
-            //     res_val = 0;    // shortcut useless long waiting
-            // }
-            set_register_value(CX_register, res_val);
-            mylog(0, "logs/main.log", "CX = 0x%04X;", res_val);
-            if(res_val != 0) {
-                mylog(0, "logs/main.log", " jump to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition (CX != 0) didn't meet: CX = 0x%04X\n", res_val);
-            }
-            break;
-        }
-        case 0xE3: {    // JCXZ SHORT-LABEL: [0xE3, IP-INC8]
-            // JCXZ (Jump if CX Zero)
-            ip_inc += 2;
-            mylog(0, "logs/main.log", "Instruction 0xE3: Relative Jump JCXZ");
-            if (get_register_value(CX_register) == 0) {
-                mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
-                ip_inc += ((int8_t*)data)[0];
-            } else {
-                mylog(0, "logs/main.log", ": condition CX == 0 didn't meet: CX = 0x%04X\n", get_register_value(CX_register));
-            }
-            break;
-        }
-        case 0xE8: {  // CALL NEAR-PROC: [0xE8, IP-ING-LO, IP-INC-HI]
-            int16_t offset = data[0] + (data[1] << 8);
-            ip_inc += 3 + offset;
-            push_register(get_register_value(IP_register)+3);
-            mylog(0, "logs/main.log", "Instruction 0xE8: Call: IP + 0x%04X\n", offset);
-            break;
-        }
-        case 0xE9: {  // JMP NEAR-LABEL: [0xE9, IP-INC-LO, IP-INC-HI]
-            int16_t offset = data[0] + (data[1] << 8);
-            ip_inc += 3;
-            ip_inc += offset;
-            mylog(0, "logs/main.log", "Instruction 0xE9: Relative jump to 0x%04X\n", offset);
-            break;
-        }
-        case 0xFF: {
-            ip_inc = 0;
-            if(get_register_field(data[0]) == 4) {  // JMP REG16/MEM16 (intra): [0xFE, MOD 100 R/M, (DISP-LO), (DISP-HI)]
-                operands_t operands = decode_operands(opcode, data, 8);
-                set_register_value(IP_register, operands.src_val);
-                mylog(0, "logs/main.log", "Instruction 0xFF: intrasegment indirect JMP 0x%04X\n", get_register_value(IP_register));
-            } else {    // if 5: // JMP REG16/MEM16 (inter): [0xFE, MOD 101 R/M, DISP-LO, DISP-HI] (only memory)
-                uint16_t addr = data[0] + (data[1] << 8);
-                addr = get_addr(DS_register, addr);
-                set_register_value(IP_register, mem_read(addr, 2));
-                set_register_value(CS_register, mem_read(addr+2, 2));
-                mylog(0, "logs/main.log", "Instruction 0xFF: intersegment indirect JMP 0x%04X\n", get_register_value(IP_register));
-            }
-            break;
-        }
-        case 0xEA: {    // JMP far label: [0xEA, IP-LO, IP-HI, CS-LO, CS-HI]
-            set_register_value(IP_register, data[0] + (data[1] << 8));
-            set_register_value(CS_register, data[2] + (data[3] << 8));
-            ip_inc = 0;
-            mylog(0, "logs/main.log", "Instruction 0xEA: Far jump to IP = 0x%04X, CS = 0x%04X\n", REGS->IP, REGS->CS);
-            break;
-        }
-        case 0xEB: {  // JMP SHORT-LABEL: [0xEB, IP-INC8]
-            ip_inc += 2;
-            ip_inc += ((int8_t*)data)[0];
-            mylog(0, "logs/main.log", "Instruction 0xEB: Relative jump to 0x%02X\n", data[0]);
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Unknown JMP instruction: 0x%02X\n", opcode);
-    }
+// Moves IP by ip_inc bytes, the jump handlers set IP themselves and return 0
+static inline int16_t jump_relative(int32_t ip_inc) {
     uint16_t new_ip = (int32_t)get_register_value(IP_register) + ip_inc;
     set_register_value(IP_register, new_ip);
     return 0;
 }
 
-uint8_t mov_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    switch(opcode) {
-        case 0x88:  // MOV REG8/MEM8, REG8: 0x88, MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x89:  // MOV REG16 REG16/MEM16: [0x89, MOD REG R/M, (DISP-LO),(DISP-HI)]
-        case 0x8A:  // MOV REG8, REG8/MEM8: [0x8A, MOD REG R/M, (DISP-LO),(DISP-HI)]
-        case 0x8B: {// MOV REG16, REG16/MEM16: [0x8B, MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            if (operands.dst_type == 1) { 
-                mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s (0x%04X @ 0x%06X), %s (0x%04X)\n", opcode, operands.destination, operands.dst_val, operands.dst.address, operands.source, operands.src_val);
-            } else if (operands.src_type == 1) {
-                mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s (0x%04X), %s (0x%04X @ 0x%06X)\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, operands.src.address);
-            } else {
-                mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s (0x%04X), %s (0x%04X)\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val);
-            }
-            ret_val += operands.num_bytes;
-            if (operands.dst_type == 0) {   // Register_mode
-                set_register_value(operands.dst.register_name, operands.src_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, operands.src_val, operands.width);
-            }
-            break;
-        }
-        case 0x8C: {    // MOV REG16/MEM16, SEGREG: [0x8C, MOD OSR R/M, (DISP-LO),(DISP-HI)]
-            // reg_field: Segment register code: OO=ES, 01=CS, 10=SS, 11 =DS
-            uint8_t reg_field = get_register_field(data[0]);
-            operands_t operands = decode_operands(opcode | 0x01, data, 0); // Set width to 16-bit
-            ret_val += operands.num_bytes;
-            operands.src_type = 0;  // Force set operands src type
-            if (reg_field == 0) {   // source = ES
-                operands.src.register_name = ES_register;
-            } else if (reg_field == 1) {
-                operands.src.register_name = CS_register;
-            } else if (reg_field == 2) {
-                operands.src.register_name = SS_register;
-            } else if (reg_field == 3) {
-                operands.src.register_name = DS_register;
-            } else {
-                printf("ERROR: Incorrect reg field: opcode = 0x%02X, reg_field = 0x%02X\n", opcode, reg_field);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s, %s\n", opcode, operands.destination, get_reg_name_string(operands.src.register_name));
-            if (operands.dst_type == 0) {
-                set_register_value(operands.dst.register_name, get_register_value(operands.src.register_name));
-            } else {
-                uint16_t value = get_register_value(operands.src.register_name);
-                mem_write(operands.dst.address, value, 2);
-            }
-            break;
-        }
-        case 0x8E: {    // MOV SEGREG, REG16/MEM16: [0x8C, MOD OSR R/M, (DISP-LO),(DISP-HI) ]
-            // reg_field: Segment register code: OO=ES, 01=CS, 10=SS, 11 =DS
-            uint8_t reg_field = get_register_field(data[0]);
-            operands_t operands = decode_operands(opcode | 0x01, data, 0); // Set width to 16-bit
-            ret_val += operands.num_bytes;
-            operands.dst_type = 0;  // Force set operands src type
-            if (reg_field == 0) {   // source = ES
-                operands.dst.register_name = ES_register;
-            } else if (reg_field == 1) {
-                operands.dst.register_name = CS_register;
-            } else if (reg_field == 2) {
-                operands.dst.register_name = SS_register;
-            } else if (reg_field == 3) {
-                operands.dst.register_name = DS_register;
-            } else {
-                printf("ERROR: Incorrect reg field: opcode = 0x%02X, reg_field = 0x%02X\n", opcode, reg_field);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV SEGREG, %s\n", opcode, operands.source);
-            set_register_value(operands.dst.register_name, get_register_value(operands.src.register_name));
-            break;
-        }
-        case 0xA0: {  // MOV AL, MEM8: [0xA0, DISP-LO, DISP-HI]
-            uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
-            uint16_t value = mem_read(addr, 1);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AL, MEM8 (0x%04X @0x%08X)\n", opcode, value, addr);
-            set_register_value(AL_register, value);
-            ret_val = 3;
-            break;
-        }
-        case 0xA1: {  // MOV AX, MEM16: [0xA1, DISP-LO, DISP-HI]
-            uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
-            uint16_t value = mem_read(addr, 2);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AX, MEM16 (0x%04X @0x%08X)\n", opcode, value, addr);
-            set_register_value(AX_register, value);
-            break;
-        }
-        case 0xA2: {  // MOV MEM8, AL: [0xA2, DISP-LO, DISP-HI]
-            uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
-            mem_write(addr, get_register_value(AL_register), 1);
-            ret_val = 3;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM8 (@0x%08X), AL (0x%04X)\n", opcode, addr, get_register_value(AL_register));
-            break;
-        }
-        case 0xA3: {  // MOV MEM16, AX: [0xA3, ADDR-LO, ADDR-HI]
-            uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
-            mem_write(addr, get_register_value(AX_register), 2);
-            ret_val = 3;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM16 (@0x%08X), AX (0x%04X)\n", opcode, addr, get_register_value(AX_register));
-            break;
-        }
-        case 0xB0: {  // MOV AL, IMMED8: [0xB0, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AL immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(AL_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB1: {  // MOV CL, IMMED8: [0xB1, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV CL immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(CL_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB2: {  // MOV DL, IMMED8: [0xB2, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV DL immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(DL_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB3: {  // MOV BL, IMMED8: [0xB3, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV BL immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(BL_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB4: {  // MOV AH, IMMED8: [0xB4, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AH immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(AH_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB5: {  // MOV CH, IMMED8: [0xB5, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV CH immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(CH_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB6: {  // MOV DH, IMMED8: [0xB6, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV DH immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(DH_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB7: {  // MOV BH, IMMED8: [0xB7, immed8]
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV BH immed8 = 0x%02X\n", opcode, data[0]);
-            set_register_value(BH_register, data[0]);
-            ret_val = 2;
-            break;
-        }
-        case 0xB8: {  // MOV AX, IMMED16: [0xB8, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AX, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(AX_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xB9: {  // MOV CX, IMMED16: [0xB9, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV CX, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(CX_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xBA: {  // MOV DX, IMMED16: [0xBB, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV DX, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(DX_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xBB: {  // MOV BX, IMMED16: [0xBB, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV BX, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(BX_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xBC: {  // MOV SP, IMMED16: [0xBC, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV SP, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(SP_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xBD: {  // MOV BP, IMMED16: [0xBD, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV BP, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(BP_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xBE: {  // MOV SI, IMMED16: [0xBC, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV SI, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(SI_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xBF: {  // MOV DI, IMMED16: [0xBC, DATA-LO, DATA-HI]
-            uint16_t immed_data = data[0] + (data[1] << 8);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOV DI, IMMED16 = 0x%04X\n", opcode, immed_data);
-            set_register_value(DI_register, immed_data);
-            ret_val = 3;
-            break;
-        }
-        case 0xC4:    // LES REG16, MEM16: [opcode, MOD REG R/M, DISP-LO, DISP-HI]  (p55)
-        case 0xC5: {  // LDS REG16, MEM16: [opcode, MOD REG R/M, DISP-LO, DISP-HI]
-            operands_t operands = decode_operands(opcode, &data[0], 1);
-            ret_val += operands.num_bytes;
-            uint32_t addr = get_addr(DS_register, operands.src_val);
-            set_register_value(operands.dst.register_name, mem_read(addr, 2));
-            if(opcode == 0xC4) {
-                set_register_value(ES_register, mem_read(addr+2, 2));
-                mylog(0, "logs/main.log", "Instruction 0x%02X: LES REG16 (%s), MEM16 (0x%04X @ 0x%08X), ES, MEM16 (0x%04X @ 0x%08X);\n", opcode, operands.destination, get_register_value(operands.dst.register_name), addr, get_register_value(ES_register), addr+2);
-            } else if(opcode == 0xC5) {
-                set_register_value(DS_register, mem_read(addr+2, 2));
-                mylog(0, "logs/main.log", "Instruction 0x%02X: LDS REG16 (%s), MEM16 (0x%04X @ 0x%08X), DS, MEM16 (0x%04X @ 0x%08X);\n", opcode, operands.destination, get_register_value(operands.dst.register_name), addr, get_register_value(DS_register), addr+2);
-            }
-            break;
-        }
-        case 0xC6: {  // MOV MEM8, IMMED8: [0xC6, MOD 000 R/M, DISP-LO, DISP-HI, DATA-8]
-            if(get_register_field(data[0]) == 0) {
-                uint16_t addr = get_addr(DS_register, data[1] + (data[2] << 8));
-                mem_write(addr, data[3], 1);
-                mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM8 (@0x%08X), IMMED8 (0x%02X)\n", opcode, addr, data[3]);
-                ret_val = 5;
-            } else {
-                REGS->invalid_operations ++;
-                printf("Invalid instruction: 0x%02X, REG field != 0\n", opcode);
-            }
-            break;
-        }
-        case 0xC7: {  // MOV MEM16, IMMED16: [0xC7, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
-            if(get_register_field(data[0]) == 0) {
-                operands_t operands = decode_operands(opcode, data, 1);
-                ret_val += operands.num_bytes + 2;
-                uint16_t value = data[operands.num_bytes] + (data[operands.num_bytes+1] << 8);
-                mem_write(operands.dst.address, value, 2);
-                mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM16 (@0x%08X), IMMED16 (0x%04X)\n", opcode, operands.dst.address, value);
-            } else {
-                REGS->invalid_operations ++;
-                printf("Invalid instruction: 0x%02X, REG field != 0\n", opcode);
-            }
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Unknown MOV instruction: 0x%02X\n", opcode);
+// Relative jump SHORT-LABEL: [opcode, IP-INC8] to the first byte of the next instruction + IP-INC8 if condition is met
+static inline int16_t jump_short_if(uint8_t condition, uint8_t *data) {
+    if(condition) {
+        mylog(0, "logs/main.log", " to 0x%02X\n", data[0]);
+        return jump_relative(2 + ((int8_t*)data)[0]);
     }
-    return ret_val;
+    mylog(0, "logs/main.log", ": condition didn't meet\n");
+    return jump_relative(2);
 }
 
-uint8_t shift_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    uint16_t res_val = 0;
-    switch(opcode) {
-        case 0xD0:      // 8-bit shifts by 1
-        case 0xD1:      // 16-bit shifts by 1
-        case 0xD2:      // 8-bit shifts by CL
-        case 0xD3: {    // 16-bit shifts by CL
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes;
-            uint8_t width = operands.width * 8;
-            if((opcode == 0xD0) || (opcode == 0xD1)) {
-                operands.src_val = 1;
-            } else if((opcode == 0xD2) || (opcode == 0xD3)) {
-                operands.src_val = get_register_value(CL_register);
-            }
-            switch(get_register_field(data[0])) {
-                case 0:   // ROL REG/MEM, 1/CL: [opcode, MOD 000 R/M, DISP-LO, DISP-HI]
-                    // rotr32(x, n) (( x>>n  ) | (x<<(64-n)))
-                    if(operands.src_val > width) {
-                        operands.src_val = operands.src_val % width;
-                    }
-                    res_val = (operands.dst_val << operands.src_val) | (operands.dst_val >> (width - operands.src_val));
-                    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SHIFT_L_OP);
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: ROL %s (0x%04X), %d: result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-                    break;
-                case 1: // ROR REG/MEM, 1/CL: [opcode, MOD 001 R/M, DISP-LO, DISP-HI]
-                    if(operands.src_val > width) {
-                        operands.src_val = operands.src_val % width;
-                    }
-                    res_val = (operands.dst_val >> operands.src_val) | (operands.dst_val << (width - operands.src_val));
-                    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SHIFT_R_OP);
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: ROR %s (0x%04X), %d: result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-                    break;
-                case 2: // RCL REG/MEM, 1/CL: [opcode, MOD 010 R/M, DISP-LO, DISP-HI]
-                    // RCL (Rotate through Carry Left) rotates the bits
-                    // in the byte or word destination operand to the left
-                    // by the number of bits specified in the count
-                    // operand. The carry flag (CF) is treated as "part
-                    // of" the destination operand; that is, its value is
-                    // rotated into the low-order bit of the destination,
-                    // and itself is replaced by the high-order bit of the
-                    // destination.
-                    printf("ERROR: unimplemented RCL REG/MEM, 1/CL operation\n");
-                    REGS->invalid_operations ++;
-                    break;
-                case 3: // RCR REG/MEM, 1/CL: [opcode, MOD 011 R/M, DISP-LO, DISP-HI]
-                    printf("ERROR: unimplemented RCR REG/MEM, 1/CL operation\n");
-                    REGS->invalid_operations ++;
-                    break;
-                case 4: // SAL/SHL REG/MEM, 1/CL, 1: [opcode, MOD 100 R/M, DISP-LO, DISP-HI]
-                    res_val = operands.dst_val << operands.src_val;
-                    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SHIFT_L_OP);
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: SAL/SHL %s (0x%04X), %d: dst , result = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-                    break;
-                case 5: // SHR REG/MEM, 1/CL: [opcode, MOD 101 R/M, DISP-LO, DISP-HI]
-                    res_val = operands.dst_val >> operands.src_val;
-                    update_flags(operands.dst_val, operands.src_val, res_val, 2, SHIFT_R_OP);
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: SHR %s (0x%04X), CL %d; result = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-                    break;
-                case 6: // INVALID_INSTRUCTION
-                    REGS->invalid_operations ++;
-                    printf("Invalid instruction: 0x%02X, REG field 110\n", opcode);
-                    break;
-                case 7: { // SAR REG/MEM, 1/CL: [opcode, MOD 111 R/M, DISP-LO, DISP-HI]
-                    uint8_t sign = 0;
-                    if(((opcode & 0x01) == 1) && ((operands.dst_val & 0x8000) > 0)) {   // 16-bit
-                        sign = 1;
-                    } else if(((opcode & 0x01) == 0) && ((operands.dst_val & 0x80) > 0)) {  // 8-bit
-                        sign = 1;
-                    }
-                    uint8_t count = operands.src_val;
-                    res_val = operands.dst_val;
-                    while(count > 0) {
-                        res_val >>= 1;
-                        if(sign && ((opcode & 0x01) == 1)) {
-                            res_val |= 0x8000;
-                        } else if(sign && ((opcode & 0x01) == 0)) {
-                            res_val |= 0x80;
-                        }
-                        count --;
-                    }
-                    update_flags(operands.dst_val, operands.src_val, res_val, 2, SHIFT_R_OP);
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: SAR %s (0x%04X), CL %d; result = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-                    break;
-                }
-            }
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        default:
-            printf("Error: Unknown Shift/Rotate instruction: 0x%02X\n", opcode);
-    }
-    return ret_val;
+// Conditional Jump instructions table:
+// Mnemonic Condition tested        Jump if ... (p69, 2-46)         Opcode
+// JA/JNBE  (CF OR ZF)=O            above/not below nor equal
+// JAE/JNB  CF=O                    above or equal/ not below       0x73
+// JB/JNAE  CF=1                    below / not above nor equal
+// JBE/JNA  (CF OR ZF)=1            below or equal/ not above
+// JC       CF=1                    carry
+// JE/JZ    ZF=1                    equal/zero
+// JG/JNLE  ((SF XOR OF) OR ZF)=O   greater / not less nor equal
+// JGE/JNL  (SF XOR OF)=O           greater or equal/not less
+// JL/JNGE  (SF XOR OF)=1           less/not greater nor equal
+// JLE/JNG  ((SF XOR OF) OR ZF)=1   less or equal/ not greater
+// JNC      CF=O                    not carry
+// JNE/JNZ  ZF=O                    not equal/ not zero             0x75
+// JNO      OF=O                    not overflow                    0x71
+// JNP/JPO  PF=O                    not parity / parity odd         0x7B
+// JNS      SF=O                    not sign                        0x79
+// JO       OF=1                    overflow
+// JP/JPE   PF=1                    parity / parity equal
+// JS       SF=1                    sign
+// Relative jump jump relative to the first byte of the next
+// instruction: JMP 0x00 jumps to the first byte of the next instruction
+int16_t jo_instr(uint8_t opcode, uint8_t *data) {   // JO SHORT-LABEL: [0x70, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0x70: Relative Jump JO SHORT-LABEL");
+    return jump_short_if(get_flag(OF) == 1, data);
 }
 
-uint8_t cmp_instr(uint8_t opcode, uint8_t *data) {
-    // CMP updates AF, CF, OF, PF, SF and ZF
-    uint8_t ret_val = 1;
-    int16_t res_val = 0;
-    operands_t operands = {0};
-    switch(opcode) {
-        case 0x38:  // CMP REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x39:  // CMP REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x3A:  // CMP REG8, REG8/MEM8      [0x3A, MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x3B: {// CMP REG16, REG16/MEM16   [0x3B, MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.dst_val - operands.src_val;
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.num_bytes, SUB_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: CMP %s (0x%04X), %s (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
-            break;
-        }
-        case 0x3C: {  // CMP AL, IMMED8: [0x3C, DATA-8]
-            operands.src_val = data[0];
-            operands.dst_val = get_register_value(AL_register);
-            res_val = operands.dst_val - operands.src_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: CMP AL immed16 = 0x%04X, res = 0x%04X\n", opcode, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, 2, SUB_OP);
-            ret_val = 2;
-            break;
-        }
-        case 0x3D: {  // CMP AX, immed16: [0x3D, DATA-LO, DATA-HI]
-            operands.src_val = (data[1] << 8) + data[0];
-            operands.dst_val = get_register_value(AX_register);
-            res_val = operands.dst_val - operands.src_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: CMP AX immed16 = 0x%04X, res = 0x%04X\n", opcode, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, 2, SUB_OP);
-            ret_val = 3;
-            break;
-        }
-        default:
-            printf("Error: Unknown CMP instruction: 0x%02X\n", opcode);
+int16_t jno_instr(uint8_t opcode, uint8_t *data) {  // JNO SHORT-LABEL: [0x71, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0x71: Relative Jump JNO");
+    return jump_short_if(get_flag(OF) == 0, data);
+}
+
+int16_t jb_instr(uint8_t opcode, uint8_t *data) {   // JB/JNAE/SHORT-LABEL JC: [0x72, IP-INC8] (p269, 4-30)
+    mylog(0, "logs/main.log", "Instruction 0x72: Relative Jump JB/JNAE/SHORT-LABEL JC");
+    return jump_short_if(get_flag(CF) == 1, data);
+}
+
+int16_t jnb_instr(uint8_t opcode, uint8_t *data) {  // JNB/JAE SHORT-LABEL JNC: [0x73, IP-INC8] (p269, 4-30)
+    mylog(0, "logs/main.log", "Instruction 0x73: Relative Jump JNB/JAE");
+    return jump_short_if(get_flag(CF) == 0, data);
+}
+
+int16_t je_instr(uint8_t opcode, uint8_t *data) {   // JE/JZ SHORT-LABEL: [0x74, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0x74: Relative Jump JE/JZ");
+    return jump_short_if(get_flag(ZF) == 1, data);
+}
+
+int16_t jne_instr(uint8_t opcode, uint8_t *data) {  // JNE/JNZ SHORT-LABEL: [0x75, IP-INC8] (p269, 4-30)
+    mylog(0, "logs/main.log", "Instruction 0x75: Relative Jump JNE/JNZ");
+    return jump_short_if(get_flag(ZF) == 0, data);
+}
+
+int16_t jbe_instr(uint8_t opcode, uint8_t *data) {  // JBE/JNA SHORT-LABEL: [0x76, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0x76: Relative Jump JBE/JNA SHORT-LABEL");
+    return jump_short_if((get_flag(CF) == 1) || (get_flag(ZF) == 1), data);
+}
+
+int16_t js_instr(uint8_t opcode, uint8_t *data) {   // JS SHORT-LABEL: [0x78, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0x78: Relative Jump JS SHORT-LABEL");
+    return jump_short_if(get_flag(SF) == 1, data);
+}
+
+int16_t jns_instr(uint8_t opcode, uint8_t *data) {  // JNS SHORT-LABEL: [0x79, IP-INC8] (p269, 4-30)
+    mylog(0, "logs/main.log", "Instruction 0x79: Relative Jump JNS");
+    return jump_short_if(get_flag(SF) == 0, data);
+}
+
+int16_t jp_instr(uint8_t opcode, uint8_t *data) {   // JP/JPE SHORT-LABEL: [0x7A, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0x7A: Relative Jump JP/JPE");
+    return jump_short_if(get_flag(PF) == 1, data);
+}
+
+int16_t jnp_instr(uint8_t opcode, uint8_t *data) {  // JNP/JPO SHORT-LABEL: [0x7B, IP-INC8] (p269, 4-30)
+    mylog(0, "logs/main.log", "Instruction 0x7B: Relative Jump JNP/JPO");
+    return jump_short_if(get_flag(PF) == 0, data);
+}
+
+int16_t jl_instr(uint8_t opcode, uint8_t *data) {   // JL/JNGE SHORT-LABEL: [0x7C, IP-INC8] (p269, 4-30)
+    mylog(0, "logs/main.log", "Instruction 0x7C: Relative Jump JL/JNGE");
+    return jump_short_if((get_flag(SF) ^ get_flag(OF)) > 0, data);
+}
+
+// RET (IMMED16): pops IP (and CS for the intersegment return), then adds IMMED16 to SP
+static inline int16_t return_instr(uint8_t opcode, uint8_t intersegment, uint16_t sp_inc) {
+    pop_register(IP_register);
+    if(intersegment) {
+        pop_register(CS_register);
     }
-    return ret_val;
+    if(sp_inc) {
+        set_register_value(SP_register, get_register_value(SP_register) + sp_inc);
+    }
+    mylog(0, "logs/main.log", "Instruction 00x%02X: RET (IP = 0x%04X, CS = 0x%04X, SP = 0x%04X)\n",
+                                                           opcode, get_register_value(IP_register),
+                                                           get_register_value(CS_register),
+                                                           get_register_value(SP_register));
+    return 0;
+}
+
+int16_t ret_immed_instr(uint8_t opcode, uint8_t *data) {    // RET IMMED16 (intrasegment): [0xC2, DATA-LO, DATA-HI]
+    return return_instr(opcode, 0, data[0] + (data[1] << 8));
+}
+
+int16_t ret_instr(uint8_t opcode, uint8_t *data) {          // RET (intrasegment): [0xC3]
+    return return_instr(opcode, 0, 0);
+}
+
+int16_t retf_immed_instr(uint8_t opcode, uint8_t *data) {   // RET IMMED16 (intersegment): [0xCA, DATA-LO, DATA-HI] p68
+    return return_instr(opcode, 1, data[0] + (data[1] << 8));
+}
+
+int16_t retf_instr(uint8_t opcode, uint8_t *data) {         // RET (intersegment): [0xCB]
+    return return_instr(opcode, 1, 0);
+}
+
+int16_t iret_instr(uint8_t opcode, uint8_t *data) {         // IRET: [0xCF]
+    pop_register(IP_register);
+    pop_register(CS_register);
+    pop_register(FLAGS_register);
+    return 0;
+}
+
+int16_t loopne_instr(uint8_t opcode, uint8_t *data) {   // LOOPNE/LOOPNZ SHORT-LABEL: [0xE0, IP-INC8]
+    // LOOPNE decrements CX and checks that CX is not zero and ZF is clear - if these
+    // conditions are met, it jumps at label, otherwise falls through
+    mylog(0, "logs/main.log", "Instruction 0xE0: Relative Jump LOOPNE/LOOPNZ SHORT-LABEL: ");
+    uint16_t cx_val = get_register_value(CX_register);
+    set_register_value(CX_register, cx_val - 1);
+    mylog(0, "logs/main.log", "CX = 0x%04X, ZF = 0x%02X;", get_register_value(CX_register), get_flag(ZF));
+    return jump_short_if(get_register_value(CX_register) != 0 && get_flag(ZF) == 0, data);
+}
+
+int16_t loope_instr(uint8_t opcode, uint8_t *data) {    // LOOPE/LOOPZ SHORT-LABEL: [0xE1, IP-INC8]
+    // LOOPE decrements ecx and checks that ecx is not zero and ZF is set - if these
+    // conditions are met, it jumps at label, otherwise falls through
+    mylog(0, "logs/main.log", "Instruction 0xE1: Relative Jump LOOPE/LOOPZ SHORT-LABEL: ");
+    uint16_t cx_val = get_register_value(CX_register);
+    set_register_value(CX_register, cx_val - 1);
+    mylog(0, "logs/main.log", "CX = 0x%04X, ZF = 0x%02X;", get_register_value(CX_register), get_flag(ZF));
+    return jump_short_if(get_register_value(CX_register) != 0 && get_flag(ZF) == 1, data);
+}
+
+int16_t loop_instr(uint8_t opcode, uint8_t *data) {     // LOOP SHORT-LABEL: [0xE2, IP-INC8]
+    // LOOP decrements CX by 1 and transfers control
+    // to the target operand if CX is not 0; otherwise the
+    // instruction following LOOP is executed.
+    mylog(0, "logs/main.log", "Instruction 0xE2: Relative Jump LOOP SHORT-LABEL: ");
+    uint16_t res_val = get_register_value(CX_register) - 1;
+    set_register_value(CX_register, res_val);
+    mylog(0, "logs/main.log", "CX = 0x%04X;", res_val);
+    return jump_short_if(res_val != 0, data);
+}
+
+int16_t jcxz_instr(uint8_t opcode, uint8_t *data) {     // JCXZ SHORT-LABEL: [0xE3, IP-INC8]
+    // JCXZ (Jump if CX Zero)
+    mylog(0, "logs/main.log", "Instruction 0xE3: Relative Jump JCXZ");
+    return jump_short_if(get_register_value(CX_register) == 0, data);
+}
+
+int16_t call_near_instr(uint8_t opcode, uint8_t *data) {    // CALL NEAR-PROC: [0xE8, IP-INC-LO, IP-INC-HI]
+    int16_t offset = data[0] + (data[1] << 8);
+    push_register(get_register_value(IP_register)+3);
+    mylog(0, "logs/main.log", "Instruction 0xE8: Call: IP + 0x%04X\n", offset);
+    return jump_relative(3 + offset);
+}
+
+int16_t jmp_near_instr(uint8_t opcode, uint8_t *data) {     // JMP NEAR-LABEL: [0xE9, IP-INC-LO, IP-INC-HI]
+    int16_t offset = data[0] + (data[1] << 8);
+    mylog(0, "logs/main.log", "Instruction 0xE9: Relative jump to 0x%04X\n", offset);
+    return jump_relative(3 + offset);
+}
+
+int16_t jmp_far_instr(uint8_t opcode, uint8_t *data) {      // JMP FAR-LABEL: [0xEA, IP-LO, IP-HI, CS-LO, CS-HI]
+    set_register_value(IP_register, data[0] + (data[1] << 8));
+    set_register_value(CS_register, data[2] + (data[3] << 8));
+    mylog(0, "logs/main.log", "Instruction 0xEA: Far jump to IP = 0x%04X, CS = 0x%04X\n", REGS->IP, REGS->CS);
+    return 0;
+}
+
+int16_t jmp_short_instr(uint8_t opcode, uint8_t *data) {    // JMP SHORT-LABEL: [0xEB, IP-INC8]
+    mylog(0, "logs/main.log", "Instruction 0xEB: Relative jump to 0x%02X\n", data[0]);
+    return jump_relative(2 + ((int8_t*)data)[0]);
+}
+
+int16_t jmp_indirect_instr(uint8_t opcode, uint8_t *data) { // JMP REG16/MEM16 (intra): [0xFF, MOD 100 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 8);
+    set_register_value(IP_register, operands.src_val);
+    mylog(0, "logs/main.log", "Instruction 0xFF: intrasegment indirect JMP 0x%04X\n", get_register_value(IP_register));
+    return 0;
+}
+
+int16_t jmp_indirect_far_instr(uint8_t opcode, uint8_t *data) { // JMP MEM16 (inter): [0xFF, MOD 101 R/M, DISP-LO, DISP-HI] (only memory)
+    uint16_t addr = data[0] + (data[1] << 8);
+    addr = get_addr(DS_register, addr);
+    set_register_value(IP_register, mem_read(addr, 2));
+    set_register_value(CS_register, mem_read(addr+2, 2));
+    mylog(0, "logs/main.log", "Instruction 0xFF: intersegment indirect JMP 0x%04X\n", get_register_value(IP_register));
+    return 0;
+}
+
+int16_t mov_reg_mem_instr(uint8_t opcode, uint8_t *data) {
+    // 0x88: MOV REG8/MEM8, REG8: [0x88, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x89: MOV REG16/MEM16, REG16: [0x89, MOD REG R/M, (DISP-LO),(DISP-HI)]
+    // 0x8A: MOV REG8, REG8/MEM8: [0x8A, MOD REG R/M, (DISP-LO),(DISP-HI)]
+    // 0x8B: MOV REG16, REG16/MEM16: [0x8B, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    if (operands.dst_type == 1) {
+        mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s (0x%04X @ 0x%06X), %s (0x%04X)\n", opcode, operands.destination, operands.dst_val, operands.dst.address, operands.source, operands.src_val);
+    } else if (operands.src_type == 1) {
+        mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s (0x%04X), %s (0x%04X @ 0x%06X)\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, operands.src.address);
+    } else {
+        mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s (0x%04X), %s (0x%04X)\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val);
+    }
+    if (operands.dst_type == 0) {   // Register_mode
+        set_register_value(operands.dst.register_name, operands.src_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, operands.src_val, operands.width);
+    }
+    return 1 + operands.num_bytes;
+}
+
+int16_t mov_from_segreg_instr(uint8_t opcode, uint8_t *data) {  // MOV REG16/MEM16, SEGREG: [0x8C, MOD 0SR R/M, (DISP-LO),(DISP-HI)]
+    // SR field: Segment register code: OO=ES, 01=CS, 10=SS, 11 =DS
+    register_name_t segment = segreg_names[get_register_field(data[0]) & 0x03];
+    operands_t operands = decode_operands(opcode | 0x01, data, 0); // Set width to 16-bit
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s, %s\n", opcode, operands.destination, get_reg_name_string(segment));
+    if (operands.dst_type == 0) {
+        set_register_value(operands.dst.register_name, get_register_value(segment));
+    } else {
+        mem_write(operands.dst.address, get_register_value(segment), 2);
+    }
+    return 1 + operands.num_bytes;
+}
+
+int16_t mov_to_segreg_instr(uint8_t opcode, uint8_t *data) {    // MOV SEGREG, REG16/MEM16: [0x8E, MOD 0SR R/M, (DISP-LO),(DISP-HI)]
+    // SR field: Segment register code: OO=ES, 01=CS, 10=SS, 11 =DS
+    register_name_t segment = segreg_names[get_register_field(data[0]) & 0x03];
+    operands_t operands = decode_operands(opcode | 0x01, data, 0); // Set width to 16-bit
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV SEGREG, %s\n", opcode, operands.source);
+    set_register_value(segment, get_register_value(operands.src.register_name));
+    return 1 + operands.num_bytes;
+}
+
+int16_t mov_al_mem_instr(uint8_t opcode, uint8_t *data) {   // MOV AL, MEM8: [0xA0, DISP-LO, DISP-HI]
+    uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
+    uint16_t value = mem_read(addr, 1);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AL, MEM8 (0x%04X @0x%08X)\n", opcode, value, addr);
+    set_register_value(AL_register, value);
+    return 3;
+}
+
+int16_t mov_ax_mem_instr(uint8_t opcode, uint8_t *data) {   // MOV AX, MEM16: [0xA1, DISP-LO, DISP-HI]
+    uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
+    uint16_t value = mem_read(addr, 2);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV AX, MEM16 (0x%04X @0x%08X)\n", opcode, value, addr);
+    set_register_value(AX_register, value);
+    return 1;
+}
+
+int16_t mov_mem_al_instr(uint8_t opcode, uint8_t *data) {   // MOV MEM8, AL: [0xA2, DISP-LO, DISP-HI]
+    uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
+    mem_write(addr, get_register_value(AL_register), 1);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM8 (@0x%08X), AL (0x%04X)\n", opcode, addr, get_register_value(AL_register));
+    return 3;
+}
+
+int16_t mov_mem_ax_instr(uint8_t opcode, uint8_t *data) {   // MOV MEM16, AX: [0xA3, ADDR-LO, ADDR-HI]
+    uint16_t addr = get_addr(DS_register, data[0] + (data[1] << 8));
+    mem_write(addr, get_register_value(AX_register), 2);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM16 (@0x%08X), AX (0x%04X)\n", opcode, addr, get_register_value(AX_register));
+    return 3;
+}
+
+int16_t mov_reg8_immed_instr(uint8_t opcode, uint8_t *data) {   // MOV REG8, IMMED8: [0xB0 + REG, immed8]
+    register_name_t reg = reg8_names[opcode & 0x07];
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s immed8 = 0x%02X\n", opcode, get_reg_name_string(reg), data[0]);
+    set_register_value(reg, data[0]);
+    return 2;
+}
+
+int16_t mov_reg16_immed_instr(uint8_t opcode, uint8_t *data) {  // MOV REG16, IMMED16: [0xB8 + REG, DATA-LO, DATA-HI]
+    register_name_t reg = reg16_names[opcode & 0x07];
+    uint16_t immed_data = data[0] + (data[1] << 8);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV %s, IMMED16 = 0x%04X\n", opcode, get_reg_name_string(reg), immed_data);
+    set_register_value(reg, immed_data);
+    return 3;
+}
+
+int16_t mov_mem8_immed_instr(uint8_t opcode, uint8_t *data) {   // MOV MEM8, IMMED8: [0xC6, MOD 000 R/M, DISP-LO, DISP-HI, DATA-8]
+    uint16_t addr = get_addr(DS_register, data[1] + (data[2] << 8));
+    mem_write(addr, data[3], 1);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM8 (@0x%08X), IMMED8 (0x%02X)\n", opcode, addr, data[3]);
+    return 5;
+}
+
+int16_t mov_mem16_immed_instr(uint8_t opcode, uint8_t *data) {  // MOV MEM16, IMMED16: [0xC7, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
+    operands_t operands = decode_operands(opcode, data, 1);
+    uint16_t value = data[operands.num_bytes] + (data[operands.num_bytes+1] << 8);
+    mem_write(operands.dst.address, value, 2);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOV MEM16 (@0x%08X), IMMED16 (0x%04X)\n", opcode, operands.dst.address, value);
+    return 1 + operands.num_bytes + 2;
+}
+
+// Shift and rotate operands: REG/MEM destination, the count is 1 for 0xD0, 0xD1 and CL for 0xD2, 0xD3
+static inline operands_t decode_shift_operands(uint8_t opcode, uint8_t *data) {
+    operands_t operands = decode_operands(opcode, data, 1);
+    operands.src_val = (opcode & 0x02) ? get_register_value(CL_register) : 1;
+    return operands;
+}
+
+// Writes the result of a shift or rotate and returns the instruction length
+static inline int16_t shift_result(operands_t *operands, uint16_t res_val) {
+    if(operands->dst_type == 0) {    // Register mode
+        set_register_value(operands->dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands->dst.address, res_val, operands->width);
+    }
+    return 1 + operands->num_bytes;
+}
+
+int16_t rol_instr(uint8_t opcode, uint8_t *data) {  // ROL REG/MEM, 1/CL: [opcode, MOD 000 R/M, DISP-LO, DISP-HI]
+    operands_t operands = decode_shift_operands(opcode, data);
+    uint8_t width = operands.width * 8;
+    // rotr32(x, n) (( x>>n  ) | (x<<(64-n)))
+    if(operands.src_val > width) {
+        operands.src_val = operands.src_val % width;
+    }
+    uint16_t res_val = (operands.dst_val << operands.src_val) | (operands.dst_val >> (width - operands.src_val));
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SHIFT_L_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ROL %s (0x%04X), %d: result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return shift_result(&operands, res_val);
+}
+
+int16_t ror_instr(uint8_t opcode, uint8_t *data) {  // ROR REG/MEM, 1/CL: [opcode, MOD 001 R/M, DISP-LO, DISP-HI]
+    operands_t operands = decode_shift_operands(opcode, data);
+    uint8_t width = operands.width * 8;
+    if(operands.src_val > width) {
+        operands.src_val = operands.src_val % width;
+    }
+    uint16_t res_val = (operands.dst_val >> operands.src_val) | (operands.dst_val << (width - operands.src_val));
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SHIFT_R_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ROR %s (0x%04X), %d: result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return shift_result(&operands, res_val);
+}
+
+int16_t shl_instr(uint8_t opcode, uint8_t *data) {  // SAL/SHL REG/MEM, 1/CL: [opcode, MOD 100 R/M, DISP-LO, DISP-HI]
+    operands_t operands = decode_shift_operands(opcode, data);
+    uint16_t res_val = operands.dst_val << operands.src_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SHIFT_L_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: SAL/SHL %s (0x%04X), %d: dst , result = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return shift_result(&operands, res_val);
+}
+
+int16_t shr_instr(uint8_t opcode, uint8_t *data) {  // SHR REG/MEM, 1/CL: [opcode, MOD 101 R/M, DISP-LO, DISP-HI]
+    operands_t operands = decode_shift_operands(opcode, data);
+    uint16_t res_val = operands.dst_val >> operands.src_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, 2, SHIFT_R_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: SHR %s (0x%04X), CL %d; result = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return shift_result(&operands, res_val);
+}
+
+int16_t sar_instr(uint8_t opcode, uint8_t *data) {  // SAR REG/MEM, 1/CL: [opcode, MOD 111 R/M, DISP-LO, DISP-HI]
+    operands_t operands = decode_shift_operands(opcode, data);
+    uint16_t sign_bit = (operands.width == 2) ? 0x8000 : 0x80;
+    uint16_t sign = operands.dst_val & sign_bit;
+    uint8_t count = operands.src_val;
+    uint16_t res_val = operands.dst_val;
+    while(count > 0) {
+        res_val = (res_val >> 1) | sign;
+        count --;
+    }
+    update_flags(operands.dst_val, operands.src_val, res_val, 2, SHIFT_R_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: SAR %s (0x%04X), CL %d; result = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return shift_result(&operands, res_val);
 }
 
-uint8_t div_instr(uint8_t opcode, uint8_t *data) {
+int16_t cmp_rm_instr(uint8_t opcode, uint8_t *data) {
+    // CMP updates AF, CF, OF, PF, SF and ZF
+    // 0x38: CMP REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x39: CMP REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x3A: CMP REG8, REG8/MEM8      [0x3A, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x3B: CMP REG16, REG16/MEM16   [0x3B, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    int16_t res_val = operands.dst_val - operands.src_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.num_bytes, SUB_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: CMP %s (0x%04X), %s (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t cmp_al_immed_instr(uint8_t opcode, uint8_t *data) { // CMP AL, IMMED8: [0x3C, DATA-8]
+    int16_t src_val = data[0];
+    int16_t dst_val = get_register_value(AL_register);
+    int16_t res_val = dst_val - src_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: CMP AL immed8 = 0x%04X, res = 0x%04X\n", opcode, src_val, res_val);
+    update_flags(dst_val, src_val, res_val, 2, SUB_OP);
+    return 2;
+}
+
+int16_t cmp_ax_immed_instr(uint8_t opcode, uint8_t *data) { // CMP AX, IMMED16: [0x3D, DATA-LO, DATA-HI]
+    int16_t src_val = (data[1] << 8) + data[0];
+    int16_t dst_val = get_register_value(AX_register);
+    int16_t res_val = dst_val - src_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: CMP AX immed16 = 0x%04X, res = 0x%04X\n", opcode, src_val, res_val);
+    update_flags(dst_val, src_val, res_val, 2, SUB_OP);
+    return 3;
+}
+
+int16_t div_instr(uint8_t opcode, uint8_t *data) {  // DIV REG16/MEM16: [0xF7, MOD 110 R/M, (DISP-LO),(DISP-HI)]
     // If the source operand is a byte, it is divided into the double-length dividend assumed
     // to be in registers AL and AH. The single-length quotient is returned in AL, and the single-length
     // remainder is returned in AH. If the source operand is a word, it is divided into the double-
@@ -1433,357 +1174,281 @@ uint8_t div_instr(uint8_t opcode, uint8_t *data) {
     // register (FFH for byte source, FFFFFH for word source), as when division by zero is attempted, a
     // type 0 interrupt is generated, and the quotient and remainder are undefined. Nonintegral quotients
     // are truncated to integers. The content of AF, CF, OF, PF, SF and ZF is undefined following execution of DIV. (p 60)
-    uint8_t ret_val = 1;
-    switch(opcode) {
-        case 0x00: {    // DIV REG8/MEM8: [0xFFFF, MOD 110 R/M, (DISP-LO),(DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0); // Treat as regular as the only operand is SRC
-            ret_val += operands.num_bytes;
-            operands.dst_val = get_register_value(AL_register);
-            uint16_t res = operands.dst_val / operands.src_val;
-            if(res > 0xFF) {
-                set_int_vector(0);
-            }
-            set_register_value(AL_register, res & 0xFF);
-            set_register_value(AH_register, (uint8_t)(operands.dst_val % operands.src_val));
-            break;
-        }
-        case 0xF7: {    // DIV REG16/MEM16: [0xF7, MOD 110 R/M, (DISP-LO),(DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0); // Treat as regular as the only operand is SRC
-            ret_val += operands.num_bytes;
-            operands.dst_val = get_register_value(AX_register);
-            uint32_t res = operands.dst_val / operands.src_val;
-            if(res > 0xFFFF) {
-                set_int_vector(0);
-            }
-            set_register_value(AX_register, res & 0xFFFF);
-            set_register_value(DX_register, (uint16_t)(operands.dst_val % operands.src_val));
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid MUL instruction: 0x%02X\n", opcode);
+    operands_t operands = decode_operands(opcode, data, 0); // Treat as regular as the only operand is SRC
+    operands.dst_val = get_register_value(AX_register);
+    uint32_t res = operands.dst_val / operands.src_val;
+    if(res > 0xFFFF) {
+        set_int_vector(0);
     }
-    return ret_val;
+    set_register_value(AX_register, res & 0xFFFF);
+    set_register_value(DX_register, (uint16_t)(operands.dst_val % operands.src_val));
+    return 1 + operands.num_bytes;
+}
+
+// p60 (2.36) If the source is a byte, then it is multiplied by register AL, and the double-length
+// result is returned in AH and AL. If the source operand is a word, then it is multiplied by register
+// AX, and the double-length result is returned in registers DX and AX. The operands are treated as
+// unsigned binary numbers (see AAM).
+int16_t mul8_instr(uint8_t opcode, uint8_t *data) {     // MUL REG8/MEM8: [0xF6, MOD 100 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    operands.dst_val = get_register_value(AL_register);
+    uint32_t res_val = operands.dst_val * (uint16_t)operands.src_val;
+    set_register_value(AX_register, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, MUL_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MUL %s (0x%04X), (0x%04X); res = 0x%08X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t mul16_instr(uint8_t opcode, uint8_t *data) {    // MUL REG16/MEM16: [0xF7, MOD 100 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    operands.dst_val = get_register_value(AX_register);
+    uint32_t res_val = operands.dst_val * (uint16_t)operands.src_val;
+    set_register_value(AX_register, res_val & 0xFFFF);
+    set_register_value(DX_register, res_val >> 16);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, MUL_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MUL %s (0x%04X), (0x%04X); res = 0x%08X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t imul8_instr(uint8_t opcode, uint8_t *data) {    // IMUL REG8/MEM8 (signed): [0xF6, MOD 101 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    operands.dst_val = get_register_value(AL_register);
+    int32_t res_val = (int16_t)operands.dst_val * operands.src_val;
+    set_register_value(AX_register, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, IMUL_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: IMUL %s (0x%04X), (0x%04X); res = 0x%08X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t imul16_instr(uint8_t opcode, uint8_t *data) {   // IMUL REG16/MEM16 (signed): [0xF7, MOD 101 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    operands.dst_val = get_register_value(AX_register);
+    int32_t res_val = (int16_t)operands.dst_val * operands.src_val;
+    set_register_value(AX_register, res_val & 0xFFFF);
+    set_register_value(DX_register, res_val >> 16);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, IMUL_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: IMUL %s (0x%04X), (0x%04X); res = 0x%08X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t add_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x00: ADD REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x01: ADD REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x02: ADD REG8, REG8/MEM8:     [0x02, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x03: ADD REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    int16_t res_val = operands.dst_val + operands.src_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADD %s (0x%04X), %s (0x%04X); res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
+    }
+    return 1 + operands.num_bytes;
 }
 
-uint8_t mul_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    switch(opcode) {
-        case 0xF6:      // 8-bit operations
-        case 0xF7: {    // 16-bit operations
-            uint8_t reg_field = get_register_field(data[0]);
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            if(reg_field == 4) { // MUL REG/MEM: [opcode, MOD 100 R/M, DISP-LO, DISP-HI]
-                    // p60 (2.36) If the source is a byte, then it is multiplied by register AL, and the double-length
-                    // result is returned in AH and AL. If the source operand is a word, then it is multiplied by register
-                    // AX, and the double-length result is returned in registers DX and AX. The operands are treated as
-                    // unsigned binary numbers (see AAM).
-                uint32_t res_val = 0;
-                if(opcode == 0xF6) {
-                    operands.dst_val = get_register_value(AL_register);
-                    res_val = operands.dst_val * (uint16_t)operands.src_val;
-                    set_register_value(AX_register, res_val);
-                } else if(opcode == 0xF7) {
-                    operands.dst_val = get_register_value(AX_register);
-                    res_val = operands.dst_val * (uint16_t)operands.src_val;
-                    set_register_value(AX_register, res_val & 0xFFFF);
-                    set_register_value(DX_register, res_val >> 16);
-                }
-                update_flags(operands.dst_val, operands.src_val, res_val, operands.width, MUL_OP);
-                mylog(0, "logs/main.log", "Instruction 0x%02X: MUL %s (0x%04X), (0x%04X); res = 0x%08X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-            } else if(reg_field == 5) { // IMUL REG/MEM (signed): [opcode, MOD 101 R/M, (DISP-LO), (DISP-HI)]
-                int32_t res_val = 0;
-                if(opcode == 0xF6) {
-                    operands.dst_val = get_register_value(AL_register);
-                    res_val = (int16_t)operands.dst_val * operands.src_val;
-                    set_register_value(AX_register, res_val);
-                } else if(opcode == 0xF7) {
-                    operands.dst_val = get_register_value(AX_register);
-                    res_val = (int16_t)operands.dst_val * operands.src_val;
-                    set_register_value(AX_register, res_val & 0xFFFF);
-                    set_register_value(DX_register, res_val >> 16);
-                }
-                update_flags(operands.dst_val, operands.src_val, res_val, operands.width, IMUL_OP);
-                mylog(0, "logs/main.log", "Instruction 0x%02X: IMUL %s (0x%04X), (0x%04X); res = 0x%08X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-            }
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid MUL instruction: 0x%02X\n", opcode);
+int16_t add_al_immed_instr(uint8_t opcode, uint8_t *data) { // ADD AL, IMMED8, [0x04, DATA-8]
+    int8_t src_val = data[0];
+    int8_t dst_val = get_register_value(AL_register);
+    int16_t res_val = dst_val + src_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADD AL (0x%04X), immed (0x%04X); res = 0x%04X\n", opcode, dst_val, src_val, res_val);
+    update_flags(dst_val, src_val, res_val, 1, ADD_OP);
+    set_register_value(AL_register, res_val);
+    return 2;
+}
+
+int16_t add_ax_immed_instr(uint8_t opcode, uint8_t *data) { // ADD AX, IMMED16: [0x05, DATA-LO, DATA-HI]
+    int16_t src_val = (data[1] << 8) + data[0];
+    int16_t dst_val = get_register_value(AX_register);
+    int16_t res_val = dst_val + src_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADD AX (0x%04X), immed (0x%04X); res = 0x%04X\n", opcode, dst_val, src_val, res_val);
+    update_flags(dst_val, src_val, res_val, 2, ADD_OP);
+    set_register_value(AX_register, res_val);
+    return 3;
+}
+
+int16_t adc_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x10: ADC REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x11: ADC REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x12: ADC REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x13: ADC REG16, REG16/MEM16:  [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    int16_t res_val = operands.dst_val + operands.src_val;
+    if(get_flag(CF)) {
+        res_val += 1;
     }
-    return ret_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADC %s (0x%04X), %s (0x%04X), CF = %d; res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, get_flag(CF), res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {                        // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
+    }
+    return 1 + operands.num_bytes;
 }
 
-uint8_t add_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    int16_t res_val = 0;
-    switch(opcode) {
-        case 0x80:    // ADD REG16/MEM16, IMMED16: [0x80, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-8]
-        case 0x81: {  // ADD REG16/MEM16, IMMED16: [0x81, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes + operands.width;
-            res_val = operands.src_val + operands.dst_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADD %s (0x%04X), immed (0x%04X); res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        case 0x82:      // ADD REG8/MEM8, IMMED8: [0x82, MOD 000 R/M, (DISP-LO),(DISP-HI), DATA-8]
-        case 0x83: {    // ADD REG16/MEM16, IMMED8: [0x83, MOD 000 R/M, (DISP-LO),(DISP-HI), DATA-SX]
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes + 1;
-            operands.src_val = (int16_t)(data[operands.num_bytes]);
-            uint8_t reg_field = get_register_field(data[0]);
-            if(reg_field != 0) {
-                REGS->invalid_operations ++;
-                printf("Error: Invalid ADD instruction: 0x%02X, reg_field = %d\n", opcode, reg_field);
-            }
-            res_val = operands.src_val + operands.dst_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADD %s (0x%04X), (int16_t)immed8 (0x%04X); res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        case 0x00:      // ADD REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x01:      // ADD REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x02:      // ADD REG8, REG8/MEM8: [0x02, MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x03: {    // ADD REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.dst_val + operands.src_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADD %s (0x%04X), %s (0x%04X); res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        case 0x04: {  // ADD AL, IMMED8, [0x04, DATA-8]
-            int8_t src_val = data[0];
-            int8_t dst_val = get_register_value(AL_register);
-            res_val = dst_val + src_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADD AL (0x%04X), immed (0x%04X); res = 0x%04X\n", opcode, dst_val, src_val, res_val);
-            update_flags(dst_val, src_val, res_val, 1, ADD_OP);
-            set_register_value(AL_register, res_val);
-            ret_val = 2;
-            break;
-        }
-        case 0x05: {    // ADD AX, IMMED16: [0x05, DATA-LO, DATA-HI]
-            int16_t src_val = (data[1] << 8) + data[0];
-            int16_t dst_val = get_register_value(AX_register);
-            res_val = dst_val + src_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADD AX (0x%04X), immed (0x%04X); res = 0x%04X\n", opcode, dst_val, src_val, res_val);
-            update_flags(dst_val, src_val, res_val, 2, ADD_OP);
-            set_register_value(AX_register, res_val);
-            ret_val = 3;
-            break;
-        }
-        case 0x10:  // ADC REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x11:  // ADC REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x12: {  // ADC REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.dst_val + operands.src_val;
-            if(get_flag(CF)) {
-                res_val += 1;
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADC %s (0x%02X), %s (0x%02X), CF = %d; res = 0x%02X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, get_flag(CF), res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {                        // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        case 0x13: {  // ADC REG16, REG16/MEM16:   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.dst_val + operands.src_val;
-            if(get_flag(CF)) {
-                res_val += 1;
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADC %s (0x%04X), %s (0x%04X), CF = %d; res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, get_flag(CF), res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {                        // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        case 0x14: {  // ADC AL, IMMED8: [DATA-8]
-            operands_t operands = {0};
-            operands.dst_val = get_register_value(AL_register);
-            operands.src_val = data[0];
-            res_val = operands.src_val + operands.dst_val;
-            if(get_flag(CF)) {
-                res_val += 1;
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADC AL (0x%04X), immed8 (0x%04X), CF = %d; res = 0x%04X\n", opcode, operands.dst_val, operands.src_val, get_flag(CF), res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, 1, ADD_OP);
-            set_register_value(AL_register, res_val);
-            ret_val = 2;
-            break;
-        }
-        case 0x15: {  // ADC AX, immed16: [DATA-LO, DATA-HI]
-            operands_t operands = {0};
-            operands.dst_val = get_register_value(AL_register);
-            operands.src_val = data[0] + (data[1] << 8);
-            res_val = operands.src_val + operands.dst_val;
-            if(get_flag(CF)) {
-                res_val += 1;
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: ADC AL (0x%04X), immed16 (0x%04X), CF = %d; res = 0x%04X\n", opcode, operands.dst_val, operands.src_val, get_flag(CF), res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, 2, ADD_OP);
-            set_register_value(AL_register, res_val);
-            ret_val = 3;
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid ADD instruction: 0x%02X\n", opcode);
+int16_t adc_al_immed_instr(uint8_t opcode, uint8_t *data) { // ADC AL, IMMED8: [0x14, DATA-8]
+    int16_t dst_val = get_register_value(AL_register);
+    int16_t src_val = data[0];
+    int16_t res_val = src_val + dst_val;
+    if(get_flag(CF)) {
+        res_val += 1;
     }
-    return ret_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADC AL (0x%04X), immed8 (0x%04X), CF = %d; res = 0x%04X\n", opcode, dst_val, src_val, get_flag(CF), res_val);
+    update_flags(dst_val, src_val, res_val, 1, ADD_OP);
+    set_register_value(AL_register, res_val);
+    return 2;
 }
 
-uint8_t sub_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    int16_t res_val = 0;
-    switch(opcode) {
-        case 0x80:   // INSTR REG8/MEM8, IMMED8: [0x80, MOD XXX R/M, (DISP-LO), (DISP-HI), DATA-8]
-        case 0x81: { // INSTR REG16/MEM16, IMMED16: [0x81, MOD XXX R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes + operands.width;
-            res_val = operands.dst_val - operands.src_val;
-            uint8_t reg_field = get_register_field(data[0]);
-            char *operation;
-            if(reg_field == 3) {  // SBB REG16/MEM16,IMMED16: [opcode, MOD 111 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
-                operation = "SBB";
-                if(get_flag(CF)) {
-                    res_val -= 1;
-                }
-            } else if(reg_field == 5) { // SUB REG16/MEM16, IMMED8: [opcode, MOD 101 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                operation = "SUB";
-            } else if(reg_field == 7) { // CMP REG16/MEM16,IMMED16: [opcode, MOD 111 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
-                operation = "CMP";
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X[%d] %s %s (0x%04X), immed (0x%04X), CF = %d; res = 0x%02X\n", opcode, reg_field, operation, operands.destination, operands.dst_val, operands.src_val, get_flag(CF), res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SUB_OP);
-            if(reg_field != 7) {
-                if(operands.dst_type == 0) {    // Register mode
-                    set_register_value(operands.dst.register_name, res_val);
-                } else {    // Register mode
-                    mem_write(operands.dst.address, res_val, operands.width);
-                }
-            }
-            break;
-        }
-        case 0x82:
-        case 0x83: {
-            // DATA-SX: 8-bit immediate value that is automatically sign-extended to 16-bits before use.
-            uint8_t reg_field = get_register_field(data[0]);
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes + 1;
-            operands.src_val = (int16_t)(data[operands.num_bytes]);
-            char *operation;
-            res_val = operands.dst_val - operands.src_val;
-            if(reg_field == 3) {        // SBB REG16/MEM16, IMMED8: [0x83, MOD 011 R/M, (DISP-LO), (DISP-HI), DATA-SX]
-                if(get_flag(CF) > 0) {
-                    res_val -= 1;
-                }
-                operation = "SBB";
-            } else if(reg_field == 5) { // SUB REG16/MEM16, IMMED8: [0x83, MOD 101 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                operation = "SUB";
-            } else if(reg_field == 7) { // CMP REG16/MEM16, IMMED8: [0x83, MOD 101 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                operation = "CMP";
-            } else {
-                REGS->invalid_operations ++;
-                printf("Error: Invalid SUB instruction: 0x%02X, reg_field = %d\n", opcode, reg_field);
-                return res_val;
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: %s %s (0x%04X), immed8 (DATA-SX for 16-bit) (0x%04X), res = 0x%04X\n", opcode, operation, operands.destination, operands.dst_val, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SUB_OP);
-            if(reg_field != 7) {
-                if(operands.dst_type == 0) {    // Register mode
-                    set_register_value(operands.dst.register_name, res_val);
-                } else {    // Memory mode
-                    mem_write(operands.dst.address, res_val, operands.width);
-                }
-            }
-            break;
-        }
-        case 0x18:  // SBB REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x19:  // SBB REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x1A:  // SBB REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x1B:  // SBB REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x28:  // SUB REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x29:  // SUB REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x2A:  // SUB REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x2B: {// SUB REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.dst_val - operands.src_val;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: SUB %s (0x%04X), %s (0x%04X), res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.destination, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SUB_OP);
-            if(operands.dst_type == 0) {
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        case 0x1C:  // SBB AL, IMMED8   [DATA-8]
-        case 0x1D:  // SBB AX, immed16  [DATA-LO, DATA-HI]
-        case 0x2C:  // SUB AL, IMMED8:  [DATA-8]
-        case 0x2D: {// SUB AX, immed16: [DATA-LO, DATA-HI]
-            operands_t operands = {0};
-            if((opcode == 0x2C) || (opcode == 0x1C)) {
-                operands.src_val = get_register_value(AL_register);
-                operands.dst_val = data[0];
-                operands.width = 1;
-                ret_val = 2;
-            } else if((opcode == 0x2D) || (opcode == 0x1D)) {
-                operands.src_val = get_register_value(AX_register);
-                operands.dst_val = data[0] + (data[1] << 8);
-                operands.width = 2;
-                ret_val = 3;
-            }
-            res_val = operands.dst_val - operands.src_val;
-            if((opcode == 0x1C) || (opcode == 0x1D)) {
-                if(get_flag(CF)) {
-                    res_val -= 1;
-                }
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: SUB %s (0x%04X), %s (0x%04X), res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.destination, operands.src_val, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SUB_OP);
-            if(opcode == 0x2C) {
-                set_register_value(AL_register, res_val);
-            } else if(opcode == 0x2D) {
-                set_register_value(AX_register, res_val);
-            }
-            break;
+int16_t adc_ax_immed_instr(uint8_t opcode, uint8_t *data) { // ADC AX, IMMED16: [0x15, DATA-LO, DATA-HI]
+    int16_t dst_val = get_register_value(AL_register);
+    int16_t src_val = data[0] + (data[1] << 8);
+    int16_t res_val = src_val + dst_val;
+    if(get_flag(CF)) {
+        res_val += 1;
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADC AL (0x%04X), immed16 (0x%04X), CF = %d; res = 0x%04X\n", opcode, dst_val, src_val, get_flag(CF), res_val);
+    update_flags(dst_val, src_val, res_val, 2, ADD_OP);
+    set_register_value(AL_register, res_val);
+    return 3;
+}
+
+// ADD REG/MEM, IMMED: [opcode, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-8 or DATA-LO, DATA-HI]
+int16_t add_immed_instr(uint8_t opcode, uint8_t *data) {
+    operands_t operands = decode_operands(opcode, data, 1);
+    int16_t res_val = operands.src_val + operands.dst_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADD %s (0x%04X), immed (0x%04X); res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
+    }
+    return 1 + operands.num_bytes + operands.width;
+}
+
+// ADD REG/MEM, IMMED8: [opcode, MOD 000 R/M, (DISP-LO),(DISP-HI), DATA-SX]
+int16_t add_immed_sx_instr(uint8_t opcode, uint8_t *data) {
+    operands_t operands = decode_operands(opcode, data, 1);
+    operands.src_val = (int16_t)(data[operands.num_bytes]);
+    int16_t res_val = operands.src_val + operands.dst_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: ADD %s (0x%04X), (int16_t)immed8 (0x%04X); res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, ADD_OP);
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
+    }
+    return 1 + operands.num_bytes + 1;
+}
+
+int16_t sub_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x18: SBB REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x19: SBB REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x1A: SBB REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x1B: SBB REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x28: SUB REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x29: SUB REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x2A: SUB REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x2B: SUB REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    int16_t res_val = operands.dst_val - operands.src_val;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: SUB %s (0x%04X), %s (0x%04X), res = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SUB_OP);
+    if(operands.dst_type == 0) {
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
+    }
+    return 1 + operands.num_bytes;
+}
+
+// SBB and SUB AL/AX, IMMED: [opcode, DATA-8] or [opcode, DATA-LO, DATA-HI], only SUB writes the result
+static inline int16_t sub_accumulator(uint8_t opcode, uint8_t *data, register_name_t reg, uint8_t width, uint8_t borrow, uint8_t write) {
+    int16_t src_val = get_register_value(reg);
+    int16_t dst_val = (width == 1) ? data[0] : (data[0] + (data[1] << 8));
+    int16_t res_val = dst_val - src_val;
+    if(borrow && get_flag(CF)) {
+        res_val -= 1;
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: %s %s (0x%04X), immed (0x%04X), res = 0x%04X\n", opcode, borrow ? "SBB" : "SUB", get_reg_name_string(reg), dst_val, src_val, res_val);
+    update_flags(dst_val, src_val, res_val, width, SUB_OP);
+    if(write) {
+        set_register_value(reg, res_val);
+    }
+    return 1 + width;
+}
+
+int16_t sbb_al_immed_instr(uint8_t opcode, uint8_t *data) { // SBB AL, IMMED8: [0x1C, DATA-8]
+    return sub_accumulator(opcode, data, AL_register, 1, 1, 0);
+}
+
+int16_t sbb_ax_immed_instr(uint8_t opcode, uint8_t *data) { // SBB AX, IMMED16: [0x1D, DATA-LO, DATA-HI]
+    return sub_accumulator(opcode, data, AX_register, 2, 1, 0);
+}
+
+int16_t sub_al_immed_instr(uint8_t opcode, uint8_t *data) { // SUB AL, IMMED8: [0x2C, DATA-8]
+    return sub_accumulator(opcode, data, AL_register, 1, 0, 1);
+}
+
+int16_t sub_ax_immed_instr(uint8_t opcode, uint8_t *data) { // SUB AX, IMMED16: [0x2D, DATA-LO, DATA-HI]
+    return sub_accumulator(opcode, data, AX_register, 2, 0, 1);
+}
+
+/* SBB, SUB and CMP REG/MEM, IMMED: [opcode, MOD XXX R/M, (DISP-LO), (DISP-HI), DATA-8 or DATA-LO, DATA-HI] for 0x80, 0x81
+   and [opcode, MOD XXX R/M, (DISP-LO), (DISP-HI), DATA-SX] for 0x82, 0x83, CMP doesn't write the result */
+static inline int16_t sub_immed(uint8_t opcode, uint8_t *data, uint8_t sign_extend, uint8_t borrow, uint8_t write, const char *operation) {
+    operands_t operands = decode_operands(opcode, data, 1);
+    int16_t ret_val = 1 + operands.num_bytes;
+    if(sign_extend) {
+        // DATA-SX: 8-bit immediate value that is automatically sign-extended to 16-bits before use.
+        operands.src_val = (int16_t)(data[operands.num_bytes]);
+        ret_val += 1;
+    } else {
+        ret_val += operands.width;
+    }
+    int16_t res_val = operands.dst_val - operands.src_val;
+    if(borrow && get_flag(CF)) {
+        res_val -= 1;
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: %s %s (0x%04X), immed (0x%04X), res = 0x%04X\n", opcode, operation, operands.destination, operands.dst_val, operands.src_val, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, SUB_OP);
+    if(write) {
+        if(operands.dst_type == 0) {    // Register mode
+            set_register_value(operands.dst.register_name, res_val);
+        } else {    // Memory mode
+            mem_write(operands.dst.address, res_val, operands.width);
         }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid SUB instruction: 0x%02X\n", opcode);
     }
     return ret_val;
 }
 
-uint8_t sahf_instr(void) {
+int16_t sbb_immed_instr(uint8_t opcode, uint8_t *data) {    // SBB REG/MEM, IMMED: [opcode, MOD 011 R/M, ...]
+    return sub_immed(opcode, data, 0, 1, 1, "SBB");
+}
+
+int16_t sub_immed_instr(uint8_t opcode, uint8_t *data) {    // SUB REG/MEM, IMMED: [opcode, MOD 101 R/M, ...]
+    return sub_immed(opcode, data, 0, 0, 1, "SUB");
+}
+
+int16_t cmp_immed_instr(uint8_t opcode, uint8_t *data) {    // CMP REG/MEM, IMMED: [opcode, MOD 111 R/M, ...]
+    return sub_immed(opcode, data, 0, 0, 0, "CMP");
+}
+
+int16_t sbb_immed_sx_instr(uint8_t opcode, uint8_t *data) { // SBB REG/MEM, IMMED8: [opcode, MOD 011 R/M, ..., DATA-SX]
+    return sub_immed(opcode, data, 1, 1, 1, "SBB");
+}
+
+int16_t sub_immed_sx_instr(uint8_t opcode, uint8_t *data) { // SUB REG/MEM, IMMED8: [opcode, MOD 101 R/M, ..., DATA-SX]
+    return sub_immed(opcode, data, 1, 0, 1, "SUB");
+}
+
+int16_t cmp_immed_sx_instr(uint8_t opcode, uint8_t *data) { // CMP REG/MEM, IMMED8: [opcode, MOD 111 R/M, ..., DATA-SX]
+    return sub_immed(opcode, data, 1, 0, 0, "CMP");
+}
+
+int16_t sahf_instr(uint8_t opcode, uint8_t *data) {
     // Loads the SF, ZF, AF, PF, and CF flags of the EFLAGS register with
     // values from the corresponding bits in the AH register (7, 6, 4, 2, 0 respectively)
     uint8_t AH = get_h(REGS->AX);
@@ -1796,458 +1461,280 @@ uint8_t sahf_instr(void) {
     return 1;
 }
 
-uint8_t lahf_instr(void) {
+int16_t lahf_instr(uint8_t opcode, uint8_t *data) {
     // Loads lower byte from the flags register into AH register
     mylog(0, "logs/main.log", "Instruction 0x9F: LAHF\n");
-    set_register_value(AH_register, 0xFF & REGS->flags);
+    set_register_value(AH_register, 0xFF & get_register_value(FLAGS_register));
     return 1;
 }
 
-uint8_t xor_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    uint16_t res_val = 0;
-    switch(opcode) {
-        case 0x30:      // XOR REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x31:      // XOR REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x32:      // XOR REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x33: {    // XOR REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.src_val ^ operands.dst_val;
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: XOR %s, %s: dst = 0x%04X, src = 0x%04X, result = 0x%04X\n", opcode, operands.destination, operands.source, operands.dst_val, operands.src_val, res_val);
-            break;
-        }
-        case 0x34:  // XOR AL, IMMED8: [0x34, DATA-8]
-            REGS->invalid_operations ++;
-            printf("Error: Invalid XOR instruction: 0x%02X\n", opcode);
-            break;
-        case 0x35:  // XOR AX, immed16: [0x35, DATA-LO, DATA-HI]
-            REGS->invalid_operations ++;
-            printf("Error: Invalid XOR instruction: 0x%02X\n", opcode);
-            break;
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid XOR instruction: 0x%02X\n", opcode);
+int16_t xor_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x30: XOR REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x31: XOR REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x32: XOR REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x33: XOR REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    uint16_t res_val = operands.src_val ^ operands.dst_val;
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
     }
-    return ret_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: XOR %s, %s: dst = 0x%04X, src = 0x%04X, result = 0x%04X\n", opcode, operands.destination, operands.source, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t or_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x08: OR REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x09: OR REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x0A: OR REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x0B: OR REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    uint16_t res_val = operands.src_val | operands.dst_val;
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
+    }
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    if(operands.dst_type == 1) {    // Memory mode
+        mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X @ 0x%08X), %s (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.dst.address, operands.source, operands.src_val, res_val);
+    } else if(operands.src_type == 1) {    // Memory mode
+        mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X), %s (0x%04X @ 0x%08X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, operands.src.address, res_val);
+    } else {
+        mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X), %s (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
+    }
+    return 1 + operands.num_bytes;
 }
 
-uint8_t or_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    uint16_t res_val = 0;
-    switch(opcode) {
-        case 0x08:      // OR REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x09:      // OR REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x0A:      // OR REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x0B: {    // OR REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.src_val | operands.dst_val;
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            if(operands.dst_type == 1) {    // Memory mode
-                mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X @ 0x%08X), %s (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.dst.address, operands.source, operands.src_val, res_val);
-            } else if(operands.src_type == 1) {    // Memory mode
-                mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X), %s (0x%04X @ 0x%08X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, operands.src.address, res_val);
-            } else {
-                mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X), %s (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
-            }
-            break;
-        }
-        case 0x0C: {  // OR AL, IMMED8 [DATA-8]
-            operands_t operands = {0};
-            operands.src_val = data[0];
-            operands.dst_val = get_register_value(AL_register);
-            res_val = operands.dst_val | operands.src_val;
-            set_register_value(AL_register, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: OR AL (0x%04X), IMMED-8 (0x%04X); result = 0x%04X\n", opcode, operands.dst_val, operands.src_val, res_val);
-            ret_val = 2;
-            break;
-        }
-        case 0x0D:{  // OR AX, IMMED16 [0x0D, DATA-LO, DATA-HI]
-            operands_t operands = {0};
-            operands.src_val = data[0] + (data[1] << 8);
-            operands.dst_val = get_register_value(AX_register);
-            res_val = operands.dst_val | operands.src_val;
-            set_register_value(AX_register, res_val);
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: OR AX (0x%04X), IMMED-16 (0x%04X); result = 0x%04X\n", opcode, operands.dst_val, operands.src_val, res_val);
-            ret_val = 3;
-            break;
-        }
-        case 0x80: {  // OR REG8/MEM8, IMMED8: [0x80, MOD 001 R/M, (DISP-LO), (DISP-HI), DATA-8]
-            operands_t operands = decode_operands(opcode, data, 1);
-            res_val = operands.dst_val | operands.src_val;
-            ret_val += operands.num_bytes + operands.width;
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, 1);
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X), immed8 (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid OR instruction: 0x%02X\n", opcode);
-    }
-    return ret_val;
+int16_t or_al_immed_instr(uint8_t opcode, uint8_t *data) {  // OR AL, IMMED8 [0x0C, DATA-8]
+    operands_t operands = {0};
+    operands.src_val = data[0];
+    operands.dst_val = get_register_value(AL_register);
+    uint16_t res_val = operands.dst_val | operands.src_val;
+    set_register_value(AL_register, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: OR AL (0x%04X), IMMED-8 (0x%04X); result = 0x%04X\n", opcode, operands.dst_val, operands.src_val, res_val);
+    return 2;
 }
 
-uint8_t adj_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    switch(opcode) {
-        case 0x27: {  // DAA
-            // https://www.righto.com/2023/01/understanding-x86s-decimal-adjust-after.html
-            uint8_t src_val = get_register_value(AL_register);
-            uint8_t res_val = src_val;
-            if(((res_val & 0x0F) > 9) || (get_flag(AF) > 0)) {
-                res_val += 6;
-            }
-            if((src_val > 0x99) || (get_flag(CF) > 0)) {
-                res_val += 0x60;
-            }
-            set_flag(SF, (res_val & 0x80) > 0);
-            set_flag(ZF, (res_val & 0xFF) == 0);
-            set_flag(PF, get_parity(res_val & 0xFF));
-            mylog(0, "logs/main.log", "Instruction 0x%02X: DAA AL = (0x%02X); result = 0x%04X\n", opcode, src_val, res_val);
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid ADJUST instruction: 0x%02X\n", opcode);
+int16_t or_ax_immed_instr(uint8_t opcode, uint8_t *data) {  // OR AX, IMMED16 [0x0D, DATA-LO, DATA-HI]
+    operands_t operands = {0};
+    operands.src_val = data[0] + (data[1] << 8);
+    operands.dst_val = get_register_value(AX_register);
+    uint16_t res_val = operands.dst_val | operands.src_val;
+    set_register_value(AX_register, res_val);
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: OR AX (0x%04X), IMMED-16 (0x%04X); result = 0x%04X\n", opcode, operands.dst_val, operands.src_val, res_val);
+    return 3;
+}
+
+int16_t or_immed_instr(uint8_t opcode, uint8_t *data) { // OR REG8/MEM8, IMMED8: [0x80, MOD 001 R/M, (DISP-LO), (DISP-HI), DATA-8]
+    operands_t operands = decode_operands(opcode, data, 1);
+    uint16_t res_val = operands.dst_val | operands.src_val;
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, 1);
     }
-    return ret_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: OR %s (0x%04X), immed8 (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes + operands.width;
 }
-uint8_t and_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    uint16_t res_val = 0;
-    switch(opcode) {
-        case 0x20:  // AND REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x21:  // AND REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x22:  // AND REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x23:  // AND REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x84: {// TEST REG8/MEM8,REG8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            res_val = operands.src_val & operands.dst_val;
-            char * operation;
-            if((opcode == 0x20) || (opcode == 0x21) || (opcode == 0x22) || (opcode == 0x23)) {
-                operation = "AND";
-                if(operands.dst_type == 0) {    // Register mode
-                    set_register_value(operands.dst.register_name, res_val);
-                } else {    // Memory mode
-                    mem_write(operands.dst.address, res_val, 2);
-                }
-            } else {
-                operation = "TEST";
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: %s %s (0x%04X), %s (0x%04X); result = 0x%04X\n",
-                  opcode, operation, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
-            break;
-        }
-        case 0xA8:      // TEST AL, IMMED8
-        case 0x24: {    // AND AL, IMMED8: [0x24, DATA-8]
-            operands_t operands = {0};
-            operands.dst_val = get_register_value(AL_register);
-            operands.src_val = data[0];
-            res_val = operands.src_val & operands.dst_val;
-            if(opcode == 0x24) {
-                set_register_value(AL_register, res_val);
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, 1, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: AND AL (0x%02X), immed8 (0x%02X); result = 0x%04X\n", opcode, operands.dst_val, operands.src_val, res_val);
-            ret_val = 2;
-            break;
-        }
-        case 0xA9:      // TEST AX, IMMED16
-        case 0x25: {    // AND AX, immed16: [DATA-LO, DATA-HI]
-            operands_t operands = {0};
-            operands.dst_val = get_register_value(AL_register);
-            operands.src_val = data[0] + (data[1] << 8);
-            res_val = operands.src_val & operands.dst_val;
-            if(opcode == 0x24) {
-                set_register_value(AX_register, res_val);
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, 2, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: AND AL (0x%02X), immed8 (0x%02X); result = 0x%04X\n", opcode, operands.dst_val, operands.src_val, res_val);
-            ret_val = 3;
-            break;
-        }
-        case 0x80:  // AND REG8/MEM8, IMMED8: [0x80, MOD 100 R/M, (DISP-LO), (DISP-HI), DATA-8]
-        case 0x81: {// AND REG16/MEM16,IMMED16: [0x81, MOD 100 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes + operands.width;
-            res_val = operands.src_val & operands.dst_val;
-            if(operands.dst_type == 0) {    // Register mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: AND %s (0x%04X), IMMED (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
-            break;
-        }
-        case 0xF6: {    // TEST REG8/MEM8, IMMED8: [0xF6, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-8]
-            uint8_t reg_field = get_register_field(data[0]);
-            if(0 != reg_field) {
-                REGS->invalid_operations ++;
-                printf("Error: Invalid TEST instruction: 0x%02X: reg_field = %d\n", opcode, reg_field);
-                return ret_val;
-            }
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes + operands.width;
-            res_val = operands.dst_val & operands.src_val;
-            update_flags(operands.dst_val, operands.src_val, res_val, 1, LOGIC_OP);
-            if(operands.dst_type == 0) {    // Register_mode
-                mylog(0, "logs/main.log", "Instruction 0x%02X: TEST %s (0x%02X), immed8 (0x%02X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
-            } else {
-                mylog(0, "logs/main.log", "Instruction 0x%02X: TEST %s (0x%02X @ 0x%06X), immed8 (0x%02X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.dst.address, operands.src_val, res_val);
-            }
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid AND instruction: 0x%02X\n", opcode);
+
+int16_t daa_instr(uint8_t opcode, uint8_t *data) {  // DAA: [0x27]
+    // https://www.righto.com/2023/01/understanding-x86s-decimal-adjust-after.html
+    uint8_t src_val = get_register_value(AL_register);
+    uint8_t res_val = src_val;
+    if(((res_val & 0x0F) > 9) || (get_flag(AF) > 0)) {
+        res_val += 6;
     }
-    return ret_val;
+    if((src_val > 0x99) || (get_flag(CF) > 0)) {
+        res_val += 0x60;
+    }
+    set_flag(SF, (res_val & 0x80) > 0);
+    set_flag(ZF, (res_val & 0xFF) == 0);
+    set_flag(PF, get_parity(res_val & 0xFF));
+    mylog(0, "logs/main.log", "Instruction 0x%02X: DAA AL = (0x%02X); result = 0x%04X\n", opcode, src_val, res_val);
+    return 1;
 }
 
-uint8_t pop_reg_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    register_name_t reg;
-    switch(opcode) {
-        case 0x07:  // POP ES
-        case 0x17:  // POP SS
-        case 0x1F:  // POP DS
-        case 0x58:  // POP AX
-        case 0x59:  // POP CX
-        case 0x5A:  // POP DX
-        case 0x5B:  // POP BX
-        case 0x5C:  // POP SP
-        case 0x5D:  // POP BP
-        case 0x5E:  // POP SI
-        case 0x5F:  // POP DI
-        case 0x9D: {// POPF
-            if(opcode == 0x07) {
-                reg = ES_register;
-            } else if(opcode == 0x17) {
-                reg = SS_register;
-            } else if(opcode == 0x1F) {
-                reg = DS_register;
-            } else if(opcode == 0x58) {
-                reg = AX_register;
-            } else if(opcode == 0x59) {
-                reg = CX_register;
-            } else if(opcode == 0x5A) {
-                reg = DX_register;
-            } else if(opcode == 0x5B) {
-                reg = BX_register;
-            } else if(opcode == 0x5C) {
-                reg = SP_register;
-            } else if(opcode == 0x5D) {
-                reg = BP_register;
-            } else if(opcode == 0x5E) {
-                reg = SI_register;
-            } else if(opcode == 0x5F) {
-                reg = DI_register;
-            } else if(opcode == 0x9D) {
-                reg = FLAGS_register;
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: POP %s\n", opcode, get_reg_name_string(reg));
-            pop_register(reg);
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid POP instruction: 0x%02X\n", opcode);
+int16_t and_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x20: AND REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x21: AND REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x22: AND REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x23: AND REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    uint16_t res_val = operands.src_val & operands.dst_val;
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, 2);
     }
-    return ret_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: AND %s (0x%04X), %s (0x%04X); result = 0x%04X\n",
+          opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+int16_t test_rm_instr(uint8_t opcode, uint8_t *data) {  // TEST REG8/MEM8,REG8: [0x84, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    uint16_t res_val = operands.src_val & operands.dst_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: TEST %s (0x%04X), %s (0x%04X); result = 0x%04X\n",
+          opcode, operands.destination, operands.dst_val, operands.source, operands.src_val, res_val);
+    return 1 + operands.num_bytes;
+}
+
+// AND and TEST AL, IMMED8: [opcode, DATA-8], TEST only sets the flags
+static inline int16_t and_al_immed(uint8_t opcode, uint8_t *data, uint8_t write) {
+    int16_t dst_val = get_register_value(AL_register);
+    int16_t src_val = data[0];
+    uint16_t res_val = src_val & dst_val;
+    if(write) {
+        set_register_value(AL_register, res_val);
+    }
+    update_flags(dst_val, src_val, res_val, 1, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: %s AL (0x%02X), immed8 (0x%02X); result = 0x%04X\n", opcode, write ? "AND" : "TEST", dst_val, src_val, res_val);
+    return 2;
 }
 
-uint8_t push_reg_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    register_name_t reg;
-    switch(opcode) {
-        case 0x06:  // PUSH ES
-        case 0x0E:  // PUSH CS
-        case 0x16:  // PUSH SS
-        case 0x1E:  // PUSH DS
-        case 0x50:  // PUSH AX
-        case 0x51:  // PUSH CX
-        case 0x52:  // PUSH DX
-        case 0x53:  // PUSH BX
-        case 0x54:  // PUSH SP
-        case 0x55:  // PUSH BP
-        case 0x56:  // PUSH SI
-        case 0x57:  // PUSH DI
-        case 0x9C: {// PUSHF
-            if(opcode == 0x06) {
-                reg = ES_register;
-            } else if(opcode == 0x0E) {
-                reg = CS_register;
-            } else if(opcode == 0x16) {
-                reg = SS_register;
-            } else if(opcode == 0x1E) {
-                reg = DS_register;
-            } else if(opcode == 0x50) {
-                reg = AX_register;
-            } else if(opcode == 0x51) {
-                reg = CX_register;
-            } else if(opcode == 0x52) {
-                reg = DX_register;
-            } else if(opcode == 0x53) {
-                reg = BX_register;
-            } else if(opcode == 0x54) {
-                reg = SP_register;
-            } else if(opcode == 0x55) {
-                reg = BP_register;
-            } else if(opcode == 0x56) {
-                reg = SI_register;
-            } else if(opcode == 0x57) {
-                reg = DI_register;
-            } else if(opcode == 0x9C) {
-                reg = FLAGS_register;
-            }
-            push_register(get_register_value(reg));
-            mylog(0, "logs/main.log", "Instruction 0x%02X: PUSH %s\n", opcode, get_reg_name_string(reg));
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid PUSH instruction: 0x%02X\n", opcode);
+int16_t and_al_immed_instr(uint8_t opcode, uint8_t *data) { // AND AL, IMMED8: [0x24, DATA-8]
+    return and_al_immed(opcode, data, 1);
+}
+
+int16_t test_al_immed_instr(uint8_t opcode, uint8_t *data) {// TEST AL, IMMED8: [0xA8, DATA-8]
+    return and_al_immed(opcode, data, 0);
+}
+
+// AND and TEST AX, IMMED16: [opcode, DATA-LO, DATA-HI], only the flags of the operation with AL are set
+int16_t test_ax_immed_instr(uint8_t opcode, uint8_t *data) {
+    int16_t dst_val = get_register_value(AL_register);
+    int16_t src_val = data[0] + (data[1] << 8);
+    uint16_t res_val = src_val & dst_val;
+    update_flags(dst_val, src_val, res_val, 2, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: AND/TEST AX (0x%02X), immed16 (0x%04X); result = 0x%04X\n", opcode, dst_val, src_val, res_val);
+    return 3;
+}
+
+// AND REG/MEM, IMMED: [0x80, MOD 100 R/M, (DISP-LO), (DISP-HI), DATA-8], [0x81, MOD 100 R/M, (DISP-LO), (DISP-HI), DATA-LO, DATA-HI]
+int16_t and_immed_instr(uint8_t opcode, uint8_t *data) {
+    operands_t operands = decode_operands(opcode, data, 1);
+    uint16_t res_val = operands.src_val & operands.dst_val;
+    if(operands.dst_type == 0) {    // Register mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
     }
-    return ret_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, operands.width, LOGIC_OP);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: AND %s (0x%04X), IMMED (0x%04X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    return 1 + operands.num_bytes + operands.width;
+}
+
+// TEST sets the zero flag, ZF, when the result of the AND operation is zero.
+// If two operands are equal, their bitwise AND is zero when both are zero.
+// TEST also sets the sign flag, SF, when the most significant bit is set in
+// the result, and the parity flag, PF, when the number of set bits is even.
+int16_t test_immed_instr(uint8_t opcode, uint8_t *data) {   // TEST REG8/MEM8, IMMED8: [0xF6, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-8]
+    operands_t operands = decode_operands(opcode, data, 1);
+    uint16_t res_val = operands.dst_val & operands.src_val;
+    update_flags(operands.dst_val, operands.src_val, res_val, 1, LOGIC_OP);
+    if(operands.dst_type == 0) {    // Register_mode
+        mylog(0, "logs/main.log", "Instruction 0x%02X: TEST %s (0x%02X), immed8 (0x%02X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.src_val, res_val);
+    } else {
+        mylog(0, "logs/main.log", "Instruction 0x%02X: TEST %s (0x%02X @ 0x%06X), immed8 (0x%02X); result = 0x%04X\n", opcode, operands.destination, operands.dst_val, operands.dst.address, operands.src_val, res_val);
+    }
+    return 1 + operands.num_bytes + operands.width;
+}
+
+int16_t pop_segreg_instr(uint8_t opcode, uint8_t *data) {   // POP ES, SS, DS: [0x07], [0x17], [0x1F]
+    register_name_t reg = segreg_names[(opcode >> 3) & 0x03];
+    mylog(0, "logs/main.log", "Instruction 0x%02X: POP %s\n", opcode, get_reg_name_string(reg));
+    pop_register(reg);
+    return 1;
 }
 
-uint8_t esc_instr(uint8_t opcode, uint8_t *data) {
+int16_t pop_reg16_instr(uint8_t opcode, uint8_t *data) {    // POP REG16: [0x58 + REG]
+    register_name_t reg = reg16_names[opcode & 0x07];
+    mylog(0, "logs/main.log", "Instruction 0x%02X: POP %s\n", opcode, get_reg_name_string(reg));
+    pop_register(reg);
+    return 1;
+}
+
+int16_t popf_instr(uint8_t opcode, uint8_t *data) {         // POPF: [0x9D]
+    mylog(0, "logs/main.log", "Instruction 0x%02X: POPF\n", opcode);
+    pop_register(FLAGS_register);
+    return 1;
+}
+
+int16_t push_segreg_instr(uint8_t opcode, uint8_t *data) {  // PUSH ES, CS, SS, DS: [0x06], [0x0E], [0x16], [0x1E]
+    register_name_t reg = segreg_names[(opcode >> 3) & 0x03];
+    push_register(get_register_value(reg));
+    mylog(0, "logs/main.log", "Instruction 0x%02X: PUSH %s\n", opcode, get_reg_name_string(reg));
+    return 1;
+}
+
+int16_t push_reg16_instr(uint8_t opcode, uint8_t *data) {   // PUSH REG16: [0x50 + REG]
+    register_name_t reg = reg16_names[opcode & 0x07];
+    push_register(get_register_value(reg));
+    mylog(0, "logs/main.log", "Instruction 0x%02X: PUSH %s\n", opcode, get_reg_name_string(reg));
+    return 1;
+}
+
+int16_t pushf_instr(uint8_t opcode, uint8_t *data) {        // PUSHF: [0x9C]
+    push_register(get_register_value(FLAGS_register));
+    mylog(0, "logs/main.log", "Instruction 0x%02X: PUSHF\n", opcode);
+    return 1;
+}
+
+int16_t esc_instr(uint8_t opcode, uint8_t *data) {
     mylog(0, "logs/main.log", "Instruction 0xD8: ESC\n");
     return 2;
 }
 
-int16_t inc_instr(uint8_t opcode, uint8_t *data) {
-    int16_t ret_val = 1;
-    register_name_t reg;
-    switch(opcode) {
-        case 0x40:  // INC AX
-        case 0x41:  // INC CX
-        case 0x42:  // INC DX
-        case 0x43:  // INC BX
-        case 0x44:  // INC SP
-        case 0x45:  // INC BP
-        case 0x46:  // INC SI
-        case 0x47: {// INC DI
-            if(opcode == 0x40) {
-                reg = AX_register;
-            }else if(opcode == 0x41) {
-                reg = CX_register;
-            } else if(opcode == 0x42) {
-                reg = DX_register;
-            } else if(opcode == 0x43) {
-                reg = BX_register;
-            } else if(opcode == 0x44) {
-                reg = SP_register;
-            } else if(opcode == 0x45) {
-                reg = BP_register;
-            } else if(opcode == 0x46) {
-                reg = SI_register;
-            } else if(opcode == 0x47) {
-                reg = DI_register;
-            }
-            uint16_t val = get_register_value(reg);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: INC %s: 0x%04X => 0x%04X\n", opcode, get_reg_name_string(reg), val, val+1);
-            set_register_value(reg, val+1);
-            update_flags(val, 1, val+1, 2, ADD_OP);
-            break;
-        }
-        case 0xFE:
-        case 0xFF: {
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes;
-            uint16_t res_val = operands.dst_val + 1;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: INC %s: 0x%04X => 0x%04X\n", opcode, operands.destination, operands.dst_val, res_val);
-            update_flags(res_val, 1, res_val, operands.width, ADD_OP);
-            if (operands.dst_type == 0) {   // Reg mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid INC instruction: 0x%02X\n", opcode);
+int16_t inc_reg16_instr(uint8_t opcode, uint8_t *data) {    // INC REG16: [0x40 + REG]
+    register_name_t reg = reg16_names[opcode & 0x07];
+    uint16_t val = get_register_value(reg);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: INC %s: 0x%04X => 0x%04X\n", opcode, get_reg_name_string(reg), val, val+1);
+    set_register_value(reg, val+1);
+    update_flags(val, 1, val+1, 2, ADD_OP);
+    return 1;
+}
+
+int16_t inc_rm_instr(uint8_t opcode, uint8_t *data) {       // INC REG/MEM: [0xFE/0xFF, MOD 000 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 1);
+    uint16_t res_val = operands.dst_val + 1;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: INC %s: 0x%04X => 0x%04X\n", opcode, operands.destination, operands.dst_val, res_val);
+    update_flags(res_val, 1, res_val, operands.width, ADD_OP);
+    if (operands.dst_type == 0) {   // Reg mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
     }
-    return ret_val;
+    return 1 + operands.num_bytes;
 }
 
-int16_t dec_instr(uint8_t opcode, uint8_t *data) {
-    int16_t ret_val = 1;
-    register_name_t reg;
-    switch(opcode) {
-        case 0x48:  // DEC AX
-        case 0x49:  // DEC CX
-        case 0x4A:  // DEC DX
-        case 0x4B:  // DEC BX
-        case 0x4C:  // DEC SP
-        case 0x4D:  // DEC BP
-        case 0x4E:  // DEC SI
-        case 0x4F: {// DEC DI
-            if(opcode == 0x48) {
-                reg = AX_register;
-            }else if(opcode == 0x49) {
-                reg = CX_register;
-            } else if(opcode == 0x4A) {
-                reg = DX_register;
-            } else if(opcode == 0x4B) {
-                reg = BX_register;
-            } else if(opcode == 0x4C) {
-                reg = SP_register;
-            } else if(opcode == 0x4D) {
-                reg = BP_register;
-            } else if(opcode == 0x4E) {
-                reg = SI_register;
-            } else if(opcode == 0x4f) {
-                reg = DI_register;
-            }
-            uint16_t val = get_register_value(reg);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: DEC %s: 0x%04X => 0x%04X\n", opcode, get_reg_name_string(reg), val, val-1);
-            set_register_value(reg, val - 1);
-            update_flags(val, 1, val-1, 2, SUB_OP);
-            break;
-        }
-        case 0xFE:
-        case 0xFF: {
-            operands_t operands = decode_operands(opcode, data, 1);
-            ret_val += operands.num_bytes;
-            uint16_t res_val = operands.dst_val - 1;
-            mylog(0, "logs/main.log", "Instruction 0x%02X: DEC %s: 0x%04X => 0x%04X\n", opcode, operands.destination, operands.dst_val, res_val);
-            update_flags(res_val, 1, res_val, operands.width, SUB_OP);
-            if (operands.dst_type == 0) {   // Reg mode
-                set_register_value(operands.dst.register_name, res_val);
-            } else {    // Memory mode
-                mem_write(operands.dst.address, res_val, operands.width);
-            }
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid DEC instruction: 0x%02X\n", opcode);
+int16_t dec_reg16_instr(uint8_t opcode, uint8_t *data) {    // DEC REG16: [0x48 + REG]
+    register_name_t reg = reg16_names[opcode & 0x07];
+    uint16_t val = get_register_value(reg);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: DEC %s: 0x%04X => 0x%04X\n", opcode, get_reg_name_string(reg), val, val-1);
+    set_register_value(reg, val - 1);
+    update_flags(val, 1, val-1, 2, SUB_OP);
+    return 1;
+}
+
+int16_t dec_rm_instr(uint8_t opcode, uint8_t *data) {       // DEC REG/MEM: [0xFE/0xFF, MOD 001 R/M, (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 1);
+    uint16_t res_val = operands.dst_val - 1;
+    mylog(0, "logs/main.log", "Instruction 0x%02X: DEC %s: 0x%04X => 0x%04X\n", opcode, operands.destination, operands.dst_val, res_val);
+    update_flags(res_val, 1, res_val, operands.width, SUB_OP);
+    if (operands.dst_type == 0) {   // Reg mode
+        set_register_value(operands.dst.register_name, res_val);
+    } else {    // Memory mode
+        mem_write(operands.dst.address, res_val, operands.width);
     }
-    return ret_val;
+    return 1 + operands.num_bytes;
 }
 
 void print_registers(void) {
@@ -2255,915 +1742,1071 @@ void print_registers(void) {
     mylog(0, "logs/main.log", "AX=0x%04X,BX=0x%04X,CX=0x%04X,DX=0x%04X,", REGS->AX, REGS->BX, REGS->CX, REGS->DX);
     mylog(0, "logs/main.log", "SI=0x%04X,DI=0x%04X,BP=0x%04X,SP=0x%04X,", REGS->SI, REGS->DI, REGS->BP, REGS->SP);
     mylog(0, "logs/main.log", "CS=0x%04X,DS=0x%04X,SS=0x%04X,ES=0x%04X,", REGS->CS, REGS->DS, REGS->SS, REGS->ES);
-    mylog(0, "logs/main.log", "IP=0x%04X,FL=0x%04X;\n", REGS->IP, REGS->flags);
+    mylog(0, "logs/main.log", "IP=0x%04X,FL=0x%04X;\n", REGS->IP, get_register_value(FLAGS_register));
 }
 
-uint8_t xchg_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t ret_val = 1;
-    switch(opcode) {
-        case 0x86:      // XCHG REG8, REG8/MEM8: [0x86, MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x87: {    // XCHG REG16, REG16/MEM16: [0x86, MOD REG R/M (DISP-LO), (DISP-HI)]
-            operands_t operands = decode_operands(opcode, data, 0);
-            ret_val += operands.num_bytes;
-            if (operands.src_type == 0) {   // Reg mode
-                set_register_value(operands.src.register_name, operands.dst_val);
-            } else {    // Memory mode
-                mem_write(operands.src.address, operands.dst_val, operands.width);
-            }
-            set_register_value(operands.dst.register_name, operands.src_val);
-            mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG %s (0x%04X), %s (0x%04X)\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val);
-            break;
-        }
-        case 0x90:  // XCHG AX, AX (NOP)
-        case 0x91:  // XCHG AX, CX
-        case 0x92:  // XCHG AX, DX
-        case 0x93:  // XCHG AX, BX
-        case 0x94:  // XCHG AX, SP
-        case 0x95:  // XCHG AX, BP
-        case 0x96:  // XCHG AX, SI
-        case 0x97: {  // XCHG AX, DI
-            register_name_t r1 = AX_register;
-            register_name_t r2 = AX_register;
-            if(opcode == 0x90) {  // XCHG AX, AX (NOP))
-                    r2 = AX_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, AX (NOP)\n", opcode);
-            } else if(opcode == 0x91) {  // XCHG AX, CX
-                    r2 = CX_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, CX\n", opcode);
-            } else if(opcode == 0x92) {  // XCHG AX, DX
-                    r2 = DX_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, DX\n", opcode);
-            } else if(opcode == 0x93) {  // XCHG AX, BX
-                    r2 = BX_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, BX\n", opcode);
-            } else if(opcode == 0x94) {  // XCHG AX, SP
-                    r2 = SP_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, SP\n", opcode);
-            } else if(opcode == 0x95) {  // XCHG AX, BP
-                    r2 = BP_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, BP\n", opcode);
-            } else if(opcode == 0x96) {  // XCHG AX, SI
-                    r2 = SI_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, SI\n", opcode);
-            } else if(opcode == 0x97) {  // XCHG AX, DI
-                    r2 = DI_register;
-                    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, DI\n", opcode);
-            }
-            set_register_value(AX_register, get_register_value(r2));
-            set_register_value(r2, get_register_value(r1));
-            break;
-        }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid INC/DEC instruction: 0x%02X\n", opcode);
+int16_t xchg_rm_instr(uint8_t opcode, uint8_t *data) {
+    // 0x86: XCHG REG8, REG8/MEM8: [0x86, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    // 0x87: XCHG REG16, REG16/MEM16: [0x87, MOD REG R/M (DISP-LO), (DISP-HI)]
+    operands_t operands = decode_operands(opcode, data, 0);
+    if (operands.src_type == 0) {   // Reg mode
+        set_register_value(operands.src.register_name, operands.dst_val);
+    } else {    // Memory mode
+        mem_write(operands.src.address, operands.dst_val, operands.width);
     }
-    return ret_val;
+    set_register_value(operands.dst.register_name, operands.src_val);
+    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG %s (0x%04X), %s (0x%04X)\n", opcode, operands.destination, operands.dst_val, operands.source, operands.src_val);
+    return 1 + operands.num_bytes;
 }
 
-uint8_t string_instr(uint8_t opcode, uint8_t *data) {
-    uint8_t opcode_len = 1;
-    switch(opcode) {
-        case 0xAA: {  // STOS DEST-STR8
-            opcode_len = 1;
-            break;
-        }
-        case 0xAB: {  // STOS DEST-STR16
-            opcode_len = 1;
-            break;
-        }
-        case 0xA5: {  // MOVS DEST-STR16, SRC-STR16
-            opcode_len = 1;
-            break;
+int16_t xchg_ax_instr(uint8_t opcode, uint8_t *data) {  // XCHG AX, REG16: [0x90 + REG] (0x90 is XCHG AX, AX: NOP)
+    register_name_t reg = reg16_names[opcode & 0x07];
+    mylog(0, "logs/main.log", "Instruction 0x%02X: XCHG AX, %s\n", opcode, get_reg_name_string(reg));
+    set_register_value(AX_register, get_register_value(reg));
+    set_register_value(reg, get_register_value(AX_register));
+    return 1;
+}
+
+/* REP string instructions: every element is one tick, the elements the running block has ticks for
+   are processed at once directly in the RAM pages (see mem_read() and mem_write()). block_step()
+   sets rep_max_elements and charges rep_elements, the number of the elements processed by the step */
+static uint32_t rep_max_elements = 1;
+static uint32_t rep_elements = 0;
+
+static inline uint32_t min_elements(uint32_t a, uint32_t b) {
+    return (a < b) ? a : b;
+}
+
+/* Returns the number of the elements from SEGMENT:OFFSET in the direction of DF which are in one page
+   accessed directly and don't wrap the offset, 0 if the element has to go through the memory module */
+static uint32_t rep_span(register_name_t segment, uint16_t offset, uint8_t width, uint8_t write) {
+    uint32_t addr = get_addr(segment, offset) & DIRECT_MEM_MASK;
+    uint8_t attrs = direct_page_attrs[addr >> MEM_PAGE_SHIFT];
+    uint32_t in_page = addr & (MEM_PAGE_SIZE - 1);
+    if((write && (attrs != MEM_PAGE_RAM)) || ((attrs & MEM_PAGE_TYPE_MASK) == MEM_PAGE_MMIO) || (in_page + width > MEM_PAGE_SIZE)) {
+        return 0;
+    }
+    if(get_flag(DF)) {
+        return min_elements(in_page / width + 1, offset / width + 1);
+    }
+    return min_elements((MEM_PAGE_SIZE - in_page) / width, (0x10000 - offset) / width);
+}
+
+/* Processes up to CX elements of MOVS, STOS or LODS as memmove/memset over the RAM, returns the number
+   of the processed elements, 0 if the next one has to be processed the usual way: the CPU log is on,
+   a segment override is pending (it applies to one element only) or the memory is not plain RAM */
+static uint32_t rep_bulk(uint8_t opcode) {
+    uint32_t count = min_elements(REGS->CX, rep_max_elements);
+    if((count < 2) || (direct_ram == NULL) || (device_log_level == 0) || (REGS->override_segment != invalid_register)) {
+        return 0;
+    }
+    uint8_t width = (opcode & 0x01) ? 2 : 1;
+    uint8_t down = get_flag(DF);
+    uint8_t reads = (opcode != 0xAA) && (opcode != 0xAB);
+    uint8_t writes = (opcode != 0xAC) && (opcode != 0xAD);
+    uint32_t done = 0;
+    while(done < count) {
+        uint32_t num = count - done;
+        if(reads) {
+            num = min_elements(num, rep_span(DS_register, REGS->SI, width, 0));
+        }
+        if(writes) {
+            num = min_elements(num, rep_span(ES_register, REGS->DI, width, 1));
+        }
+        if(num == 0) {
+            break;
+        }
+        uint32_t size = num * width;
+        uint32_t src = get_addr(DS_register, REGS->SI) & DIRECT_MEM_MASK;
+        uint32_t dst = get_addr(ES_register, REGS->DI) & DIRECT_MEM_MASK;
+        if(down) {  // The lowest addresses of the elements
+            src -= size - width;
+            dst -= size - width;
+        }
+        switch(opcode) {
+            case 0xA4:      // MOVS DEST-STR8, SRC-STR8
+            case 0xA5: {    // MOVS DEST-STR16, SRC-STR16
+                // An element copied to the source of a later one repeats the pattern, memmove doesn't
+                if(((dst > src) && (dst < src + size) && !down) || ((dst < src) && (dst + size > src) && down)) {
+                    for(uint32_t i=0; i<num; i++) {
+                        uint32_t offset = down ? (size - width - i * width) : (i * width);
+                        uint16_t value = direct_ram[src + offset] | ((width == 2) ? (direct_ram[src + offset + 1] << 8) : 0);
+                        direct_ram[dst + offset] = value & 0xFF;
+                        if(width == 2) {
+                            direct_ram[dst + offset + 1] = value >> 8;
+                        }
+                    }
+                } else {
+                    memmove(&direct_ram[dst], &direct_ram[src], size);
+                }
+                break;
+            }
+            case 0xAA:      // STOS DEST-STR8
+                memset(&direct_ram[dst], REGS->AX & 0xFF, size);
+                break;
+            case 0xAB:      // STOS DEST-STR16
+                for(uint32_t i=0; i<size; i+=2) {
+                    direct_ram[dst + i] = REGS->AX & 0xFF;
+                    direct_ram[dst + i + 1] = REGS->AX >> 8;
+                }
+                break;
+            case 0xAC:      // LODS SRC-STR8: the last element stays in AL
+                REGS->AX = (REGS->AX & 0xFF00) | direct_ram[down ? src : (src + size - 1)];
+                break;
+            case 0xAD: {    // LODS SRC-STR16
+                uint32_t last = down ? src : (src + size - 2);
+                REGS->AX = direct_ram[last] | (direct_ram[last + 1] << 8);
+                break;
+            }
         }
-        case 0xAC: {  // LODS SRC-STR8
-            opcode_len = 1;
-            break;
+        uint16_t step = down ? -size : size;
+        if(reads) {
+            REGS->SI += step;
         }
-        case 0xAD: {  // LODS SRC-STR16
-            opcode_len = 1;
-            break;
+        if(writes) {
+            REGS->DI += step;
         }
+        REGS->CX -= num;
+        done += num;
     }
+    return done;
+}
+
+/* Applies the REP prefix before a string element: returns -1 if the handler has to process one element,
+   otherwise the value the handler returns, 1 for CX == 0 and 0 if rep_bulk() has processed the elements */
+static inline int16_t string_rep_start(uint8_t opcode) {
     if(get_prefix(REPE) || get_prefix(REPNE)) {
         uint16_t cx = get_register_value(CX_register);
         if(cx == 0) {
             set_prefix(REPE, 0);
             set_prefix(REPNE, 0);
-            return opcode_len;
+            return 1;
         }
-        set_register_value(CX_register, cx - 1);
-    }
-    switch(opcode) {
-        case 0xA5: {  // MOVS DEST-STR16, SRC-STR16
-            uint32_t dst_addr = get_addr(ES_register, get_register_value(DI_register));
-            uint32_t src_addr = get_addr(DS_register, get_register_value(SI_register));
-            uint16_t val = mem_read(src_addr, 2);
-            mem_write(dst_addr, val, 2);
-            if(get_flag(DF)) {
-                set_register_value(DI_register, get_register_value(DI_register) - 2);
-                set_register_value(SI_register, get_register_value(SI_register) - 2);
-            } else {
-                set_register_value(DI_register, get_register_value(DI_register) + 2);
-                set_register_value(SI_register, get_register_value(SI_register) + 2);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: MOVS DEST-STR16, SRC-STR16 (0x%08X <= 0x%04X @ 0x%08X)\n", opcode, dst_addr, val, src_addr);
-            break;
-        }
-        case 0xAA: {  // STOS DEST-STR8
-            uint32_t addr = get_addr(ES_register, get_register_value(DI_register));
-            mem_write(addr, get_register_value(AL_register), 1);
-            if(get_flag(DF)) {
-                set_register_value(DI_register, get_register_value(DI_register) - 1);
-            } else {
-                set_register_value(DI_register, get_register_value(DI_register) + 1);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: STOS DEST-STR8 (0x%08X)\n", opcode, addr);
-            break;
-        }
-        case 0xAB: {  // STOS DEST-STR16
-            uint32_t addr = get_addr(ES_register, get_register_value(DI_register));
-            mem_write(addr, get_register_value(AX_register), 2);
-            if(get_flag(DF)) {
-                set_register_value(DI_register, get_register_value(DI_register) - 2);
-            } else {
-                set_register_value(DI_register, get_register_value(DI_register) + 2);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: STOS DEST-STR16 (0x%08X)\n", opcode, addr);
-            break;
-        }
-        case 0xAC: {  // LODS SRC-STR8
-            uint32_t addr = get_addr(DS_register, get_register_value(SI_register));
-            set_register_value(AL_register, mem_read(addr, 1));
-            if(get_flag(DF)) {
-                set_register_value(SI_register, get_register_value(SI_register) - 1);
-            } else {
-                set_register_value(SI_register, get_register_value(SI_register) + 1);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: LODS SRC-STR8 (addr = 0x%08X, value = 0x%04X)\n", opcode, addr, get_register_value(AL_register));
-            break;
-        }
-        case 0xAD: {  // LODS SRC-STR16
-            uint32_t addr = get_addr(DS_register, get_register_value(SI_register));
-            set_register_value(AX_register, mem_read(addr, 2));
-            if(get_flag(DF)) {
-                set_register_value(SI_register, get_register_value(SI_register) - 2);
-            } else {
-                set_register_value(SI_register, get_register_value(SI_register) + 2);
-            }
-            mylog(0, "logs/main.log", "Instruction 0x%02X: LODS SRC-STR16 (0x%08X)\n", opcode, addr);
-            break;
+        uint32_t done = rep_bulk(opcode);
+        if(done > 0) {
+            rep_elements = done;
+            mylog(0, "logs/main.log", "Instruction 0x%02X: REP string operation, %d elements\n", opcode, done);
+            return 0;
         }
-        default:
-            REGS->invalid_operations ++;
-            printf("Error: Invalid string operation: 0x%02X\n", opcode);
+        set_register_value(CX_register, cx - 1);
+        rep_elements = 1;
     }
+    return -1;
+}
+
+// IP stays at the string instruction while the REP prefix is set
+static inline int16_t string_rep_end(void) {
     if(get_prefix(REPE) || get_prefix(REPNE)) {
         return 0;
+    }
+    return 1;
+}
+
+int16_t movsb_instr(uint8_t opcode, uint8_t *data) {    // MOVS DEST-STR8, SRC-STR8: [0xA4]
+    int16_t ret_val = string_rep_start(opcode);
+    if(ret_val >= 0) {
+        return ret_val;
+    }
+    uint32_t dst_addr = get_addr(ES_register, get_register_value(DI_register));
+    uint32_t src_addr = get_addr(DS_register, get_register_value(SI_register));
+    uint16_t val = mem_read(src_addr, 1);
+    mem_write(dst_addr, val, 1);
+    if(get_flag(DF)) {
+        set_register_value(DI_register, get_register_value(DI_register) - 1);
+        set_register_value(SI_register, get_register_value(SI_register) - 1);
     } else {
-        return opcode_len;
+        set_register_value(DI_register, get_register_value(DI_register) + 1);
+        set_register_value(SI_register, get_register_value(SI_register) + 1);
     }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOVS DEST-STR8, SRC-STR8 (0x%08X <= 0x%02X @ 0x%08X)\n", opcode, dst_addr, val, src_addr);
+    return string_rep_end();
 }
 
-int16_t process_instruction(uint8_t * memory) {
-    // mylog("logs/main.log", "===============================================================\n");
-    mylog(0, "logs/main.log", ">>>Step %d, processing bytes: 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X:\n",
-           REGS->ticks, memory[0], memory[1], memory[2], memory[3], memory[4], memory[5]);
-    print_registers();
-    mylog(0, "logs/short.log", "Step: %d, IP: 0x%04X, data: 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X\n",
-          REGS->ticks, REGS->IP, memory[0], memory[1], memory[2], memory[3], memory[4], memory[5]);
-    int16_t ret_val = 1;
-    switch(memory[0]) {
-        case 0x00:  // ADD REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x01:  // ADD REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x02:  // ADD REG8, REG8/MEM8: [0x02, MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x03:  // ADD REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x04:  // ADD AL, IMMED8           [DATA-8]
-        case 0x05:  // ADD AX, immed16          [0x05, DATA-LO, DATA-HI]
-            ret_val = add_instr(memory[0], &memory[1]);
-            break;
-        case 0x06:  // PUSH ES
-            ret_val = push_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x07:  // POP ES
-            ret_val = pop_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x08:  // OR REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x09:  // OR REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x0A:  // OR REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x0B:  // OR REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x0C:  // OR AL, IMMED8           [DATA-8]
-        case 0x0D:  // OR AX, immed16          [DATA-LO, DATA-HI]
-            ret_val = or_instr(memory[0], &memory[1]);
-            break;
-        case 0x0E:  // PUSH CS
-            ret_val = push_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x0F:  // INVALID_INSTRUCTION;
-            REGS->invalid_operations ++;
-            printf("Invalid instruction: 0x%02X\n", memory[0]);
-            break;
-        case 0x10:  // ADC REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x11:  // ADC REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x12:  // ADC REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x13:  // ADC REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x14:  // ADC AL, IMMED8           [DATA-8]
-        case 0x15:  // ADC AX, immed16          [DATA-LO, DATA-HI]
-            ret_val = add_instr(memory[0], &memory[1]);
-            break;
-        case 0x16:  // PUSH SS
-            ret_val = push_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x17:  // POP SS
-            ret_val = pop_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x18:  // SBB REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x19:  // SBB REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x1A:  // SBB REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x1B:  // SBB REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x1C:  // SBB AL, IMMED8           [DATA-8]
-        case 0x1D:  // SBB AX, immed16          [DATA-LO, DATA-HI]
-            ret_val = sub_instr(memory[0], &memory[1]);
-            break;
-        case 0x1E:  // PUSH DS
-            ret_val = push_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x1F:  // POP DS
-            ret_val = pop_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x20:  // AND REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x21:  // AND REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x22:  // AND REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x23:  // AND REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x24:  // AND AL, IMMED8           [DATA-8]
-        case 0x25:  // AND AX, immed16          [DATA-LO, DATA-HI]
-            ret_val = and_instr(memory[0], &memory[1]);
-            break;
-        case 0x26:  // ES:
-            mylog(0, "logs/main.log", "Instruction 0x26: ES (override segment)\n");
-            set_register_value(override_segment, ES_register);
-            break;
-        case 0x27:  // DAA
-            ret_val = adj_instr(memory[0], &memory[1]);
-            break;
-        case 0x28:  // SUB REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x29:  // SUB REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x2A:  // SUB REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x2B:  // SUB REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x2C:  // SUB AL, IMMED8           [DATA-8]
-        case 0x2D:  // SUB AX, immed16          [DATA-LO, DATA-HI]
-            ret_val = sub_instr(memory[0], &memory[1]);
-            break;
-        case 0x2E:  // CS:
-            mylog(0, "logs/main.log", "Instruction 0x2E: CS (override segment)\n");
-            set_register_value(override_segment, CS_register);
-            break;
-        // case 0x2F:  // DAS
-        //     das_op();
-        //     ret_val = 1;
-        //     break;
-        case 0x30:  // XOR REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x31:  // XOR REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x32:  // XOR REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x33:  // XOR REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x34:  // XOR AL, IMMED8           [DATA-8]
-        case 0x35:  // XOR AX, immed16          [DATA-LO, DATA-HI]
-            ret_val = xor_instr(memory[0], &memory[1]);
-            break;
-        case 0x36:  // SS:
-            mylog(0, "logs/main.log", "Instruction 0x36: SS (override segment)\n");
-            set_register_value(override_segment, SS_register);
-            break;
-            break;
-        // case 0x37:  // AAA
-        //     aaa_op();
-        //     ret_val = 1;
-        //     break;
-        case 0x38:  // CMP REG8/MEM8, REG8;     [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x39:  // CMP REG16/MEM16, REG16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x3A:  // CMP REG8, REG8/MEM8      [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x3B:  // CMP REG16, REG16/MEM16   [MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x3C:  // CMP AL, IMMED8: [0x3C, DATA-8]
-        case 0x3D:  // CMP AX, immed16: [0x3D, DATA-LO, DATA-HI]
-            ret_val = cmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x3E:  // DS:
-            mylog(0, "logs/main.log", "Instruction 0x3E: DS (override segment)\n");
-            set_register_value(override_segment, DS_register);
-            break;
-            break;
-        // case 0x3F:  // AAS
-        //     aas_op();
-        //     ret_val = 1;
-        //     break;
-        case 0x40:  // INC AX
-        case 0x41:  // INC CX
-        case 0x42:  // INC DX
-        case 0x43:  // INC BX
-        case 0x44:  // INC SP
-        case 0x45:  // INC BP
-        case 0x46:  // INC SI
-        case 0x47:  // INC DI
-            ret_val = inc_instr(memory[0], &memory[1]);
-            break;
-        case 0x48:  // DEC AX
-        case 0x49:  // DEC CX
-        case 0x4A:  // DEC DX
-        case 0x4B:  // DEC BX
-        case 0x4C:  // DEC SP
-        case 0x4D:  // DEC BP
-        case 0x4E:  // DEC SI
-        case 0x4F:  // DEC DI
-            ret_val = dec_instr(memory[0], &memory[1]);
-            break;
-        case 0x50:  // PUSH AX
-        case 0x51:  // PUSH CX
-        case 0x52:  // PUSH DX
-        case 0x53:  // PUSH BX
-        case 0x54:  // PUSH SP
-        case 0x55:  // PUSH BP
-        case 0x56:  // PUSH SI
-        case 0x57:  // PUSH DI
-            ret_val = push_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x58:  // POP AX
-        case 0x59:  // POP CX
-        case 0x5A:  // POP DX
-        case 0x5B:  // POP BX
-        case 0x5C:  // POP SP
-        case 0x5D:  // POP BP
-        case 0x5E:  // POP SI
-        case 0x5F:  // POP DI
-            ret_val = pop_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x60:
-        case 0x61:
-        case 0x62:
-        case 0x63:
-        case 0x64:
-        case 0x65:
-        case 0x66:
-        case 0x67:
-        case 0x68:
-        case 0x69:
-        case 0x6A:
-        case 0x6B:
-        case 0x6C:
-        case 0x6D:
-        case 0x6E:
-        case 0x6F:
-            // INVALID_INSTRUCTION;
-            REGS->invalid_operations ++;
-            printf("Invalid instruction: 0x%02X\n", memory[0]);
-            break;
-        case 0x70:
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x71:
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x72:  // JB/JNAE/SHORT-LABEL JC: [0x72, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x73:  // JNB/JAE SHORT-LABEL JNB: [0x73, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x74:  // JE/JZ SHORT-LABEL: [0x74, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x75:  // JNE/JNZ SHORT LABEL: [0x75, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x76:  // JBE/JNA SHORT-LABE: [0x76, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        // case 0x77:
-        //     if(!jbe_op())
-        //         REGS->IP = memory[1];
-        //     break;
-        case 0x78:  // JS SHORT LABEL: [0x78, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x79:  // JNS SHORT LABEL: [0x79, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x7A:  // JP/JPE SHORT-LABEL: [0x7A, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x7B:  // JNP/JPO SHORT LABEL: [0x7B, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0x7C:   // JL/JNGE SHORT-LABEL: [0x7F, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        // case 0x7D:   // JNL/JGE SHORT-LABEL: [0x7F, IP-INC8]
-        //     if(!jl_op())
-        //         REGS->IP = memory[1];
-        //     break;
-        // case 0x7E:   // JLE/JNG SHORT-LABEL: [0x7F, IP-INC8]
-        //     if(jle_op())
-        //         REGS->IP = memory[1];
-        //     break;
-        // case 0x7F:   // JNLE/JG SHORT-LABEL: [0x7F, IP-INC8]
-        //     if(!jle_op())
-        //         REGS->IP = memory[1];
-        //     break;
-        case 0x80:  // 8-bit operations
-        case 0x81: {// 16-bit operations
-            uint8_t reg_field = get_register_field(memory[1]);
-            if(reg_field == 0) { // ADD REG8/MEM8, IMMED8: [0x80, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                ret_val = add_instr(memory[0], &memory[1]);
-            } else if(reg_field == 1) { // OR REG8/MEM8, IMMED8: [0x80, MOD 001 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                ret_val = or_instr(memory[0], &memory[1]);
-            } else if(reg_field == 2) { // ADC REG8/MEM8, IMMED8: [0x80, MOD 010 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                printf("ERROR: Unimplemented ADC (0x80) instruction!\n");
-                REGS->invalid_operations ++;
-            } else if(reg_field == 3) { // SBB REG8/MEM8, IMMED8: [0x80, MOD 011 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                ret_val = sub_instr(memory[0], &memory[1]);
-            } else if(reg_field == 4) { // AND REG8/MEM8, IMMED8: [0x80, MOD 100 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                ret_val = and_instr(memory[0], &memory[1]);
-            } else if(reg_field == 5) { // SUB REG8/MEM8, IMMED8: [0x80, MOD 101 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                ret_val = sub_instr(memory[0], &memory[1]);
-            } else if(reg_field == 6) { // XOR REG8/MEM8, IMMED8: [0x80, MOD 110 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                printf("ERROR: Unimplemented XOR (0x80) instruction!\n");
-                REGS->invalid_operations ++;
-            } else if(reg_field == 7) { // CMP REG8/MEM8, IMMED8: [0x80, MOD 111 R/M, (DISP-LO), (DISP-HI), DATA-8]
-                ret_val = sub_instr(memory[0], &memory[1]);
-            }
-            break;
-        }
-        case 0x82:    // 8-bit operations
-        case 0x83: {  // 16-bit operations
-            uint8_t reg_field = get_register_field(memory[1]);
-            if(reg_field == 0) { // ADD REG/MEM, IMMED8: [opcode, MOD 000 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                ret_val = add_instr(memory[0], &memory[1]);
-            } else if(reg_field == 1) { // Invalid intruction
-                printf("ERROR: Invalid instruction: 0x83 REG = 1\n");
-                REGS->invalid_operations ++;
-            } else if(reg_field == 2) { // ADC REG/MEM, IMMED8: [opcode, MOD 010 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                printf("ERROR: Unimplemented ADC (0x83) instruction!\n");
-                REGS->invalid_operations ++;
-            } else if(reg_field == 3) { // SBB REG/MEM, IMMED8: [opcode, MOD 011 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                ret_val = sub_instr(memory[0], &memory[1]);
-            } else if(reg_field ==4) { // Invalid intruction
-                printf("ERROR: Invalid instruction: 0x83 REG = 4\n");
-                REGS->invalid_operations ++;
-            } else if(reg_field == 5) { // SUB REG/MEM, IMMED8: [opcode, MOD 101 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                ret_val = sub_instr(memory[0], &memory[1]);
-            } else if(reg_field == 6) { // Invalid intruction
-                printf("ERROR: Invalid instruction: 0x83 REG = 6\n");
-                REGS->invalid_operations ++;
-            } else if(reg_field == 7) { // CMP REG/MEM, IMMED8: [opcode, MOD 111 RIM, (DISP-LO),(DISP-HI), DATA-SX]
-                ret_val = sub_instr(memory[0], &memory[1]);
-            }
-            break;
+int16_t movsw_instr(uint8_t opcode, uint8_t *data) {    // MOVS DEST-STR16, SRC-STR16: [0xA5]
+    int16_t ret_val = string_rep_start(opcode);
+    if(ret_val >= 0) {
+        return ret_val;
+    }
+    uint32_t dst_addr = get_addr(ES_register, get_register_value(DI_register));
+    uint32_t src_addr = get_addr(DS_register, get_register_value(SI_register));
+    uint16_t val = mem_read(src_addr, 2);
+    mem_write(dst_addr, val, 2);
+    if(get_flag(DF)) {
+        set_register_value(DI_register, get_register_value(DI_register) - 2);
+        set_register_value(SI_register, get_register_value(SI_register) - 2);
+    } else {
+        set_register_value(DI_register, get_register_value(DI_register) + 2);
+        set_register_value(SI_register, get_register_value(SI_register) + 2);
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: MOVS DEST-STR16, SRC-STR16 (0x%08X <= 0x%04X @ 0x%08X)\n", opcode, dst_addr, val, src_addr);
+    return string_rep_end();
+}
+
+int16_t stosb_instr(uint8_t opcode, uint8_t *data) {    // STOS DEST-STR8: [0xAA]
+    int16_t ret_val = string_rep_start(opcode);
+    if(ret_val >= 0) {
+        return ret_val;
+    }
+    uint32_t addr = get_addr(ES_register, get_register_value(DI_register));
+    mem_write(addr, get_register_value(AL_register), 1);
+    if(get_flag(DF)) {
+        set_register_value(DI_register, get_register_value(DI_register) - 1);
+    } else {
+        set_register_value(DI_register, get_register_value(DI_register) + 1);
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: STOS DEST-STR8 (0x%08X)\n", opcode, addr);
+    return string_rep_end();
+}
+
+int16_t stosw_instr(uint8_t opcode, uint8_t *data) {    // STOS DEST-STR16: [0xAB]
+    int16_t ret_val = string_rep_start(opcode);
+    if(ret_val >= 0) {
+        return ret_val;
+    }
+    uint32_t addr = get_addr(ES_register, get_register_value(DI_register));
+    mem_write(addr, get_register_value(AX_register), 2);
+    if(get_flag(DF)) {
+        set_register_value(DI_register, get_register_value(DI_register) - 2);
+    } else {
+        set_register_value(DI_register, get_register_value(DI_register) + 2);
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: STOS DEST-STR16 (0x%08X)\n", opcode, addr);
+    return string_rep_end();
+}
+
+int16_t lodsb_instr(uint8_t opcode, uint8_t *data) {    // LODS SRC-STR8: [0xAC]
+    int16_t ret_val = string_rep_start(opcode);
+    if(ret_val >= 0) {
+        return ret_val;
+    }
+    uint32_t addr = get_addr(DS_register, get_register_value(SI_register));
+    set_register_value(AL_register, mem_read(addr, 1));
+    if(get_flag(DF)) {
+        set_register_value(SI_register, get_register_value(SI_register) - 1);
+    } else {
+        set_register_value(SI_register, get_register_value(SI_register) + 1);
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: LODS SRC-STR8 (addr = 0x%08X, value = 0x%04X)\n", opcode, addr, get_register_value(AL_register));
+    return string_rep_end();
+}
+
+int16_t lodsw_instr(uint8_t opcode, uint8_t *data) {    // LODS SRC-STR16: [0xAD]
+    int16_t ret_val = string_rep_start(opcode);
+    if(ret_val >= 0) {
+        return ret_val;
+    }
+    uint32_t addr = get_addr(DS_register, get_register_value(SI_register));
+    set_register_value(AX_register, mem_read(addr, 2));
+    if(get_flag(DF)) {
+        set_register_value(SI_register, get_register_value(SI_register) - 2);
+    } else {
+        set_register_value(SI_register, get_register_value(SI_register) + 2);
+    }
+    mylog(0, "logs/main.log", "Instruction 0x%02X: LODS SRC-STR16 (0x%08X)\n", opcode, addr);
+    return string_rep_end();
+}
+
+int16_t invalid_instr(uint8_t opcode, uint8_t *data) {
+    REGS->invalid_operations ++;
+    printf("Invalid instruction: 0x%02X\n", opcode);
+    return 1;
+}
+
+int16_t unknown_instr(uint8_t opcode, uint8_t *data) {
+    REGS->invalid_operations ++;
+    printf("Unknown instruction: 0x%02X\n", opcode);
+    return 1;
+}
+
+// Valid group opcode (REG field is an opcode extension) which is not emulated yet
+int16_t unimplemented_instr(uint8_t opcode, uint8_t *data) {
+    REGS->invalid_operations ++;
+    printf("ERROR: Unimplemented instruction: 0x%02X REG = %d\n", opcode, get_register_field(data[0]));
+    return 1;
+}
+
+// Segment override prefix, applies to the memory operand of the next instruction
+static inline int16_t override_segment_instr(uint8_t opcode, register_name_t segment) {
+    mylog(0, "logs/main.log", "Instruction 0x%02X: %s (override segment)\n", opcode, get_reg_name_string(segment));
+    set_register_value(override_segment, segment);
+    return 1;
+}
+
+int16_t es_override_instr(uint8_t opcode, uint8_t *data) {  // ES: [0x26]
+    return override_segment_instr(opcode, ES_register);
+}
+
+int16_t cs_override_instr(uint8_t opcode, uint8_t *data) {  // CS: [0x2E]
+    return override_segment_instr(opcode, CS_register);
+}
+
+int16_t ss_override_instr(uint8_t opcode, uint8_t *data) {  // SS: [0x36]
+    return override_segment_instr(opcode, SS_register);
+}
+
+int16_t ds_override_instr(uint8_t opcode, uint8_t *data) {  // DS: [0x3E]
+    return override_segment_instr(opcode, DS_register);
+}
+
+int16_t load_pointer_instr(uint8_t opcode, uint8_t *data) {
+    // 0xC4: LES REG16, MEM16: [MOD REG R/M, DISP-LO, DISP-HI]  (p55)
+    // 0xC5: LDS REG16, MEM16: [opcode, MOD REG R/M, DISP-LO, DISP-HI]
+    operands_t operands = decode_operands(opcode | 0x02, data, 0); // Swap source and destination
+    set_register_value(operands.dst.register_name, mem_read(operands.src.address, 2));
+    set_register_value(DS_register, mem_read(operands.src.address+2, 2));
+    mylog(0, "logs/main.log", "Instruction 0xC5: LDS REG16 (%s), MEM16 (0x%04X @ 0x%08X);\n", operands.destination, mem_read(operands.src.address, 2), operands.src.address);
+    return 1 + operands.num_bytes;
+}
+
+int16_t int3_instr(uint8_t opcode, uint8_t *data) {         // INT 3: [0xCC]
+    set_int_vector(3);
+    return 1;
+}
+
+int16_t int_immed_instr(uint8_t opcode, uint8_t *data) {    // INT IMMED8: [0xCD, DATA-8]
+    set_int_vector(data[0]);
+    return 2;
+}
+
+int16_t into_instr(uint8_t opcode, uint8_t *data) {         // INTO: [0xCE]
+    set_int_vector(0);
+    return 1;
+}
+
+int16_t in_al_immed_instr(uint8_t opcode, uint8_t *data) {  // IN AL, IMMED8: [0xE4, DATA-8]
+    mylog(0, "logs/main.log", "Instruction 0xE4: IN AL IMMED8, immed8 = 0x%02X;\n", data[0]);
+    set_register_value(AL_register, io_read(data[0], 1));
+    return 2;
+}
+
+int16_t in_ax_immed_instr(uint8_t opcode, uint8_t *data) {  // IN AX, IMMED8: [0xE5, DATA-8]
+    mylog(0, "logs/main.log", "Instruction 0xE5: IN AX IMMED8, immed8 = 0x%02X;\n", data[0]);
+    set_register_value(AL_register, io_read(data[0], 2));
+    return 2;
+}
+
+int16_t out_al_immed_instr(uint8_t opcode, uint8_t *data) { // OUT AL, IMMED8: [0xE6, DATA-8]
+    // Move the content of the AL register to the io port specified in the immed8 field
+    mylog(0, "logs/main.log", "Instruction 0xE6: OUT AL IMMED8, immed8 = 0x%02X;\n", data[0]);
+    io_write(data[0], get_register_value(AL_register), 1);
+    return 2;
+}
+
+int16_t out_ax_immed_instr(uint8_t opcode, uint8_t *data) { // OUT AX, IMMED8: [0xE7, DATA-8]
+    mylog(0, "logs/main.log", "Instruction 0xE7: OUT AX IMMED8, immed8 = 0x%02X;\n", data[0]);
+    io_write(data[0], get_register_value(AX_register), 2);
+    return 2;
+}
+
+int16_t in_al_dx_instr(uint8_t opcode, uint8_t *data) {     // IN AL, DX: [0xEC]
+    mylog(0, "logs/main.log", "Instruction 0xEC: IN AL DX\n");
+    set_register_value(AL_register, io_read(get_register_value(DX_register), 1));
+    return 1;
+}
+
+int16_t in_ax_dx_instr(uint8_t opcode, uint8_t *data) {     // IN AX, DX: [0xED]
+    set_register_value(AX_register, io_read(get_register_value(DX_register), 2));
+    return 1;
+}
+
+int16_t out_al_dx_instr(uint8_t opcode, uint8_t *data) {    // OUT AL, DX: [0xEE]
+    mylog(0, "logs/main.log", "Instruction 0xEE: OUT DX AL\n");
+    io_write(get_register_value(DX_register), get_register_value(AL_register), 1); // DATA-8
+    return 1;
+}
+
+int16_t out_ax_dx_instr(uint8_t opcode, uint8_t *data) {    // OUT AX, DX: [0xEF]
+    io_write(get_register_value(DX_register), get_register_value(AX_register), 2); // DATA-16
+    return 1;
+}
+
+int16_t lock_instr(uint8_t opcode, uint8_t *data) {         // LOCK (prefix): [0xF0]
+    mylog(0, "logs/main.log", "Instruction 0xF0: LOCK\n");
+    return 1;
+}
+
+int16_t repne_instr(uint8_t opcode, uint8_t *data) {        // REPNE/REPNZ: [0xF2]
+    mylog(0, "logs/main.log", "Instruction 0xF2: REPNE/REPNZ, setting prefix\n");
+    set_prefix(REPNE, 1);
+    return 1;
+}
+
+int16_t rep_instr(uint8_t opcode, uint8_t *data) {          // REP/REPE/REPZ: [0xF3]
+    mylog(0, "logs/main.log", "Instruction 0xF3: REP/REPE/REPZ, setting prefix\n");
+    set_prefix(REPE, 1);
+    return 1;
+}
+
+int16_t hlt_instr(uint8_t opcode, uint8_t *data) {
+    // halts the CPU until the next external interrupt is fired
+    REGS->halt = 1;
+    return 1;
+}
+
+int16_t cmc_instr(uint8_t opcode, uint8_t *data) {  // CMC: [0xF5]
+    // Inverts the CF flag
+    if(get_flag(CF)) {
+        set_flag(CF, 0);
+    } else {
+        set_flag(CF, 1);
+    }
+    return 1;
+}
+
+int16_t clc_instr(uint8_t opcode, uint8_t *data) {  // CLC (Clear Carry Flag): [0xF8]
+    mylog(0, "logs/main.log", "Instruction 0xF8: Clear Carry Flag (CF)\n");
+    set_flag(CF, 0);
+    return 1;
+}
+
+int16_t stc_instr(uint8_t opcode, uint8_t *data) {  // STC (Set Carry Flag): [0xF9]
+    mylog(0, "logs/main.log", "Instruction 0xF9: Set Carry Flag (CF)\n");
+    set_flag(CF, 1);
+    return 1;
+}
+
+int16_t cli_instr(uint8_t opcode, uint8_t *data) {  // CLI: [0xFA]
+    // Clear Interrupt Flag, causes the processor to ignore maskable external interrupts
+    printf("Disabling interrupts\n");
+    mylog(0, "logs/main.log", "Instruction 0xFA: Clear Interrupt Flag (IF) to disable interrupts\n");
+    set_flag(IF, 0);
+    return 1;
+}
+
+int16_t sti_instr(uint8_t opcode, uint8_t *data) {  // STI: [0xFB]
+    // Set Interrupt Flag
+    printf("Enabling interrupts\n");
+    mylog(0, "logs/main.log", "Instruction 0xFB: Set Interrupt Flag (IF) to enable interrupts\n");
+    set_flag(IF, 1);
+    return 1;
+}
+
+int16_t cld_instr(uint8_t opcode, uint8_t *data) {  // CLD (Clear Direction Flag): [0xFC]
+    mylog(0, "logs/main.log", "Instruction 0xFC: Clear Direction Flag (DF)\n");
+    set_flag(DF, 0);
+    return 1;
+}
+
+int16_t std_instr(uint8_t opcode, uint8_t *data) {  // STD (Set Direction Flag): [0xFD]
+    mylog(0, "logs/main.log", "Instruction 0xFD: Set Direction Flag (DF)\n");
+    set_flag(DF, 1);
+    return 1;
+}
+
+typedef int16_t(*instr_handler_t)(uint8_t opcode, uint8_t *data);
+
+// Instruction handlers indexed by [opcode][REG field of the second byte]. The group opcodes
+// (0x80-0x83, 0xF6, 0xF7, 0xFE, 0xFF) use the REG field as an opcode extension, for all the
+// other opcodes the 8 entries are the same, so every instruction is a single indirect call
+static instr_handler_t opcode_table[0x100][8];
+
+void set_opcode_handler(uint8_t first, uint8_t last, instr_handler_t handler) {
+    for(uint16_t opcode=first; opcode<=last; opcode++) {
+        for(uint8_t reg_field=0; reg_field<8; reg_field++) {
+            opcode_table[opcode][reg_field] = handler;
         }
-        case 0x84:   // TEST REG8/MEM8,REG8: [0x84, MOD REG R/M, (DISP-LO), (DISP-HI)]
-            ret_val = and_instr(memory[0], &memory[1]);
-            break;
-        // case 0x85:
-        //     ret_val = test_16b_op(memory[1], &memory[2]);
-        //     break;
-        case 0x86:  // XCHG REG8, REG8/MEM8: [0x86, MOD REG R/M (DISP-LO), (DISP-HI)]
-        case 0x87:  // XCHG REG16, REG16/MEM16: [0x86, MOD REG R/M (DISP-LO), (DISP-HI)]
-            ret_val = xchg_instr(memory[0], &memory[1]);
-            break;
-        case 0x88:  // MOV REG8/MEM8, REG8: 0x88, MOD REG R/M (DISP-LO), (DISP-HI)]
-        case 0x89:  // MOV REG16/MEM16, REG16: [0x89, MOD REG R/M, (DISP-LO),(DISP-HI)]
-        case 0x8A:  // MOV REG8, REG8/MEM8: [0x8A, MOD REG R/M, (DISP-LO),(DISP-HI)]
-        case 0x8B:  // MOV REG16, REG16/MEM16: [0x8B, MOD REG R/M, (DISP-LO), (DISP-HI)]
-        case 0x8C:  // MOV REG16/MEM16, SEGREG: [0x8C, MOD 0SR R/M, (DISP-LO), (DISP-HI)]
-            // reg_field: Segment register code: OO=ES, 01=CS, 10=SS, 11 =DS
-            ret_val = mov_instr(memory[0], &memory[1]);
-            break;
-        // case 0x8D:  // LEA REG16, MEM16
-        //     ret_val = lea_op(memory[1], &memory[2]);  // DISP-LO, DISP-HI
-        //     break;
-        case 0x8E:  // MOV SEGREG, REG16/MEM16: [0x8C, MOD 0SR R/M, (DISP-LO), (DISP-HI)]
-            // reg_field: Segment register code: OO=ES, 01=CS, 10=SS, 11 =DS
-            ret_val = mov_instr(memory[0], &memory[1]);
-            break;
-        // case 0x8F:
-        //     if(0 == get_register_field(memory[1]))  // POP REG16/MEM16
-        //         ret_val = pop_op(memory[1], &memory[2]);  // DISP-LO, DISP-HI
-        //     else
-        //         INVALID_INSTRUCTION;
-        //     break;
-        case 0x90:  // XCHG AX, AX (NOP))
-        case 0x91:  // XCHG AX, CX
-        case 0x92:  // XCHG AX, DX
-        case 0x93:  // XCHG AX, BX
-        case 0x94:  // XCHG AX, SP
-        case 0x95:  // XCHG AX, BP
-        case 0x96:  // XCHG AX, SI
-        case 0x97:  // XCHG AX, DI
-            ret_val = xchg_instr(memory[0], &memory[1]);
-            break;
-        // case 0x98:  // CBW
-        //         ret_val = cbw_op();
-        //     break;
-        // case 0x99:  // CWD
-        //         ret_val = cwd_op();
-        //     break;
-        // case 0x9A:  // CALL FAR_PROC
-        //     ret_val = call_op(memory[1], &memory[2]); // [DISP-LO, DISP-HIGH, SEG-LO, SEG-HI]
-        //     break;
-        // case 0x9B:  // WAIT
-        //     ret_val = wait_op();
-        //     break;
-        case 0x9C:  // PUSHF
-            ret_val = push_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x9D:  // POPF
-            ret_val = pop_reg_instr(memory[0], &memory[1]);
-            break;
-        case 0x9E:  // SAHF
-            ret_val = sahf_instr();
-            break;
-        case 0x9F:  // LAHF
-            ret_val = lahf_instr();
-            break;
-        case 0xA0:  // MOV AL, MEM8: [0xA0, DISP-LO, DISP-HI]
-        case 0xA1:  // MOV AX, MEM16: [0xA1, DISP-LO, DISP-HI]
-        case 0xA2:  // MOV MEM8, AL: [0xA2, DISP-LO, DISP-HI]
-        case 0xA3:  // MOV MEM8, AX: [0xA3, DISP-LO, DISP-HI]
-            ret_val = mov_instr(memory[0], &memory[1]);
-            break;
-        // case 0xA4:  // MOVS DEST-STR8, SRC-STR8
-        //     ret_val = mov_str_op(memory[1], &memory[2]);
-        //     break;
-        case 0xA5:  // MOVS DEST-STR16, SRC-STR16
-            ret_val = string_instr(memory[0], &memory[1]);
-            break;
-        // case 0xA6:  // CMPSS DEST-STR8, SRC-STR8
-        //     ret_val = cmps_str_op(memory[1], &memory[2]);
-        //     break;
-        // case 0xA7:  // CMPSS DEST-STR16, SRC-STR16
-        //     ret_val = cmps_str_op(memory[1], &memory[2]);
-        //     break;
-        case 0xA8:  // TEST AL, IMMED8
-        case 0xA9:  // TEST AX, IMMED16
-            ret_val = and_instr(memory[0], &memory[1]);
-            break;
-        case 0xAA:  // STOS DEST-STR8
-            ret_val = string_instr(memory[0], &memory[1]);
-            break;
-        case 0xAB:  // STOS DEST-STR16
-            ret_val = string_instr(memory[0], &memory[1]);
-            break;
-        case 0xAC:  // LODS DEST-STR8
-            ret_val = string_instr(memory[0], &memory[1]);
-            break;
-        case 0xAD:  // LODS DEST-STR16
-            ret_val = string_instr(memory[0], &memory[1]);
-            break;
-        // case 0xAE:  // SCAS DEST-STR8
-        //     ret_val = stos_str_op(memory[1], &memory[2]);
-        //     break;
-        // case 0xAF:  // SCAS DEST-STR16
-        //     ret_val = stos_str_op(memory[1], &memory[2]);
-        //     break;
-        case 0xB0:  // MOV AL, IMMED8: [0xB0, immed8]
-        case 0xB1:  // MOV CL, IMMED8: [0xB1, immed8]
-        case 0xB2:  // MOV DL, IMMED8: [0xB2, immed8]
-        case 0xB3:  // MOV BL, IMMED8: [0xB3, immed8]
-        case 0xB4:  // MOV AH, IMMED8: [0xB4, immed8]
-        case 0xB5:  // MOV CH, IMMED8: [0xB5, immed8]
-        case 0xB6:  // MOV DH, IMMED8: [0xB6, immed8]
-        case 0xB7:  // MOV BH, IMMED8: [0xB7, immed8]
-        case 0xB8:  // MOV AX, IMMED16 [0xB8, DATA-LO, DATA-HI]
-        case 0xB9:  // MOV CX, IMMED16: [0xB9, DATA-LO, DATA-HI]
-        case 0xBA:  // MOV DX, IMMED16: [0xBA, DATA-HI, DATA-LO]
-        case 0xBB:  // MOV BX, IMMED16: [0xBB, DATA-LO, DATA-HI]
-        case 0xBC:  // MOV SP, IMMED16: [0xBC, DATA-LO, DATA-HI]
-        case 0xBD:  // MOV BP, IMMED16: [0xBD, DATA-LO, DATA-HI]
-        case 0xBE:  // MOV SI, IMMED16: [0xBE, DATA-LO, DATA-HI]
-        case 0xBF:  // MOV DI, IMMED16: [0xBF, DATA-LO, DATA-HI]
-            ret_val = mov_instr(memory[0], &memory[1]);
-            break;
-        case 0xC0:    // INVALID_INSTRUCTION;
-        case 0xC1:    // INVALID_INSTRUCTION;
-            REGS->invalid_operations ++;
-            printf("Invalid instruction: 0x%02X\n", memory[0]);
-            break;
-        case 0xC2:  // RET IMMED16 (intrasegment): [0xC2, DATA-LO, DATA-HI]
-        case 0xC3:  // RET (intrasegment)
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xC4:  // LES REG16, MEM16: [MOD REG R/M, DISP-LO, DISP-HI]  (p55)
-        case 0xC5: {  // LDS REG16, MEM16: [opcode, MOD REG R/M, DISP-LO, DISP-HI]
-            operands_t operands = decode_operands(memory[0] | 0x02, &memory[1], 0); // Swap source and destination
-            ret_val += operands.num_bytes;
-            set_register_value(operands.dst.register_name, mem_read(operands.src.address, 2));
-            set_register_value(DS_register, mem_read(operands.src.address+2, 2));
-            mylog(0, "logs/main.log", "Instruction 0xC5: LDS REG16 (%s), MEM16 (0x%04X @ 0x%08X);\n", operands.destination, mem_read(operands.src.address, 2), operands.src.address);
-            break;
+    }
+}
+
+void set_group_handler(uint8_t opcode, uint8_t reg_field, instr_handler_t handler) {
+    opcode_table[opcode][reg_field] = handler;
+}
+
+void init_opcode_table(void) {
+    set_opcode_handler(0x00, 0xFF, unknown_instr);
+    set_opcode_handler(0x00, 0x03, add_rm_instr);       // ADD REG/MEM, REG; ADD REG, REG/MEM
+    set_opcode_handler(0x04, 0x04, add_al_immed_instr); // ADD AL, IMMED8
+    set_opcode_handler(0x05, 0x05, add_ax_immed_instr); // ADD AX, IMMED16
+    set_opcode_handler(0x06, 0x06, push_segreg_instr);  // PUSH ES
+    set_opcode_handler(0x07, 0x07, pop_segreg_instr);   // POP ES
+    set_opcode_handler(0x08, 0x0B, or_rm_instr);        // OR REG/MEM, REG; OR REG, REG/MEM
+    set_opcode_handler(0x0C, 0x0C, or_al_immed_instr);  // OR AL, IMMED8
+    set_opcode_handler(0x0D, 0x0D, or_ax_immed_instr);  // OR AX, IMMED16
+    set_opcode_handler(0x0E, 0x0E, push_segreg_instr);  // PUSH CS
+    set_opcode_handler(0x0F, 0x0F, invalid_instr);
+    set_opcode_handler(0x10, 0x13, adc_rm_instr);       // ADC REG/MEM, REG; ADC REG, REG/MEM
+    set_opcode_handler(0x14, 0x14, adc_al_immed_instr); // ADC AL, IMMED8
+    set_opcode_handler(0x15, 0x15, adc_ax_immed_instr); // ADC AX, IMMED16
+    set_opcode_handler(0x16, 0x16, push_segreg_instr);  // PUSH SS
+    set_opcode_handler(0x17, 0x17, pop_segreg_instr);   // POP SS
+    set_opcode_handler(0x18, 0x1B, sub_rm_instr);       // SBB REG/MEM, REG; SBB REG, REG/MEM
+    set_opcode_handler(0x1C, 0x1C, sbb_al_immed_instr); // SBB AL, IMMED8
+    set_opcode_handler(0x1D, 0x1D, sbb_ax_immed_instr); // SBB AX, IMMED16
+    set_opcode_handler(0x1E, 0x1E, push_segreg_instr);  // PUSH DS
+    set_opcode_handler(0x1F, 0x1F, pop_segreg_instr);   // POP DS
+    set_opcode_handler(0x20, 0x23, and_rm_instr);       // AND REG/MEM, REG; AND REG, REG/MEM
+    set_opcode_handler(0x24, 0x24, and_al_immed_instr); // AND AL, IMMED8
+    set_opcode_handler(0x25, 0x25, test_ax_immed_instr);// AND AX, IMMED16
+    set_opcode_handler(0x26, 0x26, es_override_instr);  // ES:
+    set_opcode_handler(0x27, 0x27, daa_instr);          // DAA
+    set_opcode_handler(0x28, 0x2B, sub_rm_instr);       // SUB REG/MEM, REG; SUB REG, REG/MEM
+    set_opcode_handler(0x2C, 0x2C, sub_al_immed_instr); // SUB AL, IMMED8
+    set_opcode_handler(0x2D, 0x2D, sub_ax_immed_instr); // SUB AX, IMMED16
+    set_opcode_handler(0x2E, 0x2E, cs_override_instr);  // CS:
+    set_opcode_handler(0x30, 0x33, xor_rm_instr);       // XOR REG/MEM, REG; XOR REG, REG/MEM
+    set_opcode_handler(0x34, 0x35, invalid_instr);      // XOR AL/AX, IMMED
+    set_opcode_handler(0x36, 0x36, ss_override_instr);  // SS:
+    set_opcode_handler(0x38, 0x3B, cmp_rm_instr);       // CMP REG/MEM, REG; CMP REG, REG/MEM
+    set_opcode_handler(0x3C, 0x3C, cmp_al_immed_instr); // CMP AL, IMMED8
+    set_opcode_handler(0x3D, 0x3D, cmp_ax_immed_instr); // CMP AX, IMMED16
+    set_opcode_handler(0x3E, 0x3E, ds_override_instr);  // DS:
+    set_opcode_handler(0x40, 0x47, inc_reg16_instr);    // INC REG16
+    set_opcode_handler(0x48, 0x4F, dec_reg16_instr);    // DEC REG16
+    set_opcode_handler(0x50, 0x57, push_reg16_instr);   // PUSH REG16
+    set_opcode_handler(0x58, 0x5F, pop_reg16_instr);    // POP REG16
+    set_opcode_handler(0x60, 0x6F, invalid_instr);
+    // Conditional jumps SHORT-LABEL: [opcode, IP-INC8]
+    set_opcode_handler(0x70, 0x70, jo_instr);           // JO
+    set_opcode_handler(0x71, 0x71, jno_instr);          // JNO
+    set_opcode_handler(0x72, 0x72, jb_instr);           // JB/JNAE/JC
+    set_opcode_handler(0x73, 0x73, jnb_instr);          // JNB/JAE/JNC
+    set_opcode_handler(0x74, 0x74, je_instr);           // JE/JZ
+    set_opcode_handler(0x75, 0x75, jne_instr);          // JNE/JNZ
+    set_opcode_handler(0x76, 0x76, jbe_instr);          // JBE/JNA
+    set_opcode_handler(0x78, 0x78, js_instr);           // JS
+    set_opcode_handler(0x79, 0x79, jns_instr);          // JNS
+    set_opcode_handler(0x7A, 0x7A, jp_instr);           // JP/JPE
+    set_opcode_handler(0x7B, 0x7B, jnp_instr);          // JNP/JPO
+    set_opcode_handler(0x7C, 0x7C, jl_instr);           // JL/JNGE
+    // 0x80: 8-bit and 0x81: 16-bit operations with IMMED8/IMMED16: [opcode, MOD REG R/M, (DISP-LO), (DISP-HI), DATA]
+    for(uint8_t opcode=0x80; opcode<=0x81; opcode++) {
+        set_group_handler(opcode, 0, add_immed_instr);      // ADD REG/MEM, IMMED
+        set_group_handler(opcode, 1, unimplemented_instr);  // OR REG/MEM, IMMED
+        set_group_handler(opcode, 2, unimplemented_instr);  // ADC REG/MEM, IMMED
+        set_group_handler(opcode, 3, sbb_immed_instr);      // SBB REG/MEM, IMMED
+        set_group_handler(opcode, 4, and_immed_instr);      // AND REG/MEM, IMMED
+        set_group_handler(opcode, 5, sub_immed_instr);      // SUB REG/MEM, IMMED
+        set_group_handler(opcode, 6, unimplemented_instr);  // XOR REG/MEM, IMMED
+        set_group_handler(opcode, 7, cmp_immed_instr);      // CMP REG/MEM, IMMED
+    }
+    set_group_handler(0x80, 1, or_immed_instr);             // OR REG8/MEM8, IMMED8
+    // 0x82: 8-bit and 0x83: 16-bit operations with sign extended IMMED8: [opcode, MOD REG R/M, (DISP-LO),(DISP-HI), DATA-SX]
+    // OR, AND and XOR are not defined for sign extended IMMED8
+    for(uint8_t opcode=0x82; opcode<=0x83; opcode++) {
+        set_group_handler(opcode, 0, add_immed_sx_instr);   // ADD REG/MEM, IMMED8
+        set_group_handler(opcode, 1, invalid_instr);
+        set_group_handler(opcode, 2, unimplemented_instr);  // ADC REG/MEM, IMMED8
+        set_group_handler(opcode, 3, sbb_immed_sx_instr);   // SBB REG/MEM, IMMED8
+        set_group_handler(opcode, 4, invalid_instr);
+        set_group_handler(opcode, 5, sub_immed_sx_instr);   // SUB REG/MEM, IMMED8
+        set_group_handler(opcode, 6, invalid_instr);
+        set_group_handler(opcode, 7, cmp_immed_sx_instr);   // CMP REG/MEM, IMMED8
+    }
+    set_opcode_handler(0x84, 0x84, test_rm_instr);      // TEST REG8/MEM8,REG8: [0x84, MOD REG R/M, (DISP-LO), (DISP-HI)]
+    set_opcode_handler(0x86, 0x87, xchg_rm_instr);      // XCHG REG, REG/MEM: [opcode, MOD REG R/M (DISP-LO), (DISP-HI)]
+    set_opcode_handler(0x88, 0x8B, mov_reg_mem_instr);  // MOV REG/MEM, REG; MOV REG, REG/MEM
+    // MOD 0SR R/M: the REG field is a segment register for 0x8C and 0x8E, 1SR is not defined
+    for(uint8_t reg_field=0; reg_field<8; reg_field++) {
+        set_group_handler(0x8C, reg_field, (reg_field < 4) ? mov_from_segreg_instr : invalid_instr);   // MOV REG16/MEM16, SEGREG
+        set_group_handler(0x8E, reg_field, (reg_field < 4) ? mov_to_segreg_instr : invalid_instr);     // MOV SEGREG, REG16/MEM16
+    }
+    set_opcode_handler(0x90, 0x97, xchg_ax_instr);      // XCHG AX, REG16 (0x90 is NOP)
+    set_opcode_handler(0x9C, 0x9C, pushf_instr);        // PUSHF
+    set_opcode_handler(0x9D, 0x9D, popf_instr);         // POPF
+    set_opcode_handler(0x9E, 0x9E, sahf_instr);         // SAHF
+    set_opcode_handler(0x9F, 0x9F, lahf_instr);         // LAHF
+    set_opcode_handler(0xA0, 0xA0, mov_al_mem_instr);   // MOV AL, MEM8: [0xA0, DISP-LO, DISP-HI]
+    set_opcode_handler(0xA1, 0xA1, mov_ax_mem_instr);   // MOV AX, MEM16: [0xA1, DISP-LO, DISP-HI]
+    set_opcode_handler(0xA2, 0xA2, mov_mem_al_instr);   // MOV MEM8, AL: [0xA2, DISP-LO, DISP-HI]
+    set_opcode_handler(0xA3, 0xA3, mov_mem_ax_instr);   // MOV MEM16, AX: [0xA3, DISP-LO, DISP-HI]
+    set_opcode_handler(0xA4, 0xA4, movsb_instr);        // MOVS DEST-STR8, SRC-STR8
+    set_opcode_handler(0xA5, 0xA5, movsw_instr);        // MOVS DEST-STR16, SRC-STR16
+    set_opcode_handler(0xA8, 0xA8, test_al_immed_instr);// TEST AL, IMMED8
+    set_opcode_handler(0xA9, 0xA9, test_ax_immed_instr);// TEST AX, IMMED16
+    set_opcode_handler(0xAA, 0xAA, stosb_instr);        // STOS DEST-STR8
+    set_opcode_handler(0xAB, 0xAB, stosw_instr);        // STOS DEST-STR16
+    set_opcode_handler(0xAC, 0xAC, lodsb_instr);        // LODS SRC-STR8
+    set_opcode_handler(0xAD, 0xAD, lodsw_instr);        // LODS SRC-STR16
+    set_opcode_handler(0xB0, 0xB7, mov_reg8_immed_instr);   // MOV REG8, IMMED8
+    set_opcode_handler(0xB8, 0xBF, mov_reg16_immed_instr);  // MOV REG16, IMMED16
+    set_opcode_handler(0xC0, 0xC1, invalid_instr);
+    set_opcode_handler(0xC2, 0xC2, ret_immed_instr);    // RET IMMED16 (intrasegment)
+    set_opcode_handler(0xC3, 0xC3, ret_instr);          // RET (intrasegment)
+    set_opcode_handler(0xC4, 0xC5, load_pointer_instr); // LES/LDS REG16, MEM16
+    // MOV MEM, IMMED: [opcode, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA], the other REG fields are not defined
+    set_opcode_handler(0xC6, 0xC7, invalid_instr);
+    set_group_handler(0xC6, 0, mov_mem8_immed_instr);   // MOV MEM8, IMMED8
+    set_group_handler(0xC7, 0, mov_mem16_immed_instr);  // MOV MEM16, IMMED16
+    set_opcode_handler(0xC8, 0xC9, invalid_instr);
+    set_opcode_handler(0xCA, 0xCA, retf_immed_instr);   // RET IMMED16 (intersegment)
+    set_opcode_handler(0xCB, 0xCB, retf_instr);         // RET (intersegment)
+    set_opcode_handler(0xCC, 0xCC, int3_instr);         // INT 3
+    set_opcode_handler(0xCD, 0xCD, int_immed_instr);    // INT IMMED8
+    set_opcode_handler(0xCE, 0xCE, into_instr);         // INTO
+    set_opcode_handler(0xCF, 0xCF, iret_instr);         // IRET
+    // Shifts and rotates by 1 (0xD0, 0xD1) or by CL (0xD2, 0xD3): [opcode, MOD XXX R/M, (DISP-LO), (DISP-HI)]
+    for(uint8_t opcode=0xD0; opcode<=0xD3; opcode++) {
+        set_group_handler(opcode, 0, rol_instr);            // ROL REG/MEM, 1/CL
+        set_group_handler(opcode, 1, ror_instr);            // ROR REG/MEM, 1/CL
+        set_group_handler(opcode, 2, unimplemented_instr);  // RCL REG/MEM, 1/CL
+        set_group_handler(opcode, 3, unimplemented_instr);  // RCR REG/MEM, 1/CL
+        set_group_handler(opcode, 4, shl_instr);            // SAL/SHL REG/MEM, 1/CL
+        set_group_handler(opcode, 5, shr_instr);            // SHR REG/MEM, 1/CL
+        set_group_handler(opcode, 6, invalid_instr);
+        set_group_handler(opcode, 7, sar_instr);            // SAR REG/MEM, 1/CL
+    }
+    set_opcode_handler(0xD6, 0xD6, invalid_instr);
+    //  When the 8086 encounters an ESC instruction with two register operands (i.e. mod = 11),
+    // it performs a nop. When the processor encounters an ESC instruction with a memory operand,
+    // a read cycle is performed from the address indicated by the memory operand and the result is discarded.
+    set_opcode_handler(0xD8, 0xD8, esc_instr);          // ESC OPCODE, SOURCE
+    set_opcode_handler(0xE0, 0xE0, loopne_instr);       // LOOPNE/LOOPNZ SHORT-LABEL: [0xE0, IP-INC8]
+    set_opcode_handler(0xE1, 0xE1, loope_instr);        // LOOPE/LOOPZ SHORT-LABEL: [0xE1, IP-INC8]
+    set_opcode_handler(0xE2, 0xE2, loop_instr);         // LOOP SHORT-LABEL: [0xE2, IP-INC8]
+    set_opcode_handler(0xE3, 0xE3, jcxz_instr);         // JCXZ SHORT-LABEL: [0xE3, IP-INC8]
+    set_opcode_handler(0xE4, 0xE4, in_al_immed_instr);  // IN AL, IMMED8
+    set_opcode_handler(0xE5, 0xE5, in_ax_immed_instr);  // IN AX, IMMED8
+    set_opcode_handler(0xE6, 0xE6, out_al_immed_instr); // OUT AL, IMMED8
+    set_opcode_handler(0xE7, 0xE7, out_ax_immed_instr); // OUT AX, IMMED8
+    set_opcode_handler(0xE8, 0xE8, call_near_instr);    // CALL NEAR-PROC
+    set_opcode_handler(0xE9, 0xE9, jmp_near_instr);     // JMP NEAR-LABEL
+    set_opcode_handler(0xEA, 0xEA, jmp_far_instr);      // JMP FAR-LABEL
+    set_opcode_handler(0xEB, 0xEB, jmp_short_instr);    // JMP SHORT-LABEL
+    set_opcode_handler(0xEC, 0xEC, in_al_dx_instr);     // IN AL, DX
+    set_opcode_handler(0xED, 0xED, in_ax_dx_instr);     // IN AX, DX
+    set_opcode_handler(0xEE, 0xEE, out_al_dx_instr);    // OUT AL, DX
+    set_opcode_handler(0xEF, 0xEF, out_ax_dx_instr);    // OUT AX, DX
+    set_opcode_handler(0xF0, 0xF0, lock_instr);         // LOCK
+    set_opcode_handler(0xF1, 0xF1, invalid_instr);
+    set_opcode_handler(0xF2, 0xF2, repne_instr);        // REPNE/REPNZ
+    set_opcode_handler(0xF3, 0xF3, rep_instr);          // REP/REPE/REPZ
+    set_opcode_handler(0xF4, 0xF4, hlt_instr);          // HLT
+    set_opcode_handler(0xF5, 0xF5, cmc_instr);          // CMC
+    set_group_handler(0xF6, 0, test_immed_instr);       // TEST REG8/MEM8, IMMED8: [0xF6, MOD 000 R/M, DISP-LO, DISP-HI, DATA-8]
+    set_group_handler(0xF6, 1, invalid_instr);
+    set_group_handler(0xF6, 2, unimplemented_instr);    // NOT REG8/MEM8
+    set_group_handler(0xF6, 3, unimplemented_instr);    // NEG REG8/MEM8
+    set_group_handler(0xF6, 4, mul8_instr);             // MUL REG8/MEM8: [0xF6, MOD 100 R/M, DISP-LO, DISP-HI]
+    set_group_handler(0xF6, 5, imul8_instr);            // IMUL REG8/MEM8 (signed): [0xF6, MOD 101 R/M, DISP-LO, DISP-HI]
+    set_group_handler(0xF6, 6, unimplemented_instr);    // DIV REG8/MEM8
+    set_group_handler(0xF6, 7, unimplemented_instr);    // IDIV REG8/MEM8
+    set_group_handler(0xF7, 0, unimplemented_instr);    // TEST REG16/MEM16, IMMED16
+    set_group_handler(0xF7, 1, invalid_instr);
+    set_group_handler(0xF7, 2, unimplemented_instr);    // NOT REG16/MEM16
+    set_group_handler(0xF7, 3, unimplemented_instr);    // NEG REG16/MEM16
+    set_group_handler(0xF7, 4, mul16_instr);            // MUL REG16/MEM16
+    set_group_handler(0xF7, 5, imul16_instr);           // IMUL REG16/MEM16 (signed)
+    set_group_handler(0xF7, 6, div_instr);              // DIV REG16/MEM16
+    set_group_handler(0xF7, 7, unimplemented_instr);    // IDIV REG16/MEM16
+    set_opcode_handler(0xF8, 0xF8, clc_instr);          // CLC
+    set_opcode_handler(0xF9, 0xF9, stc_instr);          // STC
+    set_opcode_handler(0xFA, 0xFA, cli_instr);          // CLI
+    set_opcode_handler(0xFB, 0xFB, sti_instr);          // STI
+    set_opcode_handler(0xFC, 0xFC, cld_instr);          // CLD
+    set_opcode_handler(0xFD, 0xFD, std_instr);          // STD
+    set_opcode_handler(0xFE, 0xFE, invalid_instr);
+    set_group_handler(0xFE, 0, inc_rm_instr);           // INC REG8/MEM8: [0xFE, MOD 000 R/M, (DISP-LO), (DISP-HI)]
+    set_group_handler(0xFE, 1, dec_rm_instr);           // DEC REG8/MEM8: [0xFE, MOD 001 R/M, (DISP-LO), (DISP-HI)]
+    set_group_handler(0xFF, 0, inc_rm_instr);           // INC REG16/MEM16: [0xFF, MOD 000 R/M, (DISP-LO), (DISP-HI)]
+    set_group_handler(0xFF, 1, dec_rm_instr);           // DEC REG16/MEM16: [0xFF, MOD 001 R/M, (DISP-LO), (DISP-HI)]
+    set_group_handler(0xFF, 2, unimplemented_instr);    // CALL REG16/MEM16 (intra)
+    set_group_handler(0xFF, 3, unimplemented_instr);    // CALL MEM16 (inter)
+    set_group_handler(0xFF, 4, jmp_indirect_instr);     // JMP REG16/MEM16 (intra): [0xFF, MOD 100 R/M, (DISP-LO), (DISP-HI)]
+    set_group_handler(0xFF, 5, jmp_indirect_far_instr); // JMP MEM16 (inter): [0xFF, MOD 101 R/M, (DISP-LO), (DISP-HI)]
+    set_group_handler(0xFF, 6, unimplemented_instr);    // PUSH MEM16
+    set_group_handler(0xFF, 7, invalid_instr);
+}
+
+#define INSTR_MAX_LEN       6       // [opcode, MOD REG R/M, DISP-LO, DISP-HI, DATA-LO, DATA-HI], prefixes are separate instructions
+#define DECODE_CACHE_SIZE   0x1000  // Number of cached instructions, must be a power of 2
+#define INVALID_CODE_ADDR   0xFFFFFFFF
+
+// Instruction formats, see get_instr_format()
+#define FMT_NONE    0x00
+#define FMT_MODRM   0x01    // MOD REG R/M byte and optional displacement follow the opcode
+#define FMT_IMM8    0x02    // 8-bit immediate, port number or IP-INC8
+#define FMT_IMM16   0x04    // 16-bit immediate, address or IP-INC16
+#define FMT_FAR     0x08    // IP-LO, IP-HI, CS-LO, CS-HI
+
+// Decoded instruction, cached by linear address
+typedef struct {
+    uint32_t addr;          // Linear address (CS << 4) + IP, INVALID_CODE_ADDR for empty entries
+    uint32_t generation;    // code_page_generation[] of the page at decoding time
+    uint8_t bytes[INSTR_MAX_LEN];
+    uint8_t opcode;
+    uint8_t mod;            // MOD, REG and R/M fields, valid if the instruction has a MOD REG R/M byte
+    uint8_t reg;
+    uint8_t rm;
+    uint8_t length;         // Instruction length in bytes
+    uint16_t disp;
+    uint16_t immed;
+    instr_handler_t handler;
+} decoded_instr_t;
+
+static decoded_instr_t decode_cache[DECODE_CACHE_SIZE];
+// Incremented every time the memory module reports a write into a page the code was fetched from
+static uint32_t code_page_generation[MEM_PAGES_NUM];
+
+uint8_t get_instr_format(uint8_t opcode, uint8_t modrm) {
+    if(opcode < 0x40) {
+        switch(opcode & 0x07) {
+            case 0x00:  // OP REG8/MEM8, REG8
+            case 0x01:  // OP REG16/MEM16, REG16
+            case 0x02:  // OP REG8, REG8/MEM8
+            case 0x03:  // OP REG16, REG16/MEM16
+                return FMT_MODRM;
+            case 0x04:  // OP AL, IMMED8
+                return FMT_IMM8;
+            case 0x05:  // OP AX, IMMED16
+                return FMT_IMM16;
+            default:    // PUSH/POP SEGREG, segment override, DAA, DAS, AAA, AAS
+                return FMT_NONE;
         }
-        case 0xC6:  // MOV MEM8, IMMED8: [0xC6, MOD 000 R/M, (DISP-LO), (DISP-HI), DATA-8]
+    }
+    if((opcode >= 0x70) && (opcode <= 0x7F)) {     // Conditional jumps: [opcode, IP-INC8]
+        return FMT_IMM8;
+    }
+    if((opcode >= 0x84) && (opcode <= 0x8F)) {     // TEST, XCHG, MOV, LEA, POP with MOD REG R/M
+        return FMT_MODRM;
+    }
+    if((opcode >= 0xB0) && (opcode <= 0xB7)) {     // MOV REG8, IMMED8
+        return FMT_IMM8;
+    }
+    if((opcode >= 0xB8) && (opcode <= 0xBF)) {     // MOV REG16, IMMED16
+        return FMT_IMM16;
+    }
+    if((opcode >= 0xD0) && (opcode <= 0xD3)) {     // Shifts and rotates
+        return FMT_MODRM;
+    }
+    if((opcode >= 0xD8) && (opcode <= 0xDF)) {     // ESC
+        return FMT_MODRM;
+    }
+    if((opcode >= 0xE0) && (opcode <= 0xE7)) {     // LOOPs, JCXZ, IN/OUT with IMMED8 port
+        return FMT_IMM8;
+    }
+    switch(opcode) {
+        case 0x80:  // OP REG8/MEM8, IMMED8
+        case 0x82:  // OP REG8/MEM8, IMMED8
+        case 0x83:  // OP REG16/MEM16, IMMED8 (sign extended)
+        case 0xC6:  // MOV MEM8, IMMED8
+            return FMT_MODRM | FMT_IMM8;
+        case 0x81:  // OP REG16/MEM16, IMMED16
         case 0xC7:  // MOV MEM16, IMMED16
-            ret_val = mov_instr(memory[0], &memory[1]);
-            break;
-        case 0xC8:    // INVALID_INSTRUCTION;
-        case 0xC9:     // INVALID_INSTRUCTION;
-            REGS->invalid_operations ++;
-            printf("Invalid instruction: 0x%02X\n", memory[0]);
-            break;
-        case 0xCA:  // RET IMMED16 (intersegment): [0xCA, DATA-LO, DATA-HI] p68
-        case 0xCB:  // RET (intersegment): [0xCB]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xCC:  // INT 3
-            set_int_vector(3);
-            ret_val = 1;
-            break;
+            return FMT_MODRM | FMT_IMM16;
+        case 0x9A:  // CALL FAR-PROC
+        case 0xEA:  // JMP FAR-LABEL
+            return FMT_FAR;
+        case 0xA0:  // MOV AL, MEM8
+        case 0xA1:  // MOV AX, MEM16
+        case 0xA2:  // MOV MEM8, AL
+        case 0xA3:  // MOV MEM16, AX
+        case 0xA9:  // TEST AX, IMMED16
+        case 0xC2:  // RET IMMED16 (intrasegment)
+        case 0xCA:  // RET IMMED16 (intersegment)
+        case 0xE8:  // CALL NEAR-PROC
+        case 0xE9:  // JMP NEAR-LABEL
+            return FMT_IMM16;
+        case 0xA8:  // TEST AL, IMMED8
         case 0xCD:  // INT IMMED8
-            set_int_vector(memory[1]);
-            ret_val = 2;
-            break;
-        case 0xCE:  // INT0
-            set_int_vector(0);
-            ret_val = 1;
-            break;
-        case 0xCF:  // IRET
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xD0:  // 8-bit operations
-        case 0xD1:  // 16-bit operations
-        case 0xD2:  // 8-bit operations
-        case 0xD3:  // 16-bit operations
-            ret_val = shift_instr(memory[0], &memory[1]);
-            break;
-        // case 0xD4:
-        //     if(memory[1] == 0b00001010) {  // AAM
-        //         ret_val = aam_op(memory[1]);  // memory[1] == 0b00001010
-        //     } else {
-        //         INVALID_INSTRUCTION;
-        //     }
-        //     break;
-        // case 0xD5:
-        //     if(memory[1] == 0b00001010) {  // AAD
-        //         ret_val = aam_op(memory[1]);  // memory[1] == 0b00001010
-        //     } else {
-        //         INVALID_INSTRUCTION;
-        //     }
-        //     break;
-        case 0xD6:    // INVALID_INSTRUCTION;
-            REGS->invalid_operations ++;
-            printf("Invalid instruction: 0x%02X\n", memory[0]);
-            break;
-        // case 0xD7:  // XLAT SOURCE-TABLE
-        //     ret_val = xlat_op();
-        //     break;
-        case 0xD8:  // ESC OPCODE, SOURCE
-        // case 0xD9:
-        // case 0xDA:
-        // case 0xDB:
-        // case 0xDC:
-        // case 0xDD:
-        // case 0xDE:
-        // case 0xDF:
-            //  When the 8086 encounters an ESC instruction with two register operands (i.e. mod = 11),
-            // it performs a nop. When the processor encounters an ESC instruction with a memory operand,
-            // a read cycle is performed from the address indicated by the memory operand and the result is discarded.
-            ret_val = esc_instr(memory[0], &memory[1]);
-            break;
-        case 0xE0:  // LOOPNE/LOOPNZ SHORT-LABEL: [0xE0, IP-INC8]
-            // LOOPNE decrements ecx and checks that ecx is not zero and ZF is not set - if these
-            // conditions are met, it jumps at label, otherwise falls through
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xE1:  // LOOPE/LOOPZ SHORT-LABEL
-            // LOOPE decrements ecx and checks that ecx is not zero and ZF is set - if these
-            // conditions are met, it jumps at label, otherwise falls through
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xE2:  // LOOP SHORT-LABEL
-            // LOOP decrements ecx and checks if ecx is not zero, if that 
-            // condition is met it jumps at specified label, otherwise falls through
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xE3:  // JPXZ
-            // JCXZ (Jump if ECX Zero) branches to the label specified in the instruction if it finds a value of zero in ECX
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xE4:  // IN AL, IMMED8
-            mylog(0, "logs/main.log", "Instruction 0xE4: IN AL IMMED8, immed8 = 0x%02X;\n", memory[1]);
-            set_register_value(AL_register, io_read(memory[1], 1));
-            ret_val = 2;
-            break;
-        case 0xE5:  // IN AX, IMMED8
-            mylog(0, "logs/main.log", "Instruction 0xE5: IN AX IMMED8, immed8 = 0x%02X;\n", memory[1]);
-            set_register_value(AL_register, io_read(memory[1], 2));
-            ret_val = 2;
-            break;
-        case 0xE6:  // OUT AL, IMMED8
-            // Move the content of the AL register to the io port specified in the immed8 field
-            mylog(0, "logs/main.log", "Instruction 0xE6: OUT AL IMMED8, immed8 = 0x%02X;\n", memory[1]);
-            io_write(memory[1], get_register_value(AL_register), 1);
-            ret_val = 2;
-            break;
-        case 0xE7:  // OUT AX, IMMED8
-            mylog(0, "logs/main.log", "Instruction 0xE7: OUT AX IMMED8, immed8 = 0x%02X;\n", memory[1]);
-            io_write(memory[1], get_register_value(AX_register), 2);
-            ret_val = 2;
-            break;
-        case 0xE8:  // CALL NEAR-PROC: [0xE8, IP-ING-LO, IP-INC-HI]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xE9:  // JMP NEAR-LABEL: [0xE9, IP-INC-LO, IP-INC-HI]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xEA:  // JMP FAR-LABEL: [0xEA, IP-LO, IP-HI, CS-LO, CS-HI]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xEB:  // JMP SHORT-LABEL: [0xEB, IP-INC8]
-            ret_val = jmp_instr(memory[0], &memory[1]);
-            break;
-        case 0xEC:  // IN AL, DX
-            mylog(0, "logs/main.log", "Instruction 0xEC: IN AL DX\n");
-            set_register_value(AL_register, io_read(get_register_value(DX_register), 1));
-            break;
-        case 0xED:  // IN AX, DX
-            set_register_value(AX_register, io_read(get_register_value(DX_register), 2));
-            break;
-        case 0xEE:  // OUT AL, DX
-            mylog(0, "logs/main.log", "Instruction 0xEE: OUT DX AL\n");
-            io_write(get_register_value(DX_register), get_register_value(AL_register), 1); // DATA-8
-            break;
-        case 0xEF:  // OUT AX, DX
-            io_write(get_register_value(DX_register), get_register_value(AX_register), 2); // DATA-16
-            ret_val = 1;
-            break;
-        case 0xF0:  // LOCK (prefix)
-            mylog(0, "logs/main.log", "Instruction 0xF0: LOCK\n");
-            break;
-        case 0xF1:  // INVALID_INSTRUCTION;
-            REGS->invalid_operations ++;
-            printf("Invalid instruction: 0x%02X\n", memory[0]);
-            break;
-        case 0xF2:  // REPNE/REPNZ
-            mylog(0, "logs/main.log", "Instruction 0xF2: REPNE/REPNZ, setting prefix\n");
-            // printf("Instruction 0xF2: REPNE/REPNZ, setting prefix\n");
-            set_prefix(REPNE, 1);
-            break;
-        case 0xF3:  // REP/REPE/REPZ
-            mylog(0, "logs/main.log", "Instruction 0xF3: REP/REPE/REPZ, setting prefix\n");
-            // printf("Instruction 0xF3: REP/REPE/REPZ, setting prefix\n");
-            set_prefix(REPE, 1);
-            break;
+        case 0xD4:  // AAM
+        case 0xD5:  // AAD
+        case 0xEB:  // JMP SHORT-LABEL
+            return FMT_IMM8;
+        case 0xC4:  // LES REG16, MEM16
+        case 0xC5:  // LDS REG16, MEM16
+        case 0xFE:  // INC/DEC REG8/MEM8
+        case 0xFF:  // INC/DEC/CALL/JMP/PUSH REG16/MEM16
+            return FMT_MODRM;
+        case 0xF6:  // Only TEST REG8/MEM8, IMMED8 has an immediate
+            return (get_register_field(modrm) < 2) ? (FMT_MODRM | FMT_IMM8) : FMT_MODRM;
+        case 0xF7:  // Only TEST REG16/MEM16, IMMED16 has an immediate
+            return (get_register_field(modrm) < 2) ? (FMT_MODRM | FMT_IMM16) : FMT_MODRM;
+        default:
+            return FMT_NONE;
+    }
+}
+
+// Decodes the static part of the instruction in instr->bytes, the operand values are
+// resolved by the handlers as they depend on the registers at execution time
+void decode_instruction(decoded_instr_t *instr) {
+    uint8_t *data = instr->bytes;
+    uint8_t format = get_instr_format(data[0], data[1]);
+    uint8_t len = 1;
+    instr->opcode = data[0];
+    instr->mod = 0;
+    instr->reg = 0;
+    instr->rm = 0;
+    instr->disp = 0;
+    instr->immed = 0;
+    if(format & FMT_MODRM) {
+        instr->mod = get_mode_field(data[1]);
+        instr->reg = get_register_field(data[1]);
+        instr->rm = get_reg_mem_field(data[1]);
+        len++;
+        if((instr->mod == 2) || ((instr->mod == 0) && (instr->rm == 6))) {
+            instr->disp = data[len] + (data[len+1] << 8);
+            len += 2;
+        } else if(instr->mod == 1) {
+            instr->disp = (int8_t)data[len];
+            len += 1;
+        }
+    }
+    if(format & FMT_IMM8) {
+        instr->immed = data[len];
+        len += 1;
+    } else if(format & (FMT_IMM16 | FMT_FAR)) {
+        instr->immed = data[len] + (data[len+1] << 8);
+        len += 2;
+        if(format & FMT_FAR) {
+            instr->disp = data[len] + (data[len+1] << 8);   // CS
+            len += 2;
+        }
+    }
+    instr->length = len;
+    instr->handler = opcode_table[instr->opcode][get_register_field(data[1])];
+}
+
+void flush_decode_cache(void) {
+    for(uint32_t i=0; i<DECODE_CACHE_SIZE; i++) {
+        decode_cache[i].addr = INVALID_CODE_ADDR;
+    }
+}
+
+void flush_block_cache(void);
+
+/* Called by the memory module when a page the code was fetched from is written.
+   CODE_INVALIDATE_ALL drops the whole cache (memory reset or restore) */
+DLL_PREFIX
+void cpu_invalidate_code(uint32_t addr) {
+    if(addr == CODE_INVALIDATE_ALL) {
+        flush_decode_cache();
+        flush_block_cache();
+        return;
+    }
+    uint32_t page = (addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1);
+    code_page_generation[page]++;
+    // Instructions near the end of the previous page may extend into this one
+    code_page_generation[(page - 1) & (MEM_PAGES_NUM - 1)]++;
+}
+
+// Returns the decoded instruction at addr, reading and decoding it only on a cache miss
+decoded_instr_t *fetch_instruction(uint32_t addr) {
+    decoded_instr_t *instr = &decode_cache[addr & (DECODE_CACHE_SIZE - 1)];
+    uint32_t generation = code_page_generation[(addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1)];
+    if((instr->addr == addr) && (instr->generation == generation)) {
+        return instr;
+    }
+    for(uint8_t i=0; i<INSTR_MAX_LEN; i++) {
+        instr->bytes[i] = code_read(addr+i, 1);
+    }
+    instr->addr = addr;
+    instr->generation = generation;
+    decode_instruction(instr);
+    return instr;
+}
+
+#define BLOCK_MAX_INSTR     32      // Longest straight-line sequence executed without checking interrupts
+#define BLOCK_CACHE_SIZE    0x400   // Number of cached blocks, must be a power of 2
+#define BLOCK_STATS_FILE    "logs/cpu_blocks.log"
+#define BLOCK_STATS_NUM     32      // How many of the hottest blocks cpu_print_block_stats() reports
+
+typedef void(*jit_func_t)(void);
+
+// Basic block: straight-line code from addr up to (and including) the first instruction
+// that may change CS:IP, IF or touch the IO space
+typedef struct {
+    uint32_t addr;          // Linear address of the first instruction, INVALID_CODE_ADDR for empty entries
+    uint32_t generation;    // code_page_generation[] of the first instruction's page at build time
+    uint32_t hits;
+    uint32_t num_instr;
+    uint16_t cs;            // CS:IP the block was built for, the compiled code is only valid for it
+    uint16_t ip;
+    jit_func_t jit_code;    // Compiled block, NULL if the block is interpreted
+    decoded_instr_t instr[BLOCK_MAX_INSTR];
+} block_t;
+
+static block_t block_cache[BLOCK_CACHE_SIZE];
+static uint64_t blocks_built = 0;
+static uint64_t jit_blocks_compiled = 0;
+// State of the block being executed, shared by the interpreter loop and the compiled code
+static block_t *running_block = NULL;
+static uint16_t running_cs;
+static uint32_t block_done;     // Ticks completed by the running block
+static uint32_t block_max_ticks;
+static int block_status;
+
+// Returns 1 if the instruction has to be the last one in a block
+uint8_t ends_block(decoded_instr_t *instr) {
+    if((instr->handler == invalid_instr) || (instr->handler == unknown_instr) || (instr->handler == unimplemented_instr)) {
+        return 1;
+    }
+    uint8_t op = instr->opcode;
+    if((op >= 0x70) && (op <= 0x7F)) {     // Conditional jumps
+        return 1;
+    }
+    if((op >= 0xE0) && (op <= 0xEF)) {     // LOOPs, JCXZ, IN/OUT, CALL, JMP
+        return 1;
+    }
+    if(((op >= 0xA4) && (op <= 0xA7)) || ((op >= 0xAA) && (op <= 0xAF))) {   // String operations
+        return 1;
+    }
+    switch(op) {
+        case 0x9A:  // CALL FAR-PROC
+        case 0x9D:  // POPF
+        case 0xC2:  // RET IMMED16 (intrasegment)
+        case 0xC3:  // RET (intrasegment)
+        case 0xCA:  // RET IMMED16 (intersegment)
+        case 0xCB:  // RET (intersegment)
+        case 0xCC:  // INT 3
+        case 0xCD:  // INT IMMED8
+        case 0xCE:  // INTO
+        case 0xCF:  // IRET
+        case 0xF0:  // Prefixes apply to the next instruction
+        case 0xF2:
+        case 0xF3:
         case 0xF4:  // HLT
-            // halts the CPU until the next external interrupt is fired
-            REGS->halt = 1;
-            break;
-        case 0xF5:  // CMC
-            // Inverts the CF flag
-            if(get_flag(CF)) {
-                set_flag(CF, 0);
-            } else {
-                set_flag(CF, 1);
-            }
-            break;
-        case 0xF6: {
-            uint8_t reg_field = get_register_field(memory[1]);
-            if(reg_field == 0) { // TEST REG8/MEM8, IMMED8: [0xF6, MOD 000 R/M, DISP-LO, DISP-HI, DATA-8]
-                    // TEST sets the zero flag, ZF, when the result of the AND operation is zero.
-                    // If two operands are equal, their bitwise AND is zero when both are zero.
-                    // TEST also sets the sign flag, SF, when the most significant bit is set in
-                    // the result, and the parity flag, PF, when the number of set bits is even.
-                    
-                    ret_val = and_instr(memory[0], &memory[1]);
-                    // printf("Error: Unimplemented TEST instruction: 0x%02X\n", memory[0]);
-                    // REGS->invalid_operations ++;
-            } else if(reg_field == 1) {
-                    printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 2) { // NOT REG8/MEM8: [0xF6, MOD 010 R/M, DISP-LO, DISP-HI]
-                    printf("Error: Unimplemented NOT instruction: 0x%02X\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 3) { // NEG REG8/MEM8: [0xF6, MOD 011 R/M, DISP-LO, DISP-HI]
-                    // subtracts the operand from zero and stores the result in the same operand.
-                    // The NEG instruction affects the carry, overflow, sign, zero, and parity flags according to the result.
-                    printf("Error: Unimplemented NEG instruction: 0x%02X\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 4) { // MUL REG8/MEM8: [0xF6, MOD 100 R/M, DISP-LO, DISP-HI]
-                    // p60 (2.36) If the source is a byte, then it is multiplied by register AL, and the double-length
-                    // result is returned in AH and AL. If the source operand is a word, then it is multiplied by register
-                    // AX, and the double-length result is returned in registers DX and AX. The operands are treated as
-                    // unsigned binary numbers (see AAM).
-                    ret_val = mul_instr(memory[0], &memory[1]);
-            } else if(reg_field == 5) { // IMUL REG8/MEM8 (signed): [0xF6, MOD 101 R/M, DISP-LO, DISP-HI]
-                    ret_val = mul_instr(memory[0], &memory[1]);
-            } else if(reg_field == 6) { // DIV REG8/MEM8: [0xF6, MOD 110 R/M, DISP-LO, DISP-HI]
-                    printf("Error: Unimplemented DIV instruction: 0x%02X\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 7) { // IDIV REG8/MEM8: [0xF6, MOD 111 R/M, DISP-LO, DISP-HI]
-                    printf("Error: Unimplemented IDIV instruction: 0x%02X\n", memory[0]);
-                    REGS->invalid_operations ++;
-            }
-            break;
-        }
-        case 0xF7: {
-            uint8_t reg_field = get_register_field(memory[1]);
-            if(reg_field == 0) { // TEST REG16/MEM16, IMMED16
-                    printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 1) { // Not used
-                    printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 2) { // NOT REG16/MEM16
-                    printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 3) { // NEG REG16/MEM16
-                    printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                    REGS->invalid_operations ++;
-            } else if(reg_field == 4) { // MUL REG16/MEM16
-                    // p60 (2.36) If the source is a byte, then it is multiplied by register AL, and the double-length
-                    // result is returned in AH and AL. If the source operand is a word, then it is multiplied by register
-                    // AX, and the double-length result is returned in registers DX and AX. The operands are treated as
-                    // unsigned binary numbers (see AAM).
-                    ret_val = mul_instr(memory[0], &memory[1]);
-            } else if(reg_field == 5) { // IMUL REG16/MEM16 (signed)
-                    ret_val = mul_instr(memory[0], &memory[1]);
-            } else if(reg_field == 6) { // DIV REG16/MEM16
-                    ret_val = div_instr(memory[0], &memory[1]);
-            } else if(reg_field == 7) { // IDIV REG16/MEM16
-                    printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                    REGS->invalid_operations ++;
-            }
-            break;
-        }
-        case 0xF8:  // CLC (Clear Carry Flag): [0xF9]
-            mylog(0, "logs/main.log", "Instruction 0xF8: Clear Carry Flag (CF)\n");
-            set_flag(CF, 0);
-            break;
-        case 0xF9:  // STC (Set Carry Flag): [0xF9]
-            mylog(0, "logs/main.log", "Instruction 0xF9: Set Carry Flag (CF)\n");
-            set_flag(CF, 1);
-            break;
         case 0xFA:  // CLI
-            // Clear Interrupt Flag, causes the processor to ignore maskable external interrupts
-            printf("Disabling interrupts\n");
-            mylog(0, "logs/main.log", "Instruction 0xFA: Clear Interrupt Flag (IF) to disable interrupts\n");
-            set_flag(IF, 0);
-            break;
         case 0xFB:  // STI
-            // Set Interrupt Flag
-            printf("Enabling interrupts\n");
-            mylog(0, "logs/main.log", "Instruction 0xFB: Set Interrupt Flag (IF) to enable interrupts\n");
-            set_flag(IF, 1);
-            break;
-        case 0xFC:  // CLD: [0xFC]: Clear Direction Flag
-            mylog(0, "logs/main.log", "Instruction 0xFC: Clear Direction Flag (DF)\n");
-            set_flag(DF, 0);
-            break;
-        case 0xFD:  // STD: [0xFD]: Set Direction Flag
-            mylog(0, "logs/main.log", "Instruction 0xFD: Set Direction Flag (DF)\n");
-            set_flag(DF, 1);
-            break;
-        case 0xFE: {
-            uint8_t reg_field = get_register_field(memory[1]);
-            if(reg_field == 0) {        // INC REG8/MEM8: [0xFE, MOD 000 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = inc_instr(memory[0], &memory[1]);
-            } else if(reg_field == 1) { // DEC REG8/MEM8: [0xFE, MOD 001 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = dec_instr(memory[0], &memory[1]);
-            } else {                    // NOT USED
-                printf("Error: Invalid Instruction: 0x%02X\n", memory[0]);
-                REGS->invalid_operations ++;
-                break;
-            }
+            return 1;
+        case 0x8E:  // MOV CS, REG16/MEM16
+            return instr->reg == 1;
+        case 0xF6:  // DIV, IDIV may raise interrupt 0
+        case 0xF7:
+            return instr->reg >= 6;
+        case 0xFF:  // CALL, JMP
+            return (instr->reg >= 2) && (instr->reg <= 5);
+        default:
+            return 0;
+    }
+}
+
+void flush_block_cache(void) {
+    for(uint32_t i=0; i<BLOCK_CACHE_SIZE; i++) {
+        block_cache[i].addr = INVALID_CODE_ADDR;
+        block_cache[i].hits = 0;
+        block_cache[i].jit_code = NULL;
+    }
+}
+
+// Decodes the block starting at CS:IP, it never crosses a page or a segment boundary
+void build_block(block_t *block, uint32_t addr) {
+    uint32_t ip = REGS->IP;
+    block->addr = addr;
+    block->generation = code_page_generation[(addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1)];
+    block->hits = 0;
+    block->num_instr = 0;
+    block->cs = REGS->CS;
+    block->ip = REGS->IP;
+    block->jit_code = NULL;
+    while(block->num_instr < BLOCK_MAX_INSTR) {
+        decoded_instr_t *instr = &block->instr[block->num_instr++];
+        *instr = *fetch_instruction(addr);
+        if(ends_block(instr)) {
             break;
         }
-        case 0xFF: {
-            uint8_t reg_field = get_register_field(memory[1]);
-            if(reg_field == 0) {        // INC REG16/MEM16: [0xFE, MOD 000 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = inc_instr(memory[0], &memory[1]);
-            } else if(reg_field == 1) { // DEC REG16/MEM16: [0xFE, MOD 001 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = dec_instr(memory[0], &memory[1]);
-            } else if(reg_field == 2) { // CALL REG16/MEM16 (intra): [0xFE, MOD 010 R/M, (DISP-LO), (DISP-HI)]
-                printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                REGS->invalid_operations ++;
-            } else if(reg_field == 3) { // CALL REG16/MEM16 (inter): [0xFE, MOD 011 R/M, (DISP-LO), (DISP-HI)]
-                printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                REGS->invalid_operations ++;
-            } else if(reg_field == 4) { // JMP REG16/MEM16 (intra): [0xFE, MOD 100 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = jmp_instr(memory[0], &memory[1]);
-            } else if(reg_field == 5) { // JMP REG16/MEM16 (inter): [0xFE, MOD 101 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = jmp_instr(memory[0], &memory[1]);
-            } else if(reg_field == 6) { // PUSH MEM16: [0xFE, MOD 110 R/M, (DISP-LO), (DISP-HI)]
-                ret_val = div_instr(memory[0], &memory[1]);
-            } else if(reg_field == 7) { // Not used
-                printf("Error: Invalid Instruction: 0x%02X 001\n", memory[0]);
-                REGS->invalid_operations ++;
-            }
+        addr += instr->length;
+        ip += instr->length;
+        if((ip > 0xFFFF) || ((addr >> MEM_PAGE_SHIFT) != (block->addr >> MEM_PAGE_SHIFT))) {
             break;
         }
-        default:    // INVALID_INSTRUCTION;
-            printf("Unknown instruction: 0x%02X\n", memory[0]);
-            REGS->invalid_operations ++;
     }
-    processed_commands[memory[0]] += 1;
+    blocks_built++;
+}
+
+block_t *fetch_block(uint32_t addr) {
+    block_t *block = &block_cache[(addr ^ (addr >> 10)) & (BLOCK_CACHE_SIZE - 1)];
+    uint32_t generation = code_page_generation[(addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1)];
+    if((block->addr != addr) || (block->generation != generation)) {
+        build_block(block, addr);
+    }
+    return block;
+}
+
+static int compare_block_hits(const void *a, const void *b) {
+    uint32_t hits_a = (*(block_t**)a)->hits;
+    uint32_t hits_b = (*(block_t**)b)->hits;
+    return (hits_a < hits_b) - (hits_a > hits_b);
+}
+
+/* Writes the hit counts of the hottest cached blocks to BLOCK_STATS_FILE */
+DLL_PREFIX
+void cpu_print_block_stats(void) {
+    static block_t *sorted[BLOCK_CACHE_SIZE];
+    uint32_t num = 0;
+    for(uint32_t i=0; i<BLOCK_CACHE_SIZE; i++) {
+        if(block_cache[i].addr != INVALID_CODE_ADDR) {
+            sorted[num++] = &block_cache[i];
+        }
+    }
+    qsort(sorted, num, sizeof(block_t*), compare_block_hits);
+    FILE *f = instance_fopen(BLOCK_STATS_FILE, "w");
+    if(f == NULL) {
+        printf("ERROR: Cannot open %s\n", BLOCK_STATS_FILE);
+        return;
+    }
+    fprintf(f, "Blocks built: %llu, cached: %u, compiled: %llu\n", (unsigned long long)blocks_built, num, (unsigned long long)jit_blocks_compiled);
+    for(uint32_t i=0; (i<num) && (i<BLOCK_STATS_NUM); i++) {
+        fprintf(f, "0x%05X: %u hits, %u instructions%s\n", sorted[i]->addr, sorted[i]->hits, sorted[i]->num_instr, sorted[i]->jit_code ? ", compiled" : "");
+    }
+    fclose(f);
+}
+
+int16_t process_instruction(decoded_instr_t *instr) {
+    uint8_t *memory = instr->bytes;
+    // mylog("logs/main.log", "===============================================================\n");
+    mylog(0, "logs/main.log", ">>>Step %lld, processing bytes: 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X 0x%02X:\n",
+           (long long)REGS->ticks, memory[0], memory[1], memory[2], memory[3], memory[4], memory[5]);
+    print_registers();
+    mytrace(TRACE_INSTR, memory[0] | (memory[1] << 8) | (memory[2] << 16) | ((uint32_t)memory[3] << 24),
+            memory[4] | (memory[5] << 8), instr->length);
+    int16_t ret_val = instr->handler(instr->opcode, &memory[1]);
+    processed_commands[instr->opcode] += 1;
     return ret_val;
 }
 
+typedef struct {
+    uint16_t ip;
+    const char *log_msg;
+    const char *print_msg;
+} bios_checkpoint_t;
+
+// BIOS procedures and error handlers reported when the CPU reaches them
+static const bios_checkpoint_t bios_checkpoints[] = {
+    {0xE329, "Start 8259 Interrupt Controller Test\n", "Start 8259 Interrupt Controller Test\n"},
+    {0xE2F0, "CRT Error at 0xE2F0\n", "CRT Error 0xE2F0\n"},
+    {0xE354, "Interrupt Controller  or Timer Error at 0xE354\n", "Interrupt Controller or Timer Error at 0xE354\n"},
+    {0xE3D7, "Keyboard Test Error at 0xE3D7\n", "Keyboard Test Error at 0xE3D7\n"},
+    {0xE35D, "Start 8253 Timer Test\n", "Start 8253 Timer Test\n"},
+    {0xE242, "Initialize and start CRT controller\n", "Initialize and start CRT controller\n"},
+    {0xE3A2, "Start Keyboard Test\n", "Start Keyboard Test\n"},
+    {0xE3DE, "Setting Up Interrupt Vector Table\n", "Setting Up Interrupt Vector Table\n"},
+    {0xE418, "Start IO Box Test\n", "Start IO Box Test\n"},
+    {0xE46A, "Start Additional Read/Write Storage Test\n", "Start Additional Read/Write Storage Test\n"},
+    {0xE1CE, "Initialize the 8259 Interrupt Controller\n", "Initialize the 8259 Interrupt Controller\n"},
+    {0xF99C, "PRINT_HEX procedure\n", "PRINT_HEX procedure\n"},
+    {0xEF57, "DISK_INT procedure\n", "DISK_INT procedure\n"},
+    {0xEE6C, "DISK_GET_PARAM procedure\n", "DISK_GET_PARAM procedure\n"},
+    {0xE597, "SETUP PRINTER AND RS232 BASE ADDRESSES\n", "SETUP PRINTER AND RS232 BASE ADDRESSES\n"},
+    {0xF9D8, "ERR_BEEP PROC (not necessarily means error)\n", "ERR_BEEP PROC (not necessarily means error)\n"},
+    {0xFA08, "BEEP PROC\n", "BEEP PROC\n"},
+    {0xEE41, "NEC_OUTPUT procedure\n", "NEC_OUTPUT procedure\n"},
+    {0xE551, "DISKETTE ATTACHMENT TEST\n", "DISKETTE ATTACHMENT TEST\n"},
+};
+static uint8_t checkpoint_ips[0x10000 / 8];    // Bitmap of bios_checkpoints[].ip
+
+void init_bios_checkpoints(void) {
+    memset(checkpoint_ips, 0, sizeof(checkpoint_ips));
+    for(uint32_t i=0; i<sizeof(bios_checkpoints)/sizeof(bios_checkpoints[0]); i++) {
+        checkpoint_ips[bios_checkpoints[i].ip >> 3] |= 1 << (bios_checkpoints[i].ip & 0x07);
+    }
+}
+
+uint8_t is_bios_checkpoint(uint16_t ip) {
+    return (checkpoint_ips[ip >> 3] >> (ip & 0x07)) & 1;
+}
+
+void print_bios_checkpoint(uint16_t ip) {
+    if(!is_bios_checkpoint(ip)) {
+        return;
+    }
+    for(uint32_t i=0; i<sizeof(bios_checkpoints)/sizeof(bios_checkpoints[0]); i++) {
+        if(bios_checkpoints[i].ip == ip) {
+            mylog(0, "logs/short.log", "%s", bios_checkpoints[i].log_msg);
+            printf("%s", bios_checkpoints[i].print_msg);
+        }
+    }
+}
+
 uint16_t delayed_int_timeout = 0;
 uint16_t delayed_int_vector = 0xFFFF;
 
@@ -3189,13 +2832,13 @@ void set_int_vector(uint8_t vector) {
 // Pront list of processed commands to log file
 void print_proc_commands(void) {
     FILE *f;
-    f = fopen(COMMON_LOG_FILE, "w");
+    f = instance_fopen(COMMON_LOG_FILE, "w");
     if(f == NULL) {
         printf("ERROR: Failed to open %s", COMMON_LOG_FILE);
         return;
     }
     fprintf(f,"List of processed commands:\n");
-    for(int i=0; i<0xFF; i++) {
+    for(int i=0; i<0x100; i++) {
         fprintf(f,"Opcode 0x%02X: was executed %d times\n", i, processed_commands[i]);
     }
     fclose(f);
@@ -3203,12 +2846,12 @@ void print_proc_commands(void) {
 
 int store_registers(char *filename, registers_t *regs) {
     FILE *f;
-    f = fopen(filename, "w");
+    f = instance_fopen(filename, "w");
     if(f == NULL) {
         printf("ERROR: Failed to open %s", filename);
         return EXIT_FAILURE;
     }
-    fprintf(f, "0x%08X\n", regs->ticks);
+    fprintf(f, "0x%016llX\n", (unsigned long long)regs->ticks);
     fprintf(f, "0x%04X\n", regs->AX);
     fprintf(f, "0x%04X\n", regs->BX);
     fprintf(f, "0x%04X\n", regs->CX);
@@ -3230,13 +2873,15 @@ int store_registers(char *filename, registers_t *regs) {
 
 int restore_registers(char *filename, registers_t *regs) {
     FILE *f;
-    f = fopen(filename, "r");
+    f = instance_fopen(filename, "r");
     if(f == NULL) {
         printf("ERROR: Failed to open %s", filename);
         return EXIT_FAILURE;
     }
     uint32_t temp;
-    fscanf(f, "0x%08X\n", &regs->ticks);
+    unsigned long long ticks;
+    fscanf(f, "0x%llX\n", &ticks);
+    regs->ticks = ticks;
     fscanf(f, "0x%04X\n", &temp);
     regs->AX = (uint16_t)temp;
     fscanf(f, "0x%04X\n", &temp);
@@ -3268,7 +2913,7 @@ int restore_registers(char *filename, registers_t *regs) {
     fscanf(f, "0x%04X\n", &temp);
     regs->prefixes = (uint16_t)temp;
     fclose(f);
-    mylog(0, "logs/main.log", "Registers restored! ticks = 0x%08X\n", regs->ticks);
+    mylog(0, "logs/main.log", "Registers restored! ticks = 0x%016llX\n", (unsigned long long)regs->ticks);
     return EXIT_SUCCESS;
 }
 
@@ -3281,6 +2926,7 @@ int init_cpu(uint8_t continue_simulation) {
     // }
     REGS = calloc(1, sizeof(registers_t));
     REGS->int_vector = 0xFFFF;
+    lazy_flags.pending = 0;
     if(continue_simulation) {
         mylog(0, "logs/main.log", "Restoring registers\n");
         restore_registers(REGISTERS_FILE, REGS);
@@ -3292,6 +2938,7 @@ int init_cpu(uint8_t continue_simulation) {
 }
 
 void cpu_save_state(void) {
+    materialize_flags();
     store_registers(REGISTERS_FILE, REGS);
     // store_memory();
     // store_io();
@@ -3308,11 +2955,19 @@ void connect_address_space(uint8_t space_type, WRITE_FUNC_PTR(write_func), READ_
         io_write = write_func;
         io_read = read_func;
     } else {   // MEM_SPACE
-        mem_write = write_func;
-        mem_read = read_func;
+        mem_write_func = write_func;
+        mem_read_func = read_func;
     }
 }
 
+/* Gives the CPU direct access to the RAM of the memory module (mem_get_ram(), mem_get_page_attrs()),
+   NULL turns it off */
+DLL_PREFIX
+void set_memory_map(uint8_t *ram, uint8_t *page_attrs) {
+    direct_ram = (page_attrs != NULL) ? ram : NULL;
+    direct_page_attrs = page_attrs;
+}
+
 DLL_PREFIX
 void set_code_read_func(READ_FUNC_PTR(read_func)) {
     code_read = read_func;
@@ -3320,15 +2975,38 @@ void set_code_read_func(READ_FUNC_PTR(read_func)) {
 
 DLL_PREFIX
 void module_reset(void) {
-    REGS = (registers_t*)calloc(1, sizeof(registers_t));
+    // The registers stay at the same address, other modules keep pointers to them (set_trace_source())
+    if(REGS == NULL) {
+        REGS = (registers_t*)calloc(1, sizeof(registers_t));
+    } else {
+        memset(REGS, 0, sizeof(registers_t));
+    }
+    REGS->ticks = ticks_num;    // The reset happens at the current tick
     REGS->int_vector = 0xFFFF;
     REGS->IP = 0xFFF0;
     REGS->CS = 0xF000;
+    lazy_flags.pending = 0;
+    init_parity_table();
+    init_opcode_table();
+    init_bios_checkpoints();
+    flush_decode_cache();
+    flush_block_cache();
+    set_trace_source(&REGS->CS, &REGS->IP);
     printf("REGS->IP = 0x%04X, REGS->CS = 0x%04X\n", REGS->IP, REGS->CS);
 }
 
+/* Returns the location of a 16-bit register, used to connect other modules to CS:IP */
+DLL_PREFIX
+uint16_t *cpu_get_register_ptr(uint8_t reg) {
+    if((reg >= sizeof(reg_locations) / sizeof(reg_locations[0])) || (reg_locations[reg].width != 2)) {
+        return NULL;
+    }
+    return (uint16_t*)((uint8_t*)REGS + reg_locations[reg].offset);
+}
+
 DLL_PREFIX
 void module_save(void) {
+    materialize_flags();
     store_data(REGS, sizeof(registers_t), CPU_DUMP_FILE);
 }
 
@@ -3337,87 +3015,209 @@ void module_restore(void) {
     registers_t *temp_regs = calloc(1, sizeof(registers_t));
     if(EXIT_SUCCESS == restore_data(temp_regs, sizeof(registers_t), CPU_DUMP_FILE)) {
         memcpy(REGS, temp_regs, sizeof(registers_t));
+        lazy_flags.pending = 0;
     }
+    flush_decode_cache();
+    flush_block_cache();
 }
 
 DLL_PREFIX
-int module_tick(uint32_t ticks) {
-    if(REGS->int_vector != 0xFFFF) {
-        if(get_flag(IF)) {
-            printf("CPU interrupt %d\n", REGS->int_vector);
-            push_register(REGS->flags);
-            push_register(REGS->CS);
-            push_register(REGS->IP);
-            set_register_value(IP_register, mem_read(4 * REGS->int_vector, 2));
-            set_register_value(CS_register, mem_read((4 * REGS->int_vector) + 2, 2));
-            REGS->int_vector = 0xFFFF;
-            set_flag(IF, 0);
-            set_flag(TF, 0);}
+void module_checkpoint(void) {
+    materialize_flags();
+    snapshot_write(DEVICE_NAME, 0, REGS, sizeof(registers_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    if(EXIT_SUCCESS == snapshot_read_block(DEVICE_NAME, tick, REGS, sizeof(registers_t))) {
+        lazy_flags.pending = 0;
+    }
+    flush_decode_cache();
+    flush_block_cache();
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    materialize_flags();
+    rewind_store(slot, REGS, sizeof(registers_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    if(EXIT_SUCCESS == rewind_load(slot, REGS, sizeof(registers_t))) {
+        lazy_flags.pending = 0;
+    }
+    flush_decode_cache();
+    flush_block_cache();
+}
+
+/* Timing modes: in CPU_TIMING_INSTRUCTIONS mode every instruction (and every REP element) is one tick,
+   in CPU_TIMING_CYCLES mode a tick is a clock cycle and an instruction takes the cycles of the 8086
+   tables below. The instruction is executed at its first cycle and the rest are spent in
+   REGS->wait_cycles, so the devices see the instruction effects and run the cycles between them.
+   Not modelled: the prefetch queue, bus wait states and the extra cycles of odd address word accesses */
+#define CPU_TIMING_INSTRUCTIONS 0
+#define CPU_TIMING_CYCLES       1
+#define INTR_CYCLES             61  // Hardware interrupt acknowledge
+#define REP_END_CYCLES          9   // REP string instruction with CX = 0
+
+static uint8_t timing_mode = CPU_TIMING_INSTRUCTIONS;
+
+// Register operands or no MOD REG R/M byte, conditional jumps and LOOPs not taken
+static const uint8_t cycles_reg[256] = {
+//   0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
+     3,   3,   3,   3,   4,   4,  10,   8,   3,   3,   3,   3,   4,   4,  10,   8,   // 0x00
+     3,   3,   3,   3,   4,   4,  10,   8,   3,   3,   3,   3,   4,   4,  10,   8,   // 0x10
+     3,   3,   3,   3,   4,   4,   2,   4,   3,   3,   3,   3,   4,   4,   2,   4,   // 0x20
+     3,   3,   3,   3,   4,   4,   2,   8,   3,   3,   3,   3,   4,   4,   2,   8,   // 0x30
+     2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   2,   // 0x40
+    11,  11,  11,  11,  11,  11,  11,  11,   8,   8,   8,   8,   8,   8,   8,   8,   // 0x50
+     4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   // 0x60
+     4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   // 0x70
+     4,   4,   4,   4,   3,   3,   4,   4,   2,   2,   2,   2,   2,   2,   2,   8,   // 0x80
+     3,   3,   3,   3,   3,   3,   3,   3,   2,   5,  28,   4,  10,   8,   4,   4,   // 0x90
+    10,  10,  10,  10,  18,  18,  22,  22,   4,   4,  11,  11,  12,  12,  15,  15,   // 0xA0
+     4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   4,   // 0xB0
+    12,   8,  12,   8,  16,  16,   4,   4,  17,  18,  17,  18,  52,  51,   4,  24,   // 0xC0
+     2,   2,   8,   8,  83,  60,   4,  11,   2,   2,   2,   2,   2,   2,   2,   2,   // 0xD0
+     5,   6,   5,   6,  10,  10,  10,  10,  19,  15,  15,  15,   8,   8,   8,   8,   // 0xE0
+     2,   2,   2,   2,   2,   2,   0,   0,   2,   2,   2,   2,   2,   2,   3,   0,   // 0xF0
+};
+
+// Memory operand, without the effective address calculation (ea_cycles), only for the MOD REG R/M opcodes
+static const uint8_t cycles_mem[256] = {
+//   0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
+    16,  16,   9,   9,   0,   0,   0,   0,  16,  16,   9,   9,   0,   0,   0,   0,   // 0x00
+    16,  16,   9,   9,   0,   0,   0,   0,  16,  16,   9,   9,   0,   0,   0,   0,   // 0x10
+    16,  16,   9,   9,   0,   0,   0,   0,  16,  16,   9,   9,   0,   0,   0,   0,   // 0x20
+    16,  16,   9,   9,   0,   0,   0,   0,   9,   9,   9,   9,   0,   0,   0,   0,   // 0x30
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0x40
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0x50
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0x60
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0x70
+    17,  17,  17,  17,   9,   9,  17,  17,   9,   9,   8,   8,   9,   2,   8,  17,   // 0x80
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0x90
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0xA0
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0xB0
+     0,   0,   0,   0,  16,  16,  10,  10,   0,   0,   0,   0,   0,   0,   0,   0,   // 0xC0
+    15,  15,  20,  20,   0,   0,   0,   0,   8,   8,   8,   8,   8,   8,   8,   8,   // 0xD0
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   // 0xE0
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,  15,   0,   // 0xF0
+};
+
+// Groups by the REG field, [0] - register operand, [1] - memory operand (the upper bounds of MUL and DIV)
+static const uint8_t cycles_f6[2][8] = {{5, 5, 3, 3, 77, 98, 90, 112}, {11, 11, 16, 16, 83, 104, 96, 118}};    // TEST, TEST, NOT, NEG, MUL, IMUL, DIV, IDIV
+static const uint8_t cycles_f7[2][8] = {{5, 5, 3, 3, 133, 154, 162, 184}, {11, 11, 16, 16, 139, 160, 168, 190}};
+static const uint8_t cycles_ff[2][8] = {{2, 2, 16, 37, 11, 24, 11, 2}, {15, 15, 21, 37, 18, 24, 16, 2}};   // INC, DEC, CALL, CALL far, JMP, JMP far, PUSH
+
+// Effective address calculation by R/M, [0] - MOD 00 (R/M 110 is DISP16), [1] - MOD 01 and 10 (with displacement)
+static const uint8_t ea_cycles[2][8] = {{7, 8, 8, 7, 5, 5, 6, 5}, {11, 12, 12, 11, 9, 9, 9, 9}};
+
+// REP string instructions per element, opcodes 0xA4 - 0xAF: MOVS, CMPS, TEST (no REP), STOS, LODS, SCAS
+static const uint8_t rep_element_cycles[12] = {17, 17, 22, 22, 0, 0, 10, 10, 13, 13, 15, 15};
+
+static inline uint8_t is_string_instr(uint8_t opcode) {
+    return (opcode >= 0xA4) && (opcode <= 0xAF) && (rep_element_cycles[opcode - 0xA4] > 0);
+}
+
+// Returns the clock cycles of the executed instruction, rep is the REP prefix state before the execution
+static uint32_t instruction_cycles(decoded_instr_t *instr, uint8_t rep, uint16_t next_ip) {
+    uint8_t opcode = instr->opcode;
+    if(rep && is_string_instr(opcode)) {
+        return rep_elements ? (rep_elements * rep_element_cycles[opcode - 0xA4]) : REP_END_CYCLES;
+    }
+    uint8_t mem = (instr->mod != 3) && (get_instr_format(opcode, instr->bytes[1]) & FMT_MODRM);
+    uint32_t cycles = mem ? (cycles_mem[opcode] + ea_cycles[instr->mod != 0][instr->rm]) : cycles_reg[opcode];
+    uint8_t taken = REGS->IP != next_ip;
+    if((opcode >= 0x60) && (opcode <= 0x7F)) {     // Conditional jumps, 0x60 - 0x6F are their aliases on the 8086
+        return taken ? 16 : cycles;
+    }
+    if((opcode >= 0x80) && (opcode <= 0x83)) {     // CMP MEM, IMMED doesn't write the result
+        return ((instr->reg == 7) && mem) ? (cycles - 7) : cycles;
+    }
+    switch(opcode) {
+        case 0xD2:  // Shifts and rotates by CL
+        case 0xD3:
+            return cycles + 4 * (REGS->CX & 0xFF);
+        case 0xF6:
+            return cycles + cycles_f6[mem][instr->reg];
+        case 0xF7:
+            return cycles + cycles_f7[mem][instr->reg];
+        case 0xFF:
+            return (mem ? ea_cycles[instr->mod != 0][instr->rm] : 0) + cycles_ff[mem][instr->reg];
+        case 0xE0:  // LOOPNE
+            return taken ? 19 : cycles;
+        case 0xE1:  // LOOPE
+        case 0xE3:  // JCXZ
+            return taken ? 18 : cycles;
+        case 0xE2:  // LOOP
+            return taken ? 17 : cycles;
+        case 0xCE:  // INTO
+            return taken ? 53 : cycles;
+        default:
+            return cycles;
+    }
+}
+
+// Returns the ticks of the executed instruction: 1 (or the number of the REP elements) or its clock cycles
+static uint32_t instruction_ticks(decoded_instr_t *instr, uint8_t rep, uint16_t next_ip) {
+    uint32_t ticks = (timing_mode == CPU_TIMING_CYCLES) ? instruction_cycles(instr, rep, next_ip) : (rep_elements ? rep_elements : 1);
+    rep_elements = 0;
+    return ticks;
+}
+
+// Returns the number of the REP elements of the instruction which fit in the given ticks
+static uint32_t rep_ticks_elements(uint8_t opcode, uint32_t ticks) {
+    if((timing_mode == CPU_TIMING_CYCLES) && is_string_instr(opcode)) {
+        return ticks / rep_element_cycles[opcode - 0xA4];
+    }
+    return ticks;
+}
+
+// Spends up to max_ticks of the pending wait cycles, returns the number of the spent ticks
+static uint32_t spend_wait_cycles(uint32_t max_ticks) {
+    uint32_t num = (REGS->wait_cycles < max_ticks) ? REGS->wait_cycles : max_ticks;
+    REGS->wait_cycles -= num;
+    REGS->ticks += num;
+    ticks_num += num;
+    return num;
+}
+
+/* Switches the timing mode: CPU_TIMING_INSTRUCTIONS or CPU_TIMING_CYCLES. The delays of the
+   devices are counted in ticks, so they are clock cycles in CPU_TIMING_CYCLES mode */
+DLL_PREFIX
+void cpu_set_timing(uint8_t mode) {
+    if(mode > CPU_TIMING_CYCLES) {
+        printf("ERROR: Invalid CPU timing mode: %d\n", mode);
+        return;
+    }
+    timing_mode = mode;
+    if(REGS != NULL) {
+        REGS->wait_cycles = 0;
+    }
+}
+
+void check_interrupt(void) {
+    if((REGS->int_vector != 0xFFFF) && get_flag(IF)) {
+        printf("CPU interrupt %d\n", REGS->int_vector);
+        push_register(get_register_value(FLAGS_register));
+        push_register(REGS->CS);
+        push_register(REGS->IP);
+        set_register_value(IP_register, mem_read(4 * REGS->int_vector, 2));
+        set_register_value(CS_register, mem_read((4 * REGS->int_vector) + 2, 2));
+        REGS->int_vector = 0xFFFF;
+        set_flag(IF, 0);
+        set_flag(TF, 0);
+        if(timing_mode == CPU_TIMING_CYCLES) {
+            REGS->wait_cycles = INTR_CYCLES;
         }
-    uint32_t addr = ((uint32_t)REGS->CS << 4) + REGS->IP;
-    static uint8_t code[10];
-    for(uint8_t i=0; i<sizeof(code); i++) {
-        code[i] = code_read(addr+i, 1);
-    }
-    if(REGS->IP == 0xE329) {
-        mylog(0, "logs/short.log", "Start 8259 Interrupt Controller Test\n");
-        printf("Start 8259 Interrupt Controller Test\n");
-    } else if(REGS->IP == 0xE2F0) {
-        mylog(0, "logs/short.log", "CRT Error at 0xE2F0\n");
-        printf("CRT Error 0xE2F0\n");
-    } else if(REGS->IP == 0xE354) {
-        mylog(0, "logs/short.log", "Interrupt Controller  or Timer Error at 0xE354\n");
-        printf("Interrupt Controller or Timer Error at 0xE354\n");
-    } else if(REGS->IP == 0xE3D7) {
-        mylog(0, "logs/short.log", "Keyboard Test Error at 0xE3D7\n");
-        printf("Keyboard Test Error at 0xE3D7\n");
-    } else if(REGS->IP == 0xE35D) {
-        mylog(0, "logs/short.log", "Start 8253 Timer Test\n");
-        printf("Start 8253 Timer Test\n");
-    } else if(REGS->IP == 0xE242) {
-        mylog(0, "logs/short.log", "Initialize and start CRT controller\n");
-        printf("Initialize and start CRT controller\n");
-    } else if(REGS->IP == 0xE3A2) {
-        mylog(0, "logs/short.log", "Start Keyboard Test\n");
-        printf("Start Keyboard Test\n");
-    } else if(REGS->IP == 0xE3DE) {
-        mylog(0, "logs/short.log", "Setting Up Interrupt Vector Table\n");
-        printf("Setting Up Interrupt Vector Table\n");
-    } else if(REGS->IP == 0xE418) {
-        mylog(0, "logs/short.log", "Start IO Box Test\n");
-        printf("Start IO Box Test\n");
-    } else if(REGS->IP == 0xE46A) {
-        mylog(0, "logs/short.log", "Start Additional Read/Write Storage Test\n");
-        printf("Start Additional Read/Write Storage Test\n");
-    } else if(REGS->IP == 0xE1CE) {
-        mylog(0, "logs/short.log", "Initialize the 8259 Interrupt Controller\n");
-        printf("Initialize the 8259 Interrupt Controller\n");
-    } else if(REGS->IP == 0xF99C) {
-        mylog(0, "logs/short.log", "PRINT_HEX procedure\n");
-        printf("PRINT_HEX procedure\n");
-    } else if(REGS->IP == 0xEF57) {
-        mylog(0, "logs/short.log", "DISK_INT procedure\n");
-        printf("DISK_INT procedure\n");
-    } else if(REGS->IP == 0xEE6C) {
-        mylog(0, "logs/short.log", "DISK_GET_PARAM procedure\n");
-        printf("DISK_GET_PARAM procedure\n");
-    } else if(REGS->IP == 0xE597) {
-        mylog(0, "logs/short.log", "SETUP PRINTER AND RS232 BASE ADDRESSES\n");
-        printf("SETUP PRINTER AND RS232 BASE ADDRESSES\n");
-    } else if(REGS->IP == 0xF9D8) {
-        mylog(0, "logs/short.log", "ERR_BEEP PROC (not necessarily means error)\n");
-        printf("ERR_BEEP PROC (not necessarily means error)\n");
-    } else if(REGS->IP == 0xFA08) {
-        mylog(0, "logs/short.log", "BEEP PROC\n");
-        printf("BEEP PROC\n");
-    } else if(REGS->IP == 0xEE41) {
-        mylog(0, "logs/short.log", "NEC_OUTPUT procedure\n");
-        printf("NEC_OUTPUT procedure\n");
-    } else if(REGS->IP == 0xE551) {
-        mylog(0, "logs/short.log", "DISKETTE ATTACHMENT TEST\n");
-        printf("DISKETTE ATTACHMENT TEST\n");
-    }
-    uint8_t inc = process_instruction(code);
+    }
+}
+
+// Executes one decoded instruction at CS:IP and moves IP to the next one
+int execute_instruction(decoded_instr_t *instr) {
+    print_bios_checkpoint(REGS->IP);
+    uint8_t inc = process_instruction(instr);
     // if(REGS->ticks >= 1053807) {
     //     printf("ERROR: CPU has reached 1053807 ticks, stop\n"); 
     //     print_proc_commands();
@@ -3439,6 +3239,592 @@ int module_tick(uint32_t ticks) {
     return EXIT_FAILURE;
 }
 
+DLL_PREFIX
+int module_tick(uint32_t ticks) {
+    if(REGS->wait_cycles == 0) {
+        check_interrupt();
+    }
+    if(REGS->wait_cycles) {
+        REGS->wait_cycles--;
+        REGS->ticks++;
+        return EXIT_SUCCESS;
+    }
+    decoded_instr_t *instr = fetch_instruction(((uint32_t)REGS->CS << 4) + REGS->IP);
+    uint16_t next_ip = REGS->IP + instr->length;
+    uint8_t rep = get_prefix(REPE) || get_prefix(REPNE);
+    int res = execute_instruction(instr);
+    uint32_t ticks_taken = instruction_ticks(instr, rep, next_ip);
+    if(res == EXIT_SUCCESS) {
+        REGS->wait_cycles = ticks_taken - 1;
+    }
+    return res;
+}
+
+/* JIT tier: hot blocks are compiled into x86-64 code.
+   The register forms of MOV, ADD, SUB, CMP, AND, OR, XOR and TEST, MOV REG, IMMED,
+   INC/DEC REG16, ADD/CMP/AND/TEST with an accumulator and an immediate, LOOP, JCXZ and the
+   conditional jumps on CF, ZF, SF and PF are translated to native code working on registers_t
+   (its address is pinned in RBX, system_ticks in R12 and lazy_flags in R13).
+   The translated ALU instructions record their operation in lazy_flags exactly like
+   update_flags() does, a translated jump reads the flag from the operation recorded by
+   an earlier translated instruction of the block, so its width and type are known when
+   the block is compiled. Every other instruction is a call to block_step(), so the handlers
+   stay the reference implementation of the instruction semantics. In JIT_DIFFERENTIAL mode
+   every translated instruction is also executed by the interpreter on a copy of the registers
+   and of lazy_flags and the results are compared */
+#define JIT_OFF             0
+#define JIT_ON              1
+#define JIT_DIFFERENTIAL    2
+#define JIT_HOT_THRESHOLD   64          // Block hits before the block is compiled
+#define JIT_ARENA_SIZE      0x400000
+#define JIT_MAX_BLOCK_CODE  0x2000      // Worst case code size of a block
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define JIT_SUPPORTED   1
+#else
+    #define JIT_SUPPORTED   0
+#endif
+
+int block_step(decoded_instr_t *instr);
+
+static uint8_t jit_mode = JIT_OFF;
+static uint8_t *jit_arena = NULL;
+static uint32_t jit_arena_used = 0;
+static uint8_t *jit_ptr;
+static registers_t jit_shadow_regs;
+static lazy_flags_t jit_shadow_flags;
+
+static void emit8(uint8_t value) {
+    *jit_ptr++ = value;
+}
+
+static void emit16(uint16_t value) {
+    memcpy(jit_ptr, &value, 2);
+    jit_ptr += 2;
+}
+
+static void emit32(uint32_t value) {
+    memcpy(jit_ptr, &value, 4);
+    jit_ptr += 4;
+}
+
+static void emit64(uint64_t value) {
+    memcpy(jit_ptr, &value, 8);
+    jit_ptr += 8;
+}
+
+static void emit_mov_rax_imm64(uint64_t value) {
+    emit8(0x48); emit8(0xB8); emit64(value);        // mov rax, imm64
+}
+
+// Calls func(arg) using the host calling convention
+static void emit_call(uint64_t func, uint64_t arg) {
+#ifdef _WIN32
+    emit8(0x48); emit8(0xB9); emit64(arg);          // mov rcx, imm64
+#else
+    emit8(0x48); emit8(0xBF); emit64(arg);          // mov rdi, imm64
+#endif
+    emit_mov_rax_imm64(func);
+    emit8(0xFF); emit8(0xD0);                       // call rax
+}
+
+static void emit_jump_if_nonzero(uint8_t *target) {
+    emit8(0x85); emit8(0xC0);                       // test eax, eax
+    emit8(0x0F); emit8(0x85);                       // jnz rel32
+    emit32((uint32_t)(target - (jit_ptr + 4)));
+}
+
+static void emit_inc_dword(void *addr) {
+    emit_mov_rax_imm64((uint64_t)(uintptr_t)addr);
+    emit8(0xFF); emit8(0x00);                       // inc dword [rax]
+}
+
+// Offsets of the registers in registers_t, reg is the REG or R/M field
+static uint8_t reg16_offset(uint8_t reg) {
+    return offsetof(registers_t, regs16) + 2 * (reg & 0x07);
+}
+
+static uint8_t reg8_offset(uint8_t reg) {
+    return offsetof(registers_t, regs8) + reg8_index[reg & 0x07];
+}
+
+// Pending flags operation as far as the compiler knows it, width 0 if it is not known
+typedef struct {
+    uint8_t width;
+    operation_t op_type;
+} jit_flags_t;
+
+/* Native form of an ALU instruction: EAX = dst OP ECX.
+   The operands are loaded with the sign or zero extension the handler gets when it
+   converts them to int8_t, int16_t or uint16_t, so lazy_flags receives the same values */
+#define JIT_LOAD_ZX8        0
+#define JIT_LOAD_SX8        1
+#define JIT_LOAD_ZX16       2
+#define JIT_LOAD_SX16       3
+#define JIT_LOAD_IMMED      4
+#define JIT_RES_INT         0   // The result is recorded as computed
+#define JIT_RES_INT16       1   // int16_t result
+#define JIT_RES_UINT16      2   // uint16_t result
+
+typedef struct {
+    uint8_t host_op;        // OP r/m32, r32: 0x01 ADD, 0x09 OR, 0x21 AND, 0x29 SUB, 0x31 XOR
+    operation_t op_type;
+    uint8_t width;          // As passed to update_flags() by the handler
+    uint8_t dst_load;
+    uint8_t dst_offset;
+    uint8_t src_load;
+    uint8_t src_offset;
+    uint32_t src_immed;
+    uint8_t res_type;
+    uint8_t write;          // The result is stored into the destination register
+    uint8_t decodes;        // The handler calls decode_operands(), which consumes the segment override
+} jit_alu_t;
+
+// Fills alu if the instruction has a native form, returns 0 otherwise
+static uint8_t jit_alu_operation(decoded_instr_t *instr, jit_alu_t *alu) {
+    instr_handler_t handler = instr->handler;
+    memset(alu, 0, sizeof(jit_alu_t));
+    if((handler == inc_reg16_instr) || (handler == dec_reg16_instr)) {     // update_flags(val, 1, val +- 1, 2)
+        uint8_t inc = handler == inc_reg16_instr;
+        alu->host_op = inc ? 0x01 : 0x29;
+        alu->op_type = inc ? ADD_OP : SUB_OP;
+        alu->width = 2;
+        alu->dst_load = JIT_LOAD_ZX16;
+        alu->dst_offset = reg16_offset(instr->opcode);
+        alu->src_load = JIT_LOAD_IMMED;
+        alu->src_immed = 1;
+        alu->res_type = JIT_RES_INT;
+        alu->write = 1;
+        return 1;
+    }
+    if((handler == add_al_immed_instr) || (handler == add_ax_immed_instr)) {
+        uint8_t word = handler == add_ax_immed_instr;
+        alu->host_op = 0x01;
+        alu->op_type = ADD_OP;
+        alu->width = word ? 2 : 1;
+        alu->dst_load = word ? JIT_LOAD_SX16 : JIT_LOAD_SX8;
+        alu->dst_offset = word ? reg16_offset(0) : reg8_offset(0);
+        alu->src_load = JIT_LOAD_IMMED;
+        alu->src_immed = word ? (uint32_t)(int16_t)instr->immed : (uint32_t)(int8_t)instr->immed;
+        alu->res_type = JIT_RES_INT16;
+        alu->write = 1;
+        return 1;
+    }
+    if((handler == cmp_al_immed_instr) || (handler == cmp_ax_immed_instr)) {  // Both record width 2
+        uint8_t word = handler == cmp_ax_immed_instr;
+        alu->host_op = 0x29;
+        alu->op_type = SUB_OP;
+        alu->width = 2;
+        alu->dst_load = word ? JIT_LOAD_SX16 : JIT_LOAD_ZX8;
+        alu->dst_offset = word ? reg16_offset(0) : reg8_offset(0);
+        alu->src_load = JIT_LOAD_IMMED;
+        alu->src_immed = word ? (uint32_t)(int16_t)instr->immed : instr->immed;
+        alu->res_type = JIT_RES_INT16;
+        return 1;
+    }
+    if((handler == and_al_immed_instr) || (handler == test_al_immed_instr)) {
+        alu->host_op = 0x21;
+        alu->op_type = LOGIC_OP;
+        alu->width = 1;
+        alu->dst_load = JIT_LOAD_ZX8;
+        alu->dst_offset = reg8_offset(0);
+        alu->src_load = JIT_LOAD_IMMED;
+        alu->src_immed = instr->immed;
+        alu->res_type = JIT_RES_UINT16;
+        alu->write = handler == and_al_immed_instr;
+        return 1;
+    }
+    if(instr->mod != 3) {
+        return 0;
+    }
+    if((handler == add_rm_instr) || (handler == sub_rm_instr) || (handler == cmp_rm_instr)) {
+        alu->host_op = (handler == add_rm_instr) ? 0x01 : 0x29;
+        alu->op_type = (handler == add_rm_instr) ? ADD_OP : SUB_OP;
+        alu->res_type = JIT_RES_INT16;
+        alu->write = handler != cmp_rm_instr;
+    } else if((handler == and_rm_instr) || (handler == test_rm_instr) || (handler == or_rm_instr) || (handler == xor_rm_instr)) {
+        alu->host_op = (handler == or_rm_instr) ? 0x09 : (handler == xor_rm_instr) ? 0x31 : 0x21;
+        alu->op_type = LOGIC_OP;
+        alu->res_type = JIT_RES_UINT16;
+        alu->write = handler != test_rm_instr;
+    } else {
+        return 0;
+    }
+    uint8_t word = instr->opcode & 0x01;
+    uint8_t to_reg = instr->opcode & 0x02;      // REG is the destination
+    uint8_t src = to_reg ? instr->rm : instr->reg;
+    uint8_t dst = to_reg ? instr->reg : instr->rm;
+    alu->width = (handler == cmp_rm_instr) ? 1 : (word ? 2 : 1);    // CMP records num_bytes
+    alu->dst_load = word ? JIT_LOAD_SX16 : JIT_LOAD_ZX8;
+    alu->dst_offset = word ? reg16_offset(dst) : reg8_offset(dst);
+    alu->src_load = alu->dst_load;
+    alu->src_offset = word ? reg16_offset(src) : reg8_offset(src);
+    alu->decodes = 1;
+    return 1;
+}
+
+// Short jumps with a native form and the flag they test, -1 for the jumps on CX
+typedef struct {
+    instr_handler_t handler;
+    int8_t flag;
+    uint8_t or_zf;          // JBE jumps on CF OR ZF
+    uint8_t taken_if;
+} jit_jump_t;
+
+static const jit_jump_t jit_jumps[] = {
+    {jb_instr, CF, 0, 1},
+    {jnb_instr, CF, 0, 0},
+    {je_instr, ZF, 0, 1},
+    {jne_instr, ZF, 0, 0},
+    {jbe_instr, CF, 1, 1},
+    {js_instr, SF, 0, 1},
+    {jns_instr, SF, 0, 0},
+    {jp_instr, PF, 0, 1},
+    {jnp_instr, PF, 0, 0},
+    {loop_instr, -1, 0, 1},
+    {jcxz_instr, -1, 0, 1},
+};
+
+static const jit_jump_t *jit_jump(decoded_instr_t *instr) {
+    for(uint32_t i=0; i<sizeof(jit_jumps)/sizeof(jit_jumps[0]); i++) {
+        if(jit_jumps[i].handler == instr->handler) {
+            return &jit_jumps[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns 1 if the instruction at ip is translated to native code instead of calling the handler
+uint8_t jit_can_translate(decoded_instr_t *instr, uint16_t ip, jit_flags_t *flags) {
+    if(is_bios_checkpoint(ip) || ((uint16_t)(ip + instr->length) == 0xF9A9)) {
+        return 0;
+    }
+    if((instr->opcode >= 0xB0) && (instr->opcode <= 0xBF)) {   // MOV REG, IMMED
+        return 1;
+    }
+    if((instr->opcode >= 0x88) && (instr->opcode <= 0x8B)) {   // MOV REG, REG
+        return instr->mod == 3;
+    }
+    jit_alu_t alu;
+    if(jit_alu_operation(instr, &alu)) {
+        return 1;
+    }
+    const jit_jump_t *jump = jit_jump(instr);
+    if(jump == NULL) {
+        return 0;
+    }
+    if((uint16_t)(ip + instr->length + (int8_t)instr->immed) == 0xF9A9) {
+        return 0;
+    }
+    // get_lazy_flag() computes CF, ZF, SF and PF without materializing them for the widths 1 and 2
+    return (jump->flag < 0) || (flags->width == 1) || (flags->width == 2);
+}
+
+// Loads a register of registers_t or an immediate into EAX (reg 0) or ECX (reg 1)
+static void emit_load(uint8_t load, uint8_t offset, uint32_t immed, uint8_t reg) {
+    static const uint8_t movx[4] = {0xB6, 0xBE, 0xB7, 0xBF};   // movzx/movsx r32, byte/word
+    if(load == JIT_LOAD_IMMED) {
+        emit8(0xB8 + reg); emit32(immed);                                   // mov r32, imm32
+    } else {
+        emit8(0x0F); emit8(movx[load]); emit8(0x43 | (reg << 3)); emit8(offset);   // movzx/movsx r32, [rbx+offset]
+    }
+}
+
+static void emit_alu(jit_alu_t *alu) {
+    // Same as update_flags(): only the 8 and 16-bit ADD and SUB overwrite all the pending flags
+    uint8_t overwrites_all = ((alu->op_type == ADD_OP) || (alu->op_type == SUB_OP)) && ((alu->width == 1) || (alu->width == 2));
+    if(!overwrites_all) {
+        emit8(0x41); emit8(0x80); emit8(0x7D); emit8(offsetof(lazy_flags_t, pending)); emit8(0x00);   // cmp byte [r13+pending], 0
+        emit8(0x74); emit8(0x00);                                                                   // je skip
+        uint8_t *skip = jit_ptr;
+        emit_call((uint64_t)(uintptr_t)materialize_flags, 0);
+        skip[-1] = (uint8_t)(jit_ptr - skip);
+    }
+    if(alu->decodes) {
+        emit8(0xC7); emit8(0x43); emit8(offsetof(registers_t, override_segment)); emit32(invalid_register);   // mov dword [rbx+override_segment], 0
+    }
+    emit_load(alu->dst_load, alu->dst_offset, 0, 0);
+    emit_load(alu->src_load, alu->src_offset, alu->src_immed, 1);
+    emit8(0x41); emit8(0x89); emit8(0x45); emit8(offsetof(lazy_flags_t, dst));   // mov [r13+dst], eax
+    emit8(0x41); emit8(0x89); emit8(0x4D); emit8(offsetof(lazy_flags_t, src));   // mov [r13+src], ecx
+    emit8(alu->host_op); emit8(0xC8);                                           // OP eax, ecx
+    if(alu->res_type == JIT_RES_INT16) {
+        emit8(0x0F); emit8(0xBF); emit8(0xC0);                                  // movsx eax, ax
+    } else if(alu->res_type == JIT_RES_UINT16) {
+        emit8(0x0F); emit8(0xB7); emit8(0xC0);                                  // movzx eax, ax
+    }
+    emit8(0x41); emit8(0x89); emit8(0x45); emit8(offsetof(lazy_flags_t, res));   // mov [r13+res], eax
+    if(alu->write && (alu->dst_load >= JIT_LOAD_ZX16)) {
+        emit8(0x66); emit8(0x89); emit8(0x43); emit8(alu->dst_offset);         // mov [rbx+dst], ax
+    } else if(alu->write) {
+        emit8(0x88); emit8(0x43); emit8(alu->dst_offset);                       // mov [rbx+dst], al
+    }
+    emit8(0x41); emit8(0xC6); emit8(0x45); emit8(offsetof(lazy_flags_t, pending)); emit8(1);          // mov byte [r13+pending], 1
+    emit8(0x41); emit8(0xC6); emit8(0x45); emit8(offsetof(lazy_flags_t, width)); emit8(alu->width);  // mov byte [r13+width], width
+    emit8(0x41); emit8(0xC7); emit8(0x45); emit8(offsetof(lazy_flags_t, op_type)); emit32(alu->op_type);   // mov dword [r13+op_type], op
+}
+
+// Leaves the flag of the pending operation in AL, computed like get_lazy_flag() does
+static void emit_lazy_flag(flag_t flag, jit_flags_t *flags) {
+    uint32_t mask = (flags->width == 1) ? 0xFF : 0xFFFF;
+    if((flag == CF) && (flags->op_type == LOGIC_OP)) {
+        emit8(0x31); emit8(0xC0);                                               // xor eax, eax
+    } else if(flag == CF) {     // ADD: (res & mask) < (dst & mask), SUB: (dst & mask) < (src & mask)
+        uint8_t add = flags->op_type == ADD_OP;
+        emit8(0x41); emit8(0x8B); emit8(0x45); emit8(add ? offsetof(lazy_flags_t, res) : offsetof(lazy_flags_t, dst));   // mov eax, [r13+a]
+        emit8(0x25); emit32(mask);                                              // and eax, mask
+        emit8(0x41); emit8(0x8B); emit8(0x4D); emit8(add ? offsetof(lazy_flags_t, dst) : offsetof(lazy_flags_t, src));   // mov ecx, [r13+b]
+        emit8(0x81); emit8(0xE1); emit32(mask);                                 // and ecx, mask
+        emit8(0x39); emit8(0xC8);                                               // cmp eax, ecx
+        emit8(0x0F); emit8(0x92); emit8(0xC0);                                  // setb al
+    } else {
+        emit8(0x41); emit8(0x8B); emit8(0x45); emit8(offsetof(lazy_flags_t, res));   // mov eax, [r13+res]
+        if(flag == PF) {        // The host PF is the parity of the low byte as well
+            emit8(0x84); emit8(0xC0);                                           // test al, al
+            emit8(0x0F); emit8(0x9A); emit8(0xC0);                              // setp al
+        } else {
+            emit8(0xA9); emit32((flag == ZF) ? mask : ((flags->width == 1) ? 0x80 : 0x8000));   // test eax, imm32
+            emit8(0x0F); emit8((flag == ZF) ? 0x94 : 0x95); emit8(0xC0);        // sete/setne al
+        }
+    }
+}
+
+// The jump ends the block, so the IP it sets is where the compiled code returns
+static void emit_jump(decoded_instr_t *instr, const jit_jump_t *jump, jit_flags_t *flags) {
+    emit8(0x66); emit8(0x83); emit8(0x43); emit8(offsetof(registers_t, IP)); emit8(instr->length);  // add word [rbx+IP], len
+    if(jump->handler == loop_instr) {
+        emit8(0x66); emit8(0xFF); emit8(0x4B); emit8(reg16_offset(1));         // dec word [rbx+CX]
+        emit8(0x0F); emit8(0x95); emit8(0xC0);                                  // setne al
+    } else if(jump->handler == jcxz_instr) {
+        emit8(0x66); emit8(0x83); emit8(0x7B); emit8(reg16_offset(1)); emit8(0x00);   // cmp word [rbx+CX], 0
+        emit8(0x0F); emit8(0x94); emit8(0xC0);                                  // sete al
+    } else if(jump->or_zf) {
+        emit_lazy_flag(CF, flags);
+        emit8(0x88); emit8(0xC2);                                               // mov dl, al
+        emit_lazy_flag(ZF, flags);
+        emit8(0x08); emit8(0xD0);                                               // or al, dl
+    } else {
+        emit_lazy_flag(jump->flag, flags);
+    }
+    emit8(0x84); emit8(0xC0);                                                   // test al, al
+    emit8(jump->taken_if ? 0x74 : 0x75); emit8(5);                              // jz/jnz over the jump
+    emit8(0x66); emit8(0x83); emit8(0x43); emit8(offsetof(registers_t, IP)); emit8((uint8_t)instr->immed);  // add word [rbx+IP], IP-INC8
+}
+
+static void emit_translated(decoded_instr_t *instr, jit_flags_t *flags) {
+    uint8_t op = instr->opcode;
+    jit_alu_t alu;
+    const jit_jump_t *jump = jit_jump(instr);
+    emit8(0x49); emit8(0xFF); emit8(0x04); emit8(0x24);                 // inc qword [r12] (system ticks)
+    emit_inc_dword(&processed_commands[op]);
+    emit8(0x48); emit8(0xFF); emit8(0x43); emit8(offsetof(registers_t, ticks));     // inc qword [rbx+ticks]
+    if(jump) {
+        emit_jump(instr, jump, flags);
+        return;
+    }
+    if(jit_alu_operation(instr, &alu)) {
+        emit_alu(&alu);
+        flags->width = alu.width;
+        flags->op_type = alu.op_type;
+    } else if(op >= 0xB8) {     // mov word [rbx+reg], imm16
+        emit8(0x66); emit8(0xC7); emit8(0x43); emit8(reg16_offset(op)); emit16(instr->immed);
+    } else if(op >= 0xB0) {     // mov byte [rbx+reg], imm8
+        emit8(0xC6); emit8(0x43); emit8(reg8_offset(op)); emit8((uint8_t)instr->immed);
+    } else {
+        uint8_t word = op & 0x01;
+        uint8_t to_reg = op & 0x02;     // 0x8A, 0x8B: REG is the destination
+        uint8_t src = to_reg ? instr->rm : instr->reg;
+        uint8_t dst = to_reg ? instr->reg : instr->rm;
+        // decode_operands() consumes a pending segment override even in the register mode
+        emit8(0xC7); emit8(0x43); emit8(offsetof(registers_t, override_segment)); emit32(invalid_register);   // mov dword [rbx+override_segment], 0
+        if(word) {
+            emit8(0x66); emit8(0x8B); emit8(0x43); emit8(reg16_offset(src));   // mov ax, [rbx+src]
+            emit8(0x66); emit8(0x89); emit8(0x43); emit8(reg16_offset(dst));   // mov [rbx+dst], ax
+        } else {
+            emit8(0x8A); emit8(0x43); emit8(reg8_offset(src));                 // mov al, [rbx+src]
+            emit8(0x88); emit8(0x43); emit8(reg8_offset(dst));                 // mov [rbx+dst], al
+        }
+    }
+    emit8(0x66); emit8(0x83); emit8(0x43); emit8(offsetof(registers_t, IP)); emit8(instr->length);  // add word [rbx+IP], len
+}
+
+// Differential mode: runs the instruction through the interpreter on a copy of the registers
+int jit_check_before(decoded_instr_t *instr) {
+    registers_t *regs = REGS;
+    lazy_flags_t flags = lazy_flags;
+    jit_shadow_regs = *regs;
+    REGS = &jit_shadow_regs;
+    execute_instruction(instr);
+    processed_commands[instr->opcode]--;    // Counted by the compiled code
+    REGS = regs;
+    jit_shadow_flags = lazy_flags;          // The compiled code starts from the same pending operation
+    lazy_flags = flags;
+    return 0;
+}
+
+static uint8_t lazy_flags_equal(lazy_flags_t *a, lazy_flags_t *b) {
+    return (a->pending == b->pending) && (a->width == b->width) && (a->op_type == b->op_type) &&
+           (a->dst == b->dst) && (a->src == b->src) && (a->res == b->res);
+}
+
+int jit_check_after(decoded_instr_t *instr) {
+    if((memcmp(REGS, &jit_shadow_regs, sizeof(registers_t)) == 0) && lazy_flags_equal(&lazy_flags, &jit_shadow_flags)) {
+        return 0;
+    }
+    printf("ERROR: JIT result differs from the interpreter at 0x%05X, opcode 0x%02X\n", instr->addr, instr->opcode);
+    block_status = EXIT_FAILURE;
+    return 1;
+}
+
+static void jit_reset_arena(void) {
+    jit_arena_used = 0;
+    for(uint32_t i=0; i<BLOCK_CACHE_SIZE; i++) {
+        block_cache[i].jit_code = NULL;
+    }
+}
+
+void jit_compile_block(block_t *block) {
+    if(jit_arena == NULL) {
+        jit_arena = alloc_exec_memory(JIT_ARENA_SIZE);
+        if(jit_arena == NULL) {
+            printf("ERROR: Cannot allocate JIT code memory, JIT is disabled\n");
+            jit_mode = JIT_OFF;
+            return;
+        }
+    }
+    if(jit_arena_used + JIT_MAX_BLOCK_CODE > JIT_ARENA_SIZE) {
+        jit_reset_arena();
+    }
+    uint8_t *start = jit_arena + jit_arena_used;
+    jit_ptr = start;
+    // The epilogue goes first so that all the exits are backward jumps to a known address
+    uint8_t *epilogue = jit_ptr;
+    emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x20);     // add rsp, 32
+    emit8(0x41); emit8(0x5D);                               // pop r13
+    emit8(0x41); emit8(0x5C);                               // pop r12
+    emit8(0x5B);                                            // pop rbx
+    emit8(0xC3);                                            // ret
+    uint8_t *entry = jit_ptr;
+    emit8(0x53);                                            // push rbx
+    emit8(0x41); emit8(0x54);                               // push r12
+    emit8(0x41); emit8(0x55);                               // push r13
+    emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x20);     // sub rsp, 32 (Win64 shadow space)
+    emit_mov_rax_imm64((uint64_t)(uintptr_t)&REGS);
+    emit8(0x48); emit8(0x8B); emit8(0x18);                  // mov rbx, [rax]
+    emit_mov_rax_imm64((uint64_t)(uintptr_t)&system_ticks);
+    emit8(0x4C); emit8(0x8B); emit8(0x20);                  // mov r12, [rax]
+    emit8(0x49); emit8(0xBD); emit64((uint64_t)(uintptr_t)&lazy_flags);    // mov r13, imm64
+    uint16_t ip = block->ip;
+    jit_flags_t flags = {0, ADD_OP};
+    for(uint32_t i=0; i<block->num_instr; i++) {
+        decoded_instr_t *instr = &block->instr[i];
+        if(jit_can_translate(instr, ip, &flags)) {
+            if(jit_mode == JIT_DIFFERENTIAL) {
+                emit_call((uint64_t)(uintptr_t)jit_check_before, (uint64_t)(uintptr_t)instr);
+            }
+            emit_translated(instr, &flags);
+            if(jit_mode == JIT_DIFFERENTIAL) {
+                emit_call((uint64_t)(uintptr_t)jit_check_after, (uint64_t)(uintptr_t)instr);
+                emit_jump_if_nonzero(epilogue);
+            }
+            emit_inc_dword(&block_done);
+        } else {
+            emit_call((uint64_t)(uintptr_t)block_step, (uint64_t)(uintptr_t)instr);
+            emit_jump_if_nonzero(epilogue);
+            flags.width = 0;        // The handler may have changed the pending operation
+        }
+        ip += instr->length;
+    }
+    emit8(0xE9);                                            // jmp epilogue
+    emit32((uint32_t)(epilogue - (jit_ptr + 4)));
+    jit_arena_used += jit_ptr - start;
+    block->jit_code = (jit_func_t)entry;
+    jit_blocks_compiled++;
+}
+
+/* Switches the JIT tier at runtime: JIT_OFF, JIT_ON or JIT_DIFFERENTIAL.
+   The compiled code is dropped, so the blocks are recompiled for the new mode */
+DLL_PREFIX
+void cpu_set_jit_mode(uint8_t mode) {
+    if((mode != JIT_OFF) && !JIT_SUPPORTED) {
+        printf("ERROR: JIT is not supported on this host\n");
+        return;
+    }
+    if(mode > JIT_DIFFERENTIAL) {
+        printf("ERROR: Invalid JIT mode: %d\n", mode);
+        return;
+    }
+    jit_mode = mode;
+    jit_reset_arena();
+}
+
+// Executes one instruction of the running block, returns 1 if the block has to be left
+int block_step(decoded_instr_t *instr) {
+    uint16_t next_ip = REGS->IP + instr->length;
+    uint8_t rep = get_prefix(REPE) || get_prefix(REPNE);
+    uint32_t budget = block_max_ticks - block_done;
+    ticks_num++;
+    rep_max_elements = rep_ticks_elements(instr->opcode, budget);
+    block_status = execute_instruction(instr);
+    rep_max_elements = 1;
+    uint32_t extra = instruction_ticks(instr, rep, next_ip) - 1;
+    if(block_status != EXIT_SUCCESS) {
+        return 1;
+    }
+    if(extra >= budget) {   // The rest of the instruction cycles are spent by the next module_run() or module_tick()
+        REGS->wait_cycles = extra - (budget - 1);
+        extra = budget - 1;
+    }
+    ticks_num += extra;
+    REGS->ticks += extra;
+    block_done += 1 + extra;
+    return REGS->wait_cycles || (block_done >= block_max_ticks) || (REGS->IP != next_ip) || (REGS->CS != running_cs) ||
+           (code_page_generation[(running_block->addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1)] != running_block->generation);
+}
+
+/* Runs up to max_ticks instructions (one per tick, or the ticks of their clock cycles
+   in CPU_TIMING_CYCLES mode) as a single basic block.
+   Interrupts are checked once at the block start, the block ends early when
+   the control flow leaves it or the code it was built from is modified.
+   system_ticks is advanced here, done_ticks returns the number of executed ticks */
+DLL_PREFIX
+int module_run(uint32_t max_ticks, uint32_t *done_ticks) {
+    uint32_t waited = spend_wait_cycles(max_ticks);
+    if(waited < max_ticks) {
+        check_interrupt();
+        waited += spend_wait_cycles(max_ticks - waited);
+    }
+    if(waited == max_ticks) {
+        *done_ticks = waited;
+        return EXIT_SUCCESS;
+    }
+    block_t *block = fetch_block(((uint32_t)REGS->CS << 4) + REGS->IP);
+    running_block = block;
+    running_cs = REGS->CS;
+    block_done = waited;
+    block_max_ticks = max_ticks;
+    block_status = EXIT_SUCCESS;
+    block->hits++;
+    // Compiled blocks skip the per-instruction trace, so they only run while the CPU log is off.
+    // The translated instructions take one tick each, so the cycle timing is interpreted only
+    uint8_t native = (jit_mode != JIT_OFF) && (timing_mode == CPU_TIMING_INSTRUCTIONS) && (block->ip == REGS->IP) && (block->num_instr <= max_ticks) && (device_log_level > 0);
+    if(native && (block->jit_code == NULL) && (block->hits >= JIT_HOT_THRESHOLD)) {
+        jit_compile_block(block);
+    }
+    if(native && block->jit_code) {
+        block->jit_code();
+    } else {
+        uint32_t num = (block->num_instr < max_ticks) ? block->num_instr : max_ticks;
+        for(uint32_t i=0; i<num; i++) {
+            if(block_step(&block->instr[i])) {
+                break;
+            }
+        }
+    }
+    *done_ticks = block_done;
+    return block_status;
+}
+
 void dummy_nmi_cb(uint8_t new_state) {
     if(new_state == 1)
         mylog(1, "logs/main.log", "NMI activated\n");
@@ -3459,7 +3845,7 @@ void int_cb(uint8_t new_state) {
 }
 
 DLL_PREFIX
-uint32_t cpu_get_ticks(void) {
+uint64_t cpu_get_ticks(void) {
     return REGS->ticks;
 }
 
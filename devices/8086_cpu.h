@@ -60,8 +60,19 @@ operands_t decode_operands(uint8_t opcode, uint8_t *data, uint8_t single);
 // API functions:
 void connect_address_space(uint8_t space_type, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func));
 void set_code_read_func(READ_FUNC_PTR(read_func));
+void set_memory_map(uint8_t *ram, uint8_t *page_attrs);
+void cpu_invalidate_code(uint32_t addr);
 void module_reset(void);
 void module_save(void);
 void module_restore(void);
+void module_checkpoint(void);
+void module_restore_checkpoint(uint64_t tick);
+void module_rewind_save(uint32_t slot);
+void module_rewind_restore(uint32_t slot);
 int module_tick(uint32_t ticks);
-uint32_t cpu_get_ticks(void);
+int module_run(uint32_t max_ticks, uint32_t *done_ticks);
+void cpu_print_block_stats(void);
+void cpu_set_jit_mode(uint8_t mode);
+void cpu_set_timing(uint8_t mode);
+uint64_t cpu_get_ticks(void);
+uint16_t *cpu_get_register_ptr(uint8_t reg);
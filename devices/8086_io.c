@@ -6,8 +6,7 @@
 #include <string.h>
 
 #define IO_LOG_FILE "logs/io_log.txt"
-#define IO_DUMP_FILE "data/io_dump.bin"
-#define IO_SPACE_SIZE 0x100000
+#define IO_PORTS_NUM 0x10000
 
 #define DEVICE_NAME         "IO_SPACE"
 #define DEVICE_LOG_FILE     IO_LOG_FILE
@@ -26,10 +25,10 @@ typedef struct {
     map_t *dev_table;
 } dev_table_t;
 
-uint8_t *IO_SPACE = NULL;
 dev_table_t io_space;
 int io_error = 0;
-size_t ticks_num = 0;
+// dev_table index + 1 of the device mapped at every port, 0 if there is no device
+static uint16_t port_table[IO_PORTS_NUM];
 
 static uint32_t get_id(uint32_t val1, uint32_t val2) {
     uint32_t id = (val1 & 0xFFFF) | ((val2 & 0xFFFF) << 16);
@@ -37,24 +36,21 @@ static uint32_t get_id(uint32_t val1, uint32_t val2) {
 }
 
 /* Checks if the new address range overlaps one of existing, returns range id if there is an overlap, othervwise returns 0 */
-static uint8_t range_overlaps(uint32_t start, uint32_t end) {
-    if(io_space.dev_table == NULL) {
-        return 0;
-    }
-    for(uint32_t i=0; i<io_space.num_devices; i++) {
-        if(io_space.dev_table[i].id == 0) {    // device was unmapped
-            continue;
-        }
-        if(io_space.dev_table[i].start <= start && io_space.dev_table[i].end >= start) {
-            return 1;
-        }
-        if(io_space.dev_table[i].start <= end && io_space.dev_table[i].end >= end) {
-            return 1;
+static uint32_t range_overlaps(uint32_t start, uint32_t end) {
+    for(uint32_t addr=start; addr<=end; addr++) {
+        if(port_table[addr]) {
+            return io_space.dev_table[port_table[addr] - 1].id;
         }
     }
     return 0;
 }
 
+static void set_ports(uint32_t start, uint32_t end, uint16_t value) {
+    for(uint32_t addr=start; addr<=end; addr++) {
+        port_table[addr] = value;
+    }
+}
+
 static void add_device(uint32_t index, uint32_t id, uint32_t start_addr, uint32_t end_addr, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func)) {
     io_space.dev_table[index].start = start_addr;
     io_space.dev_table[index].end = end_addr;
@@ -81,6 +77,7 @@ static uint8_t check_allocation(void) {
             io_error = 1;
             return 0;
         }
+        io_space.size += 10;
     }
     return 1;
 }
@@ -89,8 +86,13 @@ static uint8_t check_allocation(void) {
 DLL_PREFIX
 uint32_t map_device(uint32_t start_addr, uint32_t end_addr, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func)) {
     uint32_t id = get_id(start_addr, end_addr);
+    if((start_addr > end_addr) || (end_addr >= IO_PORTS_NUM)) {
+        printf("MAPPING ERROR: invalid address range 0x%08X-0x%08X\n", start_addr, end_addr);
+        io_error = 1;
+        return 0;
+    }
     uint32_t overlaps_id = range_overlaps(start_addr, end_addr);
-    if(range_overlaps(start_addr, end_addr)) {
+    if(overlaps_id) {
         printf("MAPPING ERROR: new device ranges 0x%08X overlaps existing 0x%08X", id, overlaps_id);
         io_error = 1;
         return 0;
@@ -98,18 +100,18 @@ uint32_t map_device(uint32_t start_addr, uint32_t end_addr, WRITE_FUNC_PTR(write
     if(!check_allocation()) {   // Allocation failed
         return 0;
     }
-    uint8_t found_free_cell = 0;
+    uint32_t index = io_space.num_devices;
     for(uint32_t i=0; i<io_space.num_devices; i++) {
         if(io_space.dev_table[i].id == 0) {    // device was unmapped
-            add_device(i, id, start_addr, end_addr, write_func, read_func);
-            found_free_cell = 1;
+            index = i;
             break;
         }
     }
-    if(!found_free_cell) {
-        add_device(io_space.num_devices, id, start_addr, end_addr, write_func, read_func);
+    add_device(index, id, start_addr, end_addr, write_func, read_func);
+    if(index == io_space.num_devices) {
         io_space.num_devices += 1;
     }
+    set_ports(start_addr, end_addr, index + 1);
     if(!check_allocation()) {   // Allocation failed
         return 0;
     }
@@ -123,6 +125,7 @@ void unmap_device(uint32_t id) {
     for(uint32_t i=0; i<io_space.num_devices; i++) {
         if(io_space.dev_table[i].id == id) {
             io_space.dev_table[i].id = 0;
+            set_ports(io_space.dev_table[i].start, io_space.dev_table[i].end, 0);
             mylog(0, IO_LOG_FILE, "Device 0x%08X was successfully unmapped\n", id);
         }
     }
@@ -132,21 +135,15 @@ uint8_t port213;
 
 DLL_PREFIX
 void data_write(uint32_t addr, uint16_t value, uint8_t width) {
-    uint8_t addr_found = 0;
-    for(uint32_t i=0; i<io_space.num_devices; i++) {
-        if(io_space.dev_table[i].id == 0) {
-            continue;
-        }
-        if((io_space.dev_table[i].start) <= addr && (io_space.dev_table[i].end >= addr)) {
-            io_space.dev_table[i].write_func(addr, value, width);
-            addr_found = 1;
-        }
-    }
-    if(!addr_found) {
+    uint16_t device = (addr < IO_PORTS_NUM) ? port_table[addr] : 0;
+    if(device) {
+        io_space.dev_table[device - 1].write_func(addr, value, width);
+    } else {
         printf("IO_WRITE ERROR: No device at address 0x%08X!\n", addr);
         io_error = 1;
+        request_service();
     }
-    mylog(0, IO_LOG_FILE, "%lld, IO_WRITE addr = 0x%04X, value = 0x%04X, width = %d bytes\n", ticks_num, addr, value, width);
+    mytrace(TRACE_IO_WRITE, addr, value, width);
     
     // if ((addr >= 0x3B0) && (addr <= 0x3DC)) {
     //     mda_write(addr, value, width);
@@ -174,22 +171,15 @@ uint16_t data_read(uint32_t addr, uint8_t width) {
     if(width == 2) {
         ret_val = 0xFFFF;
     }
-    uint8_t addr_found = 0;
-    
-    for(uint32_t i=0; i<io_space.num_devices; i++) {
-        if(io_space.dev_table[i].id == 0) {
-            continue;
-        }
-        if((io_space.dev_table[i].start) <= addr && (io_space.dev_table[i].end >= addr)) {
-            ret_val = io_space.dev_table[i].read_func(addr, width);
-            addr_found = 1;
-        }
-    }
-    if(!addr_found) {
+    uint16_t device = (addr < IO_PORTS_NUM) ? port_table[addr] : 0;
+    if(device) {
+        ret_val = io_space.dev_table[device - 1].read_func(addr, width);
+    } else {
         printf("IO_READ ERROR: No device at address 0x%08X!\n", addr);
         io_error = 1;
+        request_service();
     }
-    mylog(0, IO_LOG_FILE, "%lld, IO_READ addr = 0x%04X, width = %d bytes value: 0x%04X\n", ticks_num, addr, width, ret_val);
+    mytrace(TRACE_IO_READ, addr, ret_val, width);
     // if(width == 1) {
     //     ret_val = 0xFF;
     // } else if (width == 2) {
@@ -218,48 +208,12 @@ uint16_t data_read(uint32_t addr, uint8_t width) {
     return ret_val;
 }
 
-int store_io(void) {
-    FILE *file = fopen(IO_DUMP_FILE, "wb");
-    if (file == NULL) {
-        printf("Failed to open file %s\n", IO_DUMP_FILE);
-        io_error = 1;
-        return  EXIT_FAILURE;
-    }
-    fwrite(IO_SPACE, IO_SPACE_SIZE, 1, file);
-    fclose(file);
-    return EXIT_SUCCESS;
-}
-
-int restore_io(uint8_t *io_space, const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (file == NULL) {
-        printf("Failed to open file %s\n", filename);
-        io_error = 1;
-        return  EXIT_FAILURE;
-    }
-    uint8_t *ptr = io_space;
-    size_t bytes_read = 0;
-    while((bytes_read = fread(ptr, 1, 1, file)) > 0) {
-        ptr++;
-    }
-    fclose(file);
-    return EXIT_SUCCESS;
-}
-
+/* The IO space has no memory of its own, the port map is built by map_device() and stays across resets */
 DLL_PREFIX
 void module_reset(void) {
-    IO_SPACE = (uint8_t*)calloc(sizeof(uint8_t), IO_SPACE_SIZE);
     // mda_init();
     // ppi_init();
     // timer_init();
-    if(IO_SPACE == NULL) {
-        printf("IO ERROR: Failed to allocate memory\n");
-        io_error = 1;
-        return;
-    }
-    // if(continue_simulation) {
-    //     restore_io(IO_SPACE, IO_DUMP_FILE);
-    // }
     // FILE *f;
     // f = fopen(IO_LOG_FILE, "a");
     // if(f == NULL) {
@@ -277,19 +231,43 @@ int get_io_error(void) {
 
 DLL_PREFIX
 void module_save(void) {
-    store_data(IO_SPACE, IO_SPACE_SIZE, IO_DUMP_FILE);
+    return;
 }
 
 DLL_PREFIX
 void module_restore(void) {
-    uint8_t temp[IO_SPACE_SIZE] = {0};
-    if(EXIT_SUCCESS == restore_data(temp, IO_SPACE_SIZE, IO_DUMP_FILE)) {
-        memcpy(IO_SPACE, temp, IO_SPACE_SIZE);
-    }
+    return;
+}
+
+DLL_PREFIX
+void module_checkpoint(void) {
+    return;
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    return;
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    return;
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    return;
 }
 
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    ticks_num = ticks;
     return io_error;
+}
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    if(io_error) {
+        return 1;   // Report the error on the next tick
+    }
+    return NO_PENDING_EVENT;
 }
\ No newline at end of file
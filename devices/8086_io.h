@@ -4,7 +4,6 @@
 #include <stdlib.h>
 #include "utils.h"
 
-int store_io(void);
 int get_io_error(void);     // Returns 1 if there is an IO error, otherwise returns 0
 
 // API functions:
@@ -15,4 +14,9 @@ uint16_t data_read(uint32_t addr, uint8_t width);
 void module_reset(void);
 void module_save(void);
 void module_restore(void);
-int module_tick(uint32_t ticks);
\ No newline at end of file
+void module_checkpoint(void);
+void module_restore_checkpoint(uint64_t tick);
+void module_rewind_save(uint32_t slot);
+void module_rewind_restore(uint32_t slot);
+int module_tick(uint32_t ticks);
+uint32_t module_next_event(uint32_t ticks);
\ No newline at end of file
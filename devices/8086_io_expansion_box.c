@@ -6,8 +6,6 @@
 #define DEVICE_LOG_FILE     "logs/io_expansion_box.log"
 #define DEVICE_DATA_FILE    "data/io_expansion_box.bin"
 
-size_t ticks_num = 0;
-
 DLL_PREFIX
 void module_reset(void) {
     return;
@@ -35,7 +33,32 @@ void module_restore(void) {
     return;
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    return;
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    return;
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    return;
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    return;
+}
+
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
     return 0;
 }
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    return NO_PENDING_EVENT;
+}
\ No newline at end of file
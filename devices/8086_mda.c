@@ -6,6 +6,8 @@
 #define DEVICE_LOG_FILE     "logs/mda.log"
 #define DEVICE_DATA_FILE    "data/mda.bin"
 
+#define STATUS_TOGGLE_TICKS 21  // Retrace bits of the status register toggle every STATUS_TOGGLE_TICKS ticks
+
 typedef struct {    // | Type                       | I/O | 40x25 | 80x25 | Graphic Modes
     uint8_t R0;     // | Horizontal total           | WO  | 0x38  | 0x71  | 0x38
     uint8_t R1;     // | Horizontal displayed       | WO  | 0x28  | 0x50  | 0x28
@@ -27,16 +29,16 @@ typedef struct {    // | Type                       | I/O | 40x25 | 80x25 | Grap
     uint8_t R17;    // | Light Pen L                | RO  | 0xXX  | 0xXX  | 0xXX
     uint8_t status_register;
     uint8_t mode_control_register;
+    uint64_t status_toggle_tick;    // Tick of the next toggle of the retrace bits
 } device_regs_t;
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
-
 DLL_PREFIX
 void module_reset(void) {
     memset(&regs, 0, sizeof(device_regs_t));
     regs.status_register = 0x09;
+    regs.status_toggle_tick = ticks_num + STATUS_TOGGLE_TICKS;
 }
 
 DLL_PREFIX
@@ -80,13 +82,39 @@ void module_restore(void) {
     }
 }
 
-size_t counter = 0;
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+}
 
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    if(counter++ == 20) {
+    if(ticks_num >= regs.status_toggle_tick) {
         regs.status_register ^= 0x09;
-        counter = 0;
+        regs.status_toggle_tick = ticks_num + STATUS_TOGGLE_TICKS;
     }
     return 0;
 }
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    if(ticks_num >= regs.status_toggle_tick) {
+        return 1;
+    }
+    return regs.status_toggle_tick - ticks_num;
+}
\ No newline at end of file
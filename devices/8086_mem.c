@@ -18,10 +18,39 @@ char *BIOS_FILENAME_0XF8000 = "BIOS/08NOV82_F8000.BIN";
 
 #define MEMORY_SIZE 0x100000
 
-size_t ticks_num = 0;
+#define ROM_START   0xF0000     // BIOS ROM, writes into it are ignored
+
+// Handlers of MEM_PAGE_MMIO pages
+typedef struct {
+    uint32_t id;        // map_device() id
+    WRITE_FUNC_PTR(write_func);
+    READ_FUNC_PTR(read_func);
+} mem_page_t;
 
 static uint8_t *MEMORY = NULL;
 static uint8_t error = 0;
+// MEM_PAGE_* attributes of every page, shared with the CPU (mem_get_page_attrs())
+static uint8_t page_attrs[MEM_PAGES_NUM];
+static mem_page_t mem_pages[MEM_PAGES_NUM];
+static void(*code_write_hook)(uint32_t) = NULL;
+static void(*ram_map_hook)(uint8_t*, uint8_t*) = NULL;
+
+// Pages written between two checkpoints of the rewind ring
+typedef struct {
+    uint32_t pages_num;
+    uint32_t pages_max;     // Allocated size of data in pages
+    uint16_t pages[MEM_PAGES_NUM];
+    uint8_t *data;
+} rewind_delta_t;
+
+// The memory as of the oldest checkpoint of the rewind ring, the later checkpoints keep their deltas
+static uint8_t *rewind_base = NULL;
+static rewind_delta_t rewind_deltas[REWIND_SLOTS];
+static uint32_t rewind_oldest = 0;
+static uint32_t rewind_count = 0;   // Checkpoints in the ring
+
+static uint8_t backing = MEM_BACKING_NONE;
+static uint8_t ram_mapped = 0;      // The RAM is a map_file() view of the dump file
 
 size_t get_file_size(FILE *file) {
     size_t init_location = ftell(file);
@@ -37,21 +66,19 @@ int copy_bios_into_memory(uint8_t *memory, size_t offset, const char *filename)
         printf("MEMORY ERROR: Failed to open file %s\n", filename);
         return  EXIT_FAILURE;
     }
-    if (0x8000 < get_file_size(file)) {  // Check file size
+    size_t file_size = get_file_size(file);
+    if (0x8000 < file_size) {  // Check file size
         printf("MEMORY ERROR: File %s is too large!", filename);
+        fclose(file);
         return  EXIT_FAILURE;
     }
-    uint8_t *ptr = memory + offset; // Move the memory pointer to the specified offset
-    size_t bytes_read = 0;
-    while((bytes_read = fread(ptr, 1, 1, file)) > 0) {
-        ptr++;
-    }
+    size_t bytes_read = fread(memory + offset, 1, file_size, file);
     fclose(file);
-    return EXIT_SUCCESS;
+    return (bytes_read == file_size) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int store_memory(void) {
-    FILE *file = fopen(MEMORY_DUMP_FILE, "wb");
+    FILE *file = instance_fopen(MEMORY_DUMP_FILE, "wb");
     if (file == NULL) {
         printf("MEMORY ERROR: Failed to open file %s\n", MEMORY_DUMP_FILE);
         return  EXIT_FAILURE;
@@ -62,16 +89,12 @@ int store_memory(void) {
 }
 
 int restore_memory(uint8_t *memory, const char *filename) {
-    FILE *file = fopen(filename, "rb");
+    FILE *file = instance_fopen(filename, "rb");
     if (file == NULL) {
         printf("MEMORY ERROR: Failed to open file %s\n", filename);
         return  EXIT_FAILURE;
     }
-    uint8_t *ptr = memory;
-    size_t bytes_read = 0;
-    while((bytes_read = fread(ptr, 1, 1, file)) > 0) {
-        ptr++;
-    }
+    fread(memory, 1, MEMORY_SIZE, file);
     fclose(file);
     return EXIT_SUCCESS;
 }
@@ -92,24 +115,119 @@ uint8_t * mem_init(uint8_t continue_simulation) {
 }
 
 
+/* The hook is called on the first write into a page after code was fetched from it,
+   so the CPU can drop the decoded instructions of that page */
 DLL_PREFIX
-void data_write(uint32_t addr, uint16_t value, uint8_t width) {
-    // char video_buf[VIDEO_BUFFER_SIZE];
-    if((addr >= 0xA0000) && (addr < 0xC0000)) {
-        // if((MEMORY[VIDEO_BUFFER_OFFSET] >= 0x20) && (MEMORY[VIDEO_BUFFER_OFFSET] < 0x7F)) {
-        //     for(int i=0; i<VIDEO_BUFFER_SIZE; i++) {
-        //         video_buf[i] = MEMORY[VIDEO_BUFFER_OFFSET+(i*2)];
-        //     }
-        //     mylog(1, VIDEO_MEM_LOG_FILE, "VIDEO_BUF: %s", video_buf);
-        // }
-        mylog(0, VIDEO_MEM_LOG_FILE, "MEM_WRITE addr = 0x%06X, value = 0x%04X, width = %d byte(s)\n", addr, value, width);
-    }else {
-        mylog(0, MEMORY_LOG_FILE, "MEM_WRITE addr = 0x%06X, value = 0x%04X, width = %d byte(s)\n", addr, value, width);
+void set_code_write_hook(void(*hook)(uint32_t)) {
+    code_write_hook = hook;
+}
+
+/* The hook is called with the RAM and the page attributes when the RAM moves to another address (a map_file()
+   remap on Windows), the CPU takes them like from set_memory_map() */
+DLL_PREFIX
+void set_ram_map_hook(void(*hook)(uint8_t*, uint8_t*)) {
+    ram_map_hook = hook;
+}
+
+// Takes the RAM returned by map_file(), the CPU is told if it has moved
+static void move_ram(uint8_t *memory) {
+    if(memory == MEMORY) {
+        return;
     }
-    if(width == 1) {
+    MEMORY = memory;
+    if(ram_map_hook) {
+        ram_map_hook(MEMORY, page_attrs);
+    }
+}
+
+/* The CPU reads and writes plain RAM pages directly, the other accesses go through data_read()
+   and data_write(). The page attributes stay at the same address, the RAM is passed to the hook
+   of set_ram_map_hook() when it moves */
+DLL_PREFIX
+uint8_t *mem_get_ram(void) {
+    if(MEMORY == NULL) {
+        module_reset();
+    }
+    return MEMORY;
+}
+
+DLL_PREFIX
+uint8_t *mem_get_page_attrs(void) {
+    return page_attrs;
+}
+
+/* Called on writes into the RAM pages which are not accessed directly: the first write after
+   a checkpoint marks the page dirty, the first write after a code fetch drops the decoded code */
+void check_page_write(uint32_t addr) {
+    uint32_t page = (addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1);
+    page_attrs[page] &= ~(MEM_PAGE_CLEAN | MEM_PAGE_REWIND_CLEAN);
+    if(page_attrs[page] & MEM_PAGE_CODE) {
+        page_attrs[page] &= ~MEM_PAGE_CODE;
+        if(code_write_hook) {
+            code_write_hook(addr);
+        }
+    }
+}
+
+void invalidate_all_code(void) {
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        page_attrs[i] &= ~MEM_PAGE_CODE;
+    }
+    if(code_write_hook) {
+        code_write_hook(CODE_INVALIDATE_ALL);
+    }
+}
+
+// The next checkpoint stores all the pages
+static void mark_all_dirty(void) {
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        page_attrs[i] &= ~MEM_PAGE_CLEAN;
+    }
+}
+
+// Writes a byte through the page map, used for the accesses which are not plain RAM without code
+static void write_byte(uint32_t addr, uint8_t value) {
+    addr &= MEMORY_SIZE - 1;
+    uint8_t type = page_attrs[addr >> MEM_PAGE_SHIFT] & MEM_PAGE_TYPE_MASK;
+    if(type == MEM_PAGE_RAM) {
         MEMORY[addr] = value;
+        check_page_write(addr);
+    } else if(type == MEM_PAGE_MMIO) {
+        mem_pages[addr >> MEM_PAGE_SHIFT].write_func(addr, value, 1);
+    }   // Writes into ROM are ignored
+}
+
+static uint8_t read_byte(uint32_t addr) {
+    addr &= MEMORY_SIZE - 1;
+    if((page_attrs[addr >> MEM_PAGE_SHIFT] & MEM_PAGE_TYPE_MASK) == MEM_PAGE_MMIO) {
+        return mem_pages[addr >> MEM_PAGE_SHIFT].read_func(addr, 1);
+    }
+    return MEMORY[addr];
+}
+
+DLL_PREFIX
+void data_write(uint32_t addr, uint16_t value, uint8_t width) {
+    addr &= MEMORY_SIZE - 1;
+    mytrace(TRACE_MEM_WRITE, addr, value, width);
+    uint8_t attrs = page_attrs[addr >> MEM_PAGE_SHIFT];
+    if(width == 1) {
+        if(attrs == MEM_PAGE_RAM) {
+            MEMORY[addr] = value;
+        } else {
+            write_byte(addr, value);
+        }
     } else if (width == 2) {
-        *((uint16_t*)&(MEMORY[addr])) = value;
+        if((addr & (MEM_PAGE_SIZE - 1)) == (MEM_PAGE_SIZE - 1)) {   // The word crosses a page boundary
+            write_byte(addr, value & 0xFF);
+            write_byte(addr + 1, value >> 8);
+        } else if(attrs == MEM_PAGE_RAM) {
+            *((uint16_t*)&(MEMORY[addr])) = value;
+        } else if((attrs & MEM_PAGE_TYPE_MASK) == MEM_PAGE_MMIO) {
+            mem_pages[addr >> MEM_PAGE_SHIFT].write_func(addr, value, 2);
+        } else {    // ROM or RAM with code
+            write_byte(addr, value & 0xFF);
+            write_byte(addr + 1, value >> 8);
+        }
     } else {
         printf("MEM WRITE ERROR: Incorrect width: %d\n", width);
     }
@@ -117,19 +235,23 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
 
 DLL_PREFIX
 uint16_t data_read(uint32_t addr, uint8_t width) {
+    addr &= MEMORY_SIZE - 1;
     uint16_t ret_val = 0;
+    uint8_t type = page_attrs[addr >> MEM_PAGE_SHIFT] & MEM_PAGE_TYPE_MASK;
     if(width == 1) {
-        ret_val = MEMORY[addr];
+        ret_val = (type != MEM_PAGE_MMIO) ? MEMORY[addr] : mem_pages[addr >> MEM_PAGE_SHIFT].read_func(addr, 1);
     } else if (width == 2) {
-        ret_val = MEMORY[addr] + (MEMORY[addr+1] << 8);
+        if((addr & (MEM_PAGE_SIZE - 1)) == (MEM_PAGE_SIZE - 1)) {   // The word crosses a page boundary
+            ret_val = read_byte(addr) + (read_byte(addr + 1) << 8);
+        } else if(type != MEM_PAGE_MMIO) {
+            ret_val = MEMORY[addr] + (MEMORY[addr+1] << 8);
+        } else {
+            ret_val = mem_pages[addr >> MEM_PAGE_SHIFT].read_func(addr, 2);
+        }
     } else {
         printf("MEM READ ERROR: Incorrect width: %d", width);
     }
-    if((addr >= 0xA0000) && (addr < 0xC0000)) {
-        mylog(0, VIDEO_MEM_LOG_FILE, "MEM_READ  addr = 0x%06X, value = 0x%04X, width = %d byte(s)\n", addr, ret_val, width);
-    } else {
-        mylog(0, MEMORY_LOG_FILE, "MEM_READ  addr = 0x%06X, value = 0x%04X, width = %d byte(s)\n", addr, ret_val, width);
-    }
+    mytrace(TRACE_MEM_READ, addr, ret_val, width);
     return ret_val;
 }
 
@@ -139,7 +261,9 @@ uint16_t code_read(uint32_t addr, uint8_t width) {
     if(addr < 0xE0000) {
         printf("CODE READ ERROR: Read outside of code sector: 0x%08X\n", addr);
         error = 1;
+        request_service();
     }
+    page_attrs[(addr >> MEM_PAGE_SHIFT) & (MEM_PAGES_NUM - 1)] |= MEM_PAGE_CODE;
     if(width == 1) {
         ret_val = MEMORY[addr];
     } else if (width == 2) {
@@ -151,22 +275,275 @@ uint16_t code_read(uint32_t addr, uint8_t width) {
     return ret_val;
 }
 
+// The dump file is the RAM followed by its hash (store_data())
+static int read_dump_hash(FILE *file, uint64_t *hash) {
+    if((fseek(file, MEMORY_SIZE, SEEK_SET) != 0) || (fread(hash, sizeof(uint64_t), 1, file) != 1)) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Maps the dump file as the RAM, the CPU gets the new address if it moves (move_ram())
+static int attach_ram(uint8_t shared) {
+    uint64_t hash = 0;
+    FILE *file = instance_fopen(MEMORY_DUMP_FILE, "rb");
+    if((file == NULL) || (get_file_size(file) != (MEMORY_SIZE + sizeof(uint64_t))) || (read_dump_hash(file, &hash) != EXIT_SUCCESS)) {
+        printf("MEMORY ERROR: %s is not a memory dump\n", MEMORY_DUMP_FILE);
+        if(file) {
+            fclose(file);
+        }
+        error = 1;
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+    uint8_t *memory = (uint8_t*)map_file(MEMORY, MEMORY_SIZE, MEMORY_DUMP_FILE, shared);
+    if(memory == NULL) {   // The RAM stays as it was
+        printf("MEMORY ERROR: Failed to map file %s\n", MEMORY_DUMP_FILE);
+        error = 1;
+        return EXIT_FAILURE;
+    }
+    move_ram(memory);
+    ram_mapped = 1;
+    if(hash != get_hash(MEMORY, MEMORY_SIZE)) {
+        printf("ERROR: File %s corrupted (hash check failed)\n", MEMORY_DUMP_FILE);
+        error = 1;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// Moves the RAM back into the process memory, the content stays
+static int detach_ram(void) {
+    if(!ram_mapped) {
+        return EXIT_SUCCESS;
+    }
+    uint8_t *copy = (uint8_t*)malloc(MEMORY_SIZE);
+    if(copy == NULL) {
+        printf("MEMORY ERROR: Failed to allocate memory\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(copy, MEMORY, MEMORY_SIZE);
+    uint8_t *memory = (uint8_t*)map_file(MEMORY, MEMORY_SIZE, NULL, 0);
+    if(memory == NULL) {
+        printf("MEMORY ERROR: Failed to remap the RAM\n");
+        error = 1;
+        free(copy);
+        return EXIT_FAILURE;
+    }
+    move_ram(memory);
+    memcpy(MEMORY, copy, MEMORY_SIZE);
+    free(copy);
+    ram_mapped = 0;
+    return EXIT_SUCCESS;
+}
+
+/* Selects how the RAM is backed, the content stays:
+   MEM_BACKING_NONE    - process memory, module_restore() reads the dump into it
+   MEM_BACKING_PRIVATE - module_restore() maps the dump copy-on-write, nothing is read until it is accessed
+   MEM_BACKING_SHARED  - the RAM is written into the dump file and mapped from it, so the file shows the RAM
+                         while the machine runs and module_save() only updates the hash */
+DLL_PREFIX
+int mem_set_backing(uint8_t mode) {
+    if(MEMORY == NULL) {
+        module_reset();
+    }
+    if(detach_ram() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    backing = MEM_BACKING_NONE;
+    if(mode == MEM_BACKING_SHARED) {
+        if((store_data(MEMORY, MEMORY_SIZE, MEMORY_DUMP_FILE) != EXIT_SUCCESS) || (attach_ram(1) != EXIT_SUCCESS)) {
+            return EXIT_FAILURE;
+        }
+    }
+    backing = mode;
+    return EXIT_SUCCESS;
+}
+
 DLL_PREFIX
 void module_save(void) {
+    if(backing == MEM_BACKING_SHARED) {
+        uint64_t hash = get_hash(MEMORY, MEMORY_SIZE);
+        FILE *file = instance_fopen(MEMORY_DUMP_FILE, "r+b");
+        if(file == NULL) {
+            printf("MEMORY ERROR: Failed to open file %s\n", MEMORY_DUMP_FILE);
+            return;
+        }
+        fseek(file, MEMORY_SIZE, SEEK_SET);
+        fwrite(&hash, sizeof(hash), 1, file);
+        fclose(file);
+        sync_file_map(MEMORY, MEMORY_SIZE);
+        return;
+    }
+    detach_ram();   // The dump mapped by module_restore() is going to be rewritten
     store_data(MEMORY, MEMORY_SIZE, MEMORY_DUMP_FILE);
 }
 
 DLL_PREFIX
 void module_restore(void) {
-    uint8_t temp[MEMORY_SIZE] = {0};
-    if(EXIT_SUCCESS == restore_data(temp, MEMORY_SIZE, MEMORY_DUMP_FILE)) {
+    if(backing == MEM_BACKING_NONE) {
+        // The dump is read into a buffer first, a short or corrupted one leaves the RAM as it is
+        uint8_t *temp = (uint8_t*)malloc(MEMORY_SIZE);
+        if((temp == NULL) || (restore_data(temp, MEMORY_SIZE, MEMORY_DUMP_FILE) != EXIT_SUCCESS)) {
+            printf("MEMORY ERROR: Failed to restore the memory from %s\n", MEMORY_DUMP_FILE);
+            free(temp);
+            error = 1;
+            return;
+        }
         memcpy(MEMORY, temp, MEMORY_SIZE);
+        free(temp);
+    } else if(attach_ram(backing == MEM_BACKING_SHARED) != EXIT_SUCCESS) {
+        return;
+    }
+    invalidate_all_code();
+    mark_all_dirty();
+    rewind_count = 0;
+}
+
+/* Stores only the pages written since the previous checkpoint, the runs of adjacent dirty pages
+   are written as one block. The devices mapped into the memory keep their own state */
+DLL_PREFIX
+void module_checkpoint(void) {
+    uint32_t first = 0;
+    while(first < MEM_PAGES_NUM) {
+        if(page_attrs[first] & (MEM_PAGE_CLEAN | MEM_PAGE_MMIO)) {
+            first++;
+            continue;
+        }
+        uint32_t last = first;
+        while((last < MEM_PAGES_NUM) && !(page_attrs[last] & (MEM_PAGE_CLEAN | MEM_PAGE_MMIO))) {
+            page_attrs[last] |= MEM_PAGE_CLEAN;
+            last++;
+        }
+        uint32_t addr = first << MEM_PAGE_SHIFT;
+        snapshot_write(DEVICE_NAME, addr, &MEMORY[addr], (last - first) << MEM_PAGE_SHIFT);
+        first = last;
+    }
+}
+
+static void restore_pages(uint32_t addr, void *data, uint32_t size) {
+    if((addr + size) <= MEMORY_SIZE) {
+        memcpy(&MEMORY[addr], data, size);
+    }
+}
+
+/* Replays the page blocks up to the checkpoint, every page ends up with its content as of that tick */
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    if(snapshot_read(DEVICE_NAME, tick, restore_pages) <= 0) {
+        printf("MEMORY ERROR: No memory pages at tick %lld\n", (long long)tick);
+        error = 1;
+        return;
+    }
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        page_attrs[i] |= MEM_PAGE_CLEAN;
+    }
+    invalidate_all_code();
+    rewind_count = 0;
+}
+
+static void apply_delta(uint8_t *memory, rewind_delta_t *delta) {
+    for(uint32_t i=0; i<delta->pages_num; i++) {
+        memcpy(&memory[delta->pages[i] << MEM_PAGE_SHIFT], &delta->data[i << MEM_PAGE_SHIFT], MEM_PAGE_SIZE);
+    }
+}
+
+/* The first checkpoint of the ring copies the whole memory, the next ones keep only the pages written
+   since the previous one. When the ring is full the oldest checkpoint is merged into the base copy */
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    if(rewind_count == 0) {
+        rewind_base = (rewind_base == NULL) ? (uint8_t*)malloc(MEMORY_SIZE) : rewind_base;
+        if(rewind_base == NULL) {
+            printf("MEMORY ERROR: Failed to allocate memory\n");
+            error = 1;
+            return;
+        }
+        memcpy(rewind_base, MEMORY, MEMORY_SIZE);
+        rewind_oldest = slot;
+        rewind_deltas[slot].pages_num = 0;
+    } else {
+        if(slot != ((rewind_oldest + rewind_count) % REWIND_SLOTS)) {
+            printf("MEMORY ERROR: Rewind slot %d is out of order\n", slot);
+            error = 1;
+            return;
+        }
+        if(rewind_count == REWIND_SLOTS) {
+            rewind_oldest = (rewind_oldest + 1) % REWIND_SLOTS;
+            apply_delta(rewind_base, &rewind_deltas[rewind_oldest]);
+            rewind_deltas[rewind_oldest].pages_num = 0;
+            rewind_count--;
+        }
+        rewind_delta_t *delta = &rewind_deltas[slot];
+        delta->pages_num = 0;
+        for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+            if(!(page_attrs[i] & (MEM_PAGE_REWIND_CLEAN | MEM_PAGE_MMIO))) {
+                delta->pages[delta->pages_num++] = i;
+            }
+        }
+        if(delta->pages_num > delta->pages_max) {
+            free(delta->data);
+            delta->data = (uint8_t*)malloc(delta->pages_num << MEM_PAGE_SHIFT);
+            delta->pages_max = (delta->data != NULL) ? delta->pages_num : 0;
+            if(delta->data == NULL) {
+                printf("MEMORY ERROR: Failed to allocate memory\n");
+                error = 1;
+                rewind_count = 0;
+                return;
+            }
+        }
+        for(uint32_t i=0; i<delta->pages_num; i++) {
+            memcpy(&delta->data[i << MEM_PAGE_SHIFT], &MEMORY[delta->pages[i] << MEM_PAGE_SHIFT], MEM_PAGE_SIZE);
+        }
     }
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        page_attrs[i] |= MEM_PAGE_REWIND_CLEAN;
+    }
+    rewind_count++;
+}
+
+/* Rebuilds the memory from the base copy and the deltas up to the slot, the later checkpoints are dropped.
+   The pages which differ from the current content are left dirty for module_checkpoint() */
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    uint32_t pos = (slot + REWIND_SLOTS - rewind_oldest) % REWIND_SLOTS;
+    if(pos >= rewind_count) {
+        printf("MEMORY ERROR: Rewind slot %d is empty\n", slot);
+        error = 1;
+        return;
+    }
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        if(!(page_attrs[i] & MEM_PAGE_REWIND_CLEAN)) {
+            page_attrs[i] &= ~MEM_PAGE_CLEAN;
+        }
+    }
+    for(uint32_t i=pos+1; i<rewind_count; i++) {
+        rewind_delta_t *delta = &rewind_deltas[(rewind_oldest + i) % REWIND_SLOTS];
+        for(uint32_t j=0; j<delta->pages_num; j++) {
+            page_attrs[delta->pages[j]] &= ~MEM_PAGE_CLEAN;
+        }
+    }
+    memcpy(MEMORY, rewind_base, MEMORY_SIZE);
+    for(uint32_t i=1; i<=pos; i++) {
+        apply_delta(MEMORY, &rewind_deltas[(rewind_oldest + i) % REWIND_SLOTS]);
+    }
+    rewind_count = pos + 1;
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        page_attrs[i] |= MEM_PAGE_REWIND_CLEAN;
+    }
+    invalidate_all_code();
 }
 
 DLL_PREFIX
 void module_reset(void) {
-    uint8_t *memory = (uint8_t*)calloc(sizeof(uint8_t), MEMORY_SIZE);
+    // The memory stays at the same address, the CPU accesses it directly (mem_get_ram())
+    uint8_t *memory = (MEMORY == NULL) ? (uint8_t*)map_file(NULL, MEMORY_SIZE, NULL, 0) : MEMORY;
+    if(memory == NULL) {
+        printf("MEMORY ERROR: Failed to allocate memory\n");
+        error = 1;
+        return;
+    }
+    memset(memory, 0, MEMORY_SIZE);
     // if(continue_simulation) {
     //     restore_memory(memory, MEMORY_DUMP_FILE);
     // } else {
@@ -180,32 +557,91 @@ void module_reset(void) {
     }
     // }
     MEMORY = memory;
+    for(uint32_t i=(ROM_START >> MEM_PAGE_SHIFT); i<MEM_PAGES_NUM; i++) {
+        if((page_attrs[i] & MEM_PAGE_TYPE_MASK) != MEM_PAGE_MMIO) {     // Mapped devices stay across resets
+            page_attrs[i] = MEM_PAGE_ROM;
+        }
+    }
+    invalidate_all_code();
+    mark_all_dirty();
+    rewind_count = 0;
     // return memory;
 }
 
-/* Retunrs an ID which can be used to unmap the device. In case of error returns 0 */
+/* Maps a device handling the accesses to start_addr-end_addr, the range must consist of whole pages.
+   Retunrs an ID which can be used to unmap the device. In case of error returns 0 */
 DLL_PREFIX
 uint32_t map_device(uint32_t start_addr, uint32_t end_addr, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func)) {
-    return 0;
+    if((start_addr > end_addr) || (end_addr >= MEMORY_SIZE) || (start_addr & (MEM_PAGE_SIZE - 1)) ||
+       ((end_addr + 1) & (MEM_PAGE_SIZE - 1)) || (write_func == NULL) || (read_func == NULL)) {
+        printf("MAPPING ERROR: invalid memory range 0x%05X-0x%05X\n", start_addr, end_addr);
+        error = 1;
+        return 0;
+    }
+    uint32_t first = start_addr >> MEM_PAGE_SHIFT;
+    uint32_t last = end_addr >> MEM_PAGE_SHIFT;
+    uint32_t id = (first + 1) | (last << 16);
+    for(uint32_t i=first; i<=last; i++) {
+        if((page_attrs[i] & MEM_PAGE_TYPE_MASK) == MEM_PAGE_MMIO) {
+            printf("MAPPING ERROR: new device range 0x%05X-0x%05X overlaps existing 0x%08X\n", start_addr, end_addr, mem_pages[i].id);
+            error = 1;
+            return 0;
+        }
+    }
+    for(uint32_t i=first; i<=last; i++) {
+        page_attrs[i] = MEM_PAGE_MMIO;
+        mem_pages[i].id = id;
+        mem_pages[i].write_func = write_func;
+        mem_pages[i].read_func = read_func;
+    }
+    // The CPU must not keep instructions decoded from the old content of these pages
+    invalidate_all_code();
+    mylog(0, MEMORY_LOG_FILE, "Device 0x%08X was successfully mapped at addresses 0x%05X-0x%05X\n", id, start_addr, end_addr);
+    return id;
+}
+
+/* Use the ID returned by the map_device function to unmap it, its pages become RAM again */
+DLL_PREFIX
+void unmap_device(uint32_t id) {
+    for(uint32_t i=0; i<MEM_PAGES_NUM; i++) {
+        if(((page_attrs[i] & MEM_PAGE_TYPE_MASK) == MEM_PAGE_MMIO) && (mem_pages[i].id == id)) {
+            page_attrs[i] = MEM_PAGE_RAM;
+            memset(&mem_pages[i], 0, sizeof(mem_page_t));
+        }
+    }
+    mylog(0, MEMORY_LOG_FILE, "Device 0x%08X was unmapped\n", id);
 }
 
-uint32_t counter = 0;
 #define VIDEO_BUFFER_SIZE 128
 #define VIDEO_BUFFER_OFFSET 0xB0000
+#define VIDEO_REFRESH_TICKS 8000
+
+static uint64_t video_refresh_tick = 0;
 
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    if(counter == 8000) {
+    if(ticks_num >= video_refresh_tick) {
         char video_buf[VIDEO_BUFFER_SIZE];
         
         if((MEMORY[VIDEO_BUFFER_OFFSET] >= 0x20) && (MEMORY[VIDEO_BUFFER_OFFSET] < 0x7F)) {
-            for(int i=0; i<VIDEO_BUFFER_SIZE; i++) {
+            for(int i=0; i<VIDEO_BUFFER_SIZE-1; i++) {
                 video_buf[i] = MEMORY[VIDEO_BUFFER_OFFSET+(i*2)];
             }
-            mylog(1, VIDEO_MEM_LOG_FILE, "VIDEO_BUF: %s", video_buf);
+            video_buf[VIDEO_BUFFER_SIZE-1] = 0;
+            notify_ui(VIDEO_MEM_LOG_FILE, "VIDEO_BUF: %s", video_buf);
         }
-        counter = 0;
+        video_refresh_tick = ticks_num + VIDEO_REFRESH_TICKS;
     }
-    counter++;
     return error;
 }
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    if(error) {
+        return 1;   // Report the error on the next tick
+    }
+    if(ticks_num >= video_refresh_tick) {
+        return 1;
+    }
+    return video_refresh_tick - ticks_num;
+}
\ No newline at end of file
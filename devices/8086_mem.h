@@ -4,15 +4,30 @@
 #include <stdlib.h>
 #include "utils.h"
 
+// RAM backing, see mem_set_backing()
+#define MEM_BACKING_NONE    0
+#define MEM_BACKING_PRIVATE 1
+#define MEM_BACKING_SHARED  2
 
 uint8_t * mem_init(uint8_t continue_simulation);
 void data_write(uint32_t addr, uint16_t value, uint8_t width);
 uint16_t data_read(uint32_t addr, uint8_t width);
 uint16_t code_read(uint32_t addr, uint8_t width);
+void set_code_write_hook(void(*hook)(uint32_t));
+void set_ram_map_hook(void(*hook)(uint8_t*, uint8_t*));
+uint8_t *mem_get_ram(void);
+uint8_t *mem_get_page_attrs(void);
+int mem_set_backing(uint8_t mode);
 int store_memory(void);
 
 void module_reset(void);
 void module_save(void);
 void module_restore(void);
+void module_checkpoint(void);
+void module_restore_checkpoint(uint64_t tick);
+void module_rewind_save(uint32_t slot);
+void module_rewind_restore(uint32_t slot);
 uint32_t map_device(uint32_t start_addr, uint32_t end_addr, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func));
-int module_tick(uint32_t ticks);
\ No newline at end of file
+void unmap_device(uint32_t id);
+int module_tick(uint32_t ticks);
+uint32_t module_next_event(uint32_t ticks);
\ No newline at end of file
@@ -40,8 +40,6 @@ typedef struct {
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
-
 CREATE_PIN(test_wire, PIN_OUTPUT_PP)
 
 DLL_PREFIX
@@ -108,6 +106,13 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
     }
 }
 
+/* Received byte from the host, it goes through the input journal of the scheduler (journal.c) */
+DLL_PREFIX
+void module_input(uint8_t value) {
+    regs.rx_buf = value;
+    regs.line_status |= 0x01;   // Data ready
+}
+
 DLL_PREFIX
 uint16_t data_read(uint32_t addr, uint8_t width) {
     uint16_t ret_val = 0xFF;
@@ -118,6 +123,7 @@ uint16_t data_read(uint32_t addr, uint8_t width) {
                 ret_val = regs.divisor_latch & 0xFF;
             } else {
                 ret_val = regs.rx_buf;
+                regs.line_status &= ~0x01;  // Data ready
             }
             }
             break;
@@ -180,8 +186,32 @@ void module_restore(void) {
     }
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+}
+
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    ticks_num = ticks;
     return 0;
+}
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    return NO_PENDING_EVENT;
 }
\ No newline at end of file
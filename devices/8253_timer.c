@@ -6,6 +6,8 @@
 #define DEVICE_NAME         "TIMER"
 #define DEVICE_LOG_FILE     "logs/timer.log"
 #define DEVICE_DATA_FILE    "data/8253_timer.bin"
+#define TIMER_CLOCK_DIVIDER 2           // The channels count every second tick
+#define NO_STEP             0xFFFFFFFF
 
 typedef struct {
     uint8_t read_load;
@@ -20,13 +22,16 @@ typedef struct {
 
 typedef struct {
     timer_t timer[3];
+    uint8_t tick_divider;   // Position in the TIMER_CLOCK_DIVIDER period, the channels count at 0
+    uint64_t last_tick;     // Tick the state of the channels is computed for, see timer_update()
 } device_regs_t;
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
+static void timer_update(uint64_t tick);
 
 void set_timer_state(timer_t * timer, uint8_t gate_state) {
+    timer_update(ticks_num);
     if(gate_state == 0) {
         timer->counts = 0;
     } else {
@@ -35,6 +40,7 @@ void set_timer_state(timer_t * timer, uint8_t gate_state) {
             timer->counter = timer->value;
         }
     }
+    request_service();
 }
 
 void gate0_cb(uint8_t new_state) {
@@ -76,6 +82,32 @@ void module_restore(void) {
     regs.timer[2].output = &ch2_output_pin;
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+    regs.timer[0].output = &ch0_output_pin;
+    regs.timer[1].output = &ch1_output_pin;
+    regs.timer[2].output = &ch2_output_pin;
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+    regs.timer[0].output = &ch0_output_pin;
+    regs.timer[1].output = &ch1_output_pin;
+    regs.timer[2].output = &ch2_output_pin;
+}
+
 DLL_PREFIX
 void module_reset(void) {
     for(uint8_t i=0; i<3; i++) {
@@ -90,6 +122,8 @@ void module_reset(void) {
     regs.timer[0].output = &ch0_output_pin;
     regs.timer[1].output = &ch1_output_pin;
     regs.timer[2].output = &ch2_output_pin;
+    regs.tick_divider = ticks_num % TIMER_CLOCK_DIVIDER;    // The divider phase follows the system tick
+    regs.last_tick = ticks_num;
 }
 
 static void set_value(timer_t *timer, uint16_t value) {
@@ -148,6 +182,7 @@ static uint8_t get_value(timer_t *timer) {
 DLL_PREFIX
 void data_write(uint32_t addr, uint16_t value, uint8_t width) {
     mylog(0, DEVICE_LOG_FILE, "TIMER_WRITE addr = 0x%06X, value = 0x%04X, width = %d bytes\n", addr, value, width);
+    timer_update(ticks_num);
     switch(addr) {
         case 0x40:
             set_value(&regs.timer[0], value);
@@ -180,11 +215,13 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
         default:
             printf("TIMER ERROR: attempt to write to incorrect port 0x%04X\n", addr);
     }
+    request_service();
 }
 
 DLL_PREFIX
 uint16_t data_read(uint32_t addr, uint8_t width) {
     uint16_t ret_val = 0;
+    timer_update(ticks_num);
     switch(addr) {
         case 0x40:
             ret_val = get_value(&(regs.timer[0]));
@@ -205,96 +242,178 @@ uint16_t data_read(uint32_t addr, uint8_t width) {
     return ret_val;
 }
 
-void timer_tick(timer_t *timer) {
-    if(timer->counts == 0) {
-        return;
+// Counter value loaded after the terminal count
+static uint16_t reload_value(timer_t *timer) {
+    switch(timer->mode) {
+        case 0:
+            return 0xFFFF;
+        case 4:
+            return 0;
+        default:
+            return timer->value;
+    }
+}
+
+// One-shot modes stop counting after the terminal count
+static uint8_t stops_at_terminal(timer_t *timer) {
+    return (timer->mode == 1) || (timer->mode == 4) || (timer->mode == 5);
+}
+
+// Output level after the count step made at the counter value x
+static uint8_t output_after(timer_t *timer, uint16_t x) {
+    if(x == 0) {
+        return 1;
     }
     switch(timer->mode) {
-        case 0:     // Interrupt on terminal count (one-shot)
-        case 1: {   // Programmable one-shot (retriggerable)
-            if(timer->counter == 0) {
-                if(timer->output->get_state() == 0) {
-                    timer->output->set_state(1);
-                }
-                if(timer->mode == 0) {
-                    timer->value = 0;
-                    timer->counter = 0xFFFF;
-                } else {
-                    timer->counter = timer->value;
-                    timer->counts = 0;
-                }
-            } else {
-                if(timer->output->get_state() == 1) {
-                    timer->output->set_state(0);
-                }
-                timer->counter --;
-            }
-            break;
+        case 0:     // Low until the terminal count
+        case 1:
+            return 0;
+        case 3:     // Square wave: first half of the count high, then low
+        case 7:
+            return x > (timer->value >> 1);
+        default:    // Low between 1 and 0, the rest of the time high
+            return x != 1;
+    }
+}
+
+// Number of the count steps before the step at the counter value x, NO_STEP if the counter doesn't get there
+static uint32_t steps_to(timer_t *timer, uint32_t x) {
+    if(x <= timer->counter) {
+        return timer->counter - x;
+    }
+    if(stops_at_terminal(timer) || (x > reload_value(timer))) {
+        return NO_STEP;
+    }
+    return timer->counter + 1 + reload_value(timer) - x;
+}
+
+// Number of the count steps until the channel stops, NO_STEP if it doesn't
+static uint32_t steps_to_stop(timer_t *timer) {
+    return stops_at_terminal(timer) ? (uint32_t)timer->counter + 1 : NO_STEP;
+}
+
+// Counter value at the count step j (0 - the next one), the step must be before the stop
+static uint16_t counter_at(timer_t *timer, uint32_t j) {
+    if(j <= timer->counter) {
+        return timer->counter - j;
+    }
+    j -= timer->counter + 1;
+    return reload_value(timer) - (j % ((uint32_t)reload_value(timer) + 1));
+}
+
+// Makes k count steps of the channel at once, returns the output level after them
+static uint8_t count_steps(timer_t *timer, uint32_t k) {
+    uint8_t level = output_after(timer, counter_at(timer, k - 1));
+    if(k <= timer->counter) {
+        timer->counter -= k;
+        return level;
+    }
+    timer->counter = counter_at(timer, k);  // The terminal count is one of the steps
+    if((timer->mode == 0) || (timer->mode == 4)) {
+        timer->value = 0;
+    }
+    if(stops_at_terminal(timer)) {
+        timer->counts = 0;
+    }
+    return level;
+}
+
+// Number of the count steps before the step which changes the output, NO_STEP if the output stays
+static uint32_t steps_to_edge(timer_t *timer) {
+    uint8_t level = timer->output->get_state();
+    if(output_after(timer, timer->counter) != level) {
+        return 0;
+    }
+    // The output is constant between the steps where the counter enters a new range of values
+    uint32_t terminal = steps_to(timer, 0);
+    uint32_t candidates[4] = {
+        terminal,
+        ((terminal != NO_STEP) && !stops_at_terminal(timer)) ? terminal + 1 : NO_STEP,    // Reload
+        steps_to(timer, 1),
+        steps_to(timer, timer->value >> 1),
+    };
+    uint32_t edge = NO_STEP;
+    for(uint8_t i=0; i<4; i++) {
+        if((candidates[i] != NO_STEP) && (candidates[i] > 0) && (candidates[i] < edge) &&
+           (output_after(timer, counter_at(timer, candidates[i])) != level)) {
+            edge = candidates[i];
         }
-        case 2:     // Rate generator (auto reload)
-        case 4:     // Software triggered strobe
-        case 5:     // Hardware triggered strobe
-        case 6: {   // Rate generator (auto reload)
-            if(timer->counter == 0) {
-                if(timer->output->get_state() == 0) {
-                    timer->output->set_state(1);
-                }
-                if(timer->mode == 4) {
-                    timer->value = 0;
-                }
-                timer->counter = timer->value;
-                if((timer->mode == 4) || (timer->mode == 5)) {
-                    timer->counts = 0;
-                }
-            } else {
-                if(timer->counter == 1) {    // Low between 1 and 0, the rest of the time is high
-                    if(timer->output->get_state() == 1) {
-                        timer->output->set_state(0);
-                    }
-                } else {
-                    if(timer->output->get_state() == 0) {
-                        timer->output->set_state(1);
-                    }
-                }
-                timer->counter --;
+    }
+    return edge;
+}
+
+static uint8_t channels_count(void) {
+    return regs.timer[0].counts || regs.timer[1].counts || regs.timer[2].counts;
+}
+
+// Ticks before the first count step of the channels after regs.last_tick
+static uint32_t ticks_to_step(void) {
+    return (TIMER_CLOCK_DIVIDER - regs.tick_divider) % TIMER_CLOCK_DIVIDER;
+}
+
+/* Brings the channels to their state at the given tick: the count steps of the ticks since
+   regs.last_tick are made at once. The clock divider runs even while no channel counts,
+   so a channel started later counts in the phase of the system tick */
+static void timer_update(uint64_t tick) {
+    uint8_t levels[3] = {0xFF, 0xFF, 0xFF};
+    while((regs.last_tick < tick) && channels_count()) {
+        uint64_t elapsed = tick - regs.last_tick;
+        uint32_t first = ticks_to_step();
+        uint64_t steps = (elapsed > first) ? (elapsed - first - 1) / TIMER_CLOCK_DIVIDER + 1 : 0;
+        // The divider stops after the step which stops the last counting channel
+        uint64_t last_stop = 0;
+        for(uint8_t i=0; i<3; i++) {
+            if(regs.timer[i].counts) {
+                uint64_t stop = steps_to_stop(&regs.timer[i]);
+                last_stop = (stop > last_stop) ? stop : last_stop;
             }
-            break;
         }
-        case 3:     // Square wave generator
-        case 7: {
-            if(timer->counter == 0) {
-                if(timer->output->get_state() == 0) {
-                    timer->output->set_state(1);
-                }
-                timer->counter = timer->value;
-            } else {
-                if(timer->counter <= (timer->value >> 1)) {    // First half of the count stay high, then low
-                    if(timer->output->get_state() == 1) {
-                        timer->output->set_state(0);
-                    }
-                } else {
-                    if(timer->output->get_state() == 0) {
-                        timer->output->set_state(1);
-                    }
-                }
-                timer->counter --;
+        uint64_t chunk = (last_stop <= steps) ? last_stop : steps;
+        for(uint8_t i=0; i<3; i++) {
+            if(regs.timer[i].counts && chunk) {
+                uint32_t stop = steps_to_stop(&regs.timer[i]);
+                levels[i] = count_steps(&regs.timer[i], (stop < chunk) ? stop : chunk);
             }
-            break;
+        }
+        if(last_stop <= steps) {
+            regs.tick_divider = 1 % TIMER_CLOCK_DIVIDER;
+            regs.last_tick += first + (chunk - 1) * TIMER_CLOCK_DIVIDER + 1;
+        } else {
+            regs.tick_divider = (regs.tick_divider + elapsed) % TIMER_CLOCK_DIVIDER;
+            regs.last_tick = tick;
+        }
+    }
+    if(regs.last_tick < tick) {
+        regs.tick_divider = (regs.tick_divider + (tick - regs.last_tick) % TIMER_CLOCK_DIVIDER) % TIMER_CLOCK_DIVIDER;
+        regs.last_tick = tick;
+    }
+    for(uint8_t i=0; i<3; i++) {
+        if((levels[i] != 0xFF) && (regs.timer[i].output->get_state() != levels[i])) {
+            regs.timer[i].output->set_state(levels[i]);
         }
     }
 }
 
-uint8_t tick_divider;
-
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    if(tick_divider) {
-        tick_divider = 0;
-        return 0;
-    }
-    tick_divider ++;
-    timer_tick(&(regs.timer[0]));
-    timer_tick(&(regs.timer[1]));
-    timer_tick(&(regs.timer[2]));
+    timer_update(ticks_num);
     return 0;
 }
+
+/* The channels need a tick only when an output changes, the counters
+   are computed from the elapsed ticks when the ports are accessed */
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    timer_update(ticks_num);
+    uint32_t edge = NO_STEP;
+    for(uint8_t i=0; i<3; i++) {
+        if(regs.timer[i].counts) {
+            uint32_t step = steps_to_edge(&regs.timer[i]);
+            edge = (step < edge) ? step : edge;
+        }
+    }
+    if(edge == NO_STEP) {
+        return NO_PENDING_EVENT;
+    }
+    return regs.last_tick + ticks_to_step() + (uint64_t)edge * TIMER_CLOCK_DIVIDER + 1 - ticks_num;
+}
@@ -7,6 +7,9 @@
 #define DEVICE_LOG_FILE     "logs/8255a-5_ppi.log"
 #define DEVICE_DATA_FILE    "data/8255a-5_ppi.bin"
 
+#define INT_DELAY_TICKS     10  // Ticks between the keyboard reset and the keyboard interrupt
+#define INT_PULSE_TICKS     21  // How long the interrupt line stays high
+
 #define SW1 1
 #define SW2 0
 #define SW3 1
@@ -22,13 +25,11 @@ typedef struct {
     uint8_t portc_reg;
     uint8_t cmd_reg;
     uint8_t delayed_int;
-    uint8_t delayed_int_ticks;
+    uint64_t delayed_int_tick;  // Tick when int1_pin has to change its state
 } device_regs_t;
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
-
 CREATE_PIN(int1_pin, PIN_OUTPUT_PP)   // Keyboard interrupt
 CREATE_PIN(beep_pin, PIN_OUTPUT_PP)   // Keyboard interrupt
 
@@ -69,7 +70,8 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
                 mylog(0, DEVICE_LOG_FILE, "PPI Setting Interrupt 2\n");
                 module_reset();
                 regs.delayed_int = 1;
-                regs.delayed_int_ticks = 10;
+                regs.delayed_int_tick = ticks_num + INT_DELAY_TICKS;
+                request_service();
             }
             if((value & 0x03) == 0x03) {    // Turn beep signal on
                 if(beep_pin.get_state() == 0)
@@ -92,6 +94,16 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
     }
 }
 
+/* Keyboard scan code from the host, it goes through the input journal of the scheduler (journal.c).
+   Port A returns it after the keyboard interrupt, the same way as the reset response 0xAA */
+DLL_PREFIX
+void module_input(uint8_t value) {
+    regs.porta_reg = value;
+    regs.delayed_int = 1;
+    regs.delayed_int_tick = ticks_num + INT_DELAY_TICKS;
+    request_service();
+}
+
 DLL_PREFIX
 uint16_t data_read(uint32_t addr, uint8_t width) {
     uint16_t ret_val = 0;
@@ -129,21 +141,48 @@ void module_restore(void) {
     }
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+}
+
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    if(regs.delayed_int == 1) {
-        if(regs.delayed_int_ticks > 0) {
-            regs.delayed_int_ticks --;
+    if((regs.delayed_int == 1) && (ticks_num >= regs.delayed_int_tick)) {
+        if(int1_pin.get_state() == 0) {
+            mylog(0, DEVICE_LOG_FILE, "PPI Triggering Interrupt 2\n");
+            int1_pin.set_state(1);
+            regs.delayed_int_tick = ticks_num + INT_PULSE_TICKS;
         } else {
-            if(int1_pin.get_state() == 0) {
-                mylog(0, DEVICE_LOG_FILE, "PPI Triggering Interrupt 2\n");
-                int1_pin.set_state(1);
-                regs.delayed_int_ticks = 20;
-            } else {
-                int1_pin.set_state(0);
-                regs.delayed_int = 0;
-            }
+            int1_pin.set_state(0);
+            regs.delayed_int = 0;
         }
     }
     return 0;
+}
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    if(regs.delayed_int == 0) {
+        return NO_PENDING_EVENT;
+    }
+    if(ticks_num >= regs.delayed_int_tick) {
+        return 1;
+    }
+    return regs.delayed_int_tick - ticks_num;
 }
\ No newline at end of file
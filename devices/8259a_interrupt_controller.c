@@ -24,12 +24,11 @@ typedef struct {
     uint8_t triggerded_int;
     uint8_t reg20;
     uint8_t enabled_ints;
+    uint8_t init_state;     // Step of the initialization sequence, 4 - normal mode
 } device_regs_t;
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
-
 DLL_PREFIX
 void module_reset(void) {
     memset(&regs, 0, sizeof(device_regs_t));
@@ -89,24 +88,23 @@ void trigger_interrupt(uint8_t int_num, uint8_t active) {
 }
 
 void write_byte(uint8_t addr, uint8_t data) {
-    static int state;
     if((addr == 0x20) && ((data & 0x10) > 0)) { // ICW1
         regs.ICW1 = data;
-        state = 1;  // Waiting for ICW2
-    } else if(state == 1) { // ICW2
+        regs.init_state = 1;  // Waiting for ICW2
+    } else if(regs.init_state == 1) { // ICW2
         regs.ICW2 = data;
         if(regs.ICW1 & 0x01) {
-            state = 3;  // Wait for ICW4
+            regs.init_state = 3;  // Wait for ICW4
         } else {
-            state = 2;  // Wait for ICW3
+            regs.init_state = 2;  // Wait for ICW3
         }
-    } else if(state == 2) {     // ICW3
+    } else if(regs.init_state == 2) {     // ICW3
         printf("%lld, %s ERROR: Write ICW3 is not implemented!\n", ticks_num, DEVICE_NAME);   // Not implemented
-        state = 0;
-    } else if(state == 3) { // ICW4
+        regs.init_state = 0;
+    } else if(regs.init_state == 3) { // ICW4
         regs.ICW4 = data;
-        state = 4;  // Initialization complete, go to the normal mode
-    } else if(state == 4) {
+        regs.init_state = 4;  // Initialization complete, go to the normal mode
+    } else if(regs.init_state == 4) {
         if(addr == 0x21) {
             regs.OCW1 = data;
             regs.IMR = data;
@@ -166,8 +164,32 @@ void module_restore(void) {
     }
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+}
+
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    ticks_num = ticks;
     return 0;
 }
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    return NO_PENDING_EVENT;
+}
\ No newline at end of file
@@ -8,6 +8,9 @@
 #define DEVICE_LOG_FILE     "logs/fdc.log"
 #define DEVICE_DATA_FILE    "data/fdc.bin"
 
+#define INT_DELAY_TICKS     11  // Ticks between enabling the controller and raising the interrupt
+#define INT_PULSE_TICKS     21  // How long the interrupt line stays high
+
 typedef enum {
     READ_TRACK             = 0x02,  // 0  MF SK 0 0 0 1 0
     SPECIFY                = 0x03,  // 0  0  0  0 0 0 1 1
@@ -31,7 +34,7 @@ typedef struct {
     uint8_t MSR;
     uint8_t data_reg;
     uint8_t delayed_int;
-    uint16_t delayed_int_ticks;
+    uint64_t delayed_int_tick;  // Tick when int6_pin has to change its state
     uint8_t ST0;
     uint8_t ST1;
     uint8_t ST2;
@@ -47,8 +50,6 @@ typedef struct {
 
 device_regs_t regs;
 uint8_t error;
-size_t ticks_num = 0;
-
 void state_machine(uint8_t cmd, uint8_t is_write) {
     // static commands_t command;
     // static uint8_t step = 0;
@@ -155,7 +156,8 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
     if(addr == 0x3F2) {
         if(((regs.DOR & 0x04) == 0) && ((value & 0x04) == 0x04)) {
             regs.delayed_int = 1;
-            regs.delayed_int_ticks = 10;
+            regs.delayed_int_tick = ticks_num + INT_DELAY_TICKS;
+            request_service();
         }
         regs.DOR = value;
     } else if(addr == 0x3F4) {
@@ -165,6 +167,7 @@ void data_write(uint32_t addr, uint16_t value, uint8_t width) {
     } else {
         printf("FDC ERROR: Incorrect address: 0x%04X\n", addr);
         error = 1;
+        request_service();
     }
 }
 
@@ -181,6 +184,7 @@ uint16_t data_read(uint32_t addr, uint8_t width) {
     } else {
         printf("FDC ERROR: Incorrect address: 0x%04X", addr);
         error = 1;
+        request_service();
     }
     mylog(0, DEVICE_LOG_FILE, "%lld, FDC_READ addr = 0x%04X, width = %d bytes, data = 0x%04X\n", ticks_num, addr, width, ret_val);
     return ret_val;
@@ -199,24 +203,53 @@ void module_restore(void) {
     }
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+}
+
 CREATE_PIN(int6_pin, PIN_OUTPUT_PP)   // Disk Controller interrupt
 
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    ticks_num = ticks;
-    if(regs.delayed_int == 1) {
-        if(regs.delayed_int_ticks > 0) {
-            regs.delayed_int_ticks --;
+    if((regs.delayed_int == 1) && (ticks_num >= regs.delayed_int_tick)) {
+        if(int6_pin.get_state() == 0) {
+            mylog(0, DEVICE_LOG_FILE, "FDC Triggering Interrupt 6\n");
+            int6_pin.set_state(1);
+            regs.delayed_int_tick = ticks_num + INT_PULSE_TICKS;
         } else {
-            if(int6_pin.get_state() == 0) {
-                mylog(0, DEVICE_LOG_FILE, "FDC Triggering Interrupt 6\n");
-                int6_pin.set_state(1);
-                regs.delayed_int_ticks = 20;
-            } else {
-                int6_pin.set_state(0);
-                regs.delayed_int = 0;
-            }
+            int6_pin.set_state(0);
+            regs.delayed_int = 0;
         }
     }
     return error;
+}
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    if(error) {
+        return 1;   // Report the error on the next tick
+    }
+    if(regs.delayed_int == 0) {
+        return NO_PENDING_EVENT;
+    }
+    if(ticks_num >= regs.delayed_int_tick) {
+        return 1;
+    }
+    return regs.delayed_int_tick - ticks_num;
 }
\ No newline at end of file
@@ -15,8 +15,6 @@ typedef struct {
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
-
 CREATE_PIN(test_wire, PIN_OUTPUT_PP)
 
 DLL_PREFIX
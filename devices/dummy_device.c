@@ -15,8 +15,6 @@ typedef struct {
 
 device_regs_t regs;
 
-size_t ticks_num = 0;
-
 CREATE_PIN(test_wire, PIN_OUTPUT_PP)
 
 DLL_PREFIX
@@ -52,8 +50,32 @@ void module_restore(void) {
     }
 }
 
+DLL_PREFIX
+void module_checkpoint(void) {
+    snapshot_write(DEVICE_NAME, 0, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_restore_checkpoint(uint64_t tick) {
+    snapshot_read_block(DEVICE_NAME, tick, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_save(uint32_t slot) {
+    rewind_store(slot, &regs, sizeof(device_regs_t));
+}
+
+DLL_PREFIX
+void module_rewind_restore(uint32_t slot) {
+    rewind_load(slot, &regs, sizeof(device_regs_t));
+}
+
 DLL_PREFIX
 int module_tick(uint32_t ticks) {
-    ticks_num = ticks;
     return 0;
+}
+
+DLL_PREFIX
+uint32_t module_next_event(uint32_t ticks) {
+    return NO_PENDING_EVENT;
 }
\ No newline at end of file
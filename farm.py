@@ -0,0 +1,63 @@
+import glob
+import os
+import sys
+import threading
+import time
+
+import system
+from device_manager import DevManager, TICKS_BATCH
+
+# Regression farm: runs several independent machines in one process, a worker thread per machine.
+# Every machine loads its own copies of the modules into farm/<n>/ (see load_module()) and keeps its
+# logs and state files there, the data/ files of a machine are the ones a single system.py run writes.
+# Usage: python farm.py [machines] [ticks] [--static]
+
+FARM_DIR = "farm"
+FARM_MACHINES = 4
+FARM_TICKS = 10_000_000
+
+
+def run_machine(machine, ticks, results, index):
+    ''' The native scheduler runs without holding the GIL, so the machines run in parallel '''
+    ok = True
+    while ok and machine._ticks < ticks:
+        ok = machine.tick_devices(min(TICKS_BATCH, ticks - machine._ticks))
+    for _, dev in machine.devices.items():
+        dev.module_save()
+    machine.flush_logs()
+    results[index] = ok
+
+
+def main():
+    args = [arg for arg in sys.argv[1:] if not arg.startswith("--")]
+    machines_num = int(args[0]) if len(args) > 0 else FARM_MACHINES
+    ticks = int(args[1]) if len(args) > 1 else FARM_TICKS
+    system.static_build = "--static" in sys.argv[1:]
+
+    machines = []
+    for i in range(machines_num):
+        machine = DevManager(os.path.join(FARM_DIR, str(i)))
+        for f in glob.glob(machine.path('logs/*')):
+            os.remove(f)
+        system.wires.extend(system.build_machine(machine))
+        machines.append(machine)
+
+    results = [False] * machines_num
+    threads = [threading.Thread(target=run_machine, args=(machine, ticks, results, i)) for i, machine in enumerate(machines)]
+    start = time.time()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    seconds = max(time.time() - start, 1e-6)
+
+    total = 0
+    for i, machine in enumerate(machines):
+        total += machine._ticks
+        print(f"Machine {i}: {machine._ticks} ticks, {'done' if results[i] else 'failed'}, state: {machine.path('data')}")
+    print(f"{machines_num} machines: {total} ticks in {seconds:.2f} s, {total / seconds:,.0f} ticks/s")
+    sys.exit(0 if all(results) else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,243 @@
+#include "journal.h"
+#include "scheduler.h"
+#include <string.h>
+
+#define JOURNAL_LOG_FILE "logs/journal.log"
+
+#define JOURNAL_OFF         0
+#define JOURNAL_RECORD      1
+#define JOURNAL_REPLAY      2
+
+typedef struct {
+    char name[INPUT_NAME_LEN];
+    input_func_t func;
+} input_t;
+
+static input_t inputs[INPUTS_MAX_NUM];
+static uint32_t inputs_num = 0;
+static uint8_t mode = JOURNAL_OFF;
+static char journal_file_name[256];
+static FILE *journal_file = NULL;       // Record mode: the records are appended as they come
+static journal_record_t *records = NULL;    // The input of a record is the index in inputs[]
+static uint32_t records_num = 0;
+static uint32_t records_max = 0;
+static uint32_t next_record = 0;        // Replay mode: the first record which is not delivered yet
+
+static void deliver(uint32_t input, uint8_t value) {
+    mylog(0, JOURNAL_LOG_FILE, "%lld, %s: 0x%02X\n", (long long)scheduler_get_ticks(), inputs[input].name, value);
+    inputs[input].func(value);
+    scheduler_wakeup();     // The input may move the next deadline of the device
+}
+
+static int add_record(journal_record_t *record) {
+    if(records_num == records_max) {
+        uint32_t new_max = records_max ? records_max * 2 : 1024;
+        journal_record_t *new_records = realloc(records, new_max * sizeof(journal_record_t));
+        if(new_records == NULL) {
+            printf("ERROR: Cannot allocate memory for %d journal records\n", new_max);
+            return EXIT_FAILURE;
+        }
+        records = new_records;
+        records_max = new_max;
+    }
+    records[records_num++] = *record;
+    return EXIT_SUCCESS;
+}
+
+// Record mode: (re)writes the journal file with the records kept in memory, it stays open for the next ones
+static int write_journal(void) {
+    if(journal_file) {
+        fclose(journal_file);
+    }
+    journal_file = instance_fopen(journal_file_name, "wb");
+    if(journal_file == NULL) {
+        printf("ERROR: Cannot open journal file %s\n", journal_file_name);
+        return EXIT_FAILURE;
+    }
+    uint16_t header[3] = {JOURNAL_VERSION, sizeof(journal_record_t), inputs_num};
+    fwrite(JOURNAL_MAGIC, 1, strlen(JOURNAL_MAGIC), journal_file);
+    fwrite(header, sizeof(header), 1, journal_file);
+    for(uint32_t i=0; i<inputs_num; i++) {
+        fwrite(inputs[i].name, 1, INPUT_NAME_LEN, journal_file);
+    }
+    fwrite(records, sizeof(journal_record_t), records_num, journal_file);
+    fflush(journal_file);
+    return EXIT_SUCCESS;
+}
+
+// Replay mode: reads the records, their inputs are found by name so the order of input_add() calls may differ
+static int read_journal(FILE *file) {
+    char magic[8];
+    uint16_t header[3];
+    if((fread(magic, 1, sizeof(magic), file) != sizeof(magic)) || (memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0) ||
+       (fread(header, sizeof(header), 1, file) != 1) || (header[0] != JOURNAL_VERSION) || (header[1] != sizeof(journal_record_t))) {
+        printf("ERROR: %s is not a journal file of version %d\n", journal_file_name, JOURNAL_VERSION);
+        return EXIT_FAILURE;
+    }
+    uint16_t file_inputs[INPUTS_MAX_NUM];
+    if(header[2] > INPUTS_MAX_NUM) {
+        printf("ERROR: Too many inputs in journal file %s\n", journal_file_name);
+        return EXIT_FAILURE;
+    }
+    for(uint16_t i=0; i<header[2]; i++) {
+        char name[INPUT_NAME_LEN];
+        if(fread(name, 1, INPUT_NAME_LEN, file) != INPUT_NAME_LEN) {
+            printf("ERROR: Journal file %s is truncated\n", journal_file_name);
+            return EXIT_FAILURE;
+        }
+        name[INPUT_NAME_LEN - 1] = '\0';
+        file_inputs[i] = inputs_num;
+        for(uint32_t j=0; j<inputs_num; j++) {
+            if(strcmp(inputs[j].name, name) == 0) {
+                file_inputs[i] = j;
+            }
+        }
+        if(file_inputs[i] == inputs_num) {
+            printf("ERROR: Input %s of journal file %s does not exist\n", name, journal_file_name);
+            return EXIT_FAILURE;
+        }
+    }
+    journal_record_t record;
+    while(fread(&record, sizeof(record), 1, file) == 1) {
+        if(record.input >= header[2]) {
+            printf("ERROR: Journal file %s has a record of unknown input %d\n", journal_file_name, record.input);
+            return EXIT_FAILURE;
+        }
+        record.input = file_inputs[record.input];
+        if(add_record(&record) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Registers an input, returns its index or -1 on failure. An input with the same name is replaced */
+DLL_PREFIX
+int input_add(const char *name, input_func_t func) {
+    for(uint32_t i=0; i<inputs_num; i++) {
+        if(strncmp(inputs[i].name, name, INPUT_NAME_LEN - 1) == 0) {
+            inputs[i].func = func;
+            return i;
+        }
+    }
+    if((inputs_num == INPUTS_MAX_NUM) || (func == NULL) || (mode != JOURNAL_OFF)) {
+        printf("ERROR: Cannot add input %s\n", name);
+        return -1;
+    }
+    strncpy(inputs[inputs_num].name, name, INPUT_NAME_LEN - 1);
+    inputs[inputs_num].func = func;
+    return inputs_num++;
+}
+
+/* Delivers an input from outside the machine. The inputs are recorded after the tick scheduler_get_ticks()
+   is done, the replay delivers them at the same point. During a replay the inputs are taken from the journal,
+   the ones sent here are dropped until the last record is delivered */
+DLL_PREFIX
+void input_send(uint32_t input, uint8_t value) {
+    if(input >= inputs_num) {
+        printf("ERROR: Input %d does not exist\n", input);
+        return;
+    }
+    if((mode == JOURNAL_REPLAY) && (next_record < records_num)) {
+        mylog(1, JOURNAL_LOG_FILE, "%lld, %s: 0x%02X dropped, the inputs are replayed from %s\n", (long long)scheduler_get_ticks(), inputs[input].name, value, journal_file_name);
+        return;
+    }
+    if(mode == JOURNAL_RECORD) {
+        journal_record_t record = {.tick = scheduler_get_ticks(), .input = input, .value = value};
+        if(add_record(&record) == EXIT_SUCCESS) {
+            fwrite(&record, sizeof(record), 1, journal_file);
+            fflush(journal_file);
+        }
+    }
+    deliver(input, value);
+}
+
+/* Starts a new journal file, the inputs are recorded from the current tick */
+DLL_PREFIX
+int journal_record(const char *filename) {
+    journal_stop();
+    strncpy(journal_file_name, filename, sizeof(journal_file_name) - 1);
+    if(write_journal() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    mode = JOURNAL_RECORD;
+    mylog(1, JOURNAL_LOG_FILE, "%lld, Recording the inputs to %s\n", (long long)scheduler_get_ticks(), journal_file_name);
+    return EXIT_SUCCESS;
+}
+
+/* Replays the inputs of the journal file from the current tick, the state of the machine has to be
+   the one it had at this tick of the recorded run */
+DLL_PREFIX
+int journal_replay(const char *filename) {
+    journal_stop();
+    strncpy(journal_file_name, filename, sizeof(journal_file_name) - 1);
+    FILE *file = instance_fopen(journal_file_name, "rb");
+    if(file == NULL) {
+        printf("ERROR: Failed to open file %s\n", journal_file_name);
+        return EXIT_FAILURE;
+    }
+    int res = read_journal(file);
+    fclose(file);
+    if(res != EXIT_SUCCESS) {
+        journal_stop();
+        return EXIT_FAILURE;
+    }
+    mode = JOURNAL_REPLAY;
+    journal_seek(scheduler_get_ticks());
+    mylog(1, JOURNAL_LOG_FILE, "%lld, Replaying %d inputs from %s\n", (long long)scheduler_get_ticks(), records_num - next_record, journal_file_name);
+    return EXIT_SUCCESS;
+}
+
+DLL_PREFIX
+void journal_stop(void) {
+    if(journal_file) {
+        fclose(journal_file);
+        journal_file = NULL;
+    }
+    free(records);
+    records = NULL;
+    records_num = 0;
+    records_max = 0;
+    next_record = 0;
+    mode = JOURNAL_OFF;
+}
+
+// Tick after which the next replayed input is delivered, JOURNAL_NO_TICK if there is none
+uint64_t journal_next_tick(void) {
+    if((mode != JOURNAL_REPLAY) || (next_record == records_num)) {
+        return JOURNAL_NO_TICK;
+    }
+    return records[next_record].tick;
+}
+
+void journal_deliver(uint64_t tick) {
+    while((mode == JOURNAL_REPLAY) && (next_record < records_num) && (records[next_record].tick <= tick)) {
+        journal_record_t *record = &records[next_record++];
+        deliver(record->input, record->value);
+    }
+}
+
+/* The scheduler moved to another tick (a state is restored): the replay continues from the first input
+   of this tick, the recorded inputs after it are dropped as they belong to the abandoned run */
+void journal_seek(uint64_t tick) {
+    if(mode == JOURNAL_REPLAY) {
+        next_record = 0;
+        while((next_record < records_num) && (records[next_record].tick < tick)) {
+            next_record++;
+        }
+    } else if(mode == JOURNAL_RECORD) {
+        uint32_t num = records_num;
+        while((records_num > 0) && (records[records_num - 1].tick >= tick)) {
+            records_num--;
+        }
+        if(records_num != num) {
+            write_journal();
+        }
+    }
+}
+
+void journal_reset(void) {
+    journal_stop();
+    memset(inputs, 0, sizeof(inputs));
+    inputs_num = 0;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include "utils.h"
+
+/* Input journal: the inputs that come from outside the machine (keyboard scan codes, serial port
+   bytes, wire states set by python) go through input_send(). In record mode every input is written
+   to the journal file with its tick number, in replay mode the inputs are read from the file and
+   delivered by run_ticks() at the same ticks, so a run can be repeated bit-exactly from any state
+   saved by the modules. Built into the scheduler module */
+
+#define INPUTS_MAX_NUM      32
+#define INPUT_NAME_LEN      32
+#define JOURNAL_MAGIC       "X86INPUT"
+#define JOURNAL_VERSION     1
+#define JOURNAL_NO_TICK     0xFFFFFFFFFFFFFFFFULL
+
+// Journal file: magic, version, record size, number of inputs, their names (INPUT_NAME_LEN each), records
+#pragma pack(push, 1)
+typedef struct {
+    uint64_t tick;          // Number of ticks done when the input came, it is delivered before the next one
+    uint16_t input;         // Index in the names of the file
+    uint8_t value;
+} journal_record_t;
+#pragma pack(pop)
+
+typedef void(*input_func_t)(uint8_t);
+
+DLL_PREFIX int input_add(const char *name, input_func_t func);
+DLL_PREFIX void input_send(uint32_t input, uint8_t value);
+DLL_PREFIX int journal_record(const char *filename);
+DLL_PREFIX int journal_replay(const char *filename);
+DLL_PREFIX void journal_stop(void);
+
+// Used by the scheduler
+uint64_t journal_next_tick(void);
+void journal_deliver(uint64_t tick);
+void journal_seek(uint64_t tick);
+void journal_reset(void);
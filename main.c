@@ -2,36 +2,410 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-// #include "utils.h"
+#include <time.h>
+#include "static_devices.h"
+#include "pins.h"
 #include "devices/8086_cpu.h"
-// #include "8086_io.h"
-// #include "devices/8259a_interrupt_controller.h"
+#include "devices/8086_mem.h"
 
-// #include "log_server_iface/logs_win.h"
+/* Native runner: runs the machine of config.toml without python (python build.py runner -> bin/x86emu.exe).
+   The modules come from the single library build, see static_devices.h, they are connected the same
+   way system.py does it. Run from the repository root: the BIOS, logs and data paths are relative */
 
-void test_mem_write(uint32_t addr, uint16_t value, uint8_t width) {
-    printf("TEST_MEM_WRITE: addr = 0x%06X, value: 0x%04X, width: %d\n", addr, value, width);
+#define RUNNER_MAX_LOG_LEVELS   32
+#define RUNNER_NO_TICK          0xFFFFFFFFFFFFFFFFULL
+
+// Module specific functions, the symbols are prefixed with the config.toml module name
+uint32_t ioc_map_device(uint32_t start_addr, uint32_t end_addr, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func));
+void memory_set_code_write_hook(void(*hook)(uint32_t));
+void memory_set_ram_map_hook(void(*hook)(uint8_t*, uint8_t*));
+uint8_t *memory_mem_get_ram(void);
+uint8_t *memory_mem_get_page_attrs(void);
+int memory_mem_set_backing(uint8_t mode);
+void cpu_connect_address_space(uint8_t space_type, WRITE_FUNC_PTR(write_func), READ_FUNC_PTR(read_func));
+void cpu_set_code_read_func(READ_FUNC_PTR(read_func));
+void cpu_set_memory_map(uint8_t *ram, uint8_t *page_attrs);
+void cpu_cpu_invalidate_code(uint32_t addr);
+void cpu_cpu_set_jit_mode(uint8_t mode);
+void cpu_cpu_set_timing(uint8_t mode);
+void cpu_cpu_print_block_stats(void);
+uint64_t cpu_cpu_get_ticks(void);
+uint16_t *cpu_cpu_get_register_ptr(uint8_t reg);
+void scheduler_scheduler_reset(void);
+int scheduler_scheduler_add_device(const char *name, int(*tick_func)(uint32_t), uint32_t(*next_event_func)(uint32_t), int(*run_func)(uint32_t, uint32_t*));
+void scheduler_scheduler_set_ticks(uint64_t new_ticks);
+uint64_t *scheduler_scheduler_get_ticks_ptr(void);
+void scheduler_scheduler_wakeup(void);
+int scheduler_scheduler_get_error(void);
+uint64_t scheduler_run_ticks(uint64_t n);
+void scheduler_wires_reset(void);
+int scheduler_wire_create(const char *name);
+int scheduler_wire_connect(uint32_t wire, pin_t *pin);
+void scheduler_wire_set_state(uint32_t wire, uint8_t new_state);
+int scheduler_input_add(const char *name, void(*func)(uint8_t));
+int scheduler_journal_replay(const char *filename);
+void scheduler_wires_checkpoint(void);
+void scheduler_wires_restore_checkpoint(uint64_t tick);
+int scheduler_snapshot_truncate(uint64_t tick);
+uint64_t scheduler_snapshot_last_tick(void);
+
+typedef struct {
+    const static_device_t *device;
+    uint8_t log_level;
+    uint64_t tick;          // RUNNER_NO_TICK - set at start
+} log_level_change_t;
+
+typedef struct {
+    uint64_t max_ticks;
+    uint64_t snapshot_at;   // RUNNER_NO_TICK - no snapshot
+    uint8_t jit_mode;
+    uint8_t timing;                 // 0 - one tick per instruction, 1 - one tick per clock cycle
+    uint8_t restore;
+    uint8_t ram_backing;            // MEM_BACKING_*
+    uint64_t checkpoint_every;      // 0 - no checkpoints
+    uint8_t restore_checkpoint;
+    uint64_t checkpoint_tick;       // RUNNER_NO_TICK - the last checkpoint
+    const char *replay_inputs;      // Input journal file, NULL - no replay
+    log_level_change_t log_levels[RUNNER_MAX_LOG_LEVELS];
+    uint32_t log_levels_num;
+} runner_options_t;
+
+static runner_options_t options = {.max_ticks = RUNNER_NO_TICK, .snapshot_at = RUNNER_NO_TICK};
+static uint64_t ticks = 0;
+static uint64_t next_checkpoint = 0;
+static uint8_t snapshot_started = 0;    // The first checkpoint of a new run starts a new snapshot file
+
+// Creates the wires of config.toml in the wire fabric of the scheduler module (wires.c)
+static int connect_wires(void) {
+    scheduler_wires_reset();
+    for(uint32_t i=0; i<static_get_wires_num(); i++) {
+        const static_wire_t *config = static_get_wire(i);
+        int wire = scheduler_wire_create(config->name);
+        if(wire < 0) {
+            return EXIT_FAILURE;
+        }
+        for(uint8_t j=0; j<config->pins_num; j++) {
+            if(scheduler_wire_connect(wire, config->pins[j]) < 0) {
+                printf("ERROR: Cannot connect %s to wire %s\n", config->pin_names[j], config->name);
+                return EXIT_FAILURE;
+            }
+        }
+        scheduler_wire_set_state(wire, config->default_state);
+    }
+    return EXIT_SUCCESS;
+}
+
+static const static_device_t *get_device(const char *name) {
+    const static_device_t *dev = static_find_device(name);
+    if(dev == NULL) {
+        printf("ERROR: Module %s is not found\n", name);
+    }
+    return dev;
+}
+
+// Same as system_init() in system.py
+static int system_init(void) {
+    const static_device_t *ioc = get_device("ioc");
+    const static_device_t *memory = get_device("memory");
+    if((ioc == NULL) || (memory == NULL) || (get_device("cpu") == NULL) || (get_device("scheduler") == NULL)) {
+        return EXIT_FAILURE;
+    }
+    scheduler_scheduler_reset();
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(strcmp(dev->type, "scheduler") == 0) {
+            continue;
+        }
+        char trace_file[64];
+        snprintf(trace_file, sizeof(trace_file), "logs/%s.trace", dev->name);
+        dev->module_reset();
+        dev->set_trace_file(trace_file);
+        dev->set_scheduler_hooks(scheduler_scheduler_get_ticks_ptr(), scheduler_scheduler_wakeup);
+        if(scheduler_scheduler_add_device(dev->name, dev->module_tick, dev->module_next_event, dev->module_run) < 0) {
+            printf("ERROR: Cannot add device %s to the scheduler\n", dev->name);
+            return EXIT_FAILURE;
+        }
+        if(dev->module_input && (scheduler_input_add(dev->name, dev->module_input) < 0)) {
+            return EXIT_FAILURE;
+        }
+    }
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(strcmp(dev->type, "device") != 0) {
+            continue;
+        }
+        for(uint8_t j=0; j<dev->ranges_num; j++) {
+            ioc_map_device(dev->address_ranges[j][0], dev->address_ranges[j][1], dev->data_write, dev->data_read);
+        }
+    }
+    if(connect_wires() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    cpu_connect_address_space(0, ioc->data_write, ioc->data_read);
+    cpu_connect_address_space(1, memory->data_write, memory->data_read);
+    cpu_set_code_read_func(memory->code_read);
+    memory_set_code_write_hook(cpu_cpu_invalidate_code);
+    memory_set_ram_map_hook(cpu_set_memory_map);
+    cpu_set_memory_map(memory_mem_get_ram(), memory_mem_get_page_attrs());
+    cpu_cpu_set_jit_mode(options.jit_mode);
+    cpu_cpu_set_timing(options.timing);
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(dev->set_trace_source) {
+            dev->set_trace_source(cpu_cpu_get_register_ptr(CS_register), cpu_cpu_get_register_ptr(IP_register));
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// Writes the state files of all the modules (data/*.bin)
+static void save_devices(void) {
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(dev->module_save) {
+            dev->module_save();
+        }
+    }
+}
+
+static void restore_devices(void) {
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(dev->module_restore) {
+            dev->module_restore();
+        }
+    }
+    ticks = cpu_cpu_get_ticks();
+    scheduler_scheduler_set_ticks(ticks);
+}
+
+// Appends the RAM pages written since the previous checkpoint and the registers to the snapshot file
+static void checkpoint(void) {
+    if(!snapshot_started) {
+        remove(SNAPSHOT_FILE);
+        snapshot_started = 1;
+    }
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(dev->module_checkpoint) {
+            dev->module_checkpoint();
+        }
+    }
+    scheduler_wires_checkpoint();
+}
+
+static int restore_checkpoint(uint64_t tick) {
+    if(tick == RUNNER_NO_TICK) {
+        tick = scheduler_snapshot_last_tick();
+    }
+    if((tick == SNAPSHOT_NO_TICK) || (scheduler_snapshot_truncate(tick) != EXIT_SUCCESS)) {
+        printf("ERROR: Cannot restore checkpoint from %s\n", SNAPSHOT_FILE);
+        return EXIT_FAILURE;
+    }
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(dev->module_restore_checkpoint) {
+            dev->module_restore_checkpoint(tick);
+        }
+    }
+    scheduler_wires_restore_checkpoint(tick);
+    ticks = tick;
+    scheduler_scheduler_set_ticks(ticks);
+    snapshot_started = 1;
+    next_checkpoint = ticks + options.checkpoint_every;
+    return EXIT_SUCCESS;
+}
+
+static void flush_logs(void) {
+    for(uint32_t i=0; i<static_get_devices_num(); i++) {
+        const static_device_t *dev = static_get_device(i);
+        if(dev->log_flush) {
+            dev->log_flush();
+        }
+    }
+}
+
+// at_start - the changes without a tick are applied too
+static void apply_log_levels(uint8_t at_start) {
+    for(uint32_t i=0; i<options.log_levels_num; i++) {
+        log_level_change_t *change = &options.log_levels[i];
+        if((at_start && (change->tick == RUNNER_NO_TICK)) || (change->tick == ticks)) {
+            printf("Setting log_level for %s to %d at tick %llu\n", change->device->name, change->log_level, (unsigned long long)ticks);
+            change->device->set_log_level(change->log_level);
+        }
+    }
+}
+
+// Returns the tick number where the run has to stop to apply an option, see DevManager._next_stop()
+static uint64_t next_stop(void) {
+    uint64_t target = options.max_ticks;
+    if((options.snapshot_at > ticks) && (options.snapshot_at < target)) {
+        target = options.snapshot_at;
+    }
+    if(options.checkpoint_every && (next_checkpoint > ticks) && (next_checkpoint < target)) {
+        target = next_checkpoint;
+    }
+    for(uint32_t i=0; i<options.log_levels_num; i++) {
+        uint64_t tick = options.log_levels[i].tick;
+        if((tick != RUNNER_NO_TICK) && (tick > ticks) && (tick < target)) {
+            target = tick;
+        }
+    }
+    return target;
+}
+
+static int run(void) {
+    while(ticks < options.max_ticks) {
+        if(options.checkpoint_every && (ticks >= next_checkpoint)) {
+            checkpoint();
+            next_checkpoint = ticks + options.checkpoint_every;
+        }
+        uint64_t num_ticks = next_stop() - ticks;
+        uint64_t done = scheduler_run_ticks(num_ticks);
+        ticks += done;
+        if(done != num_ticks) {
+            printf("Device failed at tick %llu with status %d\n", (unsigned long long)(ticks + 1), scheduler_scheduler_get_error());
+            return EXIT_FAILURE;
+        }
+        if(ticks == options.snapshot_at) {
+            save_devices();
+            printf("Target ticks %llu reached, devices state saved!\n", (unsigned long long)ticks);
+        }
+        apply_log_levels(0);
+    }
+    return EXIT_SUCCESS;
+}
+
+static void print_usage(void) {
+    printf("Usage: x86emu [options]\n");
+    printf("  --ticks N                   stop after N ticks, runs until a device fails by default\n");
+    printf("  --snapshot-at N             save the state of the modules (data/*.bin) at tick N\n");
+    printf("  --log-level MODULE=LEVEL    set the log level of the module, MODULE=LEVEL@N - at tick N\n");
+    printf("  --jit MODE                  0 - interpreter, 1 - compile hot blocks, 2 - check compiled blocks\n");
+    printf("  --timing MODE               0 - a tick is an instruction, 1 - a tick is a CPU clock cycle\n");
+    printf("  --continue                  restore the modules from data/*.bin\n");
+    printf("  --ram-file private          --continue maps the memory dump copy-on-write instead of reading it\n");
+    printf("  --ram-file shared           the RAM is kept in data/memory_dump.bin, other programs can read it live\n");
+    printf("  --checkpoint-every N        append an incremental checkpoint to %s every N ticks\n", SNAPSHOT_FILE);
+    printf("  --restore-checkpoint N      restore the checkpoint at tick N, 'latest' - the last one\n");
+    printf("  --replay-inputs FILE        replay the inputs of the journal file recorded by system.py --record-inputs\n");
+}
+
+static int parse_log_level(char *arg) {
+    if(options.log_levels_num >= RUNNER_MAX_LOG_LEVELS) {
+        printf("ERROR: Too many log level options\n");
+        return EXIT_FAILURE;
+    }
+    log_level_change_t *change = &options.log_levels[options.log_levels_num];
+    char *level = strchr(arg, '=');
+    if(level == NULL) {
+        printf("ERROR: Log level option %s is not MODULE=LEVEL\n", arg);
+        return EXIT_FAILURE;
+    }
+    *level++ = '\0';
+    char *tick = strchr(level, '@');
+    change->tick = RUNNER_NO_TICK;
+    if(tick) {
+        *tick++ = '\0';
+        change->tick = strtoull(tick, NULL, 0);
+    }
+    change->log_level = strtoul(level, NULL, 0);
+    change->device = get_device(arg);
+    if(change->device == NULL) {
+        return EXIT_FAILURE;
+    }
+    options.log_levels_num++;
+    return EXIT_SUCCESS;
 }
 
-uint16_t test_mem_read(uint32_t addr, uint8_t width) {
-    printf("TEST_MEM_READ: addr = 0x%06X, width: %d\n", addr, width);
-    return 0x1234;
+static int parse_args(int argc, char *argv[]) {
+    for(int i=1; i<argc; i++) {
+        char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if(strcmp(argv[i], "--continue") == 0) {
+            options.restore = 1;
+            continue;
+        }
+        if(value == NULL) {
+            printf("ERROR: Unknown option or missing value: %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        i++;
+        if(strcmp(argv[i - 1], "--ticks") == 0) {
+            options.max_ticks = strtoull(value, NULL, 0);
+        } else if(strcmp(argv[i - 1], "--snapshot-at") == 0) {
+            options.snapshot_at = strtoull(value, NULL, 0);
+        } else if(strcmp(argv[i - 1], "--checkpoint-every") == 0) {
+            options.checkpoint_every = strtoull(value, NULL, 0);
+        } else if(strcmp(argv[i - 1], "--restore-checkpoint") == 0) {
+            options.restore_checkpoint = 1;
+            options.checkpoint_tick = (strcmp(value, "latest") == 0) ? RUNNER_NO_TICK : strtoull(value, NULL, 0);
+        } else if(strcmp(argv[i - 1], "--replay-inputs") == 0) {
+            options.replay_inputs = value;
+        } else if(strcmp(argv[i - 1], "--ram-file") == 0) {
+            if(strcmp(value, "private") == 0) {
+                options.ram_backing = MEM_BACKING_PRIVATE;
+            } else if(strcmp(value, "shared") == 0) {
+                options.ram_backing = MEM_BACKING_SHARED;
+            } else {
+                printf("ERROR: Unknown RAM file mode: %s\n", value);
+                return EXIT_FAILURE;
+            }
+        } else if(strcmp(argv[i - 1], "--jit") == 0) {
+            options.jit_mode = strtoul(value, NULL, 0);
+        } else if(strcmp(argv[i - 1], "--timing") == 0) {
+            options.timing = strtoul(value, NULL, 0);
+        } else if(strcmp(argv[i - 1], "--log-level") == 0) {
+            if(parse_log_level(value) != EXIT_SUCCESS) {
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("ERROR: Unknown option: %s\n", argv[i - 1]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
-    uint8_t data[6] = {0xC5, 0x1E, 0x74, 0x00, 0x58, 0xB9};
-    // uint8_t data[6] = {0xFF, 0xA4, 0x45, 0xF0, 0xFF, 0xFF};
-    module_reset();
-    connect_address_space(0, &test_mem_write, &test_mem_read);
-    connect_address_space(1, &test_mem_write, &test_mem_read);
-    operands_t operands = decode_operands(data[0] | 0x02, &(data[1]), 0);
-    printf("Instruction 0xFF: operands.source: %s\n", operands.source);
-    printf("Instruction 0xFF: operands.src_val = 0x%04X\n", operands.src_val);
-    printf("Instruction 0xFF: operands.src_addr = 0x%06X\n", operands.src.address);
-    printf("Instruction 0xFF: operands.src_type = %d\n", operands.src_type);
-    printf("Instruction 0xFF: operands.destination: %s\n", operands.destination);
-    printf("Instruction 0xFF: operands.dst_val = 0x%04X\n", operands.dst_val);
-    printf("Instruction 0xFF: operands.dst_addr = 0x%06X\n", operands.dst.address);
-    printf("Instruction 0xFF: operands.dst_type = %d\n", operands.dst_type);
-    return 0;
+    if(parse_args(argc, argv) != EXIT_SUCCESS) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+    if(system_init() != EXIT_SUCCESS) {
+        return EXIT_FAILURE;
+    }
+    if(options.ram_backing == MEM_BACKING_PRIVATE) {
+        memory_mem_set_backing(MEM_BACKING_PRIVATE);
+    }
+    if(options.restore) {
+        printf("Restoring devices\n");
+        restore_devices();
+    } else if(options.restore_checkpoint) {
+        printf("Restoring checkpoint\n");
+        if(restore_checkpoint(options.checkpoint_tick) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    // After the restore: switching to the shared file writes the current RAM into it
+    if((options.ram_backing == MEM_BACKING_SHARED) && (memory_mem_set_backing(MEM_BACKING_SHARED) != EXIT_SUCCESS)) {
+        return EXIT_FAILURE;
+    }
+    if(options.replay_inputs && (scheduler_journal_replay(options.replay_inputs) != EXIT_SUCCESS)) {
+        return EXIT_FAILURE;
+    }
+    apply_log_levels(1);
+    uint64_t start_ticks = ticks;
+    clock_t start = clock();
+    int res = run();
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if(seconds <= 0) {
+        seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+    printf("%llu ticks in %.3f s: %.0f ticks/s\n", (unsigned long long)(ticks - start_ticks), seconds, (ticks - start_ticks) / seconds);
+    printf("Saving devices . . . ");
+    save_devices();
+    cpu_cpu_print_block_stats();
+    flush_logs();
+    printf("Done\n");
+    return res;
 }
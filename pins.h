@@ -10,7 +10,7 @@ typedef enum {
     PIN_OUTPUT_OC,
 } pin_type_t;
 
-void dummy_cb(uint8_t new_state){}
+static inline void dummy_cb(uint8_t new_state){}
 
 typedef struct pin_t {
     uint8_t state;
@@ -0,0 +1,254 @@
+#include "scheduler.h"
+#include "journal.h"
+#include <string.h>
+
+#define SCHEDULER_LOG_FILE "logs/scheduler.log"
+
+typedef struct {
+    char name[SCHEDULER_NAME_LEN];
+    tick_func_t tick;
+    next_event_func_t next_event;   // NULL for devices which have to be ticked every tick
+    run_func_t run;                 // Optional, runs several ticks of an always ticked device at once
+} sched_device_t;
+
+typedef struct {
+    uint64_t deadline;              // Tick number when the device has to be ticked
+    uint32_t device;
+} event_t;
+
+static sched_device_t devices[SCHEDULER_MAX_DEVICES];
+static uint32_t devices_num = 0;
+static uint32_t always_ticked[SCHEDULER_MAX_DEVICES];
+static uint32_t always_ticked_num = 0;
+static event_t events[SCHEDULER_MAX_DEVICES];   // Min-heap of the pending deadlines
+static uint32_t events_num = 0;
+static uint8_t rescan_needed = 0;
+static uint64_t ticks = 0;
+static int error = 0;
+
+static uint8_t event_before(event_t *a, event_t *b) {
+    if(a->deadline == b->deadline) {
+        return a->device < b->device;   // Keep devices with the same deadline in the order they were added
+    }
+    return a->deadline < b->deadline;
+}
+
+static void heap_push(event_t event) {
+    uint32_t idx = events_num++;
+    events[idx] = event;
+    while(idx > 0) {
+        uint32_t parent = (idx - 1) / 2;
+        if(!event_before(&events[idx], &events[parent])) {
+            break;
+        }
+        event_t temp = events[parent];
+        events[parent] = events[idx];
+        events[idx] = temp;
+        idx = parent;
+    }
+}
+
+static event_t heap_pop(void) {
+    event_t top = events[0];
+    events[0] = events[--events_num];
+    uint32_t idx = 0;
+    while(1) {
+        uint32_t smallest = idx;
+        uint32_t left = 2 * idx + 1;
+        uint32_t right = 2 * idx + 2;
+        if((left < events_num) && event_before(&events[left], &events[smallest])) {
+            smallest = left;
+        }
+        if((right < events_num) && event_before(&events[right], &events[smallest])) {
+            smallest = right;
+        }
+        if(smallest == idx) {
+            break;
+        }
+        event_t temp = events[smallest];
+        events[smallest] = events[idx];
+        events[idx] = temp;
+        idx = smallest;
+    }
+    return top;
+}
+
+static void schedule_device(uint32_t idx) {
+    uint32_t delay = devices[idx].next_event((uint32_t)ticks);
+    if(delay == NO_PENDING_EVENT) {
+        return;
+    }
+    event_t event = {
+        .deadline = ticks + ((delay > 0) ? delay : 1),
+        .device = idx,
+    };
+    heap_push(event);
+}
+
+static void rebuild_events(void) {
+    rescan_needed = 0;
+    events_num = 0;
+    for(uint32_t i=0; i<devices_num; i++) {
+        if(devices[i].next_event) {
+            schedule_device(i);
+        }
+    }
+}
+
+static int run_device(uint32_t idx, uint64_t end) {
+    uint64_t start = ticks;
+    uint32_t done = 0;
+    uint64_t max_ticks = end - ticks;
+    int res = devices[idx].run((max_ticks > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)max_ticks, &done);
+    ticks = start + done;
+    if(res != 0) {
+        error = res;
+        ticks++;    // The failed tick, as with tick_device()
+        printf("%lld, Device %s failed with status %d\n", (long long)ticks, devices[idx].name, res);
+    }
+    return res;
+}
+
+static int tick_device(uint32_t idx) {
+    int res = devices[idx].tick((uint32_t)ticks);
+    if(res != 0) {
+        error = res;
+        printf("%lld, Device %s failed with status %d\n", (long long)ticks, devices[idx].name, res);
+    }
+    return res;
+}
+
+DLL_PREFIX
+void scheduler_reset(void) {
+    memset(devices, 0, sizeof(devices));
+    devices_num = 0;
+    always_ticked_num = 0;
+    events_num = 0;
+    rescan_needed = 0;
+    ticks = 0;
+    error = 0;
+    journal_reset();
+}
+
+/* Registers a device, returns the device index or -1 on failure.
+   Devices without next_event_func are ticked every tick in the order they were added,
+   the rest are ticked only when the deadline they reported is reached.
+   run_func may be NULL, it is used between the deadlines when the device is the only
+   always ticked one: it runs up to the given number of ticks, advances system_ticks
+   for every tick it runs and returns the number of completed ticks through the pointer */
+DLL_PREFIX
+int scheduler_add_device(const char *name, tick_func_t tick_func, next_event_func_t next_event_func, run_func_t run_func) {
+    if(devices_num == SCHEDULER_MAX_DEVICES) {
+        printf("ERROR: Cannot add device %s: too many devices\n", name);
+        return -1;
+    }
+    if(tick_func == NULL) {
+        printf("ERROR: Cannot add device %s: tick function is NULL\n", name);
+        return -1;
+    }
+    strncpy(devices[devices_num].name, name, SCHEDULER_NAME_LEN - 1);
+    devices[devices_num].tick = tick_func;
+    devices[devices_num].next_event = next_event_func;
+    devices[devices_num].run = run_func;
+    if(next_event_func == NULL) {
+        always_ticked[always_ticked_num++] = devices_num;
+    }
+    rescan_needed = 1;
+    mylog(1, SCHEDULER_LOG_FILE, "Device %s added with index %d (%s)\n", name, devices_num, next_event_func ? "event driven" : "ticked every tick");
+    return devices_num++;
+}
+
+DLL_PREFIX
+void scheduler_set_ticks(uint64_t new_ticks) {
+    ticks = new_ticks;
+    rescan_needed = 1;
+    journal_seek(new_ticks);
+}
+
+DLL_PREFIX
+uint64_t scheduler_get_ticks(void) {
+    return ticks;
+}
+
+/* The devices read the current tick through this pointer (see set_scheduler_hooks()) */
+DLL_PREFIX
+uint64_t *scheduler_get_ticks_ptr(void) {
+    return &ticks;
+}
+
+/* Called by devices when their next deadline changes */
+DLL_PREFIX
+void scheduler_wakeup(void) {
+    rescan_needed = 1;
+}
+
+/* Returns the status returned by the device that stopped the last run, 0 if none */
+DLL_PREFIX
+int scheduler_get_error(void) {
+    return error;
+}
+
+/* Runs n ticks, stops on the first device returning non-zero.
+   Returns the number of completely processed ticks */
+DLL_PREFIX
+uint64_t run_ticks(uint64_t n) {
+    uint64_t start = ticks;
+    uint64_t end = ticks + n;
+    error = 0;
+    while(ticks < end) {
+        uint64_t input_tick = journal_next_tick();
+        if(input_tick <= ticks) {
+            journal_deliver(ticks);     // Replayed inputs come between the ticks, as they were recorded
+            input_tick = journal_next_tick();
+        }
+        if(rescan_needed) {
+            rebuild_events();
+        }
+        // Burst: no deadlines until burst_end, only the always ticked devices (the CPU) run
+        uint64_t burst_end = end;
+        if((events_num > 0) && (events[0].deadline - 1 < burst_end)) {
+            burst_end = events[0].deadline - 1;
+        }
+        if(input_tick < burst_end) {
+            burst_end = input_tick;
+        }
+        if((always_ticked_num == 1) && devices[always_ticked[0]].run) {
+            while((ticks < burst_end) && !rescan_needed) {
+                if(run_device(always_ticked[0], burst_end)) {
+                    return ticks - start - 1;
+                }
+            }
+        }
+        while((ticks < burst_end) && !rescan_needed) {
+            ticks++;
+            for(uint32_t i=0; i<always_ticked_num; i++) {
+                if(tick_device(always_ticked[i])) {
+                    return ticks - start - 1;
+                }
+            }
+        }
+        if(rescan_needed || (ticks == end) || (ticks == input_tick)) {
+            continue;
+        }
+        // Next tick has at least one deadline: the due devices and the always ticked ones
+        // are ticked in the order they were added, as if every device was ticked every tick
+        ticks++;
+        uint8_t due[SCHEDULER_MAX_DEVICES] = {0};
+        while((events_num > 0) && (events[0].deadline <= ticks)) {
+            due[heap_pop().device] = 1;
+        }
+        for(uint32_t i=0; i<devices_num; i++) {
+            if(devices[i].next_event && !due[i]) {
+                continue;
+            }
+            if(tick_device(i)) {
+                rescan_needed = 1;  // The due devices after it were not ticked and rescheduled
+                return ticks - start - 1;
+            }
+            if(devices[i].next_event) {
+                schedule_device(i);
+            }
+        }
+    }
+    return n;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include "utils.h"
+
+#define SCHEDULER_MAX_DEVICES   32
+#define SCHEDULER_NAME_LEN      32
+
+typedef int(*tick_func_t)(uint32_t);
+typedef uint32_t(*next_event_func_t)(uint32_t);
+typedef int(*run_func_t)(uint32_t, uint32_t*);
+
+DLL_PREFIX void scheduler_reset(void);
+DLL_PREFIX int scheduler_add_device(const char *name, tick_func_t tick_func, next_event_func_t next_event_func, run_func_t run_func);
+DLL_PREFIX void scheduler_set_ticks(uint64_t new_ticks);
+DLL_PREFIX uint64_t scheduler_get_ticks(void);
+DLL_PREFIX uint64_t *scheduler_get_ticks_ptr(void);
+DLL_PREFIX void scheduler_wakeup(void);
+DLL_PREFIX int scheduler_get_error(void);
+DLL_PREFIX uint64_t run_ticks(uint64_t n);
@@ -0,0 +1,44 @@
+#include "static_devices.h"
+#include <string.h>
+
+// Generated by build.py from config.toml (bin/static/static_table.c)
+extern const static_device_t static_devices[];
+extern const uint32_t static_devices_num;
+extern const static_wire_t static_wires[];
+extern const uint32_t static_wires_num;
+
+DLL_PREFIX
+uint32_t static_get_devices_num(void) {
+    return static_devices_num;
+}
+
+DLL_PREFIX
+const static_device_t *static_get_device(uint32_t index) {
+    if(index >= static_devices_num) {
+        return NULL;
+    }
+    return &static_devices[index];
+}
+
+DLL_PREFIX
+const static_device_t *static_find_device(const char *name) {
+    for(uint32_t i=0; i<static_devices_num; i++) {
+        if(strcmp(static_devices[i].name, name) == 0) {
+            return &static_devices[i];
+        }
+    }
+    return NULL;
+}
+
+DLL_PREFIX
+uint32_t static_get_wires_num(void) {
+    return static_wires_num;
+}
+
+DLL_PREFIX
+const static_wire_t *static_get_wire(uint32_t index) {
+    if(index >= static_wires_num) {
+        return NULL;
+    }
+    return &static_wires[index];
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include "utils.h"
+
+/* Single library build (python build.py static): every module of config.toml and its copy of utils.c
+   are linked into one library with the module symbols prefixed by the module name (cpu_module_tick,
+   memory_data_read), build.py generates the table of their entry points. Functions a module doesn't
+   have are NULL */
+
+#define STATIC_MAX_RANGES   4
+#define STATIC_MAX_PINS     8       // Pins connected to a wire
+
+typedef struct {
+    const char *name;       // config.toml target name, the symbol prefix of the module
+    const char *type;       // device, address_space, processor or scheduler
+    uint8_t ranges_num;
+    uint32_t address_ranges[STATIC_MAX_RANGES][2];
+    void(*set_log_func)(void(*)(const char*, char*));
+    void(*set_log_level)(uint8_t);
+    void(*set_trace_file)(const char*);
+    void(*set_trace_source)(uint16_t*, uint16_t*);
+    void(*set_scheduler_hooks)(uint64_t*, void(*)(void));
+    void(*log_flush)(void);
+    void(*module_reset)(void);
+    void(*module_save)(void);
+    void(*module_restore)(void);
+    void(*module_checkpoint)(void);
+    void(*module_restore_checkpoint)(uint64_t);
+    int(*module_tick)(uint32_t);
+    uint32_t(*module_next_event)(uint32_t);
+    int(*module_run)(uint32_t, uint32_t*);
+    WRITE_FUNC_PTR(data_write);
+    READ_FUNC_PTR(data_read);
+    READ_FUNC_PTR(code_read);
+    void(*module_input)(uint8_t);   // Input from the host, registered in the input journal of the scheduler
+} static_device_t;
+
+// Wire of config.toml, the pins are the pin_t structures of the modules (pins.h)
+typedef struct {
+    const char *name;
+    uint8_t default_state;
+    uint8_t pins_num;
+    struct pin_t *pins[STATIC_MAX_PINS];
+    const char *pin_names[STATIC_MAX_PINS];     // module.pin
+} static_wire_t;
+
+DLL_PREFIX uint32_t static_get_devices_num(void);
+DLL_PREFIX const static_device_t *static_get_device(uint32_t index);
+DLL_PREFIX const static_device_t *static_find_device(const char *name);
+DLL_PREFIX uint32_t static_get_wires_num(void);
+DLL_PREFIX const static_wire_t *static_get_wire(uint32_t index);
@@ -3,8 +3,8 @@ import os
 import sys
 import time
 
-from wires import (WireType, Wire)
-from device_manager import (DevModule, AddressSpace, Processor, DevManager)
+from wires import Wire
+from device_manager import (DevModule, AddressSpace, Processor, Scheduler, DevManager, STATIC_LIBRARY)
 from build import get_config
 
 
@@ -12,6 +12,12 @@ stop_main_thread = False
 main_thread = None
 mb = None
 wires = []
+static_build = False    # --static: the modules are loaded from the single library build
+CHECKPOINT_TICKS = 5_000_000    # --checkpoint: incremental snapshot period
+REWIND_TICKS = 1_000_000        # --rewind: period of the in-memory checkpoints mb.rewind_to() goes back to
+MEM_BACKING_PRIVATE = 1         # --ram-private: --continue maps the memory dump copy-on-write (devices/8086_mem.h)
+MEM_BACKING_SHARED = 2          # --ram-shared: the RAM is data/memory_dump.bin, other programs can read it live
+INPUT_JOURNAL_FILE = "data/inputs.bin"  # --record-inputs, --replay-inputs: the keyboard, serial and wire inputs
 
 
 def beep_wire_cb(new_state):
@@ -21,53 +27,73 @@ def beep_wire_cb(new_state):
         log_manager.send_data_to_console({"controls": {"beep-led": "off"}})
 
 
-def system_init():
-    global mb
+# Python callbacks of the UI wires
+wire_callbacks = {"beep_wire": beep_wire_cb}
+
+
+def build_machine(machine):
+    ''' Loads the modules of config.toml into the DevManager machine and connects them, returns its wires.
+        A machine with an instance directory loads its own copies of the modules there (see load_module()),
+        so several machines can run in one process '''
     config = get_config("config.toml")
+    instance_dir = machine.instance_dir
+    machine_wires = []
 
     # Instantiate devices
     for dev_name, dev_config in config.items():
         so_name = f"bin/{dev_name}.dll"
+        module_name = None
+        if static_build:
+            so_name = STATIC_LIBRARY
+            module_name = dev_name
         if dev_config["type"] == "device":
-            mb.add_device(DevModule(so_name), dev_name)
+            machine.add_device(DevModule(so_name, module_name, instance_dir), dev_name)
         elif dev_config["type"] == "address_space":
-            mb.add_device(AddressSpace(so_name), dev_name)
+            machine.add_device(AddressSpace(so_name, module_name, instance_dir), dev_name)
         elif dev_config["type"] == "processor":
-            mb.add_device(Processor(so_name), dev_name)
+            machine.add_device(Processor(so_name, module_name, instance_dir), dev_name)
+        elif dev_config["type"] == "scheduler":
+            machine.set_scheduler(Scheduler(so_name, module_name, instance_dir))
+        elif dev_config["type"] == "wire":
+            continue
         else:
             print(f"Unknown device type: {dev_config['type']}")
             os._exit(1)
     
     # Map devices
-    ioc = mb.devices["ioc"]
+    ioc = machine.devices["ioc"]
     for dev_name, dev_config in config.items():
         if dev_config['type'] == 'device':
-            dev = mb.devices[dev_name]
+            dev = machine.devices[dev_name]
             for addr_range in dev_config["address_ranges"]:
                 print(f"Mapping device {dev_name} at address range: {hex(addr_range[0])} - {hex(addr_range[1])}")
                 ioc.map_device(addr_range[0], addr_range[1], dev.data_write_p, dev.data_read_p)
 
-    wires_map = {
-        "nmi_wire": {"devices": {"cpu": "nmi_pin", "intc": "nmi_pin"}, "default_state": 0, "state_change_callback": None},
-        "int_wire": {"devices": {"cpu": "int_pin", "intc": "int_pin"}, "default_state": 0, "state_change_callback": None},
-        "int0_wire": {"devices": {"timer": "ch0_output_pin", "intc": "int0_pin"}, "default_state": 0, "state_change_callback": None},
-        "ch1_output_wire": {"devices": {"timer": "ch1_output_pin"}, "default_state": 0, "state_change_callback": None},
-        "ch2_output_wire": {"devices": {"timer": "ch2_output_pin"}, "default_state": 0, "state_change_callback": None},
-        "int1_wire": {"devices": {"ppi": "int1_pin", "intc": "int1_pin"}, "default_state": 0, "state_change_callback": None},
-        "beep_wire": {"devices": {"ppi": "beep_pin"}, "default_state": 0, "state_change_callback": beep_wire_cb},
-        "int6_wire": {"devices": {"fdc": "int6_pin", "intc": "int6_pin"}, "default_state": 0, "state_change_callback": None},
-    }
-
-    for wire_name, config in wires_map.items():
-        temp_wire = Wire(wire_name, config["state_change_callback"])
-        for dev, pin_name in config["devices"].items():
-            temp_wire.connect_device(mb.devices[dev].device, pin_name, dev)
-        temp_wire.set_state(config["default_state"])
-        wires.append(temp_wire)
-
-    mb.devices["cpu"].connect_address_space(0, mb.devices["ioc"].data_write_p, mb.devices["ioc"].data_read_p)
-    mb.devices["cpu"].connect_address_space(1, mb.devices["memory"].data_write_p, mb.devices["memory"].data_read_p)
-    mb.devices["cpu"].set_code_read_func(mb.devices["memory"].code_read_p)
+    # Wires are described in config.toml, the native runner (main.c) connects the same pins
+    for wire_name, wire_config in config.items():
+        if wire_config['type'] != 'wire':
+            continue
+        temp_wire = Wire(machine.scheduler, wire_name, wire_callbacks.get(wire_name))
+        for dev, pin_name in wire_config["pins"]:
+            temp_wire.connect_device(machine.devices[dev].device, pin_name, dev)
+        temp_wire.set_state(wire_config["default_state"])
+        machine_wires.append(temp_wire)
+
+    machine.devices["cpu"].connect_address_space(0, machine.devices["ioc"].data_write_p, machine.devices["ioc"].data_read_p)
+    machine.devices["cpu"].connect_address_space(1, machine.devices["memory"].data_write_p, machine.devices["memory"].data_read_p)
+    machine.devices["cpu"].set_code_read_func(machine.devices["memory"].code_read_p)
+    machine.devices["memory"].set_code_write_hook(machine.devices["cpu"].invalidate_code_p)
+    machine.devices["memory"].set_ram_map_hook(machine.devices["cpu"].set_memory_map_p)
+    machine.devices["cpu"].set_memory_map(machine.devices["memory"].ram_p, machine.devices["memory"].page_attrs_p)
+    machine.devices["cpu"].set_jit_mode(0)   # 1 - compile hot code blocks, 2 - check the compiled code against the interpreter
+    machine.devices["cpu"].set_timing(0)     # 1 - ticks are CPU clock cycles, the device delays are counted in cycles too
+    for _, dev in machine.devices.items():
+        dev.set_trace_source(machine.devices["cpu"].cs_p, machine.devices["cpu"].ip_p)
+    return machine_wires
+
+
+def system_init():
+    wires.extend(build_machine(mb))
 
 
 def test_system():
@@ -91,6 +117,8 @@ def exit_program():
     global stop_main_thread, main_thread, mb
     print("Saving devices . . . ", end='')
     mb.save_devices()
+    mb.devices["cpu"].print_block_stats()
+    mb.flush_logs()
     print("Done")
     print("Exit print thread . . . ", end='')
     log_manager.log_manager_exit()
@@ -100,14 +128,32 @@ def exit_program():
 
 
 def main():
-    global mb
+    global mb, static_build
+    static_build = "--static" in sys.argv[1:]
     try:
         log_manager.log_manager_init()
         mb = DevManager()
         system_init()
-        if len(sys.argv) > 1 and sys.argv[1] == "--continue":
+        if "--checkpoint" in sys.argv[1:]:
+            mb.checkpoint_every(CHECKPOINT_TICKS)
+        if "--rewind" in sys.argv[1:]:
+            mb.rewind_every(REWIND_TICKS)
+        if "--ram-private" in sys.argv[1:]:
+            mb.devices["memory"].mem_set_backing(MEM_BACKING_PRIVATE)
+        if "--continue" in sys.argv[1:]:
             print("Restoring devices")
             mb.restore_devices()
+        elif "--restore-checkpoint" in sys.argv[1:]:
+            print("Restoring the last checkpoint")
+            mb.restore_checkpoint()
+        # After the restore: switching to the shared file writes the current RAM into it
+        if "--ram-shared" in sys.argv[1:]:
+            mb.devices["memory"].mem_set_backing(MEM_BACKING_SHARED)
+        # After the restore: the journal starts at the tick of the restored state
+        if "--record-inputs" in sys.argv[1:]:
+            mb.record_inputs(INPUT_JOURNAL_FILE)
+        elif "--replay-inputs" in sys.argv[1:]:
+            mb.replay_inputs(INPUT_JOURNAL_FILE)
         
         mb.save_state_at(22_580_000)    # 20749786, 21423128
         # mb.set_log_level_at(['timer', 10, 0])
@@ -0,0 +1,245 @@
+#include "8086_cpu.h"
+#include "utils.h"
+#include "bench_cpu.h"
+#include <string.h>
+#include <time.h>
+
+void set_log_func(void(*python_log_func)(const char*, char*));
+void set_scheduler_hooks(uint64_t *ticks_source, void(*wakeup)(void));
+
+static uint8_t memory[BENCH_MEM_SIZE];
+static uint8_t ports[0x10000];     // IO reads return the last written value
+static uint8_t page_attrs[MEM_PAGES_NUM];   // All the pages are RAM accessed directly by the CPU
+
+// Reset vector jumps to BENCH_CODE_ADDR (F000:E000), the loop body mixes
+// register, memory, stack and flag-setting instructions
+static const uint8_t reset_code[] = {
+    0xEA, 0x00, 0xE0, 0x00, 0xF0,   // JMP F000:E000
+};
+
+static const uint8_t loop_code[] = {
+    0xB9, 0x00, 0x01,   // E000: MOV CX, 0x0100
+    0xB8, 0x34, 0x12,   // E003: MOV AX, 0x1234
+    0x89, 0xC3,         // E006: MOV BX, AX
+    0x01, 0xD8,         // E008: ADD AX, BX
+    0x40,               // E00A: INC AX
+    0x4B,               // E00B: DEC BX
+    0x89, 0x07,         // E00C: MOV [BX], AX
+    0x8B, 0x17,         // E00E: MOV DX, [BX]
+    0x31, 0xC0,         // E010: XOR AX, AX
+    0x3C, 0x05,         // E012: CMP AL, 5
+    0x50,               // E014: PUSH AX
+    0x58,               // E015: POP AX
+    0xE2, 0xEB,         // E016: LOOP E003
+    0xEB, 0xE6,         // E018: JMP E000
+};
+
+// REP string instructions over 32KB blocks: forward, backward, overlapping and wrapping the segment offset
+static const uint8_t rep_code[] = {
+    0xB8, 0x00, 0x10,   // E000: MOV AX, 0x1000
+    0x8E, 0xC0,         // E003: MOV ES, AX
+    0x8E, 0xD8,         // E005: MOV DS, AX
+    0xFC,               // E007: CLD
+    0x31, 0xFF,         // E008: XOR DI, DI
+    0xB9, 0x00, 0x40,   // E00A: MOV CX, 0x4000
+    0xB8, 0x34, 0x12,   // E00D: MOV AX, 0x1234
+    0xF3, 0xAB,         // E010: REP STOSW
+    0x31, 0xF6,         // E012: XOR SI, SI
+    0xBF, 0x00, 0x80,   // E014: MOV DI, 0x8000
+    0xB9, 0x00, 0x40,   // E017: MOV CX, 0x4000
+    0xF3, 0xA5,         // E01A: REP MOVSW
+    0xBE, 0x01, 0x00,   // E01C: MOV SI, 0x0001
+    0xBF, 0x02, 0x00,   // E01F: MOV DI, 0x0002
+    0xB9, 0x00, 0x10,   // E022: MOV CX, 0x1000
+    0xF3, 0xA5,         // E025: REP MOVSW (the destination overlaps the next sources)
+    0xFD,               // E027: STD
+    0xBE, 0xFF, 0x7F,   // E028: MOV SI, 0x7FFF
+    0xB9, 0x00, 0x10,   // E02B: MOV CX, 0x1000
+    0xF3, 0xAC,         // E02E: REP LODSB
+    0xBF, 0x04, 0x00,   // E030: MOV DI, 0x0004
+    0xB9, 0x00, 0x08,   // E033: MOV CX, 0x0800
+    0xF3, 0xAB,         // E036: REP STOSW (wraps DI)
+    0xBE, 0x00, 0x90,   // E038: MOV SI, 0x9000
+    0xBF, 0x10, 0x90,   // E03B: MOV DI, 0x9010
+    0xB9, 0x00, 0x04,   // E03E: MOV CX, 0x0400
+    0xF3, 0xA5,         // E041: REP MOVSW
+    0xFC,               // E043: CLD
+    0x31, 0xF6,         // E044: XOR SI, SI
+    0xBF, 0x01, 0x00,   // E046: MOV DI, 0x0001
+    0xB9, 0x00, 0x02,   // E049: MOV CX, 0x0200
+    0xF3, 0xA4,         // E04C: REP MOVSB
+    0xEB, 0xB0,         // E04E: JMP E000
+};
+
+static void bench_log(const char *log_file, char *buffer) {
+    return;
+}
+
+static uint16_t bench_mem_read(uint32_t addr, uint8_t width) {
+    addr &= BENCH_MEM_SIZE - 1;
+    if(width == 1) {
+        return memory[addr];
+    }
+    return memory[addr] | (memory[(addr + 1) & (BENCH_MEM_SIZE - 1)] << 8);
+}
+
+static void bench_mem_write(uint32_t addr, uint16_t value, uint8_t width) {
+    addr &= BENCH_MEM_SIZE - 1;
+    memory[addr] = value & 0xFF;
+    if(width == 2) {
+        memory[(addr + 1) & (BENCH_MEM_SIZE - 1)] = value >> 8;
+    }
+}
+
+static uint16_t bench_io_read(uint32_t addr, uint8_t width) {
+    return ports[addr & 0xFFFF];
+}
+
+static void bench_io_write(uint32_t addr, uint16_t value, uint8_t width) {
+    ports[addr & 0xFFFF] = value & 0xFF;
+}
+
+static uint8_t timing = 0;      // cpu_set_timing() mode, in mode 1 the instruction counts are clock cycles
+
+static void reset_cpu(uint8_t jit_mode) {
+    module_reset();
+    connect_address_space(0, bench_io_write, bench_io_read);
+    connect_address_space(1, bench_mem_write, bench_mem_read);
+    set_code_read_func(bench_mem_read);
+    set_memory_map(memory, page_attrs);
+    cpu_set_jit_mode(jit_mode);
+    cpu_set_timing(timing);
+}
+
+// Runs the CPU until the given number of instructions is executed or it fails
+static int run_cpu(uint32_t instructions, uint32_t *executed) {
+    *executed = 0;
+    while(*executed < instructions) {
+        uint32_t done = 0;
+        int res = module_run(instructions - *executed, &done);
+        *executed += done;
+        if(res != EXIT_SUCCESS) {
+            return res;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+static int load_rom(uint32_t addr, char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if(f == NULL) {
+        return EXIT_FAILURE;
+    }
+    size_t len = fread(&memory[addr], 1, BENCH_MEM_SIZE - addr, f);
+    fclose(f);
+    return (len > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void bench_rep_strings(uint32_t instructions, uint8_t jit_mode) {
+    memset(memory, 0, sizeof(memory));
+    memcpy(&memory[0xFFFF0], reset_code, sizeof(reset_code));
+    memcpy(&memory[BENCH_CODE_ADDR], rep_code, sizeof(rep_code));
+    reset_cpu(jit_mode);
+    uint32_t executed = 0;
+    clock_t start = clock();
+    if(run_cpu(instructions, &executed) != EXIT_SUCCESS) {
+        printf("ERROR: CPU failed after %u instructions of the REP string loop\n", executed);
+        return;
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if(seconds <= 0) {
+        seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+    printf("REP strings: %u instructions in %.3f s: %.0f instr/s, memory hash: 0x%016llX\n", executed, seconds, executed / seconds, (unsigned long long)get_hash(memory, sizeof(memory)));
+}
+
+static void bench_bios_post(uint8_t jit_mode) {
+    uint32_t executed = 0;
+    uint64_t total = 0;
+    clock_t elapsed = 0;
+    for(uint32_t i=0; i<BENCH_POST_RUNS; i++) {
+        memset(memory, 0, sizeof(memory));
+        memset(ports, 0, sizeof(ports));
+        if((load_rom(0xF0000, BENCH_BIOS_F0000) != EXIT_SUCCESS) || (load_rom(0xF8000, BENCH_BIOS_F8000) != EXIT_SUCCESS)) {
+            printf("BIOS images are not found, POST benchmark skipped\n");
+            return;
+        }
+        reset_cpu(jit_mode);
+        clock_t start = clock();
+        run_cpu(BENCH_POST_MAX_INSTR, &executed);   // Stops when the CPU halts
+        elapsed += clock() - start;
+        total += executed;
+    }
+    double seconds = (double)elapsed / CLOCKS_PER_SEC;
+    if(seconds <= 0) {
+        seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+    printf("BIOS POST: %u instructions per run, %llu in %.3f s: %.0f instr/s\n", executed, (unsigned long long)total, seconds, total / seconds);
+}
+
+// Runs the loop in the cycle timing mode from the given system tick, returns the memory hash
+static uint64_t run_wrap_loop(uint64_t *system_tick, uint64_t start, uint8_t jit_mode) {
+    memset(memory, 0, sizeof(memory));
+    memcpy(&memory[0xFFFF0], reset_code, sizeof(reset_code));
+    memcpy(&memory[BENCH_CODE_ADDR], loop_code, sizeof(loop_code));
+    *system_tick = start;
+    reset_cpu(jit_mode);
+    cpu_set_timing(1);
+    uint32_t executed = 0;
+    if(run_cpu(BENCH_WRAP_TICKS, &executed) != EXIT_SUCCESS) {
+        printf("ERROR: CPU failed after %u ticks from tick 0x%llX\n", executed, (unsigned long long)start);
+    }
+    if((cpu_get_ticks() != start + BENCH_WRAP_TICKS) || (*system_tick != start + BENCH_WRAP_TICKS)) {
+        printf("ERROR: Tick 0x%llX, CPU tick 0x%llX after %u ticks from tick 0x%llX\n", (unsigned long long)*system_tick,
+               (unsigned long long)cpu_get_ticks(), BENCH_WRAP_TICKS, (unsigned long long)start);
+    }
+    return get_hash(memory, sizeof(memory));
+}
+
+static void bench_tick_wrap(uint8_t jit_mode) {
+    static uint64_t system_tick = 0;
+    set_scheduler_hooks(&system_tick, NULL);
+    uint64_t hash = run_wrap_loop(&system_tick, 0, jit_mode);
+    uint64_t wrap_hash = run_wrap_loop(&system_tick, BENCH_WRAP_START, jit_mode);
+    set_scheduler_hooks(NULL, NULL);
+    if(hash != wrap_hash) {
+        printf("ERROR: Memory hash 0x%016llX across the 2^32 tick, 0x%016llX from tick 0\n", (unsigned long long)wrap_hash, (unsigned long long)hash);
+        return;
+    }
+    printf("Tick wrap: %u cycle timed ticks across the 2^32 tick, memory hash: 0x%016llX\n", BENCH_WRAP_TICKS, (unsigned long long)hash);
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t instructions = BENCH_INSTRUCTIONS;
+    if(argc > 1) {
+        instructions = strtoul(argv[1], NULL, 0);
+    }
+    uint8_t jit_mode = 0;   // bench_cpu [instructions] [jit_mode] [timing]
+    if(argc > 2) {
+        jit_mode = strtoul(argv[2], NULL, 0);
+    }
+    if(argc > 3) {
+        timing = strtoul(argv[3], NULL, 0);
+    }
+    set_log_func(bench_log);
+    memcpy(&memory[0xFFFF0], reset_code, sizeof(reset_code));
+    memcpy(&memory[BENCH_CODE_ADDR], loop_code, sizeof(loop_code));
+    reset_cpu(jit_mode);
+
+    clock_t start = clock();
+    uint32_t executed = 0;
+    if(run_cpu(instructions, &executed) != EXIT_SUCCESS) {
+        printf("ERROR: CPU failed after %u instructions\n", executed);
+        return EXIT_FAILURE;
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if(seconds <= 0) {
+        seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+    printf("Executed %u instructions in %.3f s: %.0f instr/s (JIT mode %d, timing %d)\n", executed, seconds, executed / seconds, jit_mode, timing);
+    printf("Memory hash: 0x%016llX\n", (unsigned long long)get_hash(memory, sizeof(memory)));
+    bench_rep_strings(instructions, jit_mode);
+    bench_bios_post(jit_mode);
+    bench_tick_wrap(jit_mode);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Micro-benchmark for the 8086 CPU core: runs a short register/memory loop
+// in a flat 1MB memory and reports the number of executed instructions per second
+
+#define BENCH_MEM_SIZE          0x100000
+#define BENCH_INSTRUCTIONS      20000000
+#define BENCH_CODE_ADDR         0xFE000
+
+// BIOS power-on self test: runs from reset until the CPU halts at the first device test that
+// fails (only a port latch is connected), so it measures the register, ALU and memory code of POST
+#define BENCH_POST_RUNS         10
+#define BENCH_POST_MAX_INSTR    10000000
+#define BENCH_BIOS_F0000        "BIOS/08NOV82_F0000.BIN"
+#define BENCH_BIOS_F8000        "BIOS/08NOV82_F8000.BIN"
+
+// Cycle timed run of the register/memory loop across the 2^32 system tick, it has to end in the same
+// state as the run from tick 0 and the CPU has to count the ticks past 2^32
+#define BENCH_WRAP_START        (0x100000000ULL - 1000000)
+#define BENCH_WRAP_TICKS        2000000
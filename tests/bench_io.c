@@ -0,0 +1,106 @@
+#include "8086_io.h"
+#include "utils.h"
+#include "bench_io.h"
+#include <time.h>
+
+static uint8_t ports[0x10000];      // Every mapped device latches the written values
+static uint64_t accesses = 0;
+
+// Address ranges of the devices in the order of config.toml
+static const uint32_t bench_ranges[][2] = {
+    {0x3F0, 0x3F7},     // fdc
+    {0x040, 0x043},     // timer
+    {0x3D0, 0x3DF},     // cga
+    {0x210, 0x217},     // io_exp_box
+    {0x3B0, 0x3BF},     // mda
+    {0x200, 0x20F}, {0x278, 0x27F}, {0x378, 0x37F},     // dummy
+    {0x2F8, 0x2FF}, {0x3F8, 0x3FF},     // serial_port
+    {0x060, 0x063},     // ppi
+    {0x0A0, 0x0AF}, {0x020, 0x021},     // intc
+    {0x080, 0x083}, {0x000, 0x00F},     // dma
+};
+
+static void bench_dev_write(uint32_t addr, uint16_t value, uint8_t width) {
+    ports[addr & 0xFFFF] = value & 0xFF;
+    accesses++;
+}
+
+static uint16_t bench_dev_read(uint32_t addr, uint8_t width) {
+    accesses++;
+    return ports[addr & 0xFFFF];
+}
+
+// 8259 initialization and the interrupt mask register test
+static uint32_t pic_segment(void) {
+    uint32_t sum = 0;
+    data_write(PIC_CMD_PORT, 0x13, 1);      // ICW1
+    data_write(PIC_DATA_PORT, 0x08, 1);     // ICW2
+    data_write(PIC_DATA_PORT, 0x09, 1);     // ICW4
+    data_write(PIC_DATA_PORT, 0x00, 1);     // OCW1
+    sum += data_read(PIC_DATA_PORT, 1);
+    data_write(PIC_DATA_PORT, 0xFF, 1);
+    sum += data_read(PIC_DATA_PORT, 1);
+    data_write(PIC_CMD_PORT, 0x0B, 1);      // OCW3, read ISR
+    sum += data_read(PIC_CMD_PORT, 1);
+    data_write(PIC_CMD_PORT, 0x20, 1);      // EOI
+    return sum;
+}
+
+// 8253 counter programming and the latch-and-read polling loop
+static uint32_t pit_segment(void) {
+    uint32_t sum = 0;
+    data_write(PIT_CONTROL_PORT, 0x54, 1);  // Counter 1, LSB, mode 2
+    data_write(PIT_COUNTER1_PORT, 0x12, 1);
+    for(uint32_t i=0; i<4; i++) {
+        data_write(PIT_CONTROL_PORT, 0x40, 1);  // Latch counter 1
+        sum += data_read(PIT_COUNTER1_PORT, 1);
+    }
+    data_write(PIT_CONTROL_PORT, 0x36, 1);  // Counter 0, LSB and MSB, mode 3
+    data_write(PIT_COUNTER0_PORT, 0x00, 1);
+    data_write(PIT_COUNTER0_PORT, 0x00, 1);
+    return sum;
+}
+
+// 8255 keyboard/speaker control and the switch reads
+static uint32_t ppi_segment(void) {
+    uint32_t sum = 0;
+    data_write(PPI_PORT_B, 0xCC, 1);
+    sum += data_read(PPI_PORT_A, 1);
+    data_write(PPI_PORT_B, 0x4C, 1);
+    sum += data_read(PPI_PORT_C, 1);
+    data_write(PPI_PORT_B, 0xCD, 1);
+    sum += data_read(PPI_PORT_B, 1);
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t rounds = BENCH_IO_ROUNDS;
+    if(argc > 1) {
+        rounds = strtoul(argv[1], NULL, 0);
+    }
+    module_reset();
+    for(uint32_t i=0; i<sizeof(bench_ranges)/sizeof(bench_ranges[0]); i++) {
+        if(map_device(bench_ranges[i][0], bench_ranges[i][1], bench_dev_write, bench_dev_read) == 0) {
+            printf("ERROR: Cannot map 0x%03X-0x%03X\n", bench_ranges[i][0], bench_ranges[i][1]);
+            return EXIT_FAILURE;
+        }
+    }
+    uint32_t sum = 0;
+    clock_t start = clock();
+    for(uint32_t i=0; i<rounds; i++) {
+        sum += pic_segment();
+        sum += pit_segment();
+        sum += ppi_segment();
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if(seconds <= 0) {
+        seconds = 1.0 / CLOCKS_PER_SEC;
+    }
+    if(get_io_error()) {
+        printf("ERROR: IO error during the benchmark\n");
+        return EXIT_FAILURE;
+    }
+    printf("PIC/PIT/PPI POST segments: %llu port accesses in %.3f s: %.0f accesses/s (checksum 0x%08X)\n",
+           (unsigned long long)accesses, seconds, accesses / seconds, sum);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Micro-benchmark for the IO address space: devices are mapped like in config.toml and the
+// port access patterns of the BIOS POST tests of the interrupt controller, timer and PPI are replayed
+
+#define BENCH_IO_ROUNDS     2000000
+
+#define PIC_CMD_PORT        0x20
+#define PIC_DATA_PORT       0x21
+#define PIT_COUNTER0_PORT   0x40
+#define PIT_COUNTER1_PORT   0x41
+#define PIT_CONTROL_PORT    0x43
+#define PPI_PORT_A          0x60
+#define PPI_PORT_B          0x61
+#define PPI_PORT_C          0x62
@@ -0,0 +1,51 @@
+#include "scheduler.h"
+#include "8086_mda.h"
+#include "utils.h"
+#include "test_scheduler.h"
+#include <string.h>
+
+void set_scheduler_hooks(uint64_t *ticks_source, void(*wakeup)(void));
+
+static uint64_t loop_ticks = 0;
+static uint8_t loop_status[TEST_TICKS + 1];     // MDA status read by the CPU at every tick
+static uint8_t sched_status[TEST_TICKS + 1];
+
+// Stands for the CPU polling the retrace bits, the CPU is added before the MDA like in config.toml
+static int cpu_tick(uint32_t ticks) {
+    sched_status[ticks_num] = data_read(MDA_STATUS_PORT, 1);
+    return 0;
+}
+
+int main(void) {
+    // Every device is ticked every tick in the order of config.toml
+    set_scheduler_hooks(&loop_ticks, NULL);
+    module_reset();
+    for(loop_ticks=1; loop_ticks<=TEST_TICKS; loop_ticks++) {
+        loop_status[loop_ticks] = data_read(MDA_STATUS_PORT, 1);
+        module_tick((uint32_t)loop_ticks);
+    }
+
+    // The CPU is ticked every tick, the MDA only when its deadline is reached
+    scheduler_reset();
+    set_scheduler_hooks(scheduler_get_ticks_ptr(), scheduler_wakeup);
+    module_reset();
+    scheduler_add_device("cpu", cpu_tick, NULL, NULL);
+    scheduler_add_device("mda", module_tick, module_next_event, NULL);
+    uint64_t done = run_ticks(TEST_TICKS);
+    if(done != TEST_TICKS) {
+        printf("ERROR: %llu ticks of %d are done\n", (unsigned long long)done, TEST_TICKS);
+    }
+    uint32_t toggles = 0;
+    for(uint32_t tick=2; tick<=TEST_TICKS; tick++) {
+        toggles += loop_status[tick] != loop_status[tick - 1];
+    }
+    for(uint32_t tick=1; tick<=TEST_TICKS; tick++) {
+        if(sched_status[tick] != loop_status[tick]) {
+            printf("ERROR: MDA status at tick %u is 0x%02X, the per-tick loop reads 0x%02X\n", tick, sched_status[tick], loop_status[tick]);
+            break;
+        }
+    }
+    if(toggles == 0) {
+        printf("ERROR: MDA status doesn't toggle in %d ticks\n", TEST_TICKS);
+    }
+}
\ No newline at end of file
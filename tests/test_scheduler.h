@@ -0,0 +1,10 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Unit test for the tick scheduler: the MDA retrace toggle driven by its deadlines has to be
+// seen by the CPU at the same ticks as in the loop which ticks every device every tick
+
+#define TEST_TICKS          1000
+#define MDA_STATUS_PORT     0x3BA
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "8253_timer.h"
+#include "utils.h"
+#include "test_timer.h"
+
+void set_scheduler_hooks(uint64_t *ticks_source, void(*wakeup)(void));
+
+static uint64_t ticks = 0;
+
+// Counter of a channel loaded at start_tick, as the per-tick loop counts it: the channels
+// count at every second module_tick() call and module_tick() is called from tick 1
+static uint16_t per_tick_counter(uint16_t value, uint64_t start_tick, uint64_t read_tick) {
+    uint16_t counter = value;
+    uint8_t tick_divider = 0;
+    for(uint64_t tick=1; tick<=read_tick; tick++) {
+        if(tick_divider) {
+            tick_divider = 0;
+            continue;
+        }
+        tick_divider++;
+        if(tick > start_tick) {
+            counter--;
+        }
+    }
+    return counter;
+}
+
+int main(void) {
+    set_scheduler_hooks(&ticks, NULL);
+    for(uint64_t gap=1; gap<=TEST_MAX_GAP; gap++) {
+        for(uint64_t delay=0; delay<=TEST_MAX_DELAY; delay++) {
+            ticks = 0;
+            module_reset();
+            ticks = gap;    // No channel counts until now
+            data_write(TIMER_CONTROL_PORT, 0x70, 1);    // Channel 1, LSB then MSB, mode 0
+            data_write(TIMER_COUNTER1_PORT, TEST_COUNT & 0xFF, 1);
+            data_write(TIMER_COUNTER1_PORT, TEST_COUNT >> 8, 1);
+            ticks = gap + delay;
+            uint16_t counter = data_read(TIMER_COUNTER1_PORT, 1);
+            counter |= data_read(TIMER_COUNTER1_PORT, 1) << 8;
+            uint16_t expected = per_tick_counter(TEST_COUNT, gap, gap + delay);
+            if(counter != expected) {
+                printf("ERROR: Counter 0x%04X after %llu idle ticks and %llu counting ticks, the per-tick loop reads 0x%04X\n",
+                       counter, (unsigned long long)gap, (unsigned long long)delay, expected);
+            }
+        }
+    }
+}
\ No newline at end of file
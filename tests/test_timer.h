@@ -0,0 +1,13 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Unit test for the 8253 timer: a channel programmed after an idle gap has to count
+// at the same ticks as in the loop which called module_tick() every tick
+
+#define TIMER_COUNTER1_PORT     0x41
+#define TIMER_CONTROL_PORT      0x43
+#define TEST_COUNT              0x1234
+#define TEST_MAX_GAP            7       // Idle ticks before the channel is programmed
+#define TEST_MAX_DELAY          9       // Ticks between programming and reading the counter
\ No newline at end of file
@@ -0,0 +1,64 @@
+import sys
+import os
+import struct
+
+# Renders the binary trace files written by the modules (logs/<module>.trace) in the text log format.
+# Usage: python trace_decoder.py logs/memory.trace [--location]
+# --location prefixes every line with the tick and CS:IP of the event
+
+TRACE_MAGIC = b"X86TRACE"
+TRACE_VERSION = 1
+HEADER_FORMAT = "<8sHH"
+RECORD_FORMAT = "<QIHHHBB"     # tick, addr, value, cs, ip, type, width (trace_record_t in utils.h)
+
+TRACE_MEM_READ = 0
+TRACE_MEM_WRITE = 1
+TRACE_IO_READ = 2
+TRACE_IO_WRITE = 3
+TRACE_INSTR = 4
+
+
+def render_record(tick, addr, value, cs, ip, rec_type, width):
+    if rec_type == TRACE_MEM_READ:
+        return f"MEM_READ  addr = 0x{addr:06X}, value = 0x{value:04X}, width = {width} byte(s)"
+    if rec_type == TRACE_MEM_WRITE:
+        return f"MEM_WRITE addr = 0x{addr:06X}, value = 0x{value:04X}, width = {width} byte(s)"
+    if rec_type == TRACE_IO_READ:
+        return f"{tick}, IO_READ addr = 0x{addr:04X}, width = {width} bytes value: 0x{value:04X}"
+    if rec_type == TRACE_IO_WRITE:
+        return f"{tick}, IO_WRITE addr = 0x{addr:04X}, value = 0x{value:04X}, width = {width} bytes"
+    if rec_type == TRACE_INSTR:
+        data = list(struct.pack("<IH", addr, value))
+        data_str = ' '.join(f"0x{b:02X}" for b in data)
+        return f"Step: {tick}, IP: 0x{ip:04X}, data: {data_str}"
+    return f"Unknown record type {rec_type}: addr = 0x{addr:06X}, value = 0x{value:04X}, width = {width}"
+
+
+def main(trace_file, location):
+    with open(trace_file, 'rb') as f:
+        data = f.read()
+    header_size = struct.calcsize(HEADER_FORMAT)
+    if len(data) < header_size:
+        print(f"ERROR: {trace_file} is too short")
+        return
+    magic, version, record_size = struct.unpack_from(HEADER_FORMAT, data)
+    if magic != TRACE_MAGIC or version != TRACE_VERSION or record_size != struct.calcsize(RECORD_FORMAT):
+        print(f"ERROR: {trace_file} is not a trace file of version {TRACE_VERSION}")
+        return
+    num_records = (len(data) - header_size) // record_size
+    print(f"Processing {num_records} records . . .")
+    lines = []
+    for record in struct.iter_unpack(RECORD_FORMAT, data[header_size:header_size + num_records * record_size]):
+        line = render_record(*record)
+        if location:
+            line = f"[{record[0]} {record[3]:04X}:{record[4]:04X}] {line}"
+        lines.append(line)
+    text_fname = os.path.splitext(trace_file)[0] + ".log"
+    with open(text_fname, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+    print(f"done: {text_fname}")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) >= 2:
+        main(sys.argv[1], "--location" in sys.argv[2:])
@@ -1,19 +1,60 @@
 #include "utils.h"
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
 #else
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #endif
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
 #include <time.h>
 // #include "log_server_iface/logs_win.h"
 
 #define BUFFER_SIZE 1024
 
 typedef void(*log_func_t)(const char*, char*);
-log_func_t print_log;
+log_func_t print_log = NULL;
 uint8_t device_log_level = 1;
 
+#define TRACE_RING_SIZE     0x10000     // Records, must be a power of 2
+#define TRACE_FILE_NAME_LEN 256
+#define INSTANCE_PATH_LEN   (2 * TRACE_FILE_NAME_LEN)   // A file name in the instance directory
+
+#define LOG_QUEUE_SIZE      0x100000    // Bytes, must be a power of 2
+#define LOG_FILE_BUFFER     0x40000     // Stream buffer of every log file
+#define LOG_MAX_FILES       16
+#define LOG_WRITER_SLEEP_MS 10
+#define LOG_FLUSH_MS        1000        // The files are flushed at least this often
+
+#define LOG_WRITER_STOPPED  0
+#define LOG_WRITER_RUNNING  1
+#define LOG_WRITER_FAILED   2
+
+typedef struct {
+    const char *log_file;   // Log file names are string literals, only the pointer is queued
+    uint32_t len;           // Text length, LOG_ENTRY_WRAP - the rest of the queue is unused
+    char text[];
+} log_entry_t;
+
+#define LOG_ENTRY_ALIGN     16
+#define LOG_ENTRY_WRAP      0xFFFFFFFF
+#define LOG_ENTRY_SIZE(_len) ((sizeof(log_entry_t) + (_len) + LOG_ENTRY_ALIGN - 1) & ~(LOG_ENTRY_ALIGN - 1))
+
+typedef struct {
+    const char *name;
+    FILE *file;
+} log_file_t;
+
+typedef void(*wakeup_func_t)(void);
+static uint64_t local_ticks = 0;
+uint64_t *system_ticks = &local_ticks;
+static wakeup_func_t wakeup_func = NULL;
+
 DLL_PREFIX
 void set_log_func(log_func_t python_log_func) {
     print_log = python_log_func;
@@ -24,28 +65,340 @@ void set_log_level(uint8_t new_log_level) {
     device_log_level = new_log_level;
 }
 
-// The highter log_level the highter priority
-void mylog(uint8_t log_level, const char *log_file, const char *format, ...) {
-    if(log_level < device_log_level)
+/* Connects the module to the scheduler: ticks_source is the scheduler's tick counter,
+   wakeup is called when the module's next deadline changes */
+DLL_PREFIX
+void set_scheduler_hooks(uint64_t *ticks_source, wakeup_func_t wakeup) {
+    system_ticks = (ticks_source == NULL) ? &local_ticks : ticks_source;
+    wakeup_func = wakeup;
+}
+
+/* Must be called by a module every time its state changes so that module_next_event() returns a new value */
+void request_service(void) {
+    if(wakeup_func) {
+        wakeup_func();
+    }
+}
+
+/* Logging is done by a writer thread, one per module, started by the first message or trace record.
+   The emulation thread is the only producer of the message queue and of the trace ring, the writer
+   is the only consumer, each side moves only its own index so no locks are needed */
+static _Alignas(LOG_ENTRY_ALIGN) char log_queue[LOG_QUEUE_SIZE];
+static atomic_uint log_queue_head = 0;
+static atomic_uint log_queue_tail = 0;
+static log_file_t log_files[LOG_MAX_FILES];
+static uint32_t log_files_num = 0;
+static atomic_int log_writer_state = LOG_WRITER_STOPPED;
+static atomic_uint log_flush_requests = 0;
+static atomic_uint log_flush_done = 0;
+
+static trace_record_t trace_ring[TRACE_RING_SIZE];
+static atomic_uint trace_head = 0;
+static atomic_uint trace_tail = 0;
+static char trace_file_name[TRACE_FILE_NAME_LEN] = {0};
+static FILE *trace_file = NULL;
+static uint16_t no_trace_location = 0;
+static uint16_t *trace_cs = &no_trace_location;
+static uint16_t *trace_ip = &no_trace_location;
+
+static int log_writer_ready(void);
+
+static char snapshot_file_name[TRACE_FILE_NAME_LEN] = SNAPSHOT_FILE;
+static char instance_dir[TRACE_FILE_NAME_LEN] = {0};
+static void *rewind_slots[REWIND_SLOTS];
+static uint32_t rewind_sizes[REWIND_SLOTS];
+
+/* Sets the file the trace records of the module are written to, NULL or an empty name drops them.
+   Must not be called while the module is running */
+DLL_PREFIX
+void set_trace_file(const char *filename) {
+    log_flush();
+    if(trace_file) {
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    trace_file_name[0] = 0;
+    if(filename) {
+        snprintf(trace_file_name, sizeof(trace_file_name), "%s", filename);
+    }
+}
+
+/* Sets the snapshot file of the module, all the modules of a machine must use the same file */
+DLL_PREFIX
+void set_snapshot_file(const char *filename) {
+    snprintf(snapshot_file_name, sizeof(snapshot_file_name), "%s", (filename == NULL) ? SNAPSHOT_FILE : filename);
+}
+
+/* Connects the module to the CPU registers the trace records take CS:IP from */
+DLL_PREFIX
+void set_trace_source(uint16_t *cs, uint16_t *ip) {
+    trace_cs = (cs == NULL) ? &no_trace_location : cs;
+    trace_ip = (ip == NULL) ? &no_trace_location : ip;
+}
+
+static void make_parent_dir(const char *filename) {
+    char dir[INSTANCE_PATH_LEN];
+    snprintf(dir, sizeof(dir), "%s", filename);
+    for(char *sep = strchr(dir + 1, '/'); sep != NULL; sep = strchr(sep + 1, '/')) {
+        *sep = 0;
+        #ifdef _WIN32
+        CreateDirectoryA(dir, NULL);
+        #else
+        mkdir(dir, 0777);
+        #endif
+        *sep = '/';
+    }
+}
+
+/* Sets the directory of the machine the module belongs to, NULL or an empty name - the current directory.
+   Must be called before the module opens its files. Fails if the name is too long, the directory stays */
+DLL_PREFIX
+int set_instance_dir(const char *dir) {
+    dir = (dir == NULL) ? "" : dir;
+    if(strlen(dir) >= sizeof(instance_dir)) {
+        printf("ERROR: Instance directory name is too long: %s\n", dir);
+        return EXIT_FAILURE;
+    }
+    snprintf(instance_dir, sizeof(instance_dir), "%s", dir);
+    return EXIT_SUCCESS;
+}
+
+/* Returns the path of a file of the machine, path is a buffer of INSTANCE_PATH_LEN characters.
+   Returns NULL if the path does not fit, the file must not be opened in another place */
+static const char *instance_path(const char *filename, char *path) {
+    uint8_t absolute = (filename[0] == '/') || (filename[0] == '\\') || ((filename[0] != 0) && (filename[1] == ':'));
+    if((instance_dir[0] == 0) || absolute) {
+        return filename;
+    }
+    int len = snprintf(path, INSTANCE_PATH_LEN, "%s/%s", instance_dir, filename);
+    if((len < 0) || (len >= INSTANCE_PATH_LEN)) {
+        printf("ERROR: The path of %s in %s is too long\n", filename, instance_dir);
+        return NULL;
+    }
+    return path;
+}
+
+/* Opens a file of the machine, the directories of a written file are created */
+FILE *instance_fopen(const char *filename, const char *mode) {
+    char path[INSTANCE_PATH_LEN];
+    filename = instance_path(filename, path);
+    if(filename == NULL) {
+        return NULL;
+    }
+    if(mode[0] != 'r') {
+        make_parent_dir(filename);
+    }
+    return fopen(filename, mode);
+}
+
+static int open_trace_file(void) {
+    trace_file = instance_fopen(trace_file_name, "wb");
+    if(trace_file == NULL) {
+        printf("ERROR: Cannot open trace file %s\n", trace_file_name);
+        trace_file_name[0] = 0;
+        return EXIT_FAILURE;
+    }
+    uint16_t header[2] = {TRACE_VERSION, sizeof(trace_record_t)};
+    fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace_file);
+    fwrite(header, sizeof(header), 1, trace_file);
+    return EXIT_SUCCESS;
+}
+
+// Consumer side: writes all the pending trace records to the trace file
+static void write_trace_records(void) {
+    uint32_t head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&trace_tail, memory_order_relaxed);
+    if(head == tail) {
+        return;
+    }
+    if((trace_file != NULL) || ((trace_file_name[0] != 0) && (open_trace_file() == EXIT_SUCCESS))) {
+        uint32_t start = tail & (TRACE_RING_SIZE - 1);
+        uint32_t num = head - tail;
+        uint32_t first = (start + num > TRACE_RING_SIZE) ? (TRACE_RING_SIZE - start) : num;
+        fwrite(&trace_ring[start], sizeof(trace_record_t), first, trace_file);
+        fwrite(&trace_ring[0], sizeof(trace_record_t), num - first, trace_file);
+    }
+    atomic_store_explicit(&trace_tail, head, memory_order_release);
+}
+
+/* Called through the mytrace() macro */
+void trace_event(uint8_t type, uint32_t addr, uint16_t value, uint8_t width) {
+    uint32_t head = atomic_load_explicit(&trace_head, memory_order_relaxed);
+    if(log_writer_ready() != EXIT_SUCCESS) {
+        return;
+    }
+    while(head - atomic_load_explicit(&trace_tail, memory_order_acquire) >= TRACE_RING_SIZE) {
+        sleep_ms(1);    // The ring is full, wait for the writer
+    }
+    trace_record_t *record = &trace_ring[head & (TRACE_RING_SIZE - 1)];
+    record->tick = ticks_num;
+    record->addr = addr;
+    record->value = value;
+    record->cs = *trace_cs;
+    record->ip = *trace_ip;
+    record->type = type;
+    record->width = width;
+    atomic_store_explicit(&trace_head, head + 1, memory_order_release);
+}
+
+// Returns the stream of a log file, opens it on the first message
+static FILE *get_log_file(const char *filename) {
+    for(uint32_t i=0; i<log_files_num; i++) {
+        if((log_files[i].name == filename) || (strcmp(log_files[i].name, filename) == 0)) {
+            return log_files[i].file;
+        }
+    }
+    if(log_files_num >= LOG_MAX_FILES) {
+        return NULL;
+    }
+    log_file_t *log = &log_files[log_files_num++];
+    log->name = filename;
+    log->file = instance_fopen(filename, "a");
+    if(log->file == NULL) {
+        printf("ERROR: Cannot open log file %s\n", filename);
+        return NULL;
+    }
+    setvbuf(log->file, NULL, _IOFBF, LOG_FILE_BUFFER);
+    fprintf(log->file, "%s\n", get_time());
+    return log->file;
+}
+
+// Consumer side: moves all the queued messages into the buffers of their log files
+static void write_log_messages(void) {
+    uint32_t head = atomic_load_explicit(&log_queue_head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&log_queue_tail, memory_order_relaxed);
+    while(tail != head) {
+        log_entry_t *entry = (log_entry_t*)&log_queue[tail & (LOG_QUEUE_SIZE - 1)];
+        if(entry->len == LOG_ENTRY_WRAP) {
+            tail += LOG_QUEUE_SIZE - (tail & (LOG_QUEUE_SIZE - 1));
+            continue;
+        }
+        FILE *file = get_log_file(entry->log_file);
+        if(file) {
+            fwrite(entry->text, 1, entry->len, file);
+        }
+        tail += LOG_ENTRY_SIZE(entry->len);
+    }
+    atomic_store_explicit(&log_queue_tail, tail, memory_order_release);
+}
+
+static void flush_log_files(void) {
+    for(uint32_t i=0; i<log_files_num; i++) {
+        if(log_files[i].file) {
+            fflush(log_files[i].file);
+        }
+    }
+    if(trace_file) {
+        fflush(trace_file);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI log_writer_thread(LPVOID arg) {
+#else
+static void *log_writer_thread(void *arg) {
+#endif
+    uint32_t idle_ms = 0;
+    while(1) {
+        uint32_t requests = atomic_load_explicit(&log_flush_requests, memory_order_acquire);
+        write_log_messages();
+        write_trace_records();
+        idle_ms += LOG_WRITER_SLEEP_MS;
+        if((requests != atomic_load_explicit(&log_flush_done, memory_order_relaxed)) || (idle_ms >= LOG_FLUSH_MS)) {
+            flush_log_files();
+            atomic_store_explicit(&log_flush_done, requests, memory_order_release);
+            idle_ms = 0;
+        }
+        sleep_ms(LOG_WRITER_SLEEP_MS);
+    }
+    return 0;
+}
+
+// Starts the writer thread on the first call, messages are dropped if it could not be started
+static int log_writer_ready(void) {
+    int state = atomic_load_explicit(&log_writer_state, memory_order_relaxed);
+    if(state == LOG_WRITER_STOPPED) {
+        state = LOG_WRITER_FAILED;
+        #ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, log_writer_thread, NULL, 0, NULL);
+        if(thread) {
+            CloseHandle(thread);
+            state = LOG_WRITER_RUNNING;
+        }
+        #else
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, log_writer_thread, NULL) == 0) {
+            pthread_detach(thread);
+            state = LOG_WRITER_RUNNING;
+        }
+        #endif
+        if(state == LOG_WRITER_FAILED) {
+            printf("ERROR: Cannot start the log writer thread\n");
+        }
+        atomic_store(&log_writer_state, state);
+    }
+    return (state == LOG_WRITER_RUNNING) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// The highter log_level the highter priority, called through the mylog() macro
+void log_message(uint8_t log_level, const char *log_file, const char *format, ...) {
+    if(log_writer_ready() != EXIT_SUCCESS) {
         return;
+    }
+    char buffer[BUFFER_SIZE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if(len < 0) {
+        return;
+    }
+    if(len >= BUFFER_SIZE) {
+        len = BUFFER_SIZE - 1;
+    }
+    uint32_t size = LOG_ENTRY_SIZE(len);
+    uint32_t head = atomic_load_explicit(&log_queue_head, memory_order_relaxed);
+    uint32_t offset = head & (LOG_QUEUE_SIZE - 1);
+    // Entries are not split, the end of the queue is skipped if the message does not fit there
+    uint32_t wrap = (offset + size > LOG_QUEUE_SIZE) ? (LOG_QUEUE_SIZE - offset) : 0;
+    while(head + wrap + size - atomic_load_explicit(&log_queue_tail, memory_order_acquire) > LOG_QUEUE_SIZE) {
+        sleep_ms(1);    // The queue is full, wait for the writer
+    }
+    if(wrap) {
+        ((log_entry_t*)&log_queue[offset])->len = LOG_ENTRY_WRAP;
+        head += wrap;
+        offset = 0;
+    }
+    log_entry_t *entry = (log_entry_t*)&log_queue[offset];
+    entry->log_file = log_file;
+    entry->len = len;
+    memcpy(entry->text, buffer, len);
+    atomic_store_explicit(&log_queue_head, head + size, memory_order_release);
+}
+
+/* Waits until everything logged so far is written to the files */
+DLL_PREFIX
+void log_flush(void) {
+    if(atomic_load(&log_writer_state) != LOG_WRITER_RUNNING) {
+        return;     // Nothing has been logged
+    }
+    uint32_t request = atomic_fetch_add(&log_flush_requests, 1) + 1;
+    while((int32_t)(atomic_load_explicit(&log_flush_done, memory_order_acquire) - request) < 0) {
+        sleep_ms(1);
+    }
+}
+
+/* Sends a message to the python side right away, used for UI events (it is not written to a log file) */
+void notify_ui(const char *log_file, const char *format, ...) {
+    if(print_log == NULL) {
+        return;
+    }
     va_list args;
     va_start(args, format);
     char buffer[BUFFER_SIZE] = {0};
     vsnprintf(buffer, sizeof(buffer), format, args);
-    // vprintf(format, args);
-    // printf("Processing string %s\n", buffer);
-    // log_server_send(log_file, buffer);
-    print_log(log_file, buffer);
-    #ifdef PRINT_LOGS_TO_FILE
-    FILE *file = fopen(LOG_FILE_NAME, "a");
-    if(file) {
-        vfprintf(file, format, args);
-        fclose(file);
-    } else {
-        printf("ERROR: can't open log file %s", LOG_FILE_NAME);
-    }
-    #endif
     va_end(args);
+    print_log(log_file, buffer);
 }
 
 void clear_console(void) {
@@ -72,7 +425,7 @@ char *get_time(void) {
 
 int store_data(void *data, size_t size, char *filename) {
     uint64_t hash = get_hash((uint8_t*)data, size);
-    FILE *file = fopen(filename, "wb");
+    FILE *file = instance_fopen(filename, "wb");
     if (file == NULL) {
         printf("ERROR: Failed to open file %s\n", filename);
         return EXIT_FAILURE;
@@ -84,7 +437,7 @@ int store_data(void *data, size_t size, char *filename) {
 }
 
 int restore_data(void *data, size_t size, char *filename) {
-    FILE *file = fopen(filename, "rb");
+    FILE *file = instance_fopen(filename, "rb");
     if (file == NULL) {
         printf("ERROR: Failed to open file %s\n", filename);
         return EXIT_FAILURE;
@@ -92,18 +445,175 @@ int restore_data(void *data, size_t size, char *filename) {
     size_t len_data = fread((uint8_t *)data, 1, size, file);
     uint64_t hash;
     fread(&hash, sizeof(hash), 1, file);
+    fclose(file);
     if(hash != get_hash((uint8_t*)data, size)) {
         printf("ERROR: File %s corrupted (hash check failed)\n", filename);
         return EXIT_FAILURE;
     }
-    fclose(file);
     if(len_data != size) {
-        printf("ERROR: Failed reading file %s (%lld of %lld bytes were read)\n", filename, len_data, size);
+        printf("ERROR: Failed reading file %s (%lld of %lld bytes were read)\n", filename, (long long)len_data, (long long)size);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Appends a block of the module state tagged with the current tick to the snapshot file */
+int snapshot_write(const char *name, uint32_t addr, const void *data, uint32_t size) {
+    FILE *file = instance_fopen(snapshot_file_name, "ab");
+    if(file == NULL) {
+        printf("ERROR: Failed to open file %s\n", snapshot_file_name);
+        return EXIT_FAILURE;
+    }
+    snapshot_block_t block = {.magic = SNAPSHOT_MAGIC, .tick = ticks_num, .addr = addr, .size = size};
+    strncpy(block.name, name, SNAPSHOT_NAME_LEN - 1);
+    fwrite(&block, sizeof(block), 1, file);
+    fwrite(data, 1, size, file);
+    fclose(file);
+    return EXIT_SUCCESS;
+}
+
+/* Reads the next block header, returns EXIT_FAILURE at the end of the file or if it is corrupted */
+static int snapshot_next_block(FILE *file, snapshot_block_t *block) {
+    if(fread(block, sizeof(snapshot_block_t), 1, file) != 1) {
+        return EXIT_FAILURE;
+    }
+    if(block->magic != SNAPSHOT_MAGIC) {
+        printf("ERROR: File %s corrupted (wrong snapshot block)\n", snapshot_file_name);
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
 
+/* Calls func for every block of the module written at or before tick, in the order they were written.
+   Returns the number of the blocks, -1 if there is no snapshot file */
+int snapshot_read(const char *name, uint64_t tick, snapshot_read_func_t func) {
+    FILE *file = instance_fopen(snapshot_file_name, "rb");
+    if(file == NULL) {
+        printf("ERROR: Failed to open file %s\n", snapshot_file_name);
+        return -1;
+    }
+    int blocks_num = 0;
+    uint8_t *data = NULL;
+    uint32_t data_size = 0;
+    snapshot_block_t block;
+    while((snapshot_next_block(file, &block) == EXIT_SUCCESS) && (block.tick <= tick)) {
+        if(strncmp(block.name, name, SNAPSHOT_NAME_LEN) != 0) {
+            fseek(file, block.size, SEEK_CUR);
+            continue;
+        }
+        if(block.size > data_size) {
+            free(data);
+            data_size = block.size;
+            data = malloc(data_size);
+        }
+        if((data == NULL) || (fread(data, 1, block.size, file) != block.size)) {
+            printf("ERROR: Failed reading file %s\n", snapshot_file_name);
+            break;
+        }
+        func(block.addr, data, block.size);
+        blocks_num++;
+    }
+    free(data);
+    fclose(file);
+    return blocks_num;
+}
+
+/* Loads the last block of the module written at or before tick, the block must be size bytes */
+int snapshot_read_block(const char *name, uint64_t tick, void *data, uint32_t size) {
+    FILE *file = instance_fopen(snapshot_file_name, "rb");
+    if(file == NULL) {
+        printf("ERROR: Failed to open file %s\n", snapshot_file_name);
+        return EXIT_FAILURE;
+    }
+    long offset = -1;
+    snapshot_block_t block;
+    while((snapshot_next_block(file, &block) == EXIT_SUCCESS) && (block.tick <= tick)) {
+        if((strncmp(block.name, name, SNAPSHOT_NAME_LEN) == 0) && (block.size == size)) {
+            offset = ftell(file);
+        }
+        fseek(file, block.size, SEEK_CUR);
+    }
+    int res = EXIT_FAILURE;
+    if(offset >= 0) {
+        fseek(file, offset, SEEK_SET);
+        res = (fread(data, 1, size, file) == size) ? EXIT_SUCCESS : EXIT_FAILURE;
+    } else {
+        printf("ERROR: No %s state at tick %lld in %s\n", name, (long long)tick, snapshot_file_name);
+    }
+    fclose(file);
+    return res;
+}
+
+/* Keeps a copy of the module state in the slot of the rewind ring */
+int rewind_store(uint32_t slot, const void *data, uint32_t size) {
+    if(slot >= REWIND_SLOTS) {
+        printf("ERROR: Wrong rewind slot %d\n", slot);
+        return EXIT_FAILURE;
+    }
+    if(rewind_sizes[slot] != size) {
+        free(rewind_slots[slot]);
+        rewind_slots[slot] = malloc(size);
+        rewind_sizes[slot] = (rewind_slots[slot] != NULL) ? size : 0;
+    }
+    if(rewind_slots[slot] == NULL) {
+        printf("ERROR: Failed to allocate memory for rewind slot %d\n", slot);
+        return EXIT_FAILURE;
+    }
+    memcpy(rewind_slots[slot], data, size);
+    return EXIT_SUCCESS;
+}
+
+/* Copies the state kept in the slot back, the slot must hold size bytes */
+int rewind_load(uint32_t slot, void *data, uint32_t size) {
+    if((slot >= REWIND_SLOTS) || (rewind_slots[slot] == NULL) || (rewind_sizes[slot] != size)) {
+        printf("ERROR: Rewind slot %d is empty\n", slot);
+        return EXIT_FAILURE;
+    }
+    memcpy(data, rewind_slots[slot], size);
+    return EXIT_SUCCESS;
+}
+
+/* Drops the blocks written after tick, so the run restored from that checkpoint continues the file */
+DLL_PREFIX
+int snapshot_truncate(uint64_t tick) {
+    FILE *file = instance_fopen(snapshot_file_name, "r+b");
+    if(file == NULL) {
+        printf("ERROR: Failed to open file %s\n", snapshot_file_name);
+        return EXIT_FAILURE;
+    }
+    long end = 0;
+    snapshot_block_t block;
+    while((snapshot_next_block(file, &block) == EXIT_SUCCESS) && (block.tick <= tick)) {
+        fseek(file, block.size, SEEK_CUR);
+        end = ftell(file);
+    }
+    fflush(file);
+    #ifdef _WIN32
+    int res = _chsize_s(_fileno(file), end);
+    #else
+    int res = ftruncate(fileno(file), end);
+    #endif
+    fclose(file);
+    return (res == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Returns the tick of the last checkpoint in the snapshot file, SNAPSHOT_NO_TICK if there is none */
+DLL_PREFIX
+uint64_t snapshot_last_tick(void) {
+    FILE *file = instance_fopen(snapshot_file_name, "rb");
+    if(file == NULL) {
+        return SNAPSHOT_NO_TICK;
+    }
+    uint64_t tick = SNAPSHOT_NO_TICK;
+    snapshot_block_t block;
+    while(snapshot_next_block(file, &block) == EXIT_SUCCESS) {
+        tick = block.tick;
+        fseek(file, block.size, SEEK_CUR);
+    }
+    fclose(file);
+    return tick;
+}
+
 uint64_t get_hash(uint8_t *data, size_t size) {
     uint64_t hash = 5381;
     for(size_t i=0; i<size; i++) {
@@ -112,3 +622,76 @@ uint64_t get_hash(uint8_t *data, size_t size) {
     return hash;
 }
 
+/* Allocates memory for generated code, returns NULL on failure */
+void *alloc_exec_memory(size_t size) {
+    #ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    #else
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (mem == MAP_FAILED) ? NULL : mem;
+    #endif
+}
+
+/* Maps the first size bytes of the file, zeroed memory if filename is NULL. shared - the writes go into
+   the file, otherwise they stay in the process. addr - the memory returned by a previous map_file() call
+   to replace, NULL - none. The new memory replaces addr at the same address on POSIX, Windows cannot
+   do it atomically so the view is mapped elsewhere and addr is unmapped, the caller takes the returned
+   address. Returns NULL on failure, addr stays mapped */
+void *map_file(void *addr, size_t size, const char *filename, uint8_t shared) {
+    char path[INSTANCE_PATH_LEN];
+    if(filename) {
+        filename = instance_path(filename, path);
+        if(filename == NULL) {
+            return NULL;
+        }
+    }
+    #ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    if(filename) {
+        file = CreateFileA(filename, GENERIC_READ | (shared ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE,
+                           NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE) {
+            return NULL;
+        }
+    }
+    uint8_t copy_on_write = (filename != NULL) && !shared;
+    HANDLE mapping = CreateFileMappingA(file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READWRITE,
+                                        (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+    if(file != INVALID_HANDLE_VALUE) {
+        CloseHandle(file);
+    }
+    if(mapping == NULL) {
+        return NULL;
+    }
+    void *mem = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_WRITE, 0, 0, size);
+    CloseHandle(mapping);
+    if(mem && addr) {
+        UnmapViewOfFile(addr);
+    }
+    return mem;
+    #else
+    int fd = -1;
+    if(filename) {
+        fd = open(filename, shared ? O_RDWR : O_RDONLY);
+        if(fd < 0) {
+            return NULL;
+        }
+    }
+    int flags = (shared ? MAP_SHARED : MAP_PRIVATE) | ((fd < 0) ? MAP_ANONYMOUS : 0) | (addr ? MAP_FIXED : 0);
+    void *mem = mmap(addr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if(fd >= 0) {
+        close(fd);
+    }
+    return (mem == MAP_FAILED) ? NULL : mem;
+    #endif
+}
+
+/* Starts writing the changes of a shared map_file() memory into the file */
+void sync_file_map(void *addr, size_t size) {
+    #ifdef _WIN32
+    FlushViewOfFile(addr, size);
+    #else
+    msync(addr, size, MS_ASYNC);
+    #endif
+}
+
@@ -11,18 +11,137 @@ typedef struct {
 #define READ_FUNC_PTR(_func_name)  uint16_t(*_func_name)(uint32_t, uint8_t)
 #define WRITE_FUNC_PTR(_func_name) void(*_func_name)(uint32_t, uint16_t, uint8_t)
 
+// module_next_event() return value for devices which don't need to be ticked until their state changes
+#define NO_PENDING_EVENT 0xFFFFFFFF
+
+// Guest memory is tracked in 4KB pages (code pages for the CPU decode cache)
+#define MEM_PAGE_SHIFT  12
+#define MEM_PAGE_SIZE   (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGES_NUM   (0x100000 >> MEM_PAGE_SHIFT)
+// cpu_invalidate_code() address meaning that the whole memory has changed
+#define CODE_INVALIDATE_ALL 0xFFFFFFFF
+// Page attributes of the memory module (mem_get_page_attrs())
+#define MEM_PAGE_RAM        0x00
+#define MEM_PAGE_ROM        0x01    // Writes are ignored
+#define MEM_PAGE_MMIO       0x02    // Accesses are handled by the device mapped at the page
+#define MEM_PAGE_TYPE_MASK  0x03
+#define MEM_PAGE_CODE       0x04    // Code was fetched from the page since its last write
+#define MEM_PAGE_CLEAN      0x08    // Not written since the last checkpoint (module_checkpoint())
+#define MEM_PAGE_REWIND_CLEAN 0x10  // Not written since the last checkpoint of the rewind ring (module_rewind_save())
+
+// Current system tick, shared by all the modules (points to the scheduler's counter once it is connected).
+// module_tick() and module_next_event() get only its low 32 bits, the 64-bit deadlines are compared with ticks_num
+extern uint64_t *system_ticks;
+#define ticks_num (*system_ticks)
+// Messages with a lower log level are not logged
+extern uint8_t device_log_level;
+
 #ifdef __unix__
     #define DLL_PREFIX 
 #elif defined(_WIN32) || defined(WIN32)
     #define DLL_PREFIX __declspec(dllexport)
 #endif
 
-void mylog(uint8_t log_level, const char *log_file, const char *format, ...);
+/* Log levels: 0 - trace, 1 - messages shown by default. A message is logged if its level is
+   not lower than device_log_level (set_log_level(), per module) and LOG_MIN_LEVEL (compile time,
+   can be defined per source file before including utils.h or with -DLOG_MIN_LEVEL=n).
+   mylog() is a macro: the arguments are not evaluated when the message is not logged.
+   Messages are queued and written to the files by the log writer thread of the module, log_flush()
+   waits until they are written */
+#ifndef LOG_MIN_LEVEL
+    #define LOG_MIN_LEVEL 0
+#endif
+#define mylog(_log_level, _log_file, ...) do {                                          \
+    if(((_log_level) >= LOG_MIN_LEVEL) && ((_log_level) >= device_log_level)) {         \
+        log_message((_log_level), (_log_file), __VA_ARGS__);                            \
+    }                                                                                   \
+} while(0)
+void log_message(uint8_t log_level, const char *log_file, const char *format, ...);
+
+/* Binary trace: per-access events are stored as fixed size records in a ring buffer of the module
+   and written to its trace file (set_trace_file()) by the log writer thread. trace_decoder.py
+   renders them as text. Traces are level 0 messages, they are gated like mylog(0, ...) */
+#define TRACE_MEM_READ      0
+#define TRACE_MEM_WRITE     1
+#define TRACE_IO_READ       2
+#define TRACE_IO_WRITE      3
+#define TRACE_INSTR         4   // addr and value hold the first 6 instruction bytes, width - instruction length
+
+#define TRACE_MAGIC         "X86TRACE"
+#define TRACE_VERSION       1
+
+#pragma pack(push, 1)
+typedef struct {
+    uint64_t tick;
+    uint32_t addr;
+    uint16_t value;
+    uint16_t cs;            // CPU location at the time of the event (set_trace_source())
+    uint16_t ip;
+    uint8_t type;
+    uint8_t width;
+} trace_record_t;
+#pragma pack(pop)
+
+#define mytrace(_type, _addr, _value, _width) do {                                      \
+    if((0 >= LOG_MIN_LEVEL) && (device_log_level == 0)) {                               \
+        trace_event((_type), (_addr), (_value), (_width));                              \
+    }                                                                                   \
+} while(0)
+void trace_event(uint8_t type, uint32_t addr, uint16_t value, uint8_t width);
+
+/* Snapshots: module_checkpoint() of every module appends its state to the snapshot file as blocks
+   tagged with the current tick (the registers, or only the RAM pages written since the previous
+   checkpoint), module_restore_checkpoint(tick) loads the state as of the checkpoint at that tick.
+   The ticks of the blocks never decrease through the file */
+#define SNAPSHOT_FILE       "data/snapshot.bin"
+#define SNAPSHOT_MAGIC      0x50414E53  // "SNAP"
+#define SNAPSHOT_NAME_LEN   32
+#define SNAPSHOT_NO_TICK    0xFFFFFFFFFFFFFFFFULL
+
+#pragma pack(push, 1)
+typedef struct {
+    uint32_t magic;
+    char name[SNAPSHOT_NAME_LEN];   // DEVICE_NAME of the module
+    uint64_t tick;
+    uint32_t addr;                  // Offset of the data in the module state, RAM address for the memory pages
+    uint32_t size;                  // Data size, the data follows the header
+} snapshot_block_t;
+#pragma pack(pop)
+
+typedef void(*snapshot_read_func_t)(uint32_t addr, void *data, uint32_t size);
+int snapshot_write(const char *name, uint32_t addr, const void *data, uint32_t size);
+int snapshot_read(const char *name, uint64_t tick, snapshot_read_func_t func);
+int snapshot_read_block(const char *name, uint64_t tick, void *data, uint32_t size);
+
+/* Rewind ring: module_rewind_save(slot) keeps the state of the module in memory, module_rewind_restore(slot)
+   brings it back. The slots are used in turn, a restore drops the slots saved after the restored one */
+#define REWIND_SLOTS        16
+int rewind_store(uint32_t slot, const void *data, uint32_t size);
+int rewind_load(uint32_t slot, void *data, uint32_t size);
+
+/* Machine instances: a process runs several machines by loading a copy of the module libraries per
+   machine (device_manager.load_module()), so the module globals are per machine. The files of the
+   module (logs, traces, snapshots and the data/ state files) are kept in the directory of its machine
+   (set_instance_dir()), instance_fopen() opens them by the names relative to that directory */
+
+void log_flush(void);
+void notify_ui(const char *log_file, const char *format, ...);
 void clear_console(void);
 void sleep_ms(uint32_t ms);
 char *get_time(void);
 int store_data(void *data, size_t size, char *filename);
 int restore_data(void *data, size_t size, char *filename);
 uint64_t get_hash(uint8_t *data, size_t size);
+void *alloc_exec_memory(size_t size);
+void *map_file(void *addr, size_t size, const char *filename, uint8_t shared);
+void sync_file_map(void *addr, size_t size);
 
-void set_log_level(uint8_t new_log_level);
\ No newline at end of file
+void set_log_level(uint8_t new_log_level);
+void set_trace_file(const char *filename);
+void set_trace_source(uint16_t *cs, uint16_t *ip);
+void set_snapshot_file(const char *filename);
+int set_instance_dir(const char *dir);
+FILE *instance_fopen(const char *filename, const char *mode);
+int snapshot_truncate(uint64_t tick);
+uint64_t snapshot_last_tick(void);
+void request_service(void);
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "wires.h"
+#include "scheduler.h"
+#include "journal.h"
+#include <string.h>
+
+/* Wire fabric: a wire connects the pins of the modules (CREATE_PIN in pins.h). The get_state and
+   set_state functions of a connected pin are replaced with the ones of the wire, a new state is
+   passed to all the connected pins through their _set_value functions. Built into the scheduler
+   module, the wires are described in config.toml */
+
+#define WIRES_LOG_FILE "logs/wires.log"
+#define WIRES_SNAPSHOT_NAME "WIRES"
+
+typedef struct {
+    char name[WIRE_NAME_LEN];
+    uint8_t state;
+    uint8_t pins_num;
+    pin_t *pins[WIRE_MAX_PINS];
+    wire_callback_t callback;
+    int input;                  // The states set from outside go through the input journal (journal.c)
+} wire_t;
+
+static wire_t wires[WIRES_MAX_NUM];
+static uint32_t wires_num = 0;
+
+static void set_state(wire_t *wire, uint8_t new_state) {
+    if(wire->state == new_state) {
+        return;
+    }
+    mylog(0, WIRES_LOG_FILE, "%lld, %s: changing state to %d\n", (long long)scheduler_get_ticks(), wire->name, new_state);
+    for(uint8_t i=0; i<wire->pins_num; i++) {
+        wire->pins[i]->_set_value(new_state);
+    }
+    wire->state = new_state;
+    if(wire->callback) {
+        wire->callback(new_state);
+    }
+}
+
+// The pin functions have no context argument, every wire has its own pair
+#define WIRE_FUNCS(_n)                                                                          \
+static uint8_t wire##_n##_get_state(void) { return wires[_n].state; }                          \
+static void wire##_n##_set_state(uint8_t new_state) { set_state(&wires[_n], new_state); }
+WIRE_FUNCS(0)  WIRE_FUNCS(1)  WIRE_FUNCS(2)  WIRE_FUNCS(3)  WIRE_FUNCS(4)  WIRE_FUNCS(5)  WIRE_FUNCS(6)  WIRE_FUNCS(7)
+WIRE_FUNCS(8)  WIRE_FUNCS(9)  WIRE_FUNCS(10) WIRE_FUNCS(11) WIRE_FUNCS(12) WIRE_FUNCS(13) WIRE_FUNCS(14) WIRE_FUNCS(15)
+
+static uint8_t(*get_state_funcs[WIRES_MAX_NUM])(void) = {
+    wire0_get_state, wire1_get_state, wire2_get_state, wire3_get_state, wire4_get_state, wire5_get_state, wire6_get_state, wire7_get_state,
+    wire8_get_state, wire9_get_state, wire10_get_state, wire11_get_state, wire12_get_state, wire13_get_state, wire14_get_state, wire15_get_state,
+};
+static void(*set_state_funcs[WIRES_MAX_NUM])(uint8_t) = {
+    wire0_set_state, wire1_set_state, wire2_set_state, wire3_set_state, wire4_set_state, wire5_set_state, wire6_set_state, wire7_set_state,
+    wire8_set_state, wire9_set_state, wire10_set_state, wire11_set_state, wire12_set_state, wire13_set_state, wire14_set_state, wire15_set_state,
+};
+
+DLL_PREFIX
+void wires_reset(void) {
+    memset(wires, 0, sizeof(wires));
+    wires_num = 0;
+}
+
+/* Returns the wire index or -1 on failure, the state of a new wire is 0 */
+DLL_PREFIX
+int wire_create(const char *name) {
+    if(wires_num == WIRES_MAX_NUM) {
+        printf("ERROR: Cannot create wire %s: too many wires\n", name);
+        return -1;
+    }
+    strncpy(wires[wires_num].name, name, WIRE_NAME_LEN - 1);
+    wires[wires_num].input = input_add(name, set_state_funcs[wires_num]);
+    return wires_num++;
+}
+
+DLL_PREFIX
+int wire_connect(uint32_t wire, pin_t *pin) {
+    if((wire >= wires_num) || (wires[wire].pins_num == WIRE_MAX_PINS)) {
+        printf("ERROR: Cannot connect a pin to wire %d\n", wire);
+        return -1;
+    }
+    pin->get_state = get_state_funcs[wire];
+    pin->set_state = set_state_funcs[wire];
+    wires[wire].pins[wires[wire].pins_num++] = pin;
+    return 0;
+}
+
+DLL_PREFIX
+void wire_set_callback(uint32_t wire, wire_callback_t callback) {
+    if(wire < wires_num) {
+        wires[wire].callback = callback;
+    }
+}
+
+/* Sets the state from outside the modules (python, the runner), the wire is an input of the journal */
+DLL_PREFIX
+void wire_set_state(uint32_t wire, uint8_t new_state) {
+    if(wire >= wires_num) {
+        return;
+    }
+    if(wires[wire].input < 0) {
+        set_state(&wires[wire], new_state);
+    } else {
+        input_send(wires[wire].input, new_state);
+    }
+}
+
+DLL_PREFIX
+uint8_t wire_get_state(uint32_t wire) {
+    return (wire < wires_num) ? wires[wire].state : 0;
+}
+
+/* The restored modules already have the state which follows from the wire states, so the pins
+   get the values without their callbacks. Only the UI callbacks of the wires are called */
+static void restore_states(uint8_t *states) {
+    for(uint32_t i=0; i<wires_num; i++) {
+        if(wires[i].state == states[i]) {
+            continue;
+        }
+        wires[i].state = states[i];
+        for(uint8_t j=0; j<wires[i].pins_num; j++) {
+            wires[i].pins[j]->state = states[i];
+        }
+        if(wires[i].callback) {
+            wires[i].callback(states[i]);
+        }
+    }
+}
+
+// See module_checkpoint() and module_rewind_save() of the modules
+DLL_PREFIX
+void wires_checkpoint(void) {
+    uint8_t states[WIRES_MAX_NUM] = {0};
+    for(uint32_t i=0; i<wires_num; i++) {
+        states[i] = wires[i].state;
+    }
+    snapshot_write(WIRES_SNAPSHOT_NAME, 0, states, sizeof(states));
+}
+
+DLL_PREFIX
+void wires_restore_checkpoint(uint64_t tick) {
+    uint8_t states[WIRES_MAX_NUM];
+    if(EXIT_SUCCESS == snapshot_read_block(WIRES_SNAPSHOT_NAME, tick, states, sizeof(states))) {
+        restore_states(states);
+    }
+}
+
+DLL_PREFIX
+void wires_rewind_save(uint32_t slot) {
+    uint8_t states[WIRES_MAX_NUM] = {0};
+    for(uint32_t i=0; i<wires_num; i++) {
+        states[i] = wires[i].state;
+    }
+    rewind_store(slot, states, sizeof(states));
+}
+
+DLL_PREFIX
+void wires_rewind_restore(uint32_t slot) {
+    uint8_t states[WIRES_MAX_NUM];
+    if(EXIT_SUCCESS == rewind_load(slot, states, sizeof(states))) {
+        restore_states(states);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include "utils.h"
+#include "pins.h"
+
+#define WIRES_MAX_NUM       16      // Number of WIRE_FUNCS() in wires.c
+#define WIRE_MAX_PINS       8
+#define WIRE_NAME_LEN       32
+
+// Called on every state change of the wire, used for the wires shown in the UI
+typedef void(*wire_callback_t)(uint8_t);
+
+DLL_PREFIX void wires_reset(void);
+DLL_PREFIX int wire_create(const char *name);
+DLL_PREFIX int wire_connect(uint32_t wire, pin_t *pin);
+DLL_PREFIX void wire_set_callback(uint32_t wire, wire_callback_t callback);
+DLL_PREFIX void wire_set_state(uint32_t wire, uint8_t new_state);
+DLL_PREFIX uint8_t wire_get_state(uint32_t wire);
+DLL_PREFIX void wires_checkpoint(void);
+DLL_PREFIX void wires_restore_checkpoint(uint64_t tick);
+DLL_PREFIX void wires_rewind_save(uint32_t slot);
+DLL_PREFIX void wires_rewind_restore(uint32_t slot);
@@ -1,52 +1,31 @@
 import ctypes
 
-class WireType(ctypes.c_int):
-    WIRE_INPUT = 0
-    WIRE_OUTPUT_PP = 1
-    WIRE_OUTPUT_OC = 2
-
 
 class Wire:
-    def __init__(self, name, state_change_callback):
+    ''' Wire of the native wire fabric (wires.c in the scheduler module), python sees only its state changes
+        when state_change_callback is set (UI wires) '''
+    def __init__(self, scheduler, name, state_change_callback):
         self.name = name
-        self.state = 0
+        self.scheduler = scheduler
+        self.id = scheduler.wire_create(name.encode('utf-8'))
+        if self.id < 0:
+            raise Exception(f"ERROR::: Cannot create wire {name}!")
         self.connections = []
-        self.state_change_callback = state_change_callback
-    
-    def get_state(self):
-        return self.state
-    
-    def set_state(self, new_state):
-        if self.state == new_state:
-            return
-        print(f"{self.name}: changing state to {new_state}")
-        for conn in self.connections:
-            print(f"Setting {conn['device_name']}.{conn['pin_name']} to {new_state}")
-            conn['struct']._set_value(new_state)
-        self.state = new_state
-        if self.state_change_callback:
-            self.state_change_callback(new_state)
-    
-    def connect_device(self, device, pin_name, dev_name):
-        @ctypes.CFUNCTYPE(ctypes.c_uint8)
-        def _wire_get_state():
-            return self.state
+        self.state_change_callback = None
+        if state_change_callback:
+            # Keeps the ctypes callback alive while the native code may call it
+            self.state_change_callback = ctypes.CFUNCTYPE(None, ctypes.c_uint8)(state_change_callback)
+            scheduler.wire_set_callback(self.id, self.state_change_callback)
 
-        @ctypes.CFUNCTYPE(None, ctypes.c_uint8)
-        def _wire_set_state(new_state):
-            self.set_state(new_state)
+    def get_state(self):
+        return self.scheduler.wire_get_state(self.id)
 
-        class WireStruct(ctypes.Structure):
-            _fields_ = [
-                ('state', ctypes.c_uint8),
-                ("pin_type", WireType),
-                ("get_state", ctypes.CFUNCTYPE(ctypes.c_uint8)),
-                ("_set_value", ctypes.CFUNCTYPE(None, ctypes.c_uint8)),
-                ("set_state", ctypes.CFUNCTYPE(None, ctypes.c_uint8)),
-                ("state_change_cb", ctypes.CFUNCTYPE(None, ctypes.c_uint8))
-            ]
+    def set_state(self, new_state):
+        self.scheduler.wire_set_state(self.id, new_state)
 
-        wire_struct = WireStruct.in_dll(device, pin_name)
-        wire_struct.get_state = _wire_get_state     # Replace default function
-        wire_struct.set_state = _wire_set_state     # Replace default function
-        self.connections.append({"device_name": dev_name, "pin_name": pin_name, "struct": wire_struct})
\ No newline at end of file
+    def connect_device(self, device, pin_name, dev_name):
+        # Modules of the single library build prefix their symbols with the module name
+        pin = ctypes.c_uint8.in_dll(device, getattr(device, "symbol_prefix", "") + pin_name)
+        if self.scheduler.wire_connect(self.id, ctypes.addressof(pin)) < 0:
+            raise Exception(f"ERROR::: Cannot connect {dev_name}.{pin_name} to wire {self.name}!")
+        self.connections.append({"device_name": dev_name, "pin_name": pin_name})